@@ -0,0 +1,207 @@
+#include <framework/bvh.h>
+#include <framework/mesh.h>
+#include <framework/parallel.h>
+#include <framework/wide_bvh.h>
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Bumpy grid of resolution x resolution quads in the unit square.
+static Mesh createHeightFieldMesh(uint32_t resolution)
+{
+    Mesh mesh;
+    const uint32_t numVerticesPerRow = resolution + 1;
+    mesh.vertices.resize(size_t(numVerticesPerRow) * numVerticesPerRow);
+    parallelFor(numVerticesPerRow, [&](size_t row) {
+        for (uint32_t column = 0; column < numVerticesPerRow; ++column) {
+            const glm::vec2 texCoord = glm::vec2(column, row) / static_cast<float>(resolution);
+            const float height = 0.02f * std::sin(40.0f * texCoord.x) * std::cos(30.0f * texCoord.y);
+            mesh.vertices[row * numVerticesPerRow + column] = Vertex { .position = glm::vec3(texCoord.x, height, texCoord.y), .normal = glm::vec3(0, 1, 0), .texCoord = texCoord };
+        }
+    });
+    mesh.triangles.resize(size_t(resolution) * resolution * 2);
+    parallelFor(resolution, [&](size_t row) {
+        for (uint32_t column = 0; column < resolution; ++column) {
+            const uint32_t v00 = static_cast<uint32_t>(row) * numVerticesPerRow + column;
+            const uint32_t v01 = v00 + numVerticesPerRow;
+            const size_t quad = row * resolution + column;
+            mesh.triangles[2 * quad + 0] = glm::uvec3(v00, v01, v00 + 1);
+            mesh.triangles[2 * quad + 1] = glm::uvec3(v00 + 1, v01, v01 + 1);
+        }
+    });
+    return mesh;
+}
+
+// The scene mesh is not part of the repository, so it is only benchmarked when it has been put in place.
+static std::optional<std::vector<Mesh>> loadSceneMesh()
+{
+    const std::filesystem::path sceneMeshFile = RESOURCE_ROOT "resources/dragon.obj";
+    if (!std::filesystem::exists(sceneMeshFile)) {
+        WARN("Scene mesh " << sceneMeshFile << " not found");
+        return {};
+    }
+    return loadMesh(sceneMeshFile);
+}
+
+TEST_CASE("Building the BVH", "[bvh]")
+{
+    if (const std::optional<std::vector<Mesh>> sceneMeshes = loadSceneMesh()) {
+        BENCHMARK("Scene mesh")
+        {
+            return BVH { *sceneMeshes };
+        };
+    }
+
+    // 2237^2 quads are just over 10M triangles.
+    const Mesh heightField = createHeightFieldMesh(2237);
+    BENCHMARK("10M triangle height field")
+    {
+        return BVH { heightField };
+    };
+}
+
+namespace {
+struct TraversalResults {
+    std::vector<float> t;
+    std::vector<std::optional<BVHHit>> hits;
+    std::vector<bool> occluded;
+};
+}
+
+// The scalar kernels have to compute bit for bit the same distances and barycentric coordinates as the SIMD kernels.
+static bool sameHits(const TraversalResults& lhs, const TraversalResults& rhs)
+{
+    for (size_t rayIdx = 0; rayIdx < lhs.t.size(); ++rayIdx) {
+        const std::optional<BVHHit>& lhsHit = lhs.hits[rayIdx];
+        const std::optional<BVHHit>& rhsHit = rhs.hits[rayIdx];
+        if (lhs.t[rayIdx] != rhs.t[rayIdx] || lhsHit.has_value() != rhsHit.has_value() || (lhsHit && lhsHit->barycentric != rhsHit->barycentric))
+            return false;
+    }
+    return lhs.occluded == rhs.occluded;
+}
+
+TEST_CASE("Tracing rays through the binary and wide BVHs", "[bvh]")
+{
+    // The scene mesh if it is available, a 1M triangle height field otherwise.
+    std::vector<Mesh> meshes = loadSceneMesh().value_or(std::vector<Mesh> {});
+    if (meshes.empty())
+        meshes.push_back(createHeightFieldMesh(724));
+    const BVH bvh { meshes };
+    const BVH4 bvh4 { bvh };
+    const BVH8 bvh8 { bvh };
+    constexpr float tMin = 1e-4f;
+
+    // Primary rays of a 512x512 image looking down at the scene at an angle, ordered in 2x2 blocks such that every group
+    // of 4 rays forms a coherent packet.
+    const glm::vec3 center = 0.5f * (bvh.nodes()[0].lower + bvh.nodes()[0].upper);
+    const float radius = 0.5f * glm::length(bvh.nodes()[0].upper - bvh.nodes()[0].lower);
+    const glm::vec3 eye = center + radius * glm::vec3(0.3f, 0.8f, 1.2f);
+    const glm::vec3 forward = glm::normalize(center - eye);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const glm::vec3 up = glm::cross(right, forward);
+    constexpr int resolution = 512;
+    const float halfScreenSize = std::tan(glm::radians(40.0f));
+    std::vector<Ray> primaryRays;
+    primaryRays.reserve(resolution * resolution);
+    for (int blockY = 0; blockY < resolution; blockY += 2) {
+        for (int blockX = 0; blockX < resolution; blockX += 2) {
+            for (int rayIdx = 0; rayIdx < 4; ++rayIdx) {
+                const glm::vec2 pixel { blockX + rayIdx % 2, blockY + rayIdx / 2 };
+                const glm::vec2 ndc = (pixel + 0.5f) / static_cast<float>(resolution) * 2.0f - 1.0f;
+                const glm::vec3 direction = glm::normalize(forward + halfScreenSize * (ndc.x * right + ndc.y * up));
+                primaryRays.push_back(Ray { .origin = eye, .direction = direction });
+            }
+        }
+    }
+    // Shadow rays from the primary hits to a light above the scene, in the same order.
+    const glm::vec3 lightPosition = center + radius * glm::vec3(-0.5f, 2.0f, 0.5f);
+    std::vector<Ray> shadowRays;
+    for (Ray ray : primaryRays) {
+        if (!bvh.intersect(ray, tMin))
+            continue;
+        const glm::vec3 position = ray.origin + ray.t * ray.direction;
+        const float lightDistance = glm::length(lightPosition - position);
+        shadowRays.push_back(Ray { .origin = position, .direction = (lightPosition - position) / lightDistance, .t = lightDistance - tMin });
+    }
+    shadowRays.resize(shadowRays.size() / RayPacket::size * RayPacket::size);
+    REQUIRE(!shadowRays.empty());
+
+    // All rays are traced on a single thread.
+    const auto closestHits = [&](const auto& traceRay) {
+        TraversalResults results { .t = std::vector<float>(primaryRays.size()), .hits = std::vector<std::optional<BVHHit>>(primaryRays.size()) };
+        for (size_t rayIdx = 0; rayIdx < primaryRays.size(); ++rayIdx) {
+            Ray ray = primaryRays[rayIdx];
+            results.hits[rayIdx] = traceRay(ray);
+            results.t[rayIdx] = ray.t;
+        }
+        return results;
+    };
+    const auto closestHitPackets = [&](const auto& wideBVH, WideBVHKernel kernel) {
+        TraversalResults results { .t = std::vector<float>(primaryRays.size()), .hits = std::vector<std::optional<BVHHit>>(primaryRays.size()) };
+        std::array<std::optional<BVHHit>, RayPacket::size> hits;
+        for (size_t rayIdx = 0; rayIdx < primaryRays.size(); rayIdx += RayPacket::size) {
+            RayPacket packet;
+            std::copy_n(&primaryRays[rayIdx], RayPacket::size, packet.rays.begin());
+            wideBVH.intersect(packet, hits, tMin, kernel);
+            for (size_t packetIdx = 0; packetIdx < RayPacket::size; ++packetIdx) {
+                results.hits[rayIdx + packetIdx] = hits[packetIdx];
+                results.t[rayIdx + packetIdx] = packet.rays[packetIdx].t;
+            }
+        }
+        return results;
+    };
+    const auto anyHits = [&](const auto& traceRay) {
+        TraversalResults results { .occluded = std::vector<bool>(shadowRays.size()) };
+        for (size_t rayIdx = 0; rayIdx < shadowRays.size(); ++rayIdx)
+            results.occluded[rayIdx] = traceRay(shadowRays[rayIdx]);
+        return results;
+    };
+    const auto anyHitPackets = [&](const auto& wideBVH, WideBVHKernel kernel) {
+        TraversalResults results { .occluded = std::vector<bool>(shadowRays.size()) };
+        for (size_t rayIdx = 0; rayIdx < shadowRays.size(); rayIdx += RayPacket::size) {
+            RayPacket packet;
+            std::copy_n(&shadowRays[rayIdx], RayPacket::size, packet.rays.begin());
+            const std::array<bool, RayPacket::size> occluded = wideBVH.isOccluded(packet, tMin, kernel);
+            for (size_t packetIdx = 0; packetIdx < RayPacket::size; ++packetIdx)
+                results.occluded[rayIdx + packetIdx] = occluded[packetIdx];
+        }
+        return results;
+    };
+
+    INFO("SIMD kernels: BVH4 " << BVH4::hasSIMDKernel() << ", BVH8 " << BVH8::hasSIMDKernel());
+    CHECK(sameHits(closestHits([&](Ray& ray) { return bvh4.intersect(ray, tMin); }), closestHits([&](Ray& ray) { return bvh4.intersect(ray, tMin, WideBVHKernel::Scalar); })));
+    CHECK(sameHits(closestHits([&](Ray& ray) { return bvh8.intersect(ray, tMin); }), closestHits([&](Ray& ray) { return bvh8.intersect(ray, tMin, WideBVHKernel::Scalar); })));
+    CHECK(sameHits(closestHitPackets(bvh4, WideBVHKernel::SIMD), closestHitPackets(bvh4, WideBVHKernel::Scalar)));
+    CHECK(sameHits(closestHitPackets(bvh8, WideBVHKernel::SIMD), closestHitPackets(bvh8, WideBVHKernel::Scalar)));
+    CHECK(sameHits(anyHits([&](const Ray& ray) { return bvh4.isOccluded(ray, tMin); }), anyHits([&](const Ray& ray) { return bvh4.isOccluded(ray, tMin, WideBVHKernel::Scalar); })));
+    CHECK(sameHits(anyHits([&](const Ray& ray) { return bvh8.isOccluded(ray, tMin); }), anyHits([&](const Ray& ray) { return bvh8.isOccluded(ray, tMin, WideBVHKernel::Scalar); })));
+
+    BENCHMARK("Primary, binary BVH") { return closestHits([&](Ray& ray) { return bvh.intersect(ray, tMin); }); };
+    BENCHMARK("Primary, BVH4") { return closestHits([&](Ray& ray) { return bvh4.intersect(ray, tMin); }); };
+    BENCHMARK("Primary, BVH8") { return closestHits([&](Ray& ray) { return bvh8.intersect(ray, tMin); }); };
+    BENCHMARK("Primary, BVH4 scalar kernel") { return closestHits([&](Ray& ray) { return bvh4.intersect(ray, tMin, WideBVHKernel::Scalar); }); };
+    BENCHMARK("Primary, BVH8 scalar kernel") { return closestHits([&](Ray& ray) { return bvh8.intersect(ray, tMin, WideBVHKernel::Scalar); }); };
+    BENCHMARK("Primary, BVH4 packets") { return closestHitPackets(bvh4, WideBVHKernel::SIMD); };
+    BENCHMARK("Primary, BVH8 packets") { return closestHitPackets(bvh8, WideBVHKernel::SIMD); };
+    BENCHMARK("Shadow, binary BVH") { return anyHits([&](const Ray& ray) { return bvh.isOccluded(ray, tMin); }); };
+    BENCHMARK("Shadow, BVH4") { return anyHits([&](const Ray& ray) { return bvh4.isOccluded(ray, tMin); }); };
+    BENCHMARK("Shadow, BVH8") { return anyHits([&](const Ray& ray) { return bvh8.isOccluded(ray, tMin); }); };
+    BENCHMARK("Shadow, BVH4 scalar kernel") { return anyHits([&](const Ray& ray) { return bvh4.isOccluded(ray, tMin, WideBVHKernel::Scalar); }); };
+    BENCHMARK("Shadow, BVH8 scalar kernel") { return anyHits([&](const Ray& ray) { return bvh8.isOccluded(ray, tMin, WideBVHKernel::Scalar); }); };
+    BENCHMARK("Shadow, BVH4 packets") { return anyHitPackets(bvh4, WideBVHKernel::SIMD); };
+    BENCHMARK("Shadow, BVH8 packets") { return anyHitPackets(bvh8, WideBVHKernel::SIMD); };
+}
@@ -0,0 +1,57 @@
+#include <framework/image.h>
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// RGBA gradient with some noise (such that the PNG does not compress to nothing), written to the temporary directory.
+static std::filesystem::path writeSyntheticPng(int size)
+{
+    const std::filesystem::path filePath = std::filesystem::temp_directory_path() / "benchmark_image_rgba.png";
+    if (std::filesystem::exists(filePath))
+        return filePath;
+
+    Image image { size, size, 4 };
+    const std::span<uint8_t> pixels = image.data();
+    uint32_t random = 12345;
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        const size_t x = (i / 4) % static_cast<size_t>(size), y = (i / 4) / static_cast<size_t>(size);
+        random = random * 1664525u + 1013904223u;
+        pixels[i + 0] = static_cast<uint8_t>(x / 32);
+        pixels[i + 1] = static_cast<uint8_t>(y / 32);
+        pixels[i + 2] = static_cast<uint8_t>(random >> 28);
+        pixels[i + 3] = 255;
+    }
+    const std::string filePathString = filePath.string();
+    stbi_write_png(filePathString.c_str(), size, size, 4, pixels.data(), size * 4);
+    return filePath;
+}
+
+TEST_CASE("Decoding an 8192x8192 RGBA PNG", "[image]")
+{
+    const std::filesystem::path filePath = writeSyntheticPng(8192);
+    const std::string filePathString = filePath.string();
+
+    // What Image did before it adopted the stb_image buffer: copy the pixels one byte at a time into a vector.
+    BENCHMARK("stbi_load with per-byte copy")
+    {
+        int width, height, channels;
+        stbi_uc* pStbPixels = stbi_load(filePathString.c_str(), &width, &height, &channels, STBI_default);
+        std::vector<uint8_t> pixels;
+        for (size_t i = 0; i < static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels); i++)
+            pixels.emplace_back(pStbPixels[i]);
+        stbi_image_free(pStbPixels);
+        return pixels;
+    };
+    BENCHMARK("Image")
+    {
+        return Image { filePath };
+    };
+}
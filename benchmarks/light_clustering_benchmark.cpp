@@ -0,0 +1,34 @@
+#include "light_clustering.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+DISABLE_WARNINGS_POP()
+#include <random>
+#include <vector>
+
+TEST_CASE("Binning 4096 lights into clusters", "[lights]")
+{
+    // Random lights in front of the camera, a quarter of them spotlights.
+    std::mt19937 rng { 12345 };
+    std::uniform_real_distribution<float> unitDistribution { 0.0f, 1.0f };
+    std::vector<ClusterLight> lights(4096);
+    for (ClusterLight& light : lights) {
+        light.position = glm::vec3(unitDistribution(rng) * 40.0f - 20.0f, unitDistribution(rng) * 20.0f - 10.0f, -unitDistribution(rng) * 60.0f);
+        light.range = 0.5f + unitDistribution(rng) * 2.5f;
+        light.isSpotlight = unitDistribution(rng) < 0.25f;
+        light.spotCosCutoff = 0.8f;
+    }
+
+    // Same camera as the application at 16:9.
+    const glm::mat4 projectionMatrix = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+    LightClusterGrid clusters;
+    clusters.assignLights(projectionMatrix, lights); // Warm up (cluster bounds and scratch allocations).
+    BENCHMARK("LightClusterGrid::assignLights")
+    {
+        clusters.assignLights(projectionMatrix, lights);
+        return clusters.lightIndices().size();
+    };
+}
@@ -0,0 +1,17 @@
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/catch_session.hpp>
+DISABLE_WARNINGS_POP()
+
+// Benchmarks of the CPU-side code, run with e.g. `Master_TechDemo_benchmarks "[bvh]"` to select a group.
+int main(int argc, char** argv)
+{
+    Catch::Session session;
+    // A sample of the larger benchmarks takes seconds, so take fewer than Catch2's default of 100 (--benchmark-samples
+    // still overrides this).
+    session.configData().benchmarkSamples = 10;
+    if (const int result = session.applyCommandLine(argc, argv); result != 0)
+        return result;
+    return session.run();
+}
@@ -0,0 +1,94 @@
+#include <framework/mesh.h>
+#include <framework/obj_loader.h>
+#include <framework/vertex_index_cache.h>
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <fmt/format.h>
+#include <tinyobjloader/tiny_obj_loader.h>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Height field of resolution x resolution quads (two triangles each) with normals and texture coordinates, written as
+// an OBJ file in the temporary directory.
+static std::filesystem::path writeSyntheticObj(uint32_t resolution)
+{
+    const std::filesystem::path filePath = std::filesystem::temp_directory_path() / fmt::format("benchmark_grid_{}.obj", resolution);
+    if (std::filesystem::exists(filePath))
+        return filePath;
+
+    std::ofstream file { filePath, std::ios::binary };
+    std::string buffer;
+    const uint32_t numVertices = resolution + 1;
+    for (uint32_t y = 0; y < numVertices; ++y) {
+        for (uint32_t x = 0; x < numVertices; ++x) {
+            const float u = static_cast<float>(x) / static_cast<float>(resolution);
+            const float v = static_cast<float>(y) / static_cast<float>(resolution);
+            fmt::format_to(std::back_inserter(buffer), "v {} {} {}\nvt {} {}\nvn 0 1 0\n", u, 0.1f * static_cast<float>((x * 7 + y * 13) % 17), v, u, v);
+        }
+        file << buffer;
+        buffer.clear();
+    }
+    for (uint32_t y = 0; y < resolution; ++y) {
+        for (uint32_t x = 0; x < resolution; ++x) {
+            // OBJ indices start at 1.
+            const uint32_t i00 = y * numVertices + x + 1, i10 = i00 + 1, i01 = i00 + numVertices, i11 = i01 + 1;
+            fmt::format_to(std::back_inserter(buffer), "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\nf {1}/{1}/{1} {3}/{3}/{3} {2}/{2}/{2}\n", i00, i10, i01, i11);
+        }
+        file << buffer;
+        buffer.clear();
+    }
+    return filePath;
+}
+
+TEST_CASE("Vertex deduplication of a 5M triangle OBJ", "[mesh]")
+{
+    // 1582^2 quads are just over 5M triangles.
+    const std::filesystem::path filePath = writeSyntheticObj(1582);
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, error;
+    REQUIRE(parallelLoadObj(&attrib, &shapes, &materials, &warn, &error, filePath, filePath.parent_path()));
+    REQUIRE(shapes.size() == 1);
+    const std::vector<tinyobj::index_t>& indices = shapes[0].mesh.indices;
+
+    // The index triple to vertex index map that loadMesh() used before VertexIndexCache.
+    BENCHMARK("std::map")
+    {
+        std::map<std::tuple<int, int, int>, uint32_t> vertexCache;
+        std::vector<uint32_t> vertexIndices(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i) {
+            const auto [iter, inserted] = vertexCache.try_emplace({ indices[i].vertex_index, indices[i].normal_index, indices[i].texcoord_index }, static_cast<uint32_t>(vertexCache.size()));
+            vertexIndices[i] = iter->second;
+        }
+        return vertexIndices;
+    };
+    BENCHMARK("VertexIndexCache")
+    {
+        VertexIndexCache vertexCache;
+        vertexCache.reset(indices.size());
+        std::vector<uint32_t> vertexIndices(indices.size());
+        uint32_t numVertices = 0;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            vertexIndices[i] = vertexCache.findOrInsert(indices[i], numVertices);
+            if (vertexIndices[i] == numVertices)
+                ++numVertices;
+        }
+        return vertexIndices;
+    };
+    // Everything loadMesh() does: parsing, deduplication and creating the vertices.
+    BENCHMARK("loadMesh")
+    {
+        return loadMesh(filePath, LoadMeshSettings { .maxTrianglesPerCluster = 0, .optimizeVertexOrder = false });
+    };
+}
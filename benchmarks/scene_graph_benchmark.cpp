@@ -0,0 +1,45 @@
+#include "scene_graph.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/gtc/constants.hpp>
+DISABLE_WARNINGS_POP()
+#include <vector>
+
+TEST_CASE("Updating the world matrices of a 100k node wind farm", "[scene_graph]")
+{
+    // A wind farm of 20000 windmills of five nodes each (windmill, body, rotor and two blade pairs).
+    constexpr int numWindmills = 20000;
+    constexpr int windmillsPerRow = 150;
+    SceneGraph farm;
+    farm.reserve(numWindmills * 5 + 1);
+    std::vector<SceneNode> rotorNodes;
+    const SceneNode farmNode = farm.createNode();
+    for (int i = 0; i < numWindmills; ++i) {
+        const glm::vec3 position { static_cast<float>(i % windmillsPerRow) * 8.0f, 0.0f, static_cast<float>(i / windmillsPerRow) * 8.0f };
+        const SceneNode windmill = farm.createNode(farmNode, position);
+        farm.createNode(windmill);
+        const SceneNode rotor = farm.createNode(windmill, glm::vec3(0.0f, 3.0f, 0.3f));
+        farm.createNode(rotor);
+        farm.createNode(rotor, glm::vec3(0.0f), glm::angleAxis(glm::half_pi<float>(), glm::vec3(0.0f, 0.0f, 1.0f)));
+        rotorNodes.push_back(rotor);
+    }
+    farm.updateWorldMatrices();
+
+    int iteration = 0;
+    BENCHMARK("All rotors animated")
+    {
+        const glm::quat rotation = glm::angleAxis(0.01f * static_cast<float>(++iteration), glm::vec3(0.0f, 0.0f, 1.0f));
+        for (const SceneNode rotor : rotorNodes)
+            farm.setRotation(rotor, rotation);
+        farm.updateWorldMatrices();
+        return farm.numUpdatedNodes();
+    };
+    BENCHMARK("Static")
+    {
+        farm.updateWorldMatrices();
+        return farm.numUpdatedNodes();
+    };
+}
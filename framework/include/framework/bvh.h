@@ -0,0 +1,86 @@
+#pragma once
+#include "mesh.h"
+#include "ray.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Node of a BVH. The nodes are stored in depth-first order, so the first child of an interior node directly follows it
+// and only the index of the second child has to be stored.
+struct BVHNode {
+    glm::vec3 lower;
+    uint32_t offset; // Leaf: index of the first triangle in BVH::triangles(); interior node: index of the second child.
+    glm::vec3 upper;
+    uint32_t numTriangles; // Zero for interior nodes.
+
+    [[nodiscard]] bool isLeaf() const { return numTriangles > 0; }
+};
+static_assert(sizeof(BVHNode) == 32);
+
+// Triangle of a BVH leaf. The vertex positions are copied out of the meshes and stored in the order of the leaves, such
+// that the triangles of a leaf are adjacent in memory.
+struct BVHTriangle {
+    glm::vec3 v0, v1, v2;
+    uint32_t mesh; // Index of the mesh in the meshes that the BVH was built from.
+    uint32_t triangle; // Index of the triangle in that mesh.
+};
+
+struct BVHHit {
+    uint32_t mesh;
+    uint32_t triangle;
+    glm::vec2 barycentric; // Weights of the second and third vertex.
+};
+
+struct BVHBuildSettings {
+    // Number of candidate split planes per axis is numBins - 1 (at most 64 bins).
+    uint32_t numBins { 16 };
+    uint32_t maxLeafTriangles { 8 };
+    // Cost of visiting a node relative to the cost of intersecting a triangle.
+    float traversalCost { 1.0f };
+};
+
+// Bounding volume hierarchy over the triangles of one or more meshes, built with the binned surface area heuristic
+// (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies", 2007). The top of the tree is built with
+// parallel binning until there are enough subtrees to keep all threads busy, after which the subtrees are built in
+// parallel (see parallelFor()).
+class BVH {
+public:
+    BVH() = default;
+    explicit BVH(const Mesh& mesh, const BVHBuildSettings& settings = {});
+    explicit BVH(std::span<const Mesh> meshes, const BVHBuildSettings& settings = {});
+
+    // Closest intersection in (tMin, ray.t); ray.t is set to the distance of the intersection.
+    [[nodiscard]] std::optional<BVHHit> intersect(Ray& ray, float tMin = 0.0f) const;
+    // Whether any triangle intersects the ray in (tMin, ray.t); stops at the first intersection that is found.
+    [[nodiscard]] bool isOccluded(const Ray& ray, float tMin = 0.0f) const;
+
+    // Collision queries: append the indices (into triangles()) of the triangles whose bounding boxes overlap the box,
+    // and test whether any triangle intersects a sphere.
+    void overlappingTriangles(const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& triangles) const;
+    [[nodiscard]] bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+    [[nodiscard]] std::span<const BVHNode> nodes() const;
+    [[nodiscard]] std::span<const BVHTriangle> triangles() const;
+    [[nodiscard]] bool empty() const;
+    // Expected cost of a random ray according to the surface area heuristic, in triangle intersections.
+    [[nodiscard]] float sahCost(float traversalCost = 1.0f) const;
+
+    // Nodes deeper than this are turned into leaves (a ray traversal needs a stack entry per level).
+    static constexpr uint32_t maxDepth = 64;
+    // Distances at which rays leave boxes are scaled by this factor, such that rounding errors in the slab test do not
+    // cull triangles that touch the boundary of their box (Ize, "Robust BVH Ray Traversal", 2013).
+    static constexpr float robustExitScale = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+private:
+    std::vector<BVHNode> m_nodes;
+    std::vector<BVHTriangle> m_triangles;
+};
@@ -7,19 +7,30 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 DISABLE_WARNINGS_POP()
+#include <cassert>
+#include <cstdint>
 #include <filesystem>
-#include <vector>
+#include <memory>
+#include <span>
 
 
 struct Image {
 public:
     explicit Image(const std::filesystem::path& filePath);
+    // Create a black image with the given dimensions.
+    Image(int width, int height, int channels);
+    // Images own a potentially large pixel buffer, so they can be moved but not (accidentally) copied.
+    Image(const Image&) = delete;
+    Image(Image&&) noexcept = default;
 
+    Image& operator=(const Image&) = delete;
+    Image& operator=(Image&&) noexcept = default;
 
     void writeBitmapToFile(const std::filesystem::path& filePath);
 
 public:
     int width, height, channels;
+    std::filesystem::path sourceFile; // File that the image was loaded from.
     template<int image_channels = 3> glm::vec<image_channels, float>get_pixel(const int index) const {
         //Template argument should equal actual image channels
         assert(image_channels == channels);
@@ -42,9 +53,24 @@ public:
     }
 
     uint8_t* get_data() {
-        return pixels.data();
+        return pixels.get();
+    }
+    const uint8_t* get_data() const {
+        return pixels.get();
+    }
+
+    // All pixels, stored row by row with the channels of each pixel interleaved.
+    [[nodiscard]] std::span<uint8_t> data() {
+        return { pixels.get(), sizeInBytes() };
+    }
+    [[nodiscard]] std::span<const uint8_t> data() const {
+        return { pixels.get(), sizeInBytes() };
+    }
+    [[nodiscard]] size_t sizeInBytes() const {
+        return static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels);
     }
 
 private:
-    std::vector<uint8_t> pixels;
+    // The buffer decoded by stb_image is adopted as is; the deleter frees it the same way it was allocated.
+    std::unique_ptr<uint8_t[], void (*)(void*)> pixels;
 };
@@ -0,0 +1,19 @@
+#pragma once
+#include "image.h"
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+
+// Process-wide cache of decoded images, keyed by their (canonical) file path.
+//
+// The cache only holds weak references: an image stays cached for as long as any material, texture or other user
+// holds on to it, and is decoded again when requested after the last reference was dropped. Different images may be
+// decoded concurrently from multiple threads; concurrent requests for the same image wait for a single decode.
+[[nodiscard]] std::shared_ptr<Image> loadImageCached(const std::filesystem::path& filePath);
+
+struct ImageCacheStatistics {
+    size_t numHits { 0 }; // Requests served by an image that was already decoded (or being decoded).
+    size_t numDecodes { 0 }; // Requests that had to decode the image.
+    size_t numDecodedBytes { 0 }; // Total size of the pixel data of all decoded images.
+};
+[[nodiscard]] ImageCacheStatistics imageCacheStatistics();
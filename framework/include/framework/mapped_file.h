@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+// Read-only memory mapping of a file. The contents stay valid for as long as the MappedFile object is alive.
+class MappedFile {
+public:
+    // Map the given file into memory; returns std::nullopt if the file cannot be opened or mapped.
+    [[nodiscard]] static std::optional<MappedFile> open(const std::filesystem::path& filePath);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) noexcept;
+    ~MappedFile();
+
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) noexcept;
+
+    [[nodiscard]] std::span<const std::byte> data() const;
+
+private:
+    MappedFile() = default;
+    void unmap();
+
+private:
+    const std::byte* m_pData { nullptr };
+    size_t m_size { 0 };
+#ifdef _WIN32
+    void* m_fileHandle { nullptr };
+    void* m_mappingHandle { nullptr };
+#endif
+};
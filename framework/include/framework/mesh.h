@@ -6,6 +6,7 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
+#include <cstdint>
 #include <filesystem>
 #include <optional>
 #include <span>
@@ -33,11 +34,33 @@ struct Material {
 	std::shared_ptr<Image> kdTexture;
 };
 
+// Axis-aligned bounding box and bounding sphere of the vertex positions of a mesh.
+struct MeshBounds {
+	glm::vec3 lower { 0.0f };
+	glm::vec3 upper { 0.0f };
+	glm::vec3 sphereCenter { 0.0f };
+	float sphereRadius { 0.0f };
+};
+
+// Spatially coherent range of consecutive triangles of a mesh (see buildMeshClusters()), used for culling.
+struct MeshCluster {
+	uint32_t firstTriangle;
+	uint32_t numTriangles;
+	MeshBounds bounds;
+	// Normal cone of the (geometric) triangle normals. All triangles face away from a viewer at position p if
+	//   dot(bounds.sphereCenter - p, coneAxis) > coneCutoff * length(bounds.sphereCenter - p) + (1 + coneCutoff) * bounds.sphereRadius
+	// The cutoff is the sine of the cone's half angle, or 1 (never backfacing) if the cone is wider than a hemisphere.
+	glm::vec3 coneAxis { 0.0f };
+	float coneCutoff { 1.0f };
+};
+
 struct Mesh {
 	// Vertices contain the vertex positions and normals of the mesh.
 	std::vector<Vertex> vertices;
 	// A triangle contains a triplet of values corresponding to the indices of the 3 vertices in the vertices array.
 	std::vector<glm::uvec3> triangles;
+	// Clusters covering all triangles in order; empty unless the triangles were grouped with buildMeshClusters().
+	std::vector<MeshCluster> clusters;
 
 	Material material;
 };
@@ -45,9 +68,19 @@ struct Mesh {
 struct LoadMeshSettings {
 	bool normalizeVertexPositions { false };
 	bool cacheVertices { true };
+	// Group the triangles of every sub mesh into clusters of at most this many triangles (0 to disable).
+	uint32_t maxTrianglesPerCluster { 0 };
+	// Reorder the triangles and vertices for the GPU's vertex caches and to reduce overdraw (see <framework/mesh_optimization.h>).
+	bool optimizeVertexOrder { false };
 };
 
-[[nodiscard]] std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings = {});
+struct MeshOptimizationReport;
+// If the vertex order is optimized and pOptimizationReport is given, it receives the vertex cache statistics of all sub
+// meshes before and after the optimization.
+[[nodiscard]] std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings = {}, MeshOptimizationReport* pOptimizationReport = nullptr);
+[[nodiscard]] MeshBounds computeMeshBounds(std::span<const Vertex> vertices);
+// Reorder the triangles into spatially coherent clusters of at most maxTrianglesPerCluster triangles and fill mesh.clusters.
+void buildMeshClusters(Mesh& mesh, size_t maxTrianglesPerCluster);
 [[nodiscard]] Mesh mergeMeshes(std::span<const Mesh> meshes);
 void meshFlipX(Mesh& mesh);
 void meshFlipY(Mesh& mesh);
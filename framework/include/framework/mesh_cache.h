@@ -0,0 +1,42 @@
+#pragma once
+#include "mapped_file.h"
+#include "mesh.h"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Binary cache of the (already deduplicated) output of loadMesh(), stored next to the source file as "<file>.meshcache".
+// The cache is memory mapped when opened so the vertex and triangle arrays can be handed to the GPU without any parsing.
+// A cache is only used if it was created with the same LoadMeshSettings and if neither the source file nor the material
+// libraries that it names changed since; this is decided by the size and modification time of every file, falling back
+// to a hash of its contents.
+class MeshCache {
+public:
+    // Open the cache belonging to the given source file; returns std::nullopt if it does not exist or is stale.
+    [[nodiscard]] static std::optional<MeshCache> open(const std::filesystem::path& sourceFile, const LoadMeshSettings& settings);
+    // Write the cache for the given source file. Failing to write the cache is not fatal and only prints a warning.
+    static void write(const std::filesystem::path& sourceFile, const LoadMeshSettings& settings, std::span<const Mesh> meshes);
+    [[nodiscard]] static std::filesystem::path cacheFilePath(const std::filesystem::path& sourceFile);
+
+    [[nodiscard]] size_t numSubMeshes() const;
+    [[nodiscard]] std::span<const Vertex> vertices(size_t subMesh) const;
+    [[nodiscard]] std::span<const glm::uvec3> triangles(size_t subMesh) const;
+    [[nodiscard]] std::span<const MeshCluster> clusters(size_t subMesh) const;
+    // Reconstruct the material of a sub mesh, loading its diffuse texture (if any) through loadImageCached().
+    [[nodiscard]] Material material(size_t subMesh) const;
+
+    // Copy the cached data into regular meshes.
+    [[nodiscard]] std::vector<Mesh> toMeshes() const;
+
+private:
+    struct SubMeshRecord;
+
+    MeshCache(MappedFile&& file, const std::filesystem::path& sourceFile);
+    [[nodiscard]] const SubMeshRecord& record(size_t subMesh) const;
+
+private:
+    MappedFile m_file;
+    std::filesystem::path m_baseDir;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "mesh.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <span>
+
+// Number of entries of the FIFO post-transform vertex cache that is modelled by the functions below.
+constexpr size_t defaultVertexCacheSize = 16;
+
+// Efficiency of a triangle order for a FIFO post-transform vertex cache.
+struct VertexCacheStatistics {
+    size_t numTransformedVertices { 0 }; // Cache misses.
+    size_t numTriangles { 0 };
+    size_t numVertices { 0 }; // Vertices that are used by at least one triangle.
+
+    // Average cache miss ratio: transformed vertices per triangle (from 3 down to about 0.5 for large regular meshes).
+    [[nodiscard]] float acmr() const;
+    // Average transform to vertex ratio: transformed vertices per vertex (1 is optimal).
+    [[nodiscard]] float atvr() const;
+
+    VertexCacheStatistics& operator+=(const VertexCacheStatistics& other);
+};
+
+// Simulate a FIFO vertex cache of cacheSize entries; all indices must be smaller than numVertices.
+[[nodiscard]] VertexCacheStatistics analyzeVertexCache(std::span<const glm::uvec3> triangles, size_t numVertices, size_t cacheSize = defaultVertexCacheSize);
+
+// Reorder the triangles for the post-transform vertex cache with Tipsify (Sander, Nehab & Barczak, "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw", 2007), which runs in linear time. All indices must be smaller
+// than numVertices.
+void optimizeVertexCache(std::span<glm::uvec3> triangles, size_t numVertices, size_t cacheSize = defaultVertexCacheSize);
+
+// Reorder the vertices in the order in which the triangles first use them (vertices that are not used go last) and
+// remap the triangles accordingly, such that vertex fetches walk through the vertex buffer mostly sequentially.
+void optimizeVertexFetch(Mesh& mesh);
+
+struct MeshOptimizationReport {
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+};
+
+// Optimize the triangle and vertex order of a mesh for rendering: the triangles of every cluster (or of the whole mesh
+// if it has no clusters) are reordered for the vertex cache, the clusters are sorted such that the clusters facing
+// away from the center of the mesh are drawn first (reducing overdraw), and finally the vertices are reordered for
+// fetch locality. Clusters stay intact; only their order changes.
+MeshOptimizationReport optimizeMeshVertexOrder(Mesh& mesh, size_t cacheSize = defaultVertexCacheSize);
@@ -0,0 +1,18 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <tinyobjloader/tiny_obj_loader.h>
+DISABLE_WARNINGS_POP()
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Multi-threaded drop-in replacement for tinyobj::LoadObj (with triangulation enabled).
+//
+// The file is split into chunks of whole lines which are parsed in parallel using tinyobjloader's own parser, after
+// which the chunks are stitched together in file order. The resulting attributes, shapes and materials are identical
+// to those of tinyobj::LoadObj. Files using features that cannot be stitched exactly (e.g. polygons with more than
+// four vertices) are transparently handed to tinyobj::LoadObj instead.
+bool parallelLoadObj(tinyobj::attrib_t* pAttrib, std::vector<tinyobj::shape_t>* pShapes, std::vector<tinyobj::material_t>* pMaterials,
+    std::string* pWarn, std::string* pError, const std::filesystem::path& file, const std::filesystem::path& mtlBaseDir);
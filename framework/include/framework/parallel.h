@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Number of threads that parallelFor() distributes work over (at least 1).
+[[nodiscard]] unsigned numWorkerThreads();
+
+// Call function(i) for every i in [0, count), spread over numWorkerThreads() threads (including the calling thread).
+// Items are handed out one at a time so that items with uneven amounts of work are balanced automatically; prefer
+// a few large items (e.g. chunks of a file or sub meshes) over many tiny ones. Returns once all items have finished.
+// If any call throws then the remaining items are skipped and the first exception is rethrown on the calling thread.
+void parallelFor(size_t count, const std::function<void(size_t)>& function);
+
+// Same as parallelFor(), but every thread starts with a contiguous block of the items and steals half of the remaining
+// items of another thread once its own block is done. Neighbouring items (e.g. the tiles of an image) thus tend to be
+// processed by the same thread, and threads only touch each other's state when they run out of work.
+void parallelForWorkStealing(size_t count, const std::function<void(size_t)>& function);
@@ -8,14 +8,48 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 DISABLE_WARNINGS_POP()
+#include <cstdint>
 #include <exception>
 #include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 struct ShaderLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+// 64-bit FNV-1a hash of a uniform (block) name.
+constexpr uint64_t hashUniformName(std::string_view name)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Name of a uniform, hashed at compile time when constructed from a string literal: shader.set("mvpMatrix", mvp);
+// The name itself is only kept for error messages, so it should outlive the call that it is passed to.
+struct UniformName {
+    consteval UniformName(const char* pName)
+        : name(pName)
+        , hash(hashUniformName(pName))
+    {
+    }
+    // For names that are only known at run time.
+    explicit constexpr UniformName(std::string_view runtimeName)
+        : name(runtimeName)
+        , hash(hashUniformName(runtimeName))
+    {
+    }
+
+    std::string_view name;
+    uint64_t hash;
+};
+
 class Shader {
 public:
     Shader();
@@ -29,7 +63,29 @@ public:
     void bind() const;
 
     // Bind the uniform define by the given name to the given buffer and location in its assigned block, 
-    void bindUniformBlock(const std::string& blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const;
+    void bindUniformBlock(UniformName blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const;
+
+    // Set the value of a uniform. The active uniforms are enumerated when the program is linked, so these do not
+    // allocate or query OpenGL. The program does not need to be bound. Uniforms that are not active (e.g. because the
+    // compiler optimized them away) are silently ignored, matching OpenGL's behavior for location -1.
+    void set(UniformName name, bool value) const;
+    void set(UniformName name, int value) const;
+    void set(UniformName name, unsigned value) const;
+    void set(UniformName name, float value) const;
+    void set(UniformName name, const glm::vec2& value) const;
+    void set(UniformName name, const glm::vec3& value) const;
+    void set(UniformName name, const glm::vec4& value) const;
+    void set(UniformName name, const glm::mat3& value) const;
+    void set(UniformName name, const glm::mat4& value) const;
+    // Set (the first values of) an array uniform.
+    void set(UniformName name, std::span<const int> values) const;
+    void set(UniformName name, std::span<const float> values) const;
+    void set(UniformName name, std::span<const glm::vec3> values) const;
+    void set(UniformName name, std::span<const glm::vec4> values) const;
+    void set(UniformName name, std::span<const glm::mat4> values) const;
+
+    // Location of an active uniform, or -1 if there is no such uniform.
+    [[nodiscard]] GLint uniformLocation(UniformName name) const;
 
     // Query an attribute location by its name in the shader
     GLuint getAttributeLocation(const std::string& name) const;
@@ -41,8 +97,22 @@ private:
     friend class ShaderBuilder;
     Shader(GLuint program);
 
+    struct UniformInfo {
+        uint64_t nameHash;
+        GLint location;
+    };
+    struct UniformBlockInfo {
+        uint64_t nameHash;
+        GLuint index;
+        GLuint binding;
+    };
+    void enumerateUniforms();
+
 private:
     GLuint m_program;
+    // Both sorted by name hash.
+    std::vector<UniformInfo> m_uniforms;
+    mutable std::vector<UniformBlockInfo> m_uniformBlocks;
 };
 
 class ShaderBuilder {
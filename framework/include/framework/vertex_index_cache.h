@@ -0,0 +1,67 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <tinyobjloader/tiny_obj_loader.h>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash table that maps the (vertex, normal, texcoord) index triple of a tinyobjloader index to the
+// index of the corresponding vertex in the generated mesh. Much faster than a std::map on large meshes because the
+// slots are stored in one flat array and lookups only ever touch a couple of neighbouring cache lines.
+class VertexIndexCache {
+public:
+    // Empty the table and size it for (at most) the given number of unique vertices. The allocation of an earlier
+    // reset() is reused when it is large enough.
+    void reset(size_t maxNumVertices)
+    {
+        // Keep the load factor at or below 50% so that linear probing sequences stay short.
+        size_t capacity = 16;
+        while (capacity < 2 * maxNumVertices)
+            capacity *= 2;
+        m_mask = capacity - 1;
+        m_slots.assign(capacity, Slot {});
+    }
+
+    // Return the cached vertex index of the given key if it exists; otherwise insert newIndex and return that.
+    uint32_t findOrInsert(const tinyobj::index_t& index, uint32_t newIndex)
+    {
+        const Key key { static_cast<uint32_t>(index.vertex_index), static_cast<uint32_t>(index.normal_index), static_cast<uint32_t>(index.texcoord_index) };
+        for (size_t slotIdx = hash(key) & m_mask;; slotIdx = (slotIdx + 1) & m_mask) {
+            Slot& slot = m_slots[slotIdx];
+            if (slot.key.vertex == emptyKey) {
+                slot.key = key;
+                slot.value = newIndex;
+                return newIndex;
+            } else if (slot.key == key) {
+                return slot.value;
+            }
+        }
+    }
+
+private:
+    struct Key {
+        uint32_t vertex, normal, texCoord;
+
+        [[nodiscard]] constexpr bool operator==(const Key&) const noexcept = default;
+    };
+    struct Slot {
+        Key key { emptyKey, emptyKey, emptyKey };
+        uint32_t value { 0 };
+    };
+    // tinyobjloader always provides a vertex (position) index, so -1 can never occur as a valid key.
+    static constexpr uint32_t emptyKey = 0xFFFFFFFF;
+
+    static uint64_t hash(const Key& key)
+    {
+        // Multiplicative hashing of the packed index triple; the high bits are folded in so that the mask keeps them.
+        uint64_t h = (uint64_t(key.vertex) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(key.normal) * 0xC2B2AE3D27D4EB4Full) ^ (uint64_t(key.texCoord) * 0x165667B19E3779F9ull);
+        h ^= h >> 29;
+        return h;
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_mask { 0 };
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "bvh.h"
+#include "ray.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Node of a WideBVH with the bounds of its (up to) Width children in structure-of-arrays layout, such that a ray is
+// tested against all children at once with SIMD instructions. Unused child slots have inverted bounds that never hit.
+template <uint32_t Width>
+struct alignas(32) WideBVHNode {
+    std::array<float, Width> lowerX, lowerY, lowerZ;
+    std::array<float, Width> upperX, upperY, upperZ;
+    // Interior child: index of the child node; leaf: index of its first triangle block.
+    std::array<uint32_t, Width> children;
+    std::array<uint32_t, Width> numBlocks; // Zero for interior children.
+};
+
+// Width triangles in structure-of-arrays layout. The edges are stored instead of the other two vertices, because that is
+// what the ray/triangle test needs. Unused lanes hold degenerate triangles whose mesh is WideBVH::invalidMesh.
+template <uint32_t Width>
+struct alignas(32) TriangleBlock {
+    std::array<float, Width> v0X, v0Y, v0Z;
+    std::array<float, Width> edge1X, edge1Y, edge1Z;
+    std::array<float, Width> edge2X, edge2Y, edge2Z;
+    std::array<uint32_t, Width> mesh;
+    std::array<uint32_t, Width> triangle;
+};
+
+// Rays that are traced together. They should be coherent (e.g. the primary rays of a 2x2 pixel block) because a node is
+// visited as soon as one of them hits it.
+struct RayPacket {
+    static constexpr size_t size = 4;
+    std::array<Ray, size> rays;
+};
+
+enum class WideBVHKernel {
+    SIMD, // SSE for 4 lanes and AVX2 for 8 lanes (if the CPU supports it); Scalar otherwise.
+    Scalar // Loops over the lanes; computes bit for bit the same results as SIMD.
+};
+
+// Bounding volume hierarchy with Width children per node, created by collapsing the levels of a binary BVH (BVH4 and
+// BVH8 in the literature). Traversal tests a ray against all children of a node at once, and the triangles of the leaves
+// in blocks of Width. The results equal those of the binary BVH, except which triangle is reported if several
+// triangles are hit at exactly the same distance.
+template <uint32_t Width>
+class WideBVH {
+public:
+    static_assert(Width == 4 || Width == 8);
+
+    WideBVH() = default;
+    explicit WideBVH(const BVH& bvh);
+
+    // Closest intersection in (tMin, ray.t); ray.t is set to the distance of the intersection.
+    [[nodiscard]] std::optional<BVHHit> intersect(Ray& ray, float tMin = 0.0f, WideBVHKernel kernel = WideBVHKernel::SIMD) const;
+    [[nodiscard]] bool isOccluded(const Ray& ray, float tMin = 0.0f, WideBVHKernel kernel = WideBVHKernel::SIMD) const;
+    // Packet versions of the functions above, with the rays of the packet in the SIMD lanes.
+    void intersect(RayPacket& packet, std::array<std::optional<BVHHit>, RayPacket::size>& hits, float tMin = 0.0f,
+        WideBVHKernel kernel = WideBVHKernel::SIMD) const;
+    [[nodiscard]] std::array<bool, RayPacket::size> isOccluded(const RayPacket& packet, float tMin = 0.0f, WideBVHKernel kernel = WideBVHKernel::SIMD) const;
+
+    [[nodiscard]] std::span<const WideBVHNode<Width>> nodes() const;
+    [[nodiscard]] std::span<const TriangleBlock<Width>> blocks() const;
+    [[nodiscard]] bool empty() const;
+    // Whether WideBVHKernel::SIMD traces single rays with SIMD instructions; packets have 4 lanes and use SSE if available.
+    [[nodiscard]] static bool hasSIMDKernel();
+
+    static constexpr uint32_t invalidMesh = 0xFFFFFFFF;
+
+private:
+    uint32_t collapse(const BVH& bvh, uint32_t binaryNodeIdx, std::span<const std::pair<uint32_t, uint32_t>> triangleRanges);
+
+private:
+    std::vector<WideBVHNode<Width>> m_nodes;
+    std::vector<TriangleBlock<Width>> m_blocks;
+};
+
+extern template class WideBVH<4>;
+extern template class WideBVH<8>;
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
@@ -0,0 +1,571 @@
+#include "bvh.h"
+#include "parallel.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+struct AABB {
+    glm::vec3 lower { std::numeric_limits<float>::max() };
+    glm::vec3 upper { std::numeric_limits<float>::lowest() };
+
+    void extend(const glm::vec3& point)
+    {
+        lower = glm::min(lower, point);
+        upper = glm::max(upper, point);
+    }
+    void extend(const AABB& other)
+    {
+        lower = glm::min(lower, other.lower);
+        upper = glm::max(upper, other.upper);
+    }
+    // Half of the surface area; the SAH only needs ratios of areas.
+    [[nodiscard]] float halfArea() const
+    {
+        const glm::vec3 extent = glm::max(upper - lower, 0.0f);
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+};
+
+constexpr uint32_t maxBins = 64;
+// Ranges of at least this many triangles are binned with parallelFor() while building the top of the tree.
+constexpr uint32_t parallelBinningThreshold = 1 << 16;
+constexpr uint32_t trianglesPerBinningChunk = 1 << 14;
+// Marks a node of the top of the tree that is a placeholder for a subtree that is built separately.
+constexpr uint32_t subtreePlaceholder = 0xFFFFFFFF;
+
+// Bounds of a triangle together with its index. The builder partitions these instead of triangle indices, such that it
+// streams through memory rather than gathering the bounds of every triangle from a separate array.
+struct TriangleReference {
+    AABB bounds;
+    uint32_t triangle;
+
+    [[nodiscard]] glm::vec3 centroid() const { return 0.5f * (bounds.lower + bounds.upper); }
+};
+
+// Only the first numBins bins of every axis are initialized; most nodes are small, so resetting all of them would
+// dominate the build time.
+struct Bins {
+    explicit Bins(uint32_t numBins)
+    {
+        for (int axis = 0; axis < 3; ++axis) {
+            std::fill_n(std::begin(lower[axis]), numBins, glm::vec3(std::numeric_limits<float>::max()));
+            std::fill_n(std::begin(upper[axis]), numBins, glm::vec3(std::numeric_limits<float>::lowest()));
+            std::fill_n(std::begin(counts[axis]), numBins, 0u);
+        }
+    }
+
+    void add(int axis, uint32_t bin, const AABB& bounds, uint32_t count = 1)
+    {
+        lower[axis][bin] = glm::min(lower[axis][bin], bounds.lower);
+        upper[axis][bin] = glm::max(upper[axis][bin], bounds.upper);
+        counts[axis][bin] += count;
+    }
+    [[nodiscard]] AABB bounds(int axis, uint32_t bin) const { return AABB { .lower = lower[axis][bin], .upper = upper[axis][bin] }; }
+
+    std::array<std::array<glm::vec3, maxBins>, 3> lower;
+    std::array<std::array<glm::vec3, maxBins>, 3> upper;
+    std::array<std::array<uint32_t, maxBins>, 3> counts;
+};
+
+struct Split {
+    int axis { -1 }; // -1 if the range should become a leaf.
+    uint32_t bin { 0 }; // Triangles in bins [0, bin) go to the first child.
+    uint32_t numBins { 0 };
+};
+
+class BVHBuilder {
+public:
+    BVHBuilder(const BVHBuildSettings& settings, std::span<TriangleReference> references)
+        : m_numBins(std::clamp(settings.numBins, 2u, maxBins))
+        , m_maxLeafTriangles(std::max(settings.maxLeafTriangles, 1u))
+        , m_traversalCost(settings.traversalCost)
+        , m_references(references)
+    {
+    }
+
+    // Build the tree over references [begin, end) in depth-first order. If subtreeSize is given, ranges of at most
+    // that many triangles are not built but replaced by placeholders whose offset is an index into subtrees.
+    void build(uint32_t begin, uint32_t end, uint32_t depth, std::vector<BVHNode>& nodes, std::optional<uint32_t> subtreeSize,
+        std::vector<std::array<uint32_t, 3>>& subtrees) const
+    {
+        const bool parallel = subtreeSize.has_value();
+        if (subtreeSize && end - begin <= *subtreeSize) {
+            nodes.push_back(BVHNode { .lower {}, .offset = static_cast<uint32_t>(subtrees.size()), .upper {}, .numTriangles = subtreePlaceholder });
+            subtrees.push_back({ begin, end, depth });
+            return;
+        }
+
+        const auto [nodeBounds, centroidBounds] = computeBounds(begin, end, parallel);
+        const uint32_t nodeIdx = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BVHNode { .lower = nodeBounds.lower, .offset = begin, .upper = nodeBounds.upper, .numTriangles = end - begin });
+        if (end - begin == 1)
+            return;
+
+        const Split split = findSplit(begin, end, nodeBounds, centroidBounds, parallel);
+        if ((split.axis == -1 && end - begin <= m_maxLeafTriangles) || depth + 1 >= BVH::maxDepth)
+            return;
+
+        uint32_t middle;
+        if (split.axis == -1) {
+            // The SAH cannot separate the triangles (e.g. because their centroids coincide), but the leaf would be too
+            // large; split the range in half.
+            middle = begin + (end - begin) / 2;
+        } else {
+            const int axis = split.axis;
+            const float lower = centroidBounds.lower[axis];
+            const float scale = static_cast<float>(split.numBins) / (centroidBounds.upper[axis] - lower);
+            const auto first = std::begin(m_references) + begin;
+            middle = static_cast<uint32_t>(std::partition(first, std::begin(m_references) + end,
+                                               [&](const TriangleReference& reference) { return binIndex(reference.centroid()[axis], lower, scale, split.numBins) < split.bin; })
+                - std::begin(m_references));
+        }
+
+        nodes[nodeIdx].numTriangles = 0;
+        build(begin, middle, depth + 1, nodes, subtreeSize, subtrees);
+        nodes[nodeIdx].offset = static_cast<uint32_t>(nodes.size());
+        build(middle, end, depth + 1, nodes, subtreeSize, subtrees);
+    }
+
+private:
+    [[nodiscard]] static uint32_t binIndex(float centroid, float lower, float scale, uint32_t numBins)
+    {
+        return std::min(static_cast<uint32_t>(std::max((centroid - lower) * scale, 0.0f)), numBins - 1);
+    }
+
+    // Bounds of the triangles and of their centroids.
+    [[nodiscard]] std::pair<AABB, AABB> computeBounds(uint32_t begin, uint32_t end, bool parallel) const
+    {
+        const auto computeChunk = [&](uint32_t chunkBegin, uint32_t chunkEnd) {
+            std::pair<AABB, AABB> bounds;
+            for (uint32_t i = chunkBegin; i < chunkEnd; ++i) {
+                bounds.first.extend(m_references[i].bounds);
+                bounds.second.extend(m_references[i].centroid());
+            }
+            return bounds;
+        };
+        if (!parallel || end - begin < parallelBinningThreshold)
+            return computeChunk(begin, end);
+
+        std::vector<std::pair<AABB, AABB>> chunkBounds((end - begin + trianglesPerBinningChunk - 1) / trianglesPerBinningChunk);
+        parallelFor(chunkBounds.size(), [&](size_t chunk) {
+            const uint32_t chunkBegin = begin + static_cast<uint32_t>(chunk) * trianglesPerBinningChunk;
+            chunkBounds[chunk] = computeChunk(chunkBegin, std::min(chunkBegin + trianglesPerBinningChunk, end));
+        });
+        std::pair<AABB, AABB> bounds;
+        for (const auto& [triangleBounds, centroidBounds] : chunkBounds) {
+            bounds.first.extend(triangleBounds);
+            bounds.second.extend(centroidBounds);
+        }
+        return bounds;
+    }
+
+    [[nodiscard]] Split findSplit(uint32_t begin, uint32_t end, const AABB& nodeBounds, const AABB& centroidBounds, bool parallel) const
+    {
+        // Small nodes, which are the vast majority, do not need more candidate planes than they have triangles.
+        const uint32_t numBins = std::min(m_numBins, std::max(end - begin, 2u));
+        const glm::vec3 extent = centroidBounds.upper - centroidBounds.lower;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; ++axis)
+            scale[axis] = extent[axis] > 0.0f ? static_cast<float>(numBins) / extent[axis] : 0.0f;
+
+        const auto binChunk = [&](uint32_t chunkBegin, uint32_t chunkEnd, Bins& bins) {
+            for (uint32_t i = chunkBegin; i < chunkEnd; ++i) {
+                const TriangleReference& reference = m_references[i];
+                const glm::vec3 centroid = reference.centroid();
+                for (int axis = 0; axis < 3; ++axis)
+                    bins.add(axis, binIndex(centroid[axis], centroidBounds.lower[axis], scale[axis], numBins), reference.bounds);
+            }
+        };
+        Bins bins { numBins };
+        if (!parallel || end - begin < parallelBinningThreshold) {
+            binChunk(begin, end, bins);
+        } else {
+            std::vector<Bins> chunkBins((end - begin + trianglesPerBinningChunk - 1) / trianglesPerBinningChunk, Bins { numBins });
+            parallelFor(chunkBins.size(), [&](size_t chunk) {
+                const uint32_t chunkBegin = begin + static_cast<uint32_t>(chunk) * trianglesPerBinningChunk;
+                binChunk(chunkBegin, std::min(chunkBegin + trianglesPerBinningChunk, end), chunkBins[chunk]);
+            });
+            for (const Bins& chunk : chunkBins) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    for (uint32_t bin = 0; bin < numBins; ++bin)
+                        bins.add(axis, bin, chunk.bounds(axis, bin), chunk.counts[axis][bin]);
+                }
+            }
+        }
+
+        // Sweep from the right to get the cost of every right child, then from the left to evaluate the splits.
+        // Ranges that are too large for a leaf are split even if the SAH prefers a leaf.
+        Split bestSplit;
+        float bestCost = end - begin <= m_maxLeafTriangles ? static_cast<float>(end - begin) : std::numeric_limits<float>::infinity();
+        const float invNodeArea = 1.0f / std::max(nodeBounds.halfArea(), std::numeric_limits<float>::min());
+        for (int axis = 0; axis < 3; ++axis) {
+            if (scale[axis] == 0.0f)
+                continue;
+            std::array<float, maxBins> rightCosts;
+            AABB rightBounds;
+            uint32_t rightCount = 0;
+            for (uint32_t bin = numBins - 1; bin > 0; --bin) {
+                rightBounds.extend(bins.bounds(axis, bin));
+                rightCount += bins.counts[axis][bin];
+                rightCosts[bin] = rightBounds.halfArea() * static_cast<float>(rightCount);
+            }
+            AABB leftBounds;
+            uint32_t leftCount = 0;
+            for (uint32_t bin = 1; bin < numBins; ++bin) {
+                leftBounds.extend(bins.bounds(axis, bin - 1));
+                leftCount += bins.counts[axis][bin - 1];
+                if (leftCount == 0 || leftCount == end - begin)
+                    continue;
+                const float cost = m_traversalCost + (leftBounds.halfArea() * static_cast<float>(leftCount) + rightCosts[bin]) * invNodeArea;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = Split { .axis = axis, .bin = bin, .numBins = numBins };
+                }
+            }
+        }
+        return bestSplit;
+    }
+
+private:
+    uint32_t m_numBins;
+    uint32_t m_maxLeafTriangles;
+    float m_traversalCost;
+    std::span<TriangleReference> m_references;
+};
+
+// Copy the nodes of the top of the tree to nodes in depth-first order, replacing the placeholders by their subtrees.
+void appendNodes(std::span<const BVHNode> topNodes, uint32_t topNodeIdx, std::span<const std::vector<BVHNode>> subtreeNodes, std::vector<BVHNode>& nodes)
+{
+    const BVHNode& topNode = topNodes[topNodeIdx];
+    if (topNode.numTriangles == subtreePlaceholder) {
+        const uint32_t base = static_cast<uint32_t>(nodes.size());
+        for (BVHNode node : subtreeNodes[topNode.offset]) {
+            if (!node.isLeaf())
+                node.offset += base;
+            nodes.push_back(node);
+        }
+    } else if (topNode.isLeaf()) {
+        nodes.push_back(topNode);
+    } else {
+        const size_t nodeIdx = nodes.size();
+        nodes.push_back(topNode);
+        appendNodes(topNodes, topNodeIdx + 1, subtreeNodes, nodes);
+        nodes[nodeIdx].offset = static_cast<uint32_t>(nodes.size());
+        appendNodes(topNodes, topNode.offset, subtreeNodes, nodes);
+    }
+}
+
+// Reciprocal of the ray direction for the slab test. Components that are (nearly) zero are replaced by a tiny value
+// with the same sign, because 0 * infinity is NaN for rays whose origin lies exactly on a slab plane.
+glm::vec3 safeInverseDirection(const glm::vec3& direction)
+{
+    constexpr float minComponent = 1e-20f;
+    glm::vec3 result;
+    for (int axis = 0; axis < 3; ++axis)
+        result[axis] = 1.0f / (std::abs(direction[axis]) < minComponent ? std::copysign(minComponent, direction[axis]) : direction[axis]);
+    return result;
+}
+
+// Distance at which the ray enters the node's box, or infinity if it misses the box within [tMin, ray.t].
+float intersectNode(const BVHNode& node, const Ray& ray, const glm::vec3& invDirection, float tMin)
+{
+    const glm::vec3 t0 = (node.lower - ray.origin) * invDirection;
+    const glm::vec3 t1 = (node.upper - ray.origin) * invDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    const float tEnter = std::max({ tNear.x, tNear.y, tNear.z, tMin });
+    const float tExit = std::min(std::min({ tFar.x, tFar.y, tFar.z }) * BVH::robustExitScale, ray.t);
+    return tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity();
+}
+
+// Möller-Trumbore ray/triangle intersection; only accepts intersections in (tMin, ray.t).
+bool intersectTriangle(const BVHTriangle& triangle, const Ray& ray, float tMin, float& t, glm::vec2& barycentric)
+{
+    const glm::vec3 edge1 = triangle.v1 - triangle.v0;
+    const glm::vec3 edge2 = triangle.v2 - triangle.v0;
+    const glm::vec3 p = glm::cross(ray.direction, edge2);
+    const float determinant = glm::dot(edge1, p);
+    if (std::abs(determinant) < 1e-12f)
+        return false;
+    const float invDeterminant = 1.0f / determinant;
+    const glm::vec3 s = ray.origin - triangle.v0;
+    const float u = glm::dot(s, p) * invDeterminant;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = glm::dot(ray.direction, q) * invDeterminant;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(edge2, q) * invDeterminant;
+    barycentric = glm::vec2(u, v);
+    return t > tMin && t < ray.t;
+}
+
+// Closest point on a triangle (Ericson, "Real-Time Collision Detection", section 5.1.5).
+glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    const glm::vec3 bp = p - b;
+    const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + d1 / (d1 - d3) * ab;
+    const glm::vec3 cp = p - c;
+    const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + d2 / (d2 - d6) * ac;
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+    const float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+}
+
+BVH::BVH(const Mesh& mesh, const BVHBuildSettings& settings)
+    : BVH(std::span(&mesh, 1), settings)
+{
+}
+
+BVH::BVH(std::span<const Mesh> meshes, const BVHBuildSettings& settings)
+{
+    std::vector<uint32_t> meshFirstTriangles(meshes.size() + 1, 0);
+    for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx)
+        meshFirstTriangles[meshIdx + 1] = meshFirstTriangles[meshIdx] + static_cast<uint32_t>(meshes[meshIdx].triangles.size());
+    const uint32_t numTriangles = meshFirstTriangles.back();
+    if (numTriangles == 0)
+        return;
+
+    // Global triangle index to mesh and triangle index.
+    const auto meshTriangle = [&](uint32_t triangle) {
+        const uint32_t meshIdx = static_cast<uint32_t>(std::upper_bound(std::begin(meshFirstTriangles), std::end(meshFirstTriangles), triangle) - std::begin(meshFirstTriangles) - 1);
+        return std::pair { meshIdx, triangle - meshFirstTriangles[meshIdx] };
+    };
+    std::vector<TriangleReference> references(numTriangles);
+    const uint32_t numChunks = (numTriangles + trianglesPerBinningChunk - 1) / trianglesPerBinningChunk;
+    parallelFor(numChunks, [&](size_t chunk) {
+        const uint32_t chunkBegin = static_cast<uint32_t>(chunk) * trianglesPerBinningChunk;
+        const uint32_t chunkEnd = std::min(chunkBegin + trianglesPerBinningChunk, numTriangles);
+        for (uint32_t triangle = chunkBegin; triangle < chunkEnd; ++triangle) {
+            const auto [meshIdx, meshTriangleIdx] = meshTriangle(triangle);
+            const Mesh& mesh = meshes[meshIdx];
+            TriangleReference& reference = references[triangle];
+            for (glm::length_t corner = 0; corner < 3; ++corner)
+                reference.bounds.extend(mesh.vertices[mesh.triangles[meshTriangleIdx][corner]].position);
+            reference.triangle = triangle;
+        }
+    });
+
+    // Build the top of the tree until the ranges are small enough to keep all threads busy, then build the subtrees in
+    // parallel and stitch them into the top of the tree.
+    const BVHBuilder builder { settings, references };
+    const uint32_t subtreeSize = std::max(numTriangles / (8 * numWorkerThreads()), 1024u);
+    std::vector<BVHNode> topNodes;
+    std::vector<std::array<uint32_t, 3>> subtrees;
+    builder.build(0, numTriangles, 0, topNodes, subtreeSize, subtrees);
+
+    std::vector<std::vector<BVHNode>> subtreeNodes(subtrees.size());
+    parallelFor(subtrees.size(), [&](size_t subtreeIdx) {
+        const auto [begin, end, depth] = subtrees[subtreeIdx];
+        std::vector<std::array<uint32_t, 3>> noSubtrees;
+        builder.build(begin, end, depth, subtreeNodes[subtreeIdx], std::nullopt, noSubtrees);
+    });
+    m_nodes.reserve(topNodes.size() + std::accumulate(std::begin(subtreeNodes), std::end(subtreeNodes), size_t(0), [](size_t sum, const auto& nodes) { return sum + nodes.size(); }));
+    appendNodes(topNodes, 0, subtreeNodes, m_nodes);
+
+    // Store the triangles in the order of the leaves.
+    m_triangles.resize(numTriangles);
+    parallelFor(numChunks, [&](size_t chunk) {
+        const uint32_t chunkBegin = static_cast<uint32_t>(chunk) * trianglesPerBinningChunk;
+        const uint32_t chunkEnd = std::min(chunkBegin + trianglesPerBinningChunk, numTriangles);
+        for (uint32_t i = chunkBegin; i < chunkEnd; ++i) {
+            const auto [meshIdx, meshTriangleIdx] = meshTriangle(references[i].triangle);
+            const Mesh& mesh = meshes[meshIdx];
+            const glm::uvec3& triangle = mesh.triangles[meshTriangleIdx];
+            m_triangles[i] = BVHTriangle {
+                .v0 = mesh.vertices[triangle.x].position,
+                .v1 = mesh.vertices[triangle.y].position,
+                .v2 = mesh.vertices[triangle.z].position,
+                .mesh = meshIdx,
+                .triangle = meshTriangleIdx
+            };
+        }
+    });
+}
+
+std::optional<BVHHit> BVH::intersect(Ray& ray, float tMin) const
+{
+    if (m_nodes.empty())
+        return std::nullopt;
+
+    const glm::vec3 invDirection = safeInverseDirection(ray.direction);
+    if (intersectNode(m_nodes[0], ray, invDirection, tMin) == std::numeric_limits<float>::infinity())
+        return std::nullopt;
+
+    std::optional<BVHHit> hit;
+    std::array<uint32_t, maxDepth> stack;
+    size_t stackSize = 0;
+    uint32_t nodeIdx = 0;
+    while (true) {
+        const BVHNode& node = m_nodes[nodeIdx];
+        if (node.isLeaf()) {
+            for (uint32_t triangleIdx = node.offset; triangleIdx < node.offset + node.numTriangles; ++triangleIdx) {
+                float t;
+                glm::vec2 barycentric;
+                if (intersectTriangle(m_triangles[triangleIdx], ray, tMin, t, barycentric)) {
+                    ray.t = t;
+                    hit = BVHHit { .mesh = m_triangles[triangleIdx].mesh, .triangle = m_triangles[triangleIdx].triangle, .barycentric = barycentric };
+                }
+            }
+        } else {
+            // Visit the closest child first such that ray.t shrinks early and more boxes are missed.
+            uint32_t nearChild = nodeIdx + 1, farChild = node.offset;
+            float tNear = intersectNode(m_nodes[nearChild], ray, invDirection, tMin);
+            float tFar = intersectNode(m_nodes[farChild], ray, invDirection, tMin);
+            if (tFar < tNear) {
+                std::swap(nearChild, farChild);
+                std::swap(tNear, tFar);
+            }
+            if (tNear != std::numeric_limits<float>::infinity()) {
+                if (tFar != std::numeric_limits<float>::infinity())
+                    stack[stackSize++] = farChild;
+                nodeIdx = nearChild;
+                continue;
+            }
+        }
+        if (stackSize == 0)
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+    return hit;
+}
+
+bool BVH::isOccluded(const Ray& ray, float tMin) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = safeInverseDirection(ray.direction);
+    std::array<uint32_t, maxDepth> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+        if (intersectNode(node, ray, invDirection, tMin) == std::numeric_limits<float>::infinity())
+            continue;
+        if (node.isLeaf()) {
+            for (uint32_t triangleIdx = node.offset; triangleIdx < node.offset + node.numTriangles; ++triangleIdx) {
+                float t;
+                glm::vec2 barycentric;
+                if (intersectTriangle(m_triangles[triangleIdx], ray, tMin, t, barycentric))
+                    return true;
+            }
+        } else {
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+        }
+    }
+    return false;
+}
+
+void BVH::overlappingTriangles(const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& triangles) const
+{
+    if (m_nodes.empty())
+        return;
+
+    const auto overlaps = [&](const glm::vec3& otherLower, const glm::vec3& otherUpper) {
+        return glm::all(glm::lessThanEqual(otherLower, upper)) && glm::all(glm::lessThanEqual(lower, otherUpper));
+    };
+    std::array<uint32_t, maxDepth> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+        if (!overlaps(node.lower, node.upper))
+            continue;
+        if (node.isLeaf()) {
+            for (uint32_t triangleIdx = node.offset; triangleIdx < node.offset + node.numTriangles; ++triangleIdx) {
+                const BVHTriangle& triangle = m_triangles[triangleIdx];
+                if (overlaps(glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2)), glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2))))
+                    triangles.push_back(triangleIdx);
+            }
+        } else {
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+        }
+    }
+}
+
+bool BVH::intersectsSphere(const glm::vec3& center, float radius) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    const float radiusSquared = radius * radius;
+    const auto distanceSquared = [&](const glm::vec3& point) { return glm::dot(point - center, point - center); };
+    std::array<uint32_t, maxDepth> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+        if (distanceSquared(glm::clamp(center, node.lower, node.upper)) > radiusSquared)
+            continue;
+        if (node.isLeaf()) {
+            for (uint32_t triangleIdx = node.offset; triangleIdx < node.offset + node.numTriangles; ++triangleIdx) {
+                const BVHTriangle& triangle = m_triangles[triangleIdx];
+                if (distanceSquared(closestPointOnTriangle(center, triangle.v0, triangle.v1, triangle.v2)) <= radiusSquared)
+                    return true;
+            }
+        } else {
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+        }
+    }
+    return false;
+}
+
+std::span<const BVHNode> BVH::nodes() const
+{
+    return m_nodes;
+}
+
+std::span<const BVHTriangle> BVH::triangles() const
+{
+    return m_triangles;
+}
+
+bool BVH::empty() const
+{
+    return m_nodes.empty();
+}
+
+float BVH::sahCost(float traversalCost) const
+{
+    if (m_nodes.empty())
+        return 0.0f;
+
+    const auto halfArea = [](const BVHNode& node) { return AABB { .lower = node.lower, .upper = node.upper }.halfArea(); };
+    float cost = 0.0f;
+    for (const BVHNode& node : m_nodes)
+        cost += halfArea(node) * (node.isLeaf() ? static_cast<float>(node.numTriangles) : traversalCost);
+    return cost / std::max(halfArea(m_nodes[0]), std::numeric_limits<float>::min());
+}
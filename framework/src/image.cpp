@@ -8,6 +8,7 @@ DISABLE_WARNINGS_PUSH()
 #include <stb/stb_image_write.h>
 DISABLE_WARNINGS_POP()
 #include <cassert>
+#include <cstdlib>
 #include <exception>
 #include <iostream>
 #include <string>
@@ -16,11 +17,13 @@ DISABLE_WARNINGS_POP()
 // write image to a file
 void Image::writeBitmapToFile(const std::filesystem::path& filePath) {
     std::string filePathString = filePath.string();
-    stbi_write_bmp(filePathString.c_str(), width, height, channels, pixels.data());
+    stbi_write_bmp(filePathString.c_str(), width, height, channels, pixels.get());
 }
 
 // Image constructor, create image from file
 Image::Image(const std::filesystem::path& filePath)
+    : sourceFile(filePath)
+    , pixels(nullptr, stbi_image_free)
 {
 	if (!std::filesystem::exists(filePath)) {
 		std::cerr << "Texture file " << filePath << " does not exist!" << std::endl;
@@ -28,14 +31,22 @@ Image::Image(const std::filesystem::path& filePath)
 	}
 
 	const auto filePathStr = filePath.string(); // Create l-value so c_str() is safe.
-	stbi_uc* stbPixels = stbi_load(filePathStr.c_str(), &width, &height, &channels, STBI_default);
+	pixels.reset(stbi_load(filePathStr.c_str(), &width, &height, &channels, STBI_default));
 
-	if (!stbPixels) {
+	if (!pixels) {
 		std::cerr << "Failed to read texture " << filePath << " using stb_image.h" << std::endl;
 		throw std::exception();
 	}
+}
 
-	for (size_t i = 0UL; i < width * height * channels; i++) { pixels.emplace_back(stbPixels[i]); }
-
-	stbi_image_free(stbPixels);
+Image::Image(int imageWidth, int imageHeight, int imageChannels)
+    : width(imageWidth)
+    , height(imageHeight)
+    , channels(imageChannels)
+    , pixels(static_cast<uint8_t*>(std::calloc(sizeInBytes(), 1)), std::free)
+{
+	if (!pixels && sizeInBytes() > 0) {
+		std::cerr << "Failed to allocate a " << width << "x" << height << " image" << std::endl;
+		throw std::exception();
+	}
 }
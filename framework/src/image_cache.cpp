@@ -0,0 +1,88 @@
+#include "image_cache.h"
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+namespace {
+
+struct CacheEntry {
+    std::weak_ptr<Image> image;
+    // Valid while the image is being decoded by another thread.
+    std::shared_future<std::shared_ptr<Image>> pendingImage;
+};
+
+struct ImageCache {
+    std::mutex mutex;
+    std::unordered_map<std::string, CacheEntry> entries;
+    ImageCacheStatistics statistics;
+};
+
+}
+
+static ImageCache& imageCache()
+{
+    static ImageCache cache;
+    return cache;
+}
+
+// Make sure that different spellings of the same path (e.g. "a/../b.png" and "b.png") share a cache entry.
+static std::string cacheKey(const std::filesystem::path& filePath)
+{
+    std::error_code errorCode;
+    const auto canonicalPath = std::filesystem::weakly_canonical(filePath, errorCode);
+    return (errorCode ? filePath.lexically_normal() : canonicalPath).generic_string();
+}
+
+std::shared_ptr<Image> loadImageCached(const std::filesystem::path& filePath)
+{
+    ImageCache& cache = imageCache();
+    const std::string key = cacheKey(filePath);
+
+    std::unique_lock lock { cache.mutex };
+    CacheEntry& entry = cache.entries[key];
+    if (auto pImage = entry.image.lock()) {
+        ++cache.statistics.numHits;
+        return pImage;
+    }
+    if (entry.pendingImage.valid()) {
+        ++cache.statistics.numHits;
+        const auto pendingImage = entry.pendingImage;
+        lock.unlock();
+        return pendingImage.get();
+    }
+
+    // Decode the image without holding the lock so that other images can be decoded in parallel.
+    std::promise<std::shared_ptr<Image>> imagePromise;
+    entry.pendingImage = imagePromise.get_future().share();
+    lock.unlock();
+
+    std::shared_ptr<Image> pImage;
+    try {
+        pImage = std::make_shared<Image>(filePath);
+    } catch (...) {
+        lock.lock();
+        cache.entries.erase(key);
+        lock.unlock();
+        imagePromise.set_exception(std::current_exception());
+        throw;
+    }
+
+    lock.lock();
+    entry.image = pImage;
+    entry.pendingImage = {};
+    ++cache.statistics.numDecodes;
+    cache.statistics.numDecodedBytes += static_cast<size_t>(pImage->width) * static_cast<size_t>(pImage->height) * static_cast<size_t>(pImage->channels);
+    lock.unlock();
+    imagePromise.set_value(pImage);
+    return pImage;
+}
+
+ImageCacheStatistics imageCacheStatistics()
+{
+    ImageCache& cache = imageCache();
+    std::scoped_lock lock { cache.mutex };
+    return cache.statistics;
+}
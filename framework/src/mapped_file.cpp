@@ -0,0 +1,107 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <utility>
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& filePath)
+{
+    MappedFile out;
+#ifdef _WIN32
+    out.m_fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (out.m_fileHandle == INVALID_HANDLE_VALUE) {
+        out.m_fileHandle = nullptr;
+        return {};
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(out.m_fileHandle, &fileSize))
+        return {};
+    out.m_size = static_cast<size_t>(fileSize.QuadPart);
+    if (out.m_size == 0)
+        return out; // Cannot map an empty file; data() simply returns an empty span.
+
+    out.m_mappingHandle = CreateFileMappingW(out.m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!out.m_mappingHandle)
+        return {};
+    out.m_pData = static_cast<const std::byte*>(MapViewOfFile(out.m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!out.m_pData)
+        return {};
+#else
+    const int fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+    if (fileDescriptor == -1)
+        return {};
+
+    struct stat fileStats;
+    if (fstat(fileDescriptor, &fileStats) != 0) {
+        ::close(fileDescriptor);
+        return {};
+    }
+    out.m_size = static_cast<size_t>(fileStats.st_size);
+    if (out.m_size == 0) {
+        ::close(fileDescriptor);
+        return out; // Cannot map an empty file; data() simply returns an empty span.
+    }
+
+    // The mapping keeps its own reference to the file so the descriptor can be closed right away.
+    void* pMapping = mmap(nullptr, out.m_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    ::close(fileDescriptor);
+    if (pMapping == MAP_FAILED)
+        return {};
+    out.m_pData = static_cast<const std::byte*>(pMapping);
+#endif
+    return out;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    unmap();
+    m_pData = std::exchange(other.m_pData, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+    m_fileHandle = std::exchange(other.m_fileHandle, nullptr);
+    m_mappingHandle = std::exchange(other.m_mappingHandle, nullptr);
+#endif
+    return *this;
+}
+
+std::span<const std::byte> MappedFile::data() const
+{
+    return { m_pData, m_pData ? m_size : 0 };
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (m_pData)
+        UnmapViewOfFile(m_pData);
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+    if (m_fileHandle)
+        CloseHandle(m_fileHandle);
+    m_fileHandle = nullptr;
+    m_mappingHandle = nullptr;
+#else
+    if (m_pData)
+        munmap(const_cast<std::byte*>(m_pData), m_size);
+#endif
+    m_pData = nullptr;
+    m_size = 0;
+}
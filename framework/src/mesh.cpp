@@ -1,7 +1,14 @@
 #include "mesh.h"
+#include "image_cache.h"
+#include "mesh_optimization.h"
+#include "obj_loader.h"
+#include "parallel.h"
+#include "vertex_index_cache.h"
 // Suppress warnings in third-party code.
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
@@ -9,47 +16,27 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <exception>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <numeric>
 #include <span>
 #include <stack>
 #include <string>
-#include <tuple>
-#include <map>
+#include <utility>
+#include <vector>
 
 static void centerAndScaleToUnitMesh(std::span<Mesh> meshes);
+static void flipClusters(Mesh& mesh, glm::length_t axis);
 
 static glm::vec3 construct_vec3(const float* pFloats)
 {
     return glm::vec3(pFloats[0], pFloats[1], pFloats[2]);
 }
 
-// https://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
-template <class T>
-static void hash_combine(std::size_t& seed, const T& v)
-{
-    std::hash<T> hasher;
-    seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-}
-
-struct VertexHash {
-    size_t operator()(const Vertex& v) const
-    {
-        size_t seed = 0;
-        hash_combine(seed, v.position.x);
-        hash_combine(seed, v.position.y);
-        hash_combine(seed, v.position.z);
-        hash_combine(seed, v.normal.x);
-        hash_combine(seed, v.normal.y);
-        hash_combine(seed, v.normal.z);
-        hash_combine(seed, v.texCoord.s);
-        hash_combine(seed, v.texCoord.t);
-        return seed;
-    }
-};
-
-std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings)
+std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings, MeshOptimizationReport* pOptimizationReport)
 {
     if (!std::filesystem::exists(file)) {
         std::cerr << "File " << file << " does not exist." << std::endl;
@@ -63,20 +50,31 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSett
     std::vector<tinyobj::material_t> inMaterials;
 
     std::string warn, error;
-    bool ret = tinyobj::LoadObj(&inAttrib, &inShapes, &inMaterials, &warn, &error, file.string().c_str(), baseDir.string().c_str());
+    bool ret = parallelLoadObj(&inAttrib, &inShapes, &inMaterials, &warn, &error, file, baseDir);
     if (!ret) {
         std::cerr << "Failed to load mesh " << file << std::endl;
         throw std::exception();
     }
 
-    std::vector<Mesh> out;
+    // Decode the diffuse textures up front; materials that share a texture also share the decoded image.
+    std::vector<std::shared_ptr<Image>> materialTextures(inMaterials.size());
+    parallelFor(inMaterials.size(), [&](size_t materialIdx) {
+        if (!inMaterials[materialIdx].diffuse_texname.empty())
+            materialTextures[materialIdx] = loadImageCached(baseDir / inMaterials[materialIdx].diffuse_texname);
+    });
+
+    // tinyobjloader does not automatically split the mesh into smaller sub meshes according to material so we have to do it ourselves.
+    struct SubMeshRange {
+        const tinyobj::shape_t* pShape;
+        size_t startTriangle, endTriangle;
+    };
+    std::vector<SubMeshRange> subMeshRanges;
     for (const auto& shape : inShapes) {
         assert(shape.mesh.indices.size() % 3 == 0);
 
         size_t startTriangle = 0;
         auto prevMaterialID = shape.mesh.material_ids[0];
         for (size_t endTriangle = 0; endTriangle < shape.mesh.indices.size() / 3; ++endTriangle) {
-            // tinyobjloader does not automatically split the mesh into smaller sub meshes according to material so we have to do it ourselves.
             if (endTriangle == shape.mesh.indices.size() / 3 - 1)
                 ++endTriangle; // End of the tinyobj.shape; write remaining mesh.
             else if (shape.mesh.material_ids[endTriangle] == prevMaterialID)
@@ -84,68 +82,102 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSett
             else
                 prevMaterialID = shape.mesh.material_ids[endTriangle];
 
-            Mesh mesh;
-            using CacheKey = std::tuple<uint32_t, uint32_t, uint32_t>;
-            std::map<CacheKey, uint32_t> vertexCache; // Map the index of a vertex as loaded by tinyobjloader to its index in the generated mesh
-            for (size_t i = startTriangle * 3; i != endTriangle * 3; i += 3) {
-                const glm::vec3 v0 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 0].vertex_index]);
-                const glm::vec3 v1 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 1].vertex_index]);
-                const glm::vec3 v2 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 2].vertex_index]);
-                const auto geometricNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
-
-                // Load the triangle indices and lazily create the vertices.
-                glm::uvec3 triangle;
-                for (unsigned j = 0; j < 3; j++) {
-                    const auto& tinyObjIndex = shape.mesh.indices[i + j];
-                    Vertex vertex {
-                        .position = construct_vec3(&inAttrib.vertices[3 * tinyObjIndex.vertex_index]),
-                        .normal = glm::vec3(0),
-                        .texCoord = glm::vec2(0)
-                    };
-                    if (tinyObjIndex.normal_index != -1 && !inAttrib.normals.empty())
-                        vertex.normal = glm::vec3(inAttrib.normals[3 * tinyObjIndex.normal_index + 0], inAttrib.normals[3 * tinyObjIndex.normal_index + 1], inAttrib.normals[3 * tinyObjIndex.normal_index + 2]);
-                    else
-                        vertex.normal = geometricNormal;
-                    if (tinyObjIndex.texcoord_index != -1 && !inAttrib.texcoords.empty())
-                        vertex.texCoord = glm::vec2(inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 0], inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 1]);
-
-                    const CacheKey cacheKey { tinyObjIndex.vertex_index, tinyObjIndex.normal_index, tinyObjIndex.texcoord_index };
-                    if (auto iter = vertexCache.find(cacheKey); settings.cacheVertices && iter != std::end(vertexCache)) {
-                        // Already visited this vertex? Reuse it!
-                        triangle[j] = iter->second;
-                    } else {
-                        // New vertex? Create it and store it in the vertex cache.
-                        vertexCache[cacheKey] = triangle[j] = (unsigned)mesh.vertices.size();
-                        mesh.vertices.push_back(vertex);
-                    }
-                }
-                mesh.triangles.push_back(triangle);
-            }
+            subMeshRanges.push_back({ &shape, startTriangle, endTriangle });
+            startTriangle = endTriangle;
+        }
+    }
 
-            const auto materialID = shape.mesh.material_ids[startTriangle];
-            if (materialID == -1) {
-                mesh.material.kd = glm::vec3(1.0f);
-                mesh.material.ks = glm::vec3(0.0f);
-                mesh.material.shininess = 1.0f;
-            } else {
-                const auto& objMaterial = inMaterials[materialID];
-                mesh.material.kd = construct_vec3(objMaterial.diffuse);
-                if (!objMaterial.diffuse_texname.empty()) {
-                    mesh.material.kdTexture = std::make_shared<Image>(baseDir / objMaterial.diffuse_texname);
+    // Sub meshes are independent of each other so they can be constructed in parallel.
+    std::vector<Mesh> out(subMeshRanges.size());
+    // Vertex caches are handed from one sub mesh to the next instead of being reallocated for every sub mesh. At most
+    // one exists per thread, and they are released once all sub meshes are loaded.
+    std::mutex vertexCachesMutex;
+    std::vector<VertexIndexCache> vertexCaches;
+    parallelFor(subMeshRanges.size(), [&](size_t subMeshIdx) {
+        const auto& [pShape, startTriangle, endTriangle] = subMeshRanges[subMeshIdx];
+        const tinyobj::shape_t& shape = *pShape;
+
+        Mesh& mesh = out[subMeshIdx];
+        const size_t numTriangles = endTriangle - startTriangle;
+        mesh.triangles.reserve(numTriangles);
+        VertexIndexCache vertexCache;
+        if (settings.cacheVertices) {
+            {
+                std::scoped_lock lock { vertexCachesMutex };
+                if (!vertexCaches.empty()) {
+                    vertexCache = std::move(vertexCaches.back());
+                    vertexCaches.pop_back();
                 }
-                mesh.material.ks = construct_vec3(objMaterial.specular);
-                mesh.material.shininess = objMaterial.shininess;
-                mesh.material.transparency = objMaterial.dissolve;
             }
+            vertexCache.reset(3 * numTriangles); // Map the index of a vertex as loaded by tinyobjloader to its index in the generated mesh
+        }
+        for (size_t i = startTriangle * 3; i != endTriangle * 3; i += 3) {
+            const glm::vec3 v0 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 0].vertex_index]);
+            const glm::vec3 v1 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 1].vertex_index]);
+            const glm::vec3 v2 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 2].vertex_index]);
+            const auto geometricNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
 
-            out.push_back(std::move(mesh));
+            // Load the triangle indices and lazily create the vertices.
+            glm::uvec3 triangle;
+            for (unsigned j = 0; j < 3; j++) {
+                const auto& tinyObjIndex = shape.mesh.indices[i + j];
+                const auto newVertexIndex = (uint32_t)mesh.vertices.size();
+                triangle[j] = settings.cacheVertices ? vertexCache.findOrInsert(tinyObjIndex, newVertexIndex) : newVertexIndex;
+                if (triangle[j] != newVertexIndex)
+                    continue; // Already visited this vertex? Reuse it!
 
-            startTriangle = endTriangle;
+                // New vertex? Create it (it was already stored in the vertex cache).
+                Vertex vertex {
+                    .position = construct_vec3(&inAttrib.vertices[3 * tinyObjIndex.vertex_index]),
+                    .normal = glm::vec3(0),
+                    .texCoord = glm::vec2(0)
+                };
+                if (tinyObjIndex.normal_index != -1 && !inAttrib.normals.empty())
+                    vertex.normal = glm::vec3(inAttrib.normals[3 * tinyObjIndex.normal_index + 0], inAttrib.normals[3 * tinyObjIndex.normal_index + 1], inAttrib.normals[3 * tinyObjIndex.normal_index + 2]);
+                else
+                    vertex.normal = geometricNormal;
+                if (tinyObjIndex.texcoord_index != -1 && !inAttrib.texcoords.empty())
+                    vertex.texCoord = glm::vec2(inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 0], inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 1]);
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.triangles.push_back(triangle);
         }
-    }
+        if (settings.cacheVertices) {
+            std::scoped_lock lock { vertexCachesMutex };
+            vertexCaches.push_back(std::move(vertexCache));
+        }
+
+        const auto materialID = shape.mesh.material_ids[startTriangle];
+        if (materialID == -1) {
+            mesh.material.kd = glm::vec3(1.0f);
+            mesh.material.ks = glm::vec3(0.0f);
+            mesh.material.shininess = 1.0f;
+        } else {
+            const auto& objMaterial = inMaterials[materialID];
+            mesh.material.kd = construct_vec3(objMaterial.diffuse);
+            mesh.material.kdTexture = materialTextures[materialID];
+            mesh.material.ks = construct_vec3(objMaterial.specular);
+            mesh.material.shininess = objMaterial.shininess;
+            mesh.material.transparency = objMaterial.dissolve;
+        }
+    });
 
     if (settings.normalizeVertexPositions)
         centerAndScaleToUnitMesh(out);
+    if (settings.maxTrianglesPerCluster > 0) {
+        for (Mesh& mesh : out)
+            buildMeshClusters(mesh, settings.maxTrianglesPerCluster);
+    }
+    if (settings.optimizeVertexOrder) {
+        MeshOptimizationReport total;
+        for (Mesh& mesh : out) {
+            const MeshOptimizationReport report = optimizeMeshVertexOrder(mesh);
+            total.before += report.before;
+            total.after += report.after;
+        }
+        if (pOptimizationReport)
+            *pOptimizationReport = total;
+    }
 
     return out;
 }
@@ -177,11 +209,160 @@ static void centerAndScaleToUnitMesh(std::span<Mesh> meshes)
     }
 }
 
+MeshBounds computeMeshBounds(std::span<const Vertex> vertices)
+{
+    if (vertices.empty())
+        return {};
+
+    MeshBounds bounds { .lower = vertices[0].position, .upper = vertices[0].position };
+    for (const Vertex& vertex : vertices) {
+        bounds.lower = glm::min(bounds.lower, vertex.position);
+        bounds.upper = glm::max(bounds.upper, vertex.position);
+    }
+    // Centering the sphere on the box is not optimal, but the radius is the distance to the farthest vertex rather
+    // than half the box diagonal, which is a lot tighter for round meshes.
+    bounds.sphereCenter = 0.5f * (bounds.lower + bounds.upper);
+    float maxDistance2 = 0.0f;
+    for (const Vertex& vertex : vertices) {
+        const glm::vec3 offset = vertex.position - bounds.sphereCenter;
+        maxDistance2 = std::max(glm::dot(offset, offset), maxDistance2);
+    }
+    bounds.sphereRadius = std::sqrt(maxDistance2);
+    return bounds;
+}
+
+void buildMeshClusters(Mesh& mesh, size_t maxTrianglesPerCluster)
+{
+    assert(maxTrianglesPerCluster > 0);
+    const auto trianglePosition = [&](const glm::uvec3& triangle, glm::length_t corner) {
+        return mesh.vertices[triangle[corner]].position;
+    };
+    // The centroids are partitioned themselves (rather than indices to them) to keep the memory accesses sequential.
+    struct TriangleCentroid {
+        glm::vec3 centroid;
+        uint32_t triangle;
+    };
+    std::vector<TriangleCentroid> centroids(mesh.triangles.size());
+    for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+        const glm::uvec3& triangle = mesh.triangles[i];
+        centroids[i] = { (trianglePosition(triangle, 0) + trianglePosition(triangle, 1) + trianglePosition(triangle, 2)) / 3.0f, static_cast<uint32_t>(i) };
+    }
+
+    // Split a range at the median centroid along the longest axis of its centroid bounds.
+    using Range = std::pair<size_t, size_t>;
+    const auto split = [&](size_t begin, size_t end) {
+        glm::vec3 lower { std::numeric_limits<float>::max() }, upper { std::numeric_limits<float>::lowest() };
+        for (size_t i = begin; i < end; ++i) {
+            lower = glm::min(lower, centroids[i].centroid);
+            upper = glm::max(upper, centroids[i].centroid);
+        }
+        const glm::vec3 extent = upper - lower;
+        const glm::length_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const size_t middle = begin + (end - begin) / 2;
+        const auto centroidsBegin = std::begin(centroids);
+        std::nth_element(centroidsBegin + static_cast<std::ptrdiff_t>(begin), centroidsBegin + static_cast<std::ptrdiff_t>(middle), centroidsBegin + static_cast<std::ptrdiff_t>(end),
+            [=](const TriangleCentroid& lhs, const TriangleCentroid& rhs) { return lhs.centroid[axis] < rhs.centroid[axis]; });
+        return middle;
+    };
+
+    // Split the triangles until every range fits in a cluster (the leaves of a kd-tree). The top levels are split
+    // breadth first until there are enough subtrees to keep all worker threads busy. The subtrees are split depth first
+    // with the lower half first, so concatenating their leaves keeps the leaves in order.
+    std::vector<Range> subtrees { { 0, centroids.size() } };
+    for (bool anySplit = true; anySplit && subtrees.size() < 4 * numWorkerThreads();) {
+        anySplit = false;
+        std::vector<Range> nextSubtrees;
+        for (const auto& [begin, end] : subtrees) {
+            if (end - begin <= maxTrianglesPerCluster) {
+                nextSubtrees.emplace_back(begin, end);
+                continue;
+            }
+            const size_t middle = split(begin, end);
+            nextSubtrees.emplace_back(begin, middle);
+            nextSubtrees.emplace_back(middle, end);
+            anySplit = true;
+        }
+        subtrees = std::move(nextSubtrees);
+    }
+    std::vector<std::vector<Range>> subtreeLeaves(subtrees.size());
+    parallelFor(subtrees.size(), [&](size_t subtreeIdx) {
+        std::stack<Range> ranges;
+        ranges.push(subtrees[subtreeIdx]);
+        while (!ranges.empty()) {
+            const auto [begin, end] = ranges.top();
+            ranges.pop();
+            if (end - begin <= maxTrianglesPerCluster) {
+                if (end > begin)
+                    subtreeLeaves[subtreeIdx].emplace_back(begin, end);
+                continue;
+            }
+            const size_t middle = split(begin, end);
+            ranges.push({ middle, end });
+            ranges.push({ begin, middle });
+        }
+    });
+
+    std::vector<glm::uvec3> sortedTriangles(mesh.triangles.size());
+    for (size_t i = 0; i < centroids.size(); ++i)
+        sortedTriangles[i] = mesh.triangles[centroids[i].triangle];
+    mesh.triangles = std::move(sortedTriangles);
+
+    mesh.clusters.clear();
+    for (const std::vector<Range>& leaves : subtreeLeaves) {
+        for (const auto& [begin, end] : leaves)
+            mesh.clusters.push_back({ .firstTriangle = static_cast<uint32_t>(begin), .numTriangles = static_cast<uint32_t>(end - begin) });
+    }
+
+    // Clusters are small, so they are handed out in batches.
+    constexpr size_t clustersPerBatch = 64;
+    parallelFor((mesh.clusters.size() + clustersPerBatch - 1) / clustersPerBatch, [&](size_t batch) {
+        std::vector<Vertex> clusterVertices;
+        std::vector<glm::vec3> clusterNormals;
+        const size_t endCluster = std::min((batch + 1) * clustersPerBatch, mesh.clusters.size());
+        for (size_t clusterIdx = batch * clustersPerBatch; clusterIdx < endCluster; ++clusterIdx) {
+            MeshCluster& cluster = mesh.clusters[clusterIdx];
+            clusterVertices.clear();
+            clusterNormals.clear();
+            glm::vec3 normalSum { 0.0f };
+            for (size_t i = cluster.firstTriangle; i < cluster.firstTriangle + cluster.numTriangles; ++i) {
+                const glm::uvec3& triangle = mesh.triangles[i];
+                for (glm::length_t corner = 0; corner < 3; ++corner)
+                    clusterVertices.push_back(mesh.vertices[triangle[corner]]);
+                // The winding decides whether a triangle is backfacing, so the cone is made of the geometric normals.
+                const glm::vec3 normal = glm::cross(trianglePosition(triangle, 1) - trianglePosition(triangle, 0), trianglePosition(triangle, 2) - trianglePosition(triangle, 0));
+                const float normalLength = glm::length(normal);
+                if (normalLength > 0.0f) {
+                    clusterNormals.push_back(normal / normalLength);
+                    normalSum += clusterNormals.back();
+                }
+            }
+            cluster.bounds = computeMeshBounds(clusterVertices);
+
+            const float normalSumLength = glm::length(normalSum);
+            if (normalSumLength < 1e-6f)
+                continue;
+            cluster.coneAxis = normalSum / normalSumLength;
+            float minDot = 1.0f;
+            for (const glm::vec3& normal : clusterNormals)
+                minDot = std::min(glm::dot(normal, cluster.coneAxis), minDot);
+            cluster.coneCutoff = minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+        }
+    });
+}
+
 Mesh mergeMeshes(std::span<const Mesh> meshes)
 {
     Mesh out;
     out.material = meshes[0].material;
+    // The clusters can only be kept if every triangle of the merged mesh belongs to one.
+    const bool keepClusters = std::all_of(std::begin(meshes), std::end(meshes), [](const Mesh& mesh) { return mesh.triangles.empty() || !mesh.clusters.empty(); });
     for (const auto& mesh : meshes) {
+        if (keepClusters) {
+            for (MeshCluster cluster : mesh.clusters) {
+                cluster.firstTriangle += static_cast<uint32_t>(out.triangles.size());
+                out.clusters.push_back(cluster);
+            }
+        }
         const auto vertexOffset = out.vertices.size();
         out.vertices.resize(out.vertices.size() + mesh.vertices.size());
         std::copy(std::begin(mesh.vertices), std::end(mesh.vertices), std::begin(out.vertices) + vertexOffset);
@@ -199,6 +380,7 @@ void meshFlipX(Mesh& mesh)
         v.position.x = -v.position.x;
         v.normal.x = -v.normal.x;
     }
+    flipClusters(mesh, 0);
 }
 
 void meshFlipY(Mesh& mesh)
@@ -207,6 +389,7 @@ void meshFlipY(Mesh& mesh)
         v.position.y = -v.position.y;
         v.normal.y = -v.normal.y;
     }
+    flipClusters(mesh, 1);
 }
 
 void meshFlipZ(Mesh& mesh)
@@ -215,4 +398,18 @@ void meshFlipZ(Mesh& mesh)
         v.position.z = -v.position.z;
         v.normal.z = -v.normal.z;
     }
-}
\ No newline at end of file
+    flipClusters(mesh, 2);
+}
+
+static void flipClusters(Mesh& mesh, glm::length_t axis)
+{
+    for (MeshCluster& cluster : mesh.clusters) {
+        std::swap(cluster.bounds.lower[axis], cluster.bounds.upper[axis]);
+        cluster.bounds.lower[axis] = -cluster.bounds.lower[axis];
+        cluster.bounds.upper[axis] = -cluster.bounds.upper[axis];
+        cluster.bounds.sphereCenter[axis] = -cluster.bounds.sphereCenter[axis];
+        // Mirroring flips the winding, so the geometric normals are mirrored and then negated.
+        cluster.coneAxis = -cluster.coneAxis;
+        cluster.coneAxis[axis] = -cluster.coneAxis[axis];
+    }
+}
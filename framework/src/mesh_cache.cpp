@@ -0,0 +1,378 @@
+#include "mesh_cache.h"
+#include "image_cache.h"
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+// Bump the version whenever the layout of the file, Vertex or the output of loadMesh() changes.
+static constexpr uint32_t cacheVersion = 4;
+static constexpr std::array<char, 8> cacheMagic { 'C', 'G', 'M', 'E', 'S', 'H', 'C', '\0' };
+static constexpr uint64_t dataAlignment = 16;
+
+static_assert(std::is_trivially_copyable_v<Vertex> && sizeof(Vertex) == 8 * sizeof(float), "Vertex is stored as raw bytes in the mesh cache");
+static_assert(sizeof(glm::uvec3) == 3 * sizeof(uint32_t), "Triangles are stored as raw bytes in the mesh cache");
+static_assert(std::is_trivially_copyable_v<MeshCluster>, "Clusters are stored as raw bytes in the mesh cache");
+
+struct FileHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t settingsFlags;
+    uint64_t numDependencies;
+    uint64_t numSubMeshes;
+};
+
+// File that the cached meshes were created from: the source file, followed by the material libraries that it names.
+struct DependencyRecord {
+    uint64_t size; // missingFileSize if the file did not exist.
+    int64_t modificationTime;
+    uint64_t hash;
+    // Path relative to the directory of the source file (UTF-8); empty for the source file itself.
+    uint64_t pathOffset, pathLength;
+};
+static constexpr uint64_t missingFileSize = ~uint64_t(0);
+
+struct MeshCache::SubMeshRecord {
+    uint64_t vertexOffset, numVertices;
+    uint64_t triangleOffset, numTriangles;
+    uint64_t clusterOffset, numClusters;
+    std::array<float, 3> kd, ks;
+    float shininess, transparency;
+    // Path of the diffuse texture relative to the directory of the source file (UTF-8); empty if there is none.
+    uint64_t texturePathOffset, texturePathLength;
+};
+
+static uint32_t settingsFlags(const LoadMeshSettings& settings)
+{
+    return (settings.normalizeVertexPositions ? 1u : 0u) | (settings.cacheVertices ? 2u : 0u) | (settings.optimizeVertexOrder ? 4u : 0u) | (settings.maxTrianglesPerCluster << 3);
+}
+
+static int64_t modificationTime(const std::filesystem::path& file)
+{
+    std::error_code errorCode;
+    const auto time = std::filesystem::last_write_time(file, errorCode);
+    return errorCode ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+// 64-bit FNV-1a hash of the file contents.
+static std::optional<uint64_t> hashFileContents(const std::filesystem::path& file)
+{
+    const auto mappedFile = MappedFile::open(file);
+    if (!mappedFile)
+        return {};
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const std::byte byte : mappedFile->data()) {
+        hash ^= static_cast<uint64_t>(byte);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Names of the material libraries (mtllib statements) of an OBJ file, relative to the directory of the file.
+static std::vector<std::string> materialLibraries(const std::filesystem::path& objFile)
+{
+    const auto mappedFile = MappedFile::open(objFile);
+    if (!mappedFile)
+        return {};
+
+    const std::string_view contents { reinterpret_cast<const char*>(mappedFile->data().data()), mappedFile->data().size() };
+    constexpr std::string_view whitespace = " \t\r";
+    std::vector<std::string> out;
+    for (size_t lineStart = 0; lineStart < contents.size();) {
+        const size_t lineEnd = std::min(contents.find('\n', lineStart), contents.size());
+        std::string_view line = contents.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+        if (!line.starts_with("mtllib") || line.size() == 6 || whitespace.find(line[6]) == std::string_view::npos)
+            continue;
+        // Like tinyobjloader, a statement may name multiple files separated by whitespace.
+        line.remove_prefix(6);
+        while (true) {
+            line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+            if (line.empty())
+                break;
+            const size_t nameLength = std::min(line.find_first_of(whitespace), line.size());
+            out.emplace_back(line.substr(0, nameLength));
+            line.remove_prefix(nameLength);
+        }
+    }
+    return out;
+}
+
+static DependencyRecord dependencyRecord(const std::filesystem::path& file)
+{
+    std::error_code errorCode;
+    const auto size = std::filesystem::file_size(file, errorCode);
+    if (errorCode)
+        return DependencyRecord { .size = missingFileSize, .modificationTime = 0, .hash = 0 };
+    return DependencyRecord { .size = size, .modificationTime = modificationTime(file), .hash = hashFileContents(file).value_or(0) };
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + dataAlignment - 1) / dataAlignment * dataAlignment;
+}
+
+std::filesystem::path MeshCache::cacheFilePath(const std::filesystem::path& sourceFile)
+{
+    std::filesystem::path out = sourceFile;
+    out += ".meshcache";
+    return out;
+}
+
+std::optional<MeshCache> MeshCache::open(const std::filesystem::path& sourceFile, const LoadMeshSettings& settings)
+{
+    const auto cacheFile = cacheFilePath(sourceFile);
+    auto mappedFile = MappedFile::open(cacheFile);
+    if (!mappedFile)
+        return {};
+
+    std::span<const std::byte> data = mappedFile->data();
+    if (data.size() < sizeof(FileHeader))
+        return {};
+    FileHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != cacheMagic || header.version != cacheVersion || header.settingsFlags != settingsFlags(settings))
+        return {};
+    if (header.numDependencies > data.size() / sizeof(DependencyRecord) || sizeof(FileHeader) + header.numDependencies * sizeof(DependencyRecord) > data.size())
+        return {};
+
+    // Only hash a file if its size and modification time do not match (e.g. after a fresh checkout). If the contents
+    // did not change then the new modification time is stored, such that the file is not hashed again next time.
+    const auto baseDir = sourceFile.parent_path();
+    std::vector<std::pair<uint64_t, int64_t>> modificationTimeUpdates;
+    for (uint64_t i = 0; i < header.numDependencies; ++i) {
+        const uint64_t recordOffset = sizeof(FileHeader) + i * sizeof(DependencyRecord);
+        DependencyRecord record;
+        std::memcpy(&record, data.data() + recordOffset, sizeof(record));
+        if (record.pathOffset > data.size() || record.pathLength > data.size() - record.pathOffset)
+            return {};
+        const auto* pPath = reinterpret_cast<const char8_t*>(data.data() + record.pathOffset);
+        const auto file = record.pathLength > 0 ? baseDir / std::u8string(pPath, static_cast<size_t>(record.pathLength)) : sourceFile;
+
+        std::error_code errorCode;
+        const auto size = std::filesystem::file_size(file, errorCode);
+        if ((errorCode ? missingFileSize : size) != record.size)
+            return {};
+        if (errorCode)
+            continue;
+        if (const int64_t time = modificationTime(file); time != record.modificationTime) {
+            if (hashFileContents(file) != record.hash)
+                return {};
+            modificationTimeUpdates.emplace_back(recordOffset + offsetof(DependencyRecord, modificationTime), time);
+        }
+    }
+    if (!modificationTimeUpdates.empty()) {
+        // Unmap the file while writing to it, since not every OS allows writing to a mapped file. Failing to update
+        // the cache is harmless.
+        mappedFile.reset();
+        {
+            std::fstream stream { cacheFile, std::ios::binary | std::ios::in | std::ios::out };
+            for (const auto& [offset, time] : modificationTimeUpdates) {
+                stream.seekp(static_cast<std::streamoff>(offset));
+                stream.write(reinterpret_cast<const char*>(&time), sizeof(time));
+            }
+        }
+        mappedFile = MappedFile::open(cacheFile);
+        if (!mappedFile || mappedFile->data().size() != data.size())
+            return {};
+        data = mappedFile->data();
+    }
+
+    // Protect against truncated or otherwise corrupted cache files.
+    const uint64_t recordsStart = sizeof(FileHeader) + header.numDependencies * sizeof(DependencyRecord);
+    if (header.numSubMeshes > data.size() / sizeof(SubMeshRecord) || recordsStart + header.numSubMeshes * sizeof(SubMeshRecord) > data.size())
+        return {};
+    for (uint64_t i = 0; i < header.numSubMeshes; ++i) {
+        SubMeshRecord record;
+        std::memcpy(&record, data.data() + recordsStart + i * sizeof(SubMeshRecord), sizeof(record));
+        const auto fits = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+            return offset % dataAlignment == 0 && offset <= data.size() && count <= (data.size() - offset) / elementSize;
+        };
+        if (!fits(record.vertexOffset, record.numVertices, sizeof(Vertex)) || !fits(record.triangleOffset, record.numTriangles, sizeof(glm::uvec3)) || !fits(record.clusterOffset, record.numClusters, sizeof(MeshCluster)))
+            return {};
+        if (record.texturePathOffset > data.size() || record.texturePathLength > data.size() - record.texturePathOffset)
+            return {};
+    }
+
+    return MeshCache(std::move(*mappedFile), sourceFile);
+}
+
+void MeshCache::write(const std::filesystem::path& sourceFile, const LoadMeshSettings& settings, std::span<const Mesh> meshes)
+{
+    const auto baseDir = sourceFile.parent_path();
+    std::vector<std::string> dependencyPaths { "" };
+    for (std::string& materialLibrary : materialLibraries(sourceFile))
+        dependencyPaths.push_back(std::move(materialLibrary));
+    std::vector<DependencyRecord> dependencies;
+    for (const std::string& path : dependencyPaths)
+        dependencies.push_back(dependencyRecord(path.empty() ? sourceFile : baseDir / std::u8string(std::begin(path), std::end(path))));
+    if (dependencies[0].size == missingFileSize)
+        return;
+
+    std::vector<std::string> texturePaths;
+    std::vector<SubMeshRecord> records;
+    uint64_t offset = sizeof(FileHeader) + dependencies.size() * sizeof(DependencyRecord) + meshes.size() * sizeof(SubMeshRecord);
+    for (const Mesh& mesh : meshes) {
+        std::string texturePath;
+        if (mesh.material.kdTexture) {
+            const auto relativePath = mesh.material.kdTexture->sourceFile.lexically_relative(baseDir);
+            const auto u8Path = (relativePath.empty() ? mesh.material.kdTexture->sourceFile : relativePath).generic_u8string();
+            texturePath.assign(std::begin(u8Path), std::end(u8Path));
+        }
+
+        SubMeshRecord& record = records.emplace_back();
+        record.vertexOffset = offset = alignOffset(offset);
+        record.numVertices = mesh.vertices.size();
+        offset += record.numVertices * sizeof(Vertex);
+        record.triangleOffset = offset = alignOffset(offset);
+        record.numTriangles = mesh.triangles.size();
+        offset += record.numTriangles * sizeof(glm::uvec3);
+        record.clusterOffset = offset = alignOffset(offset);
+        record.numClusters = mesh.clusters.size();
+        offset += record.numClusters * sizeof(MeshCluster);
+        record.texturePathOffset = offset;
+        record.texturePathLength = texturePath.size();
+        offset += texturePath.size();
+        record.kd = { mesh.material.kd.x, mesh.material.kd.y, mesh.material.kd.z };
+        record.ks = { mesh.material.ks.x, mesh.material.ks.y, mesh.material.ks.z };
+        record.shininess = mesh.material.shininess;
+        record.transparency = mesh.material.transparency;
+        texturePaths.push_back(std::move(texturePath));
+    }
+    for (size_t i = 0; i < dependencies.size(); ++i) {
+        dependencies[i].pathOffset = offset;
+        dependencies[i].pathLength = dependencyPaths[i].size();
+        offset += dependencyPaths[i].size();
+    }
+
+    std::error_code errorCode;
+    FileHeader header;
+    header.magic = cacheMagic;
+    header.version = cacheVersion;
+    header.settingsFlags = settingsFlags(settings);
+    header.numDependencies = dependencies.size();
+    header.numSubMeshes = meshes.size();
+
+    // Write to a temporary file first so that a crash or concurrent run never leaves a half-written cache behind.
+    const auto cacheFile = cacheFilePath(sourceFile);
+    auto tmpFile = cacheFile;
+    tmpFile += ".tmp";
+    {
+        std::ofstream stream { tmpFile, std::ios::binary };
+        uint64_t position = 0;
+        const auto writeBytes = [&](const void* pData, uint64_t size) {
+            stream.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+            position += size;
+        };
+        const auto pad = [&](uint64_t target) {
+            static constexpr std::array<char, dataAlignment> zeros {};
+            writeBytes(zeros.data(), target - position);
+        };
+
+        writeBytes(&header, sizeof(header));
+        writeBytes(dependencies.data(), dependencies.size() * sizeof(DependencyRecord));
+        writeBytes(records.data(), records.size() * sizeof(SubMeshRecord));
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            pad(records[i].vertexOffset);
+            writeBytes(meshes[i].vertices.data(), records[i].numVertices * sizeof(Vertex));
+            pad(records[i].triangleOffset);
+            writeBytes(meshes[i].triangles.data(), records[i].numTriangles * sizeof(glm::uvec3));
+            pad(records[i].clusterOffset);
+            writeBytes(meshes[i].clusters.data(), records[i].numClusters * sizeof(MeshCluster));
+            writeBytes(texturePaths[i].data(), texturePaths[i].size());
+        }
+        for (const std::string& path : dependencyPaths)
+            writeBytes(path.data(), path.size());
+
+        if (!stream) {
+            std::cerr << "Warning: could not write mesh cache " << cacheFile << std::endl;
+            stream.close();
+            std::filesystem::remove(tmpFile, errorCode);
+            return;
+        }
+    }
+    std::filesystem::rename(tmpFile, cacheFile, errorCode);
+    if (errorCode) {
+        std::cerr << "Warning: could not write mesh cache " << cacheFile << ": " << errorCode.message() << std::endl;
+        std::filesystem::remove(tmpFile, errorCode);
+    }
+}
+
+MeshCache::MeshCache(MappedFile&& file, const std::filesystem::path& sourceFile)
+    : m_file(std::move(file))
+    , m_baseDir(sourceFile.parent_path())
+{
+}
+
+size_t MeshCache::numSubMeshes() const
+{
+    FileHeader header;
+    std::memcpy(&header, m_file.data().data(), sizeof(header));
+    return static_cast<size_t>(header.numSubMeshes);
+}
+
+const MeshCache::SubMeshRecord& MeshCache::record(size_t subMesh) const
+{
+    // Records start after the header and the dependencies, which are multiples of 8 bytes, so they are suitably aligned.
+    static_assert(sizeof(FileHeader) % alignof(SubMeshRecord) == 0 && sizeof(DependencyRecord) % alignof(SubMeshRecord) == 0);
+    FileHeader header;
+    std::memcpy(&header, m_file.data().data(), sizeof(header));
+    const size_t recordsStart = sizeof(FileHeader) + static_cast<size_t>(header.numDependencies) * sizeof(DependencyRecord);
+    return reinterpret_cast<const SubMeshRecord*>(m_file.data().data() + recordsStart)[subMesh];
+}
+
+std::span<const Vertex> MeshCache::vertices(size_t subMesh) const
+{
+    const SubMeshRecord& subMeshRecord = record(subMesh);
+    return { reinterpret_cast<const Vertex*>(m_file.data().data() + subMeshRecord.vertexOffset), static_cast<size_t>(subMeshRecord.numVertices) };
+}
+
+std::span<const glm::uvec3> MeshCache::triangles(size_t subMesh) const
+{
+    const SubMeshRecord& subMeshRecord = record(subMesh);
+    return { reinterpret_cast<const glm::uvec3*>(m_file.data().data() + subMeshRecord.triangleOffset), static_cast<size_t>(subMeshRecord.numTriangles) };
+}
+
+std::span<const MeshCluster> MeshCache::clusters(size_t subMesh) const
+{
+    const SubMeshRecord& subMeshRecord = record(subMesh);
+    return { reinterpret_cast<const MeshCluster*>(m_file.data().data() + subMeshRecord.clusterOffset), static_cast<size_t>(subMeshRecord.numClusters) };
+}
+
+Material MeshCache::material(size_t subMesh) const
+{
+    const SubMeshRecord& subMeshRecord = record(subMesh);
+    Material out;
+    out.kd = glm::vec3(subMeshRecord.kd[0], subMeshRecord.kd[1], subMeshRecord.kd[2]);
+    out.ks = glm::vec3(subMeshRecord.ks[0], subMeshRecord.ks[1], subMeshRecord.ks[2]);
+    out.shininess = subMeshRecord.shininess;
+    out.transparency = subMeshRecord.transparency;
+    if (subMeshRecord.texturePathLength > 0) {
+        const auto* pPath = reinterpret_cast<const char8_t*>(m_file.data().data() + subMeshRecord.texturePathOffset);
+        out.kdTexture = loadImageCached(m_baseDir / std::u8string(pPath, static_cast<size_t>(subMeshRecord.texturePathLength)));
+    }
+    return out;
+}
+
+std::vector<Mesh> MeshCache::toMeshes() const
+{
+    std::vector<Mesh> out(numSubMeshes());
+    for (size_t i = 0; i < out.size(); ++i) {
+        const auto cachedVertices = vertices(i);
+        const auto cachedTriangles = triangles(i);
+        const auto cachedClusters = clusters(i);
+        out[i].vertices.assign(std::begin(cachedVertices), std::end(cachedVertices));
+        out[i].triangles.assign(std::begin(cachedTriangles), std::end(cachedTriangles));
+        out[i].clusters.assign(std::begin(cachedClusters), std::end(cachedClusters));
+        out[i].material = material(i);
+    }
+    return out;
+}
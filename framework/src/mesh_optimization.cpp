@@ -0,0 +1,244 @@
+#include "mesh_optimization.h"
+#include "parallel.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+float VertexCacheStatistics::acmr() const
+{
+    return numTriangles > 0 ? static_cast<float>(numTransformedVertices) / static_cast<float>(numTriangles) : 0.0f;
+}
+
+float VertexCacheStatistics::atvr() const
+{
+    return numVertices > 0 ? static_cast<float>(numTransformedVertices) / static_cast<float>(numVertices) : 0.0f;
+}
+
+VertexCacheStatistics& VertexCacheStatistics::operator+=(const VertexCacheStatistics& other)
+{
+    numTransformedVertices += other.numTransformedVertices;
+    numTriangles += other.numTriangles;
+    numVertices += other.numVertices;
+    return *this;
+}
+
+VertexCacheStatistics analyzeVertexCache(std::span<const glm::uvec3> triangles, size_t numVertices, size_t cacheSize)
+{
+    // A vertex is in the FIFO cache if fewer than cacheSize vertices were transformed since it was transformed itself.
+    std::vector<size_t> cacheTimes(numVertices, 0);
+    size_t timeStamp = cacheSize + 1;
+    VertexCacheStatistics statistics { .numTriangles = triangles.size() };
+    for (const glm::uvec3& triangle : triangles) {
+        for (glm::length_t corner = 0; corner < 3; ++corner) {
+            const uint32_t vertex = triangle[corner];
+            if (cacheTimes[vertex] == 0)
+                ++statistics.numVertices;
+            if (timeStamp - cacheTimes[vertex] > cacheSize) {
+                cacheTimes[vertex] = timeStamp++;
+                ++statistics.numTransformedVertices;
+            }
+        }
+    }
+    return statistics;
+}
+
+void optimizeVertexCache(std::span<glm::uvec3> triangles, size_t numVertices, size_t cacheSize)
+{
+    const size_t numTriangles = triangles.size();
+    if (numTriangles == 0)
+        return;
+
+    // The triangles that use each vertex (compressed rows).
+    std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+    for (const glm::uvec3& triangle : triangles) {
+        for (glm::length_t corner = 0; corner < 3; ++corner)
+            ++adjacencyOffsets[triangle[corner] + 1];
+    }
+    std::partial_sum(std::begin(adjacencyOffsets), std::end(adjacencyOffsets), std::begin(adjacencyOffsets));
+    std::vector<uint32_t> adjacency(3 * numTriangles);
+    std::vector<uint32_t> liveTriangles(numVertices);
+    {
+        std::vector<uint32_t> writePositions(std::begin(adjacencyOffsets), std::end(adjacencyOffsets) - 1);
+        for (size_t triangleIdx = 0; triangleIdx < numTriangles; ++triangleIdx) {
+            for (glm::length_t corner = 0; corner < 3; ++corner)
+                adjacency[writePositions[triangles[triangleIdx][corner]]++] = static_cast<uint32_t>(triangleIdx);
+        }
+        for (size_t vertex = 0; vertex < numVertices; ++vertex)
+            liveTriangles[vertex] = adjacencyOffsets[vertex + 1] - adjacencyOffsets[vertex];
+    }
+
+    std::vector<size_t> cacheTimes(numVertices, 0);
+    std::vector<uint8_t> emitted(numTriangles, 0);
+    std::vector<uint32_t> deadEndStack;
+    std::vector<uint32_t> candidates;
+    std::vector<glm::uvec3> output;
+    output.reserve(numTriangles);
+    size_t timeStamp = cacheSize + 1;
+    size_t cursor = 0;
+
+    // Emit all remaining triangles around a "fanning" vertex, then continue with the vertex that was used by them and
+    // that will still be in the cache after its own remaining triangles have been emitted (or fall back to the most
+    // recently used vertex that has triangles left, or the next vertex in input order).
+    std::optional<uint32_t> fanningVertex = 0;
+    while (fanningVertex) {
+        candidates.clear();
+        for (uint32_t i = adjacencyOffsets[*fanningVertex]; i < adjacencyOffsets[*fanningVertex + 1]; ++i) {
+            const uint32_t triangleIdx = adjacency[i];
+            if (emitted[triangleIdx])
+                continue;
+            emitted[triangleIdx] = 1;
+            const glm::uvec3 triangle = triangles[triangleIdx];
+            output.push_back(triangle);
+            for (glm::length_t corner = 0; corner < 3; ++corner) {
+                const uint32_t vertex = triangle[corner];
+                deadEndStack.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if (timeStamp - cacheTimes[vertex] > cacheSize)
+                    cacheTimes[vertex] = timeStamp++;
+            }
+        }
+
+        fanningVertex.reset();
+        size_t bestPriority = 0;
+        for (const uint32_t vertex : candidates) {
+            if (liveTriangles[vertex] == 0)
+                continue;
+            // Prefer the vertex that entered the cache the longest ago, as long as it stays in the cache.
+            const size_t age = timeStamp - cacheTimes[vertex];
+            const size_t priority = age + 2 * liveTriangles[vertex] <= cacheSize ? age : 0;
+            if (!fanningVertex || priority > bestPriority) {
+                fanningVertex = vertex;
+                bestPriority = priority;
+            }
+        }
+        while (!fanningVertex && !deadEndStack.empty()) {
+            const uint32_t vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+            if (liveTriangles[vertex] > 0)
+                fanningVertex = vertex;
+        }
+        for (; !fanningVertex && cursor < numVertices; ++cursor) {
+            if (liveTriangles[cursor] > 0)
+                fanningVertex = static_cast<uint32_t>(cursor);
+        }
+    }
+    assert(output.size() == numTriangles);
+    std::copy(std::begin(output), std::end(output), std::begin(triangles));
+}
+
+// Run optimizeVertexCache() on a range of triangles that only uses a few of the mesh's vertices, using compact
+// indices such that the cost does not depend on the size of the whole mesh. The compact indices are assigned with a
+// small open addressing hash table, which is a lot faster than sorting the vertices of every cluster.
+static void optimizeVertexCacheCompact(std::span<glm::uvec3> triangles, size_t cacheSize)
+{
+    constexpr uint32_t emptySlot = 0xFFFFFFFF;
+    const size_t tableSize = std::bit_ceil(std::max(6 * triangles.size(), size_t(1)));
+    std::vector<uint32_t> tableVertices(tableSize, emptySlot);
+    std::vector<uint32_t> tableIndices(tableSize);
+    std::vector<uint32_t> usedVertices;
+    usedVertices.reserve(3 * triangles.size());
+    const auto compactIndex = [&](uint32_t vertex) {
+        size_t slot = (vertex * 2654435761u) & (tableSize - 1);
+        while (tableVertices[slot] != vertex) {
+            if (tableVertices[slot] == emptySlot) {
+                tableVertices[slot] = vertex;
+                tableIndices[slot] = static_cast<uint32_t>(usedVertices.size());
+                usedVertices.push_back(vertex);
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        return tableIndices[slot];
+    };
+    for (glm::uvec3& triangle : triangles)
+        triangle = glm::uvec3(compactIndex(triangle.x), compactIndex(triangle.y), compactIndex(triangle.z));
+    optimizeVertexCache(triangles, usedVertices.size(), cacheSize);
+    for (glm::uvec3& triangle : triangles)
+        triangle = glm::uvec3(usedVertices[triangle.x], usedVertices[triangle.y], usedVertices[triangle.z]);
+}
+
+void optimizeVertexFetch(Mesh& mesh)
+{
+    constexpr uint32_t unused = 0xFFFFFFFF;
+    std::vector<uint32_t> newIndices(mesh.vertices.size(), unused);
+    std::vector<Vertex> newVertices;
+    newVertices.reserve(mesh.vertices.size());
+    for (glm::uvec3& triangle : mesh.triangles) {
+        for (glm::length_t corner = 0; corner < 3; ++corner) {
+            uint32_t& newIndex = newIndices[triangle[corner]];
+            if (newIndex == unused) {
+                newIndex = static_cast<uint32_t>(newVertices.size());
+                newVertices.push_back(mesh.vertices[triangle[corner]]);
+            }
+            triangle[corner] = newIndex;
+        }
+    }
+    for (size_t vertex = 0; vertex < mesh.vertices.size(); ++vertex) {
+        if (newIndices[vertex] == unused)
+            newVertices.push_back(mesh.vertices[vertex]);
+    }
+    mesh.vertices = std::move(newVertices);
+}
+
+MeshOptimizationReport optimizeMeshVertexOrder(Mesh& mesh, size_t cacheSize)
+{
+    MeshOptimizationReport report;
+    report.before = analyzeVertexCache(mesh.triangles, mesh.vertices.size(), cacheSize);
+
+    if (mesh.clusters.empty()) {
+        optimizeVertexCache(mesh.triangles, mesh.vertices.size(), cacheSize);
+    } else {
+        // Clusters are independent of each other; hand them out in batches because they are small.
+        constexpr size_t clustersPerBatch = 64;
+        parallelFor((mesh.clusters.size() + clustersPerBatch - 1) / clustersPerBatch, [&](size_t batch) {
+            const size_t endCluster = std::min((batch + 1) * clustersPerBatch, mesh.clusters.size());
+            for (size_t clusterIdx = batch * clustersPerBatch; clusterIdx < endCluster; ++clusterIdx) {
+                const MeshCluster& cluster = mesh.clusters[clusterIdx];
+                optimizeVertexCacheCompact(std::span(mesh.triangles).subspan(cluster.firstTriangle, cluster.numTriangles), cacheSize);
+            }
+        });
+
+        // Overdraw: clusters on the outside of the mesh that face outwards are likely to occlude the other clusters,
+        // so they are drawn first (Tipsify sorts its clusters the same way).
+        glm::vec3 meshCenter { 0.0f };
+        for (const MeshCluster& cluster : mesh.clusters)
+            meshCenter += static_cast<float>(cluster.numTriangles) * cluster.bounds.sphereCenter;
+        meshCenter /= static_cast<float>(std::max(mesh.triangles.size(), size_t(1)));
+        std::vector<float> occlusionPotentials(mesh.clusters.size());
+        for (size_t clusterIdx = 0; clusterIdx < mesh.clusters.size(); ++clusterIdx) {
+            const MeshCluster& cluster = mesh.clusters[clusterIdx];
+            occlusionPotentials[clusterIdx] = glm::dot(cluster.bounds.sphereCenter - meshCenter, cluster.coneAxis);
+        }
+        std::vector<uint32_t> clusterOrder(mesh.clusters.size());
+        std::iota(std::begin(clusterOrder), std::end(clusterOrder), 0u);
+        std::stable_sort(std::begin(clusterOrder), std::end(clusterOrder), [&](uint32_t lhs, uint32_t rhs) { return occlusionPotentials[lhs] > occlusionPotentials[rhs]; });
+
+        std::vector<glm::uvec3> sortedTriangles;
+        std::vector<MeshCluster> sortedClusters;
+        sortedTriangles.reserve(mesh.triangles.size());
+        sortedClusters.reserve(mesh.clusters.size());
+        for (const uint32_t clusterIdx : clusterOrder) {
+            MeshCluster cluster = mesh.clusters[clusterIdx];
+            const auto first = std::begin(mesh.triangles) + cluster.firstTriangle;
+            cluster.firstTriangle = static_cast<uint32_t>(sortedTriangles.size());
+            sortedTriangles.insert(std::end(sortedTriangles), first, first + cluster.numTriangles);
+            sortedClusters.push_back(cluster);
+        }
+        mesh.triangles = std::move(sortedTriangles);
+        mesh.clusters = std::move(sortedClusters);
+    }
+
+    optimizeVertexFetch(mesh);
+    report.after = analyzeVertexCache(mesh.triangles, mesh.vertices.size(), cacheSize);
+    return report;
+}
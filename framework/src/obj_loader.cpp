@@ -0,0 +1,418 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <map>
+#include <streambuf>
+#include <string_view>
+
+// Files smaller than this are parsed by a single thread; the chunks of larger files are at least this large.
+static constexpr size_t minChunkSize = size_t(1) << 20;
+
+namespace {
+
+// Exposes a block of memory as a std::streambuf so that tinyobjloader can parse it without copying it into a string.
+class MemoryStreamBuffer : public std::streambuf {
+public:
+    MemoryStreamBuffer(const char* pBegin, const char* pEnd)
+    {
+        // std::streambuf only reads through the get area so it is safe to cast away const here.
+        setg(const_cast<char*>(pBegin), const_cast<char*>(pBegin), const_cast<char*>(pEnd));
+    }
+};
+
+enum class CommandType {
+    Faces,
+    UseMaterial,
+    Group,
+    Object,
+    MaterialLibrary
+};
+
+// Any statement in the file, other than vertex attributes, that influences how faces are grouped into shapes.
+struct Command {
+    CommandType type;
+    size_t first; // Faces: index of the first face. Other commands: index of their first name.
+    size_t count; // Faces: number of faces. Other commands: number of names.
+    size_t firstIndex; // Faces: offset into the indices array of the first face.
+    size_t numVertices; // Number of vertex positions parsed in this chunk before the command.
+};
+
+// Relative (negative) indices can only be resolved once the number of attributes in the preceding chunks is known.
+struct IndexFixup {
+    size_t index;
+    int attribute; // 0 = position, 1 = normal, 2 = texture coordinate.
+};
+
+struct ObjChunk {
+    std::vector<tinyobj::real_t> vertices, normals, texCoords;
+    std::vector<tinyobj::index_t> indices;
+    std::vector<uint8_t> faceSizes;
+    std::vector<Command> commands;
+    std::vector<std::string> names;
+    std::vector<IndexFixup> fixups;
+    size_t materialLibraryAttributeCount { 0 };
+    // Set if the chunk contains something that cannot be stitched exactly; the whole file is then handed to tinyobjloader.
+    bool unsupported { false };
+
+    [[nodiscard]] size_t numVertices() const { return vertices.size() / 3; }
+    [[nodiscard]] size_t attributeCount() const { return vertices.size() + normals.size() + texCoords.size(); }
+    void addCommand(CommandType type, size_t first, size_t count) { commands.push_back({ type, first, count, 0, numVertices() }); }
+};
+
+// Records the names of material libraries instead of loading them: materials are loaded while stitching the chunks
+// such that material IDs are assigned in file order.
+class MaterialLibraryRecorder : public tinyobj::MaterialReader {
+public:
+    explicit MaterialLibraryRecorder(ObjChunk& chunk)
+        : m_chunk(chunk)
+    {
+    }
+
+    bool operator()(const std::string& matId, std::vector<tinyobj::material_t>*, std::map<std::string, int>*, std::string*, std::string*) override
+    {
+        // tinyobjloader tries all file names of a "mtllib" statement until one loads (which never happens here). Two
+        // adjacent "mtllib" statements are therefore indistinguishable from one statement with multiple file names.
+        if (!m_chunk.commands.empty() && m_chunk.commands.back().type == CommandType::MaterialLibrary && m_chunk.materialLibraryAttributeCount == m_chunk.attributeCount()) {
+            m_chunk.unsupported = true;
+        }
+        m_chunk.materialLibraryAttributeCount = m_chunk.attributeCount();
+        m_chunk.names.push_back(matId);
+        m_chunk.addCommand(CommandType::MaterialLibrary, m_chunk.names.size() - 1, 1);
+        return false;
+    }
+
+private:
+    ObjChunk& m_chunk;
+};
+
+}
+
+// Convert an OBJ index (1-based, negative = relative to the end) into a 0-based index, deferring relative indices.
+static int resolveIndex(ObjChunk& chunk, int objIndex, size_t numParsed, int attribute)
+{
+    if (objIndex > 0)
+        return objIndex - 1;
+    if (objIndex == 0) {
+        // Zero means "not specified" for normals and texture coordinates; a missing position is an error.
+        if (attribute == 0)
+            chunk.unsupported = true;
+        return -1;
+    }
+    chunk.fixups.push_back({ chunk.indices.size(), attribute });
+    return static_cast<int>(numParsed) + objIndex;
+}
+
+static void parseChunk(std::string_view text, ObjChunk& chunk)
+{
+    tinyobj::callback_t callbacks;
+    callbacks.vertex_cb = [](void* pUserData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t) {
+        auto& vertices = static_cast<ObjChunk*>(pUserData)->vertices;
+        vertices.insert(std::end(vertices), { x, y, z });
+    };
+    callbacks.normal_cb = [](void* pUserData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+        auto& normals = static_cast<ObjChunk*>(pUserData)->normals;
+        normals.insert(std::end(normals), { x, y, z });
+    };
+    callbacks.texcoord_cb = [](void* pUserData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t) {
+        auto& texCoords = static_cast<ObjChunk*>(pUserData)->texCoords;
+        texCoords.insert(std::end(texCoords), { x, y });
+    };
+    callbacks.index_cb = [](void* pUserData, tinyobj::index_t* pIndices, int numIndices) {
+        ObjChunk& chunk = *static_cast<ObjChunk*>(pUserData);
+        // Polygons with more than four vertices are triangulated by ear clipping, which we do not replicate.
+        if (numIndices > 4) {
+            chunk.unsupported = true;
+            return;
+        }
+
+        if (chunk.commands.empty() || chunk.commands.back().type != CommandType::Faces)
+            chunk.commands.push_back({ CommandType::Faces, chunk.faceSizes.size(), 0, chunk.indices.size(), chunk.numVertices() });
+        chunk.commands.back().count++;
+        chunk.faceSizes.push_back(static_cast<uint8_t>(numIndices));
+        for (int i = 0; i < numIndices; ++i) {
+            tinyobj::index_t index;
+            index.vertex_index = resolveIndex(chunk, pIndices[i].vertex_index, chunk.vertices.size() / 3, 0);
+            index.normal_index = resolveIndex(chunk, pIndices[i].normal_index, chunk.normals.size() / 3, 1);
+            index.texcoord_index = resolveIndex(chunk, pIndices[i].texcoord_index, chunk.texCoords.size() / 2, 2);
+            chunk.indices.push_back(index);
+        }
+    };
+    callbacks.usemtl_cb = [](void* pUserData, const char* pName, int) {
+        ObjChunk& chunk = *static_cast<ObjChunk*>(pUserData);
+        // tinyobj::LoadObj only uses the first word of the line as the material name.
+        pName += std::strspn(pName, " \t");
+        chunk.names.emplace_back(pName, std::strcspn(pName, " \t\r"));
+        chunk.addCommand(CommandType::UseMaterial, chunk.names.size() - 1, 1);
+    };
+    callbacks.group_cb = [](void* pUserData, const char** pNames, int numNames) {
+        ObjChunk& chunk = *static_cast<ObjChunk*>(pUserData);
+        const size_t first = chunk.names.size();
+        chunk.names.insert(std::end(chunk.names), pNames, pNames + numNames);
+        chunk.addCommand(CommandType::Group, first, static_cast<size_t>(numNames));
+    };
+    callbacks.object_cb = [](void* pUserData, const char* pName) {
+        ObjChunk& chunk = *static_cast<ObjChunk*>(pUserData);
+        chunk.names.emplace_back(pName);
+        chunk.addCommand(CommandType::Object, chunk.names.size() - 1, 1);
+    };
+
+    // Line and point primitives are not reported through the callbacks but do influence which shapes are created.
+    for (size_t lineStart = 0; lineStart < text.size() && !chunk.unsupported;) {
+        const size_t token = text.find_first_not_of(" \t", lineStart);
+        if (token != std::string_view::npos && token + 1 < text.size() && (text[token] == 'l' || text[token] == 'p') && (text[token + 1] == ' ' || text[token + 1] == '\t'))
+            chunk.unsupported = true;
+        lineStart = text.find('\n', lineStart);
+        lineStart = lineStart == std::string_view::npos ? text.size() : lineStart + 1;
+    }
+    if (chunk.unsupported)
+        return;
+
+    MemoryStreamBuffer streamBuffer { text.data(), text.data() + text.size() };
+    std::istream stream { &streamBuffer };
+    MaterialLibraryRecorder materialLibraryRecorder { chunk };
+    tinyobj::LoadObjWithCallback(stream, callbacks, &chunk, &materialLibraryRecorder, nullptr, nullptr);
+}
+
+// Split the text into roughly equally sized chunks that each start at the beginning of a line.
+static std::vector<std::string_view> splitIntoChunks(std::string_view text)
+{
+    const size_t numChunks = std::clamp(text.size() / minChunkSize, size_t(1), size_t(4) * numWorkerThreads());
+    std::vector<std::string_view> out;
+    size_t chunkStart = 0;
+    for (size_t i = 1; i <= numChunks && chunkStart < text.size(); ++i) {
+        size_t chunkEnd = text.size();
+        if (i != numChunks) {
+            chunkEnd = std::max(i * text.size() / numChunks, chunkStart);
+            chunkEnd = std::min(text.find('\n', chunkEnd), text.size() - 1) + 1;
+        }
+        out.push_back(text.substr(chunkStart, chunkEnd - chunkStart));
+        chunkStart = chunkEnd;
+    }
+    return out;
+}
+
+namespace {
+
+// Replays the statements of all chunks in file order, mirroring how tinyobj::LoadObj groups faces into shapes.
+class ShapeBuilder {
+public:
+    ShapeBuilder(const std::vector<tinyobj::real_t>& vertices, std::vector<tinyobj::shape_t>& shapes, std::string* pWarn)
+        : m_vertices(vertices)
+        , m_shapes(shapes)
+        , m_pWarn(pWarn)
+    {
+    }
+
+    void addFaces(const ObjChunk& chunk, const Command& command) { m_pendingFaces.push_back({ &chunk, command }); }
+
+    void useMaterial(int materialID, size_t numVertices)
+    {
+        if (materialID == m_materialID)
+            return;
+        exportPendingFaces(numVertices);
+        m_materialID = materialID;
+    }
+
+    // Start a new shape; the name of the previous shape is kept if pName is nullptr.
+    void startShape(const std::string* pName, size_t numVertices)
+    {
+        exportPendingFaces(numVertices);
+        if (!m_shape.mesh.indices.empty())
+            m_shapes.push_back(std::move(m_shape));
+        m_shape = tinyobj::shape_t();
+        if (pName)
+            m_name = *pName;
+    }
+
+    void finish(size_t numVertices)
+    {
+        if (exportPendingFaces(numVertices) || !m_shape.mesh.indices.empty())
+            m_shapes.push_back(std::move(m_shape));
+    }
+
+private:
+    void warn(const char* pMessage)
+    {
+        if (m_pWarn)
+            *m_pWarn += pMessage;
+    }
+
+    void addTriangle(const tinyobj::index_t& i0, const tinyobj::index_t& i1, const tinyobj::index_t& i2)
+    {
+        m_shape.mesh.indices.insert(std::end(m_shape.mesh.indices), { i0, i1, i2 });
+        m_shape.mesh.num_face_vertices.push_back(3);
+        m_shape.mesh.material_ids.push_back(m_materialID);
+        m_shape.mesh.smoothing_group_ids.push_back(0);
+    }
+
+    // Equivalent of tinyobjloader's exportGroupsToShape(); numVertices is the number of vertex positions parsed so far.
+    bool exportPendingFaces(size_t numVertices)
+    {
+        if (m_pendingFaces.empty())
+            return false;
+
+        m_shape.name = m_name;
+        for (const auto& [pChunk, command] : m_pendingFaces) {
+            const tinyobj::index_t* pIndices = &pChunk->indices[command.firstIndex];
+            for (size_t face = command.first; face != command.first + command.count; ++face) {
+                const size_t faceSize = pChunk->faceSizes[face];
+                if (faceSize == 3) {
+                    addTriangle(pIndices[0], pIndices[1], pIndices[2]);
+                } else if (faceSize == 4) {
+                    const auto isValid = [&](const tinyobj::index_t& index) { return static_cast<size_t>(index.vertex_index) < numVertices; };
+                    if (std::all_of(pIndices, pIndices + 4, isValid)) {
+                        // Split the quad along its shortest diagonal (same arithmetic as tinyobjloader).
+                        const auto diagonalLengthSquared = [&](const tinyobj::index_t& a, const tinyobj::index_t& b) {
+                            const tinyobj::real_t* pA = &m_vertices[3 * static_cast<size_t>(a.vertex_index)];
+                            const tinyobj::real_t* pB = &m_vertices[3 * static_cast<size_t>(b.vertex_index)];
+                            const tinyobj::real_t ex = pB[0] - pA[0];
+                            const tinyobj::real_t ey = pB[1] - pA[1];
+                            const tinyobj::real_t ez = pB[2] - pA[2];
+                            return ex * ex + ey * ey + ez * ez;
+                        };
+                        if (diagonalLengthSquared(pIndices[0], pIndices[2]) < diagonalLengthSquared(pIndices[1], pIndices[3])) {
+                            addTriangle(pIndices[0], pIndices[1], pIndices[2]);
+                            addTriangle(pIndices[0], pIndices[2], pIndices[3]);
+                        } else {
+                            addTriangle(pIndices[0], pIndices[1], pIndices[3]);
+                            addTriangle(pIndices[1], pIndices[2], pIndices[3]);
+                        }
+                    } else {
+                        warn("Face with invalid vertex index found.\n");
+                    }
+                } else {
+                    warn("Degenerated face found\n.");
+                }
+                pIndices += faceSize;
+            }
+        }
+        m_pendingFaces.clear();
+        return true;
+    }
+
+private:
+    struct PendingFaces {
+        const ObjChunk* pChunk;
+        Command command;
+    };
+
+    const std::vector<tinyobj::real_t>& m_vertices;
+    std::vector<tinyobj::shape_t>& m_shapes;
+    std::string* m_pWarn;
+
+    std::vector<PendingFaces> m_pendingFaces;
+    tinyobj::shape_t m_shape;
+    std::string m_name;
+    int m_materialID { -1 };
+};
+
+}
+
+bool parallelLoadObj(tinyobj::attrib_t* pAttrib, std::vector<tinyobj::shape_t>* pShapes, std::vector<tinyobj::material_t>* pMaterials,
+    std::string* pWarn, std::string* pError, const std::filesystem::path& file, const std::filesystem::path& mtlBaseDir)
+{
+    const auto loadSequential = [&]() {
+        return tinyobj::LoadObj(pAttrib, pShapes, pMaterials, pWarn, pError, file.string().c_str(), mtlBaseDir.string().c_str());
+    };
+
+    const auto mappedFile = MappedFile::open(file);
+    if (!mappedFile)
+        return loadSequential(); // Let tinyobjloader report the error.
+
+    // Parse all chunks in parallel.
+    const std::span<const std::byte> fileData = mappedFile->data();
+    const auto chunkTexts = splitIntoChunks(std::string_view(reinterpret_cast<const char*>(fileData.data()), fileData.size()));
+    std::vector<ObjChunk> chunks(chunkTexts.size());
+    parallelFor(chunks.size(), [&](size_t i) { parseChunk(chunkTexts[i], chunks[i]); });
+    if (std::any_of(std::begin(chunks), std::end(chunks), [](const ObjChunk& chunk) { return chunk.unsupported; }))
+        return loadSequential();
+
+    // Concatenate the vertex attributes and rebase relative indices.
+    struct AttributeOffsets {
+        size_t vertices { 0 }, normals { 0 }, texCoords { 0 };
+    };
+    std::vector<AttributeOffsets> chunkOffsets(chunks.size() + 1);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunkOffsets[i + 1].vertices = chunkOffsets[i].vertices + chunks[i].vertices.size();
+        chunkOffsets[i + 1].normals = chunkOffsets[i].normals + chunks[i].normals.size();
+        chunkOffsets[i + 1].texCoords = chunkOffsets[i].texCoords + chunks[i].texCoords.size();
+    }
+    *pAttrib = tinyobj::attrib_t();
+    pAttrib->vertices.resize(chunkOffsets.back().vertices);
+    pAttrib->normals.resize(chunkOffsets.back().normals);
+    pAttrib->texcoords.resize(chunkOffsets.back().texCoords);
+    parallelFor(chunks.size(), [&](size_t i) {
+        ObjChunk& chunk = chunks[i];
+        const AttributeOffsets& offsets = chunkOffsets[i];
+        std::copy(std::begin(chunk.vertices), std::end(chunk.vertices), std::begin(pAttrib->vertices) + static_cast<std::ptrdiff_t>(offsets.vertices));
+        std::copy(std::begin(chunk.normals), std::end(chunk.normals), std::begin(pAttrib->normals) + static_cast<std::ptrdiff_t>(offsets.normals));
+        std::copy(std::begin(chunk.texCoords), std::end(chunk.texCoords), std::begin(pAttrib->texcoords) + static_cast<std::ptrdiff_t>(offsets.texCoords));
+        for (const IndexFixup& fixup : chunk.fixups) {
+            tinyobj::index_t& index = chunk.indices[fixup.index];
+            if (fixup.attribute == 0)
+                index.vertex_index += static_cast<int>(offsets.vertices / 3);
+            else if (fixup.attribute == 1)
+                index.normal_index += static_cast<int>(offsets.normals / 3);
+            else
+                index.texcoord_index += static_cast<int>(offsets.texCoords / 2);
+        }
+    });
+
+    // Replay all statements in file order to group the faces into shapes and to load the materials.
+    std::string baseDir = mtlBaseDir.string();
+    if (!baseDir.empty() && baseDir.back() != static_cast<char>(std::filesystem::path::preferred_separator))
+        baseDir += static_cast<char>(std::filesystem::path::preferred_separator);
+    tinyobj::MaterialFileReader materialFileReader { baseDir };
+    std::map<std::string, int> materialMap;
+
+    pShapes->clear();
+    pMaterials->clear();
+    ShapeBuilder shapeBuilder { pAttrib->vertices, *pShapes, pWarn };
+    for (size_t chunkIdx = 0; chunkIdx < chunks.size(); ++chunkIdx) {
+        const ObjChunk& chunk = chunks[chunkIdx];
+        const size_t vertexOffset = chunkOffsets[chunkIdx].vertices / 3;
+        for (const Command& command : chunk.commands) {
+            const size_t numVertices = vertexOffset + command.numVertices;
+            switch (command.type) {
+            case CommandType::Faces: {
+                shapeBuilder.addFaces(chunk, command);
+            } break;
+            case CommandType::UseMaterial: {
+                const std::string& materialName = chunk.names[command.first];
+                int materialID = -1;
+                if (auto iter = materialMap.find(materialName); iter != std::end(materialMap))
+                    materialID = iter->second;
+                else if (pWarn)
+                    *pWarn += "material [ '" + materialName + "' ] not found in .mtl\n";
+                shapeBuilder.useMaterial(materialID, numVertices);
+            } break;
+            case CommandType::Group: {
+                // tinyobj::LoadObj only resets the name of an unnamed group when warnings are requested.
+                std::string groupName;
+                for (size_t i = 0; i < command.count; ++i)
+                    groupName += (i == 0 ? "" : " ") + chunk.names[command.first + i];
+                shapeBuilder.startShape(command.count > 0 || pWarn ? &groupName : nullptr, numVertices);
+            } break;
+            case CommandType::Object: {
+                shapeBuilder.startShape(&chunk.names[command.first], numVertices);
+            } break;
+            case CommandType::MaterialLibrary: {
+                std::string materialWarn, materialError;
+                const bool loaded = materialFileReader(chunk.names[command.first], pMaterials, &materialMap, &materialWarn, &materialError);
+                if (pWarn)
+                    *pWarn += materialWarn;
+                if (pError)
+                    *pError += materialError;
+                if (!loaded && pWarn)
+                    *pWarn += "Failed to load material file(s). Use default material.\n";
+            } break;
+            };
+        }
+    }
+    shapeBuilder.finish(pAttrib->vertices.size() / 3);
+    return true;
+}
@@ -0,0 +1,128 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+unsigned numWorkerThreads()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& function)
+{
+    const size_t numThreads = std::min(static_cast<size_t>(numWorkerThreads()), count);
+    if (numThreads <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    std::atomic_size_t nextItem { 0 };
+    std::exception_ptr pException;
+    std::mutex exceptionMutex;
+    const auto worker = [&]() {
+        for (size_t i = nextItem++; i < count; i = nextItem++) {
+            try {
+                function(i);
+            } catch (...) {
+                std::scoped_lock lock { exceptionMutex };
+                if (!pException)
+                    pException = std::current_exception();
+                nextItem = count; // Skip the remaining items.
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t i = 1; i < numThreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (pException)
+        std::rethrow_exception(pException);
+}
+
+void parallelForWorkStealing(size_t count, const std::function<void(size_t)>& function)
+{
+    const size_t numThreads = std::min(static_cast<size_t>(numWorkerThreads()), count);
+    if (numThreads <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    // The remaining items [begin, end) of every thread are packed into one atomic so that the owner can take items from
+    // the front while other threads steal from the back, without locks.
+    assert(count < (uint64_t(1) << 32));
+    const auto pack = [](uint64_t begin, uint64_t end) { return begin << 32 | end; };
+    const auto unpackBegin = [](uint64_t range) { return range >> 32; };
+    const auto unpackEnd = [](uint64_t range) { return range & 0xFFFFFFFF; };
+    const auto ranges = std::make_unique<std::atomic_uint64_t[]>(numThreads);
+    for (size_t thread = 0; thread < numThreads; ++thread)
+        ranges[thread] = pack(count * thread / numThreads, count * (thread + 1) / numThreads);
+
+    std::atomic_bool failed { false };
+    std::exception_ptr pException;
+    std::mutex exceptionMutex;
+    const auto takeFromFront = [&](size_t thread) -> std::optional<size_t> {
+        uint64_t range = ranges[thread].load();
+        while (unpackBegin(range) < unpackEnd(range)) {
+            if (ranges[thread].compare_exchange_weak(range, pack(unpackBegin(range) + 1, unpackEnd(range))))
+                return unpackBegin(range);
+        }
+        return std::nullopt;
+    };
+    const auto steal = [&](size_t thief) {
+        for (size_t offset = 1; offset < numThreads; ++offset) {
+            const size_t victim = (thief + offset) % numThreads;
+            uint64_t range = ranges[victim].load();
+            while (unpackBegin(range) < unpackEnd(range)) {
+                const uint64_t numStolen = (unpackEnd(range) - unpackBegin(range) + 1) / 2;
+                const uint64_t newEnd = unpackEnd(range) - numStolen;
+                if (ranges[victim].compare_exchange_weak(range, pack(unpackBegin(range), newEnd))) {
+                    // The thief's own range is empty, so nobody else modifies it concurrently.
+                    ranges[thief] = pack(newEnd, newEnd + numStolen);
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    const auto worker = [&](size_t thread) {
+        do {
+            while (const std::optional<size_t> item = takeFromFront(thread)) {
+                if (failed)
+                    return;
+                try {
+                    function(*item);
+                } catch (...) {
+                    std::scoped_lock lock { exceptionMutex };
+                    if (!pException)
+                        pException = std::current_exception();
+                    failed = true; // Skip the remaining items.
+                }
+            }
+        } while (steal(thread));
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t thread = 1; thread < numThreads; ++thread)
+        threads.emplace_back(worker, thread);
+    worker(0);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (pException)
+        std::rethrow_exception(pException);
+}
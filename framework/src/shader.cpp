@@ -2,7 +2,9 @@
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
+#include <glm/gtc/type_ptr.hpp>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iostream>
@@ -26,8 +28,10 @@ Shader::Shader()
 }
 
 Shader::Shader(Shader&& other)
+    : m_program(other.m_program)
+    , m_uniforms(std::move(other.m_uniforms))
+    , m_uniformBlocks(std::move(other.m_uniformBlocks))
 {
-    m_program = other.m_program;
     other.m_program = invalid;
 }
 
@@ -43,6 +47,8 @@ Shader& Shader::operator=(Shader&& other)
         glDeleteProgram(m_program);
 
     m_program = other.m_program;
+    m_uniforms = std::move(other.m_uniforms);
+    m_uniformBlocks = std::move(other.m_uniformBlocks);
     other.m_program = invalid;
     return *this;
 }
@@ -53,15 +59,157 @@ void Shader::bind() const
     glUseProgram(m_program);
 }
 
-void Shader::bindUniformBlock(const std::string& blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const
+void Shader::bindUniformBlock(UniformName blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const
 {
-    GLuint blockIdx = glGetUniformBlockIndex(m_program, blockName.data());
-    if (blockIdx != GL_INVALID_INDEX) {
-        glUniformBlockBinding(m_program, blockIdx, bindingLocation);
+    auto iter = std::lower_bound(std::begin(m_uniformBlocks), std::end(m_uniformBlocks), blockName.hash,
+        [](const UniformBlockInfo& block, uint64_t nameHash) { return block.nameHash < nameHash; });
+    if (iter != std::end(m_uniformBlocks) && iter->nameHash == blockName.hash) {
+        // The binding is part of the program state so it only needs to be changed when it differs.
+        if (iter->binding != bindingLocation) {
+            glUniformBlockBinding(m_program, iter->index, bindingLocation);
+            iter->binding = bindingLocation;
+        }
         glBindBufferBase(GL_UNIFORM_BUFFER, bindingLocation, uniformBlockBuffer);
     } else {
-        std::cout << "Could not bind uniform block " << blockName << " invalid name" << std::endl;
+        std::cout << "Could not bind uniform block " << blockName.name << " invalid name" << std::endl;
+    }
+}
+
+GLint Shader::uniformLocation(UniformName name) const
+{
+    const auto iter = std::lower_bound(std::begin(m_uniforms), std::end(m_uniforms), name.hash,
+        [](const UniformInfo& uniform, uint64_t nameHash) { return uniform.nameHash < nameHash; });
+    return iter != std::end(m_uniforms) && iter->nameHash == name.hash ? iter->location : -1;
+}
+
+void Shader::set(UniformName name, bool value) const
+{
+    set(name, value ? 1 : 0);
+}
+
+void Shader::set(UniformName name, int value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform1i(m_program, location, value);
+}
+
+void Shader::set(UniformName name, unsigned value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform1ui(m_program, location, value);
+}
+
+void Shader::set(UniformName name, float value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform1f(m_program, location, value);
+}
+
+void Shader::set(UniformName name, const glm::vec2& value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform2fv(m_program, location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(UniformName name, const glm::vec3& value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform3fv(m_program, location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(UniformName name, const glm::vec4& value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniform4fv(m_program, location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(UniformName name, const glm::mat3& value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniformMatrix3fv(m_program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::set(UniformName name, const glm::mat4& value) const
+{
+    if (const GLint location = uniformLocation(name); location != -1)
+        glProgramUniformMatrix4fv(m_program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::set(UniformName name, std::span<const int> values) const
+{
+    if (const GLint location = uniformLocation(name); location != -1 && !values.empty())
+        glProgramUniform1iv(m_program, location, static_cast<GLsizei>(values.size()), values.data());
+}
+
+void Shader::set(UniformName name, std::span<const float> values) const
+{
+    if (const GLint location = uniformLocation(name); location != -1 && !values.empty())
+        glProgramUniform1fv(m_program, location, static_cast<GLsizei>(values.size()), values.data());
+}
+
+void Shader::set(UniformName name, std::span<const glm::vec3> values) const
+{
+    if (const GLint location = uniformLocation(name); location != -1 && !values.empty())
+        glProgramUniform3fv(m_program, location, static_cast<GLsizei>(values.size()), glm::value_ptr(values[0]));
+}
+
+void Shader::set(UniformName name, std::span<const glm::vec4> values) const
+{
+    if (const GLint location = uniformLocation(name); location != -1 && !values.empty())
+        glProgramUniform4fv(m_program, location, static_cast<GLsizei>(values.size()), glm::value_ptr(values[0]));
+}
+
+void Shader::set(UniformName name, std::span<const glm::mat4> values) const
+{
+    if (const GLint location = uniformLocation(name); location != -1 && !values.empty())
+        glProgramUniformMatrix4fv(m_program, location, static_cast<GLsizei>(values.size()), GL_FALSE, glm::value_ptr(values[0]));
+}
+
+void Shader::enumerateUniforms()
+{
+    GLint numUniforms = 0, maxNameLength = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::string name;
+    m_uniforms.clear();
+    for (GLuint i = 0; i < static_cast<GLuint>(numUniforms); ++i) {
+        GLsizei nameLength = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        name.resize(static_cast<size_t>(maxNameLength));
+        glGetActiveUniform(m_program, i, maxNameLength, &nameLength, &size, &type, name.data());
+        name.resize(static_cast<size_t>(nameLength));
+
+        const GLint location = glGetUniformLocation(m_program, name.c_str());
+        if (location == -1)
+            continue; // Member of a uniform block.
+        // Arrays are reported as "name[0]" but are set through their base name.
+        if (name.ends_with("[0]"))
+            name.resize(name.size() - 3);
+        m_uniforms.push_back({ hashUniformName(name), location });
     }
+
+    GLint numUniformBlocks = 0, maxBlockNameLength = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCKS, &numUniformBlocks);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+    m_uniformBlocks.clear();
+    for (GLuint i = 0; i < static_cast<GLuint>(numUniformBlocks); ++i) {
+        GLsizei nameLength = 0;
+        GLint binding = 0;
+        name.resize(static_cast<size_t>(maxBlockNameLength));
+        glGetActiveUniformBlockName(m_program, i, maxBlockNameLength, &nameLength, name.data());
+        name.resize(static_cast<size_t>(nameLength));
+        glGetActiveUniformBlockiv(m_program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+        m_uniformBlocks.push_back({ hashUniformName(name), i, static_cast<GLuint>(binding) });
+    }
+
+    // Lookups use binary search over the name hashes; two names with the same hash would be indistinguishable.
+    std::sort(std::begin(m_uniforms), std::end(m_uniforms), [](const UniformInfo& lhs, const UniformInfo& rhs) { return lhs.nameHash < rhs.nameHash; });
+    std::sort(std::begin(m_uniformBlocks), std::end(m_uniformBlocks), [](const UniformBlockInfo& lhs, const UniformBlockInfo& rhs) { return lhs.nameHash < rhs.nameHash; });
+    const bool uniformCollision = std::adjacent_find(std::begin(m_uniforms), std::end(m_uniforms), [](const UniformInfo& lhs, const UniformInfo& rhs) { return lhs.nameHash == rhs.nameHash; }) != std::end(m_uniforms);
+    const bool blockCollision = std::adjacent_find(std::begin(m_uniformBlocks), std::end(m_uniformBlocks), [](const UniformBlockInfo& lhs, const UniformBlockInfo& rhs) { return lhs.nameHash == rhs.nameHash; }) != std::end(m_uniformBlocks);
+    if (uniformCollision || blockCollision)
+        throw ShaderLoadingException("Shader program contains uniforms whose names have the same hash");
 }
 
 GLuint Shader::getAttributeLocation(const std::string& name) const
@@ -119,7 +267,9 @@ Shader ShaderBuilder::build()
         throw ShaderLoadingException("Shader program failed to link");
     }
 
-    return Shader(program);
+    Shader shader(program);
+    shader.enumerateUniforms();
+    return shader;
 }
 
 void ShaderBuilder::freeShaders()
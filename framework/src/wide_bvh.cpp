@@ -0,0 +1,498 @@
+#include "wide_bvh.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIDE_BVH_SSE 1
+#endif
+// Only the AVX2 kernel itself is compiled for AVX2 (it is selected at run time), such that the rest of the framework still
+// runs on CPUs without it. MSVC has no per-function targets, so it only gets the kernel when everything targets AVX2.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define WIDE_BVH_AVX2 1
+#define WIDE_BVH_AVX2_TARGET_REGION 1
+#elif defined(__AVX2__)
+#define WIDE_BVH_AVX2 1
+#endif
+#if defined(WIDE_BVH_SSE) || defined(WIDE_BVH_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t emptyChild = 0xFFFFFFFF;
+
+// The kernels below are written once against these types, which wrap the SIMD registers of one instruction set each.
+// ScalarFloat performs the same IEEE operations lane by lane (min and max included, which follow the SSE semantics of
+// returning the second operand if the comparison fails), so it computes bit for bit the same results. Comparisons
+// return a bit mask with one bit per lane.
+template <size_t Width>
+struct ScalarFloat {
+    static constexpr size_t width = Width;
+    std::array<float, Width> lanes;
+
+    static ScalarFloat broadcast(float value)
+    {
+        ScalarFloat result;
+        result.lanes.fill(value);
+        return result;
+    }
+    static ScalarFloat load(const float* pValues)
+    {
+        ScalarFloat result;
+        std::copy_n(pValues, Width, std::begin(result.lanes));
+        return result;
+    }
+    void store(float* pValues) const { std::copy_n(std::begin(lanes), Width, pValues); }
+
+    template <typename F>
+    friend ScalarFloat apply(const ScalarFloat& lhs, const ScalarFloat& rhs, F&& function)
+    {
+        ScalarFloat result;
+        for (size_t lane = 0; lane < Width; ++lane)
+            result.lanes[lane] = function(lhs.lanes[lane], rhs.lanes[lane]);
+        return result;
+    }
+    template <typename F>
+    friend uint32_t compare(const ScalarFloat& lhs, const ScalarFloat& rhs, F&& function)
+    {
+        uint32_t mask = 0;
+        for (size_t lane = 0; lane < Width; ++lane)
+            mask |= (function(lhs.lanes[lane], rhs.lanes[lane]) ? 1u : 0u) << lane;
+        return mask;
+    }
+
+    friend ScalarFloat operator+(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a + b; }); }
+    friend ScalarFloat operator-(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a - b; }); }
+    friend ScalarFloat operator*(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a * b; }); }
+    friend ScalarFloat operator/(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a / b; }); }
+    friend ScalarFloat min(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a < b ? a : b; }); }
+    friend ScalarFloat max(const ScalarFloat& lhs, const ScalarFloat& rhs) { return apply(lhs, rhs, [](float a, float b) { return a > b ? a : b; }); }
+    friend ScalarFloat abs(const ScalarFloat& value) { return apply(value, value, [](float a, float) { return std::abs(a); }); }
+    friend uint32_t less(const ScalarFloat& lhs, const ScalarFloat& rhs) { return compare(lhs, rhs, [](float a, float b) { return a < b; }); }
+    friend uint32_t lessEqual(const ScalarFloat& lhs, const ScalarFloat& rhs) { return compare(lhs, rhs, [](float a, float b) { return a <= b; }); }
+    friend uint32_t greater(const ScalarFloat& lhs, const ScalarFloat& rhs) { return compare(lhs, rhs, [](float a, float b) { return a > b; }); }
+    friend uint32_t greaterEqual(const ScalarFloat& lhs, const ScalarFloat& rhs) { return compare(lhs, rhs, [](float a, float b) { return a >= b; }); }
+};
+
+#ifdef WIDE_BVH_SSE
+struct SSEFloat {
+    static constexpr size_t width = 4;
+    __m128 value;
+
+    static SSEFloat broadcast(float value) { return { _mm_set1_ps(value) }; }
+    static SSEFloat load(const float* pValues) { return { _mm_loadu_ps(pValues) }; }
+    void store(float* pValues) const { _mm_storeu_ps(pValues, value); }
+
+    friend SSEFloat operator+(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_add_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat operator-(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_sub_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat operator*(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_mul_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat operator/(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_div_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat min(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_min_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat max(const SSEFloat& lhs, const SSEFloat& rhs) { return { _mm_max_ps(lhs.value, rhs.value) }; }
+    friend SSEFloat abs(const SSEFloat& value) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), value.value) }; }
+    friend uint32_t less(const SSEFloat& lhs, const SSEFloat& rhs) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(lhs.value, rhs.value))); }
+    friend uint32_t lessEqual(const SSEFloat& lhs, const SSEFloat& rhs) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(lhs.value, rhs.value))); }
+    friend uint32_t greater(const SSEFloat& lhs, const SSEFloat& rhs) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(lhs.value, rhs.value))); }
+    friend uint32_t greaterEqual(const SSEFloat& lhs, const SSEFloat& rhs) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(lhs.value, rhs.value))); }
+};
+#endif
+
+#ifdef WIDE_BVH_AVX2
+bool cpuSupportsAVX2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return true;
+#endif
+}
+#endif
+
+// SIMD type that WideBVHKernel::SIMD uses for the given number of lanes, apart from the AVX2 kernel (see traverseRaySIMD()).
+template <size_t Width>
+struct SIMDFloatType {
+    using type = ScalarFloat<Width>;
+};
+#ifdef WIDE_BVH_SSE
+template <>
+struct SIMDFloatType<4> {
+    using type = SSEFloat;
+};
+#endif
+
+#include "wide_bvh_kernels.h"
+
+#ifdef WIDE_BVH_AVX2
+// The single ray kernels once more, with AVXFloat and everything else that they define compiled for AVX2. The standard
+// library and glm functions that they call are defined outside of this region and keep the baseline instruction set,
+// so the linker cannot pick an AVX2 copy of them for the rest of the program.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(WIDE_BVH_AVX2_TARGET_REGION)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2 {
+
+// The operators are free functions rather than hidden friends, because GCC does not apply the target pragma to friends
+// that are defined inside the class.
+struct AVXFloat {
+    static constexpr size_t width = 8;
+    __m256 value;
+
+    static AVXFloat broadcast(float value) { return { _mm256_set1_ps(value) }; }
+    static AVXFloat load(const float* pValues) { return { _mm256_loadu_ps(pValues) }; }
+    void store(float* pValues) const { _mm256_storeu_ps(pValues, value); }
+};
+
+AVXFloat operator+(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_add_ps(lhs.value, rhs.value) }; }
+AVXFloat operator-(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_sub_ps(lhs.value, rhs.value) }; }
+AVXFloat operator*(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_mul_ps(lhs.value, rhs.value) }; }
+AVXFloat operator/(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_div_ps(lhs.value, rhs.value) }; }
+AVXFloat min(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_min_ps(lhs.value, rhs.value) }; }
+AVXFloat max(const AVXFloat& lhs, const AVXFloat& rhs) { return { _mm256_max_ps(lhs.value, rhs.value) }; }
+AVXFloat abs(const AVXFloat& value) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value.value) }; }
+uint32_t less(const AVXFloat& lhs, const AVXFloat& rhs) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(lhs.value, rhs.value, _CMP_LT_OQ))); }
+uint32_t lessEqual(const AVXFloat& lhs, const AVXFloat& rhs) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(lhs.value, rhs.value, _CMP_LE_OQ))); }
+uint32_t greater(const AVXFloat& lhs, const AVXFloat& rhs) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(lhs.value, rhs.value, _CMP_GT_OQ))); }
+uint32_t greaterEqual(const AVXFloat& lhs, const AVXFloat& rhs) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(lhs.value, rhs.value, _CMP_GE_OQ))); }
+
+#include "wide_bvh_kernels.h"
+
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(WIDE_BVH_AVX2_TARGET_REGION)
+#pragma GCC pop_options
+#endif
+#endif
+
+// WideBVHKernel::SIMD for a single ray: the AVX2 kernel for 8 lanes if the CPU supports it, SIMDFloatType otherwise.
+template <bool AnyHit, uint32_t Width>
+bool traverseRaySIMD(std::span<const WideBVHNode<Width>> nodes, std::span<const TriangleBlock<Width>> blocks, Ray& ray, float tMin, BVHHit& hit)
+{
+#ifdef WIDE_BVH_AVX2
+    if constexpr (Width == 8) {
+        if (cpuSupportsAVX2())
+            return avx2::traverseRay<avx2::AVXFloat, AnyHit, Width>(nodes, blocks, ray, tMin, hit);
+    }
+#endif
+    return traverseRay<typename SIMDFloatType<Width>::type, AnyHit, Width>(nodes, blocks, ray, tMin, hit);
+}
+
+// Trace a packet of rays with the rays in the lanes; returns a mask of the rays that hit something.
+template <typename Float, bool AnyHit, uint32_t Width>
+uint32_t traversePacket(std::span<const WideBVHNode<Width>> nodes, std::span<const TriangleBlock<Width>> blocks, RayPacket& packet, float tMin,
+    std::array<std::optional<BVHHit>, RayPacket::size>& hits)
+{
+    static_assert(Float::width == RayPacket::size);
+    constexpr uint32_t allRays = (1u << RayPacket::size) - 1;
+    std::array<std::array<float, RayPacket::size>, 3> origins, directions, invDirections;
+    std::array<float, RayPacket::size> tMax;
+    for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx) {
+        const Ray& ray = packet.rays[rayIdx];
+        const glm::vec3 invDirection = safeInverseDirection(ray.direction);
+        for (glm::length_t axis = 0; axis < 3; ++axis) {
+            const auto axisIdx = static_cast<size_t>(axis);
+            origins[axisIdx][rayIdx] = ray.origin[axis];
+            directions[axisIdx][rayIdx] = ray.direction[axis];
+            invDirections[axisIdx][rayIdx] = invDirection[axis];
+        }
+        tMax[rayIdx] = ray.t;
+    }
+    const Vec3<Float> origin { Float::load(origins[0].data()), Float::load(origins[1].data()), Float::load(origins[2].data()) };
+    const Vec3<Float> direction { Float::load(directions[0].data()), Float::load(directions[1].data()), Float::load(directions[2].data()) };
+    const Vec3<Float> invDirection { Float::load(invDirections[0].data()), Float::load(invDirections[1].data()), Float::load(invDirections[2].data()) };
+    const Float tMinLanes = Float::broadcast(tMin);
+    Float tMaxLanes = Float::load(tMax.data());
+
+    std::array<StackEntry, BVH::maxDepth * Width> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = StackEntry { .index = 0, .numBlocks = 0, .tEnter = tMin };
+    uint32_t hitRays = 0;
+    while (stackSize > 0) {
+        const StackEntry entry = stack[--stackSize];
+        // Rays that found an occluder are done; rays that found a closer intersection than the entry distance (the
+        // minimum over the rays that hit the node) are not.
+        const uint32_t activeRays = AnyHit ? allRays & ~hitRays : allRays;
+        if (entry.tEnter > *std::max_element(std::begin(tMax), std::end(tMax)))
+            continue;
+
+        if (entry.numBlocks > 0) {
+            for (uint32_t blockIdx = entry.index; blockIdx < entry.index + entry.numBlocks; ++blockIdx) {
+                const TriangleBlock<Width>& block = blocks[blockIdx];
+                for (uint32_t lane = 0; lane < Width && block.mesh[lane] != WideBVH<Width>::invalidMesh; ++lane) {
+                    const TriangleTest<Float> test = intersectTriangles(origin, direction,
+                        Vec3<Float> { Float::broadcast(block.v0X[lane]), Float::broadcast(block.v0Y[lane]), Float::broadcast(block.v0Z[lane]) },
+                        Vec3<Float> { Float::broadcast(block.edge1X[lane]), Float::broadcast(block.edge1Y[lane]), Float::broadcast(block.edge1Z[lane]) },
+                        Vec3<Float> { Float::broadcast(block.edge2X[lane]), Float::broadcast(block.edge2Y[lane]), Float::broadcast(block.edge2Z[lane]) },
+                        tMinLanes, tMaxLanes);
+                    const uint32_t mask = test.mask & activeRays;
+                    if (mask == 0)
+                        continue;
+                    if constexpr (AnyHit) {
+                        hitRays |= mask;
+                        if (hitRays == allRays)
+                            return hitRays;
+                        continue;
+                    }
+
+                    std::array<float, RayPacket::size> t, u, v;
+                    test.t.store(t.data());
+                    test.u.store(u.data());
+                    test.v.store(v.data());
+                    for (uint32_t rayMask = mask; rayMask != 0; rayMask &= rayMask - 1) {
+                        const auto rayIdx = static_cast<size_t>(std::countr_zero(rayMask));
+                        tMax[rayIdx] = t[rayIdx];
+                        hits[rayIdx] = BVHHit { .mesh = block.mesh[lane], .triangle = block.triangle[lane], .barycentric = glm::vec2(u[rayIdx], v[rayIdx]) };
+                    }
+                    hitRays |= mask;
+                    tMaxLanes = Float::load(tMax.data());
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode<Width>& node = nodes[entry.index];
+        const size_t first = stackSize;
+        for (uint32_t child = 0; child < Width && node.children[child] != emptyChild; ++child) {
+            const auto slab = [&](size_t axis, float lower, float upper) {
+                const Float t0 = (Float::broadcast(lower) - origin[axis]) * invDirection[axis];
+                const Float t1 = (Float::broadcast(upper) - origin[axis]) * invDirection[axis];
+                return std::pair { min(t0, t1), max(t0, t1) };
+            };
+            const auto [tEnterX, tExitX] = slab(0, node.lowerX[child], node.upperX[child]);
+            const auto [tEnterY, tExitY] = slab(1, node.lowerY[child], node.upperY[child]);
+            const auto [tEnterZ, tExitZ] = slab(2, node.lowerZ[child], node.upperZ[child]);
+            const Float tEnter = max(max(tEnterX, tEnterY), max(tEnterZ, tMinLanes));
+            const Float tExit = min(min(min(tExitX, tExitY), tExitZ) * Float::broadcast(BVH::robustExitScale), tMaxLanes);
+            const uint32_t mask = lessEqual(tEnter, tExit) & activeRays;
+            if (mask == 0)
+                continue;
+
+            std::array<float, RayPacket::size> tEnters;
+            tEnter.store(tEnters.data());
+            float nearest = std::numeric_limits<float>::max();
+            for (uint32_t rayMask = mask; rayMask != 0; rayMask &= rayMask - 1)
+                nearest = std::min(nearest, tEnters[static_cast<size_t>(std::countr_zero(rayMask))]);
+            pushSorted(stack, stackSize, first, StackEntry { .index = node.children[child], .numBlocks = node.numBlocks[child], .tEnter = nearest });
+        }
+    }
+
+    if constexpr (!AnyHit) {
+        for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx)
+            packet.rays[rayIdx].t = tMax[rayIdx];
+    }
+    return hitRays;
+}
+
+}
+
+template <uint32_t Width>
+WideBVH<Width>::WideBVH(const BVH& bvh)
+{
+    const std::span<const BVHNode> nodes = bvh.nodes();
+    if (nodes.empty())
+        return;
+
+    // The triangles of every subtree are contiguous because the leaves are stored in depth-first order. Children are
+    // stored after their parent, so iterating backwards visits them first.
+    std::vector<std::pair<uint32_t, uint32_t>> triangleRanges(nodes.size()); // First triangle and number of triangles.
+    for (size_t nodeIdx = nodes.size(); nodeIdx-- > 0;) {
+        const BVHNode& node = nodes[nodeIdx];
+        if (node.isLeaf()) {
+            triangleRanges[nodeIdx] = { node.offset, node.numTriangles };
+        } else {
+            const auto& [leftFirst, leftCount] = triangleRanges[nodeIdx + 1];
+            triangleRanges[nodeIdx] = { leftFirst, leftCount + triangleRanges[node.offset].second };
+        }
+    }
+    collapse(bvh, 0, triangleRanges);
+}
+
+template <uint32_t Width>
+uint32_t WideBVH<Width>::collapse(const BVH& bvh, uint32_t binaryNodeIdx, std::span<const std::pair<uint32_t, uint32_t>> triangleRanges)
+{
+    const std::span<const BVHNode> binaryNodes = bvh.nodes();
+    // Subtrees that fit in a single triangle block become leaves.
+    const auto isLeaf = [&](uint32_t nodeIdx) { return binaryNodes[nodeIdx].isLeaf() || triangleRanges[nodeIdx].second <= Width; };
+    const auto area = [&](uint32_t nodeIdx) {
+        const glm::vec3 extent = binaryNodes[nodeIdx].upper - binaryNodes[nodeIdx].lower;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    };
+
+    // Replace the interior child with the largest surface area by its children until the node is full.
+    std::array<uint32_t, Width> children;
+    uint32_t numChildren = 0;
+    if (isLeaf(binaryNodeIdx)) {
+        children[numChildren++] = binaryNodeIdx;
+    } else {
+        children[numChildren++] = binaryNodeIdx + 1;
+        children[numChildren++] = binaryNodes[binaryNodeIdx].offset;
+        while (numChildren < Width) {
+            std::optional<uint32_t> largestChild;
+            for (uint32_t child = 0; child < numChildren; ++child) {
+                if (!isLeaf(children[child]) && (!largestChild || area(children[child]) > area(children[*largestChild])))
+                    largestChild = child;
+            }
+            if (!largestChild)
+                break;
+            const uint32_t nodeIdx = children[*largestChild];
+            children[*largestChild] = nodeIdx + 1;
+            children[numChildren++] = binaryNodes[nodeIdx].offset;
+        }
+    }
+
+    const uint32_t wideNodeIdx = static_cast<uint32_t>(m_nodes.size());
+    WideBVHNode<Width>& wideNode = m_nodes.emplace_back();
+    wideNode.lowerX.fill(std::numeric_limits<float>::infinity());
+    wideNode.lowerY.fill(std::numeric_limits<float>::infinity());
+    wideNode.lowerZ.fill(std::numeric_limits<float>::infinity());
+    wideNode.upperX.fill(-std::numeric_limits<float>::infinity());
+    wideNode.upperY.fill(-std::numeric_limits<float>::infinity());
+    wideNode.upperZ.fill(-std::numeric_limits<float>::infinity());
+    wideNode.children.fill(emptyChild);
+    wideNode.numBlocks.fill(0);
+    for (uint32_t child = 0; child < numChildren; ++child) {
+        const BVHNode& binaryNode = binaryNodes[children[child]];
+        m_nodes[wideNodeIdx].lowerX[child] = binaryNode.lower.x;
+        m_nodes[wideNodeIdx].lowerY[child] = binaryNode.lower.y;
+        m_nodes[wideNodeIdx].lowerZ[child] = binaryNode.lower.z;
+        m_nodes[wideNodeIdx].upperX[child] = binaryNode.upper.x;
+        m_nodes[wideNodeIdx].upperY[child] = binaryNode.upper.y;
+        m_nodes[wideNodeIdx].upperZ[child] = binaryNode.upper.z;
+        if (!isLeaf(children[child])) {
+            // Recursion appends to m_nodes, so the node is looked up again afterwards.
+            const uint32_t childNodeIdx = collapse(bvh, children[child], triangleRanges);
+            m_nodes[wideNodeIdx].children[child] = childNodeIdx;
+            continue;
+        }
+
+        const auto [firstTriangle, numTriangles] = triangleRanges[children[child]];
+        m_nodes[wideNodeIdx].children[child] = static_cast<uint32_t>(m_blocks.size());
+        m_nodes[wideNodeIdx].numBlocks[child] = (numTriangles + Width - 1) / Width;
+        for (uint32_t i = 0; i < numTriangles; i += Width) {
+            TriangleBlock<Width>& block = m_blocks.emplace_back();
+            for (uint32_t lane = 0; lane < Width; ++lane) {
+                // Unused lanes get a degenerate triangle, which the intersection test rejects.
+                BVHTriangle triangle { .v0 = glm::vec3(0.0f), .v1 = glm::vec3(0.0f), .v2 = glm::vec3(0.0f), .mesh = invalidMesh, .triangle = 0 };
+                if (i + lane < numTriangles)
+                    triangle = bvh.triangles()[firstTriangle + i + lane];
+                const glm::vec3 edge1 = triangle.v1 - triangle.v0;
+                const glm::vec3 edge2 = triangle.v2 - triangle.v0;
+                block.v0X[lane] = triangle.v0.x;
+                block.v0Y[lane] = triangle.v0.y;
+                block.v0Z[lane] = triangle.v0.z;
+                block.edge1X[lane] = edge1.x;
+                block.edge1Y[lane] = edge1.y;
+                block.edge1Z[lane] = edge1.z;
+                block.edge2X[lane] = edge2.x;
+                block.edge2Y[lane] = edge2.y;
+                block.edge2Z[lane] = edge2.z;
+                block.mesh[lane] = triangle.mesh;
+                block.triangle[lane] = triangle.triangle;
+            }
+        }
+    }
+    return wideNodeIdx;
+}
+
+template <uint32_t Width>
+std::optional<BVHHit> WideBVH<Width>::intersect(Ray& ray, float tMin, WideBVHKernel kernel) const
+{
+    if (m_nodes.empty())
+        return std::nullopt;
+
+    BVHHit hit;
+    const bool found = kernel == WideBVHKernel::SIMD
+        ? traverseRaySIMD<false, Width>(m_nodes, m_blocks, ray, tMin, hit)
+        : traverseRay<ScalarFloat<Width>, false, Width>(m_nodes, m_blocks, ray, tMin, hit);
+    if (found)
+        return hit;
+    return std::nullopt;
+}
+
+template <uint32_t Width>
+bool WideBVH<Width>::isOccluded(const Ray& ray, float tMin, WideBVHKernel kernel) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    Ray shadowRay = ray;
+    BVHHit hit;
+    return kernel == WideBVHKernel::SIMD
+        ? traverseRaySIMD<true, Width>(m_nodes, m_blocks, shadowRay, tMin, hit)
+        : traverseRay<ScalarFloat<Width>, true, Width>(m_nodes, m_blocks, shadowRay, tMin, hit);
+}
+
+template <uint32_t Width>
+void WideBVH<Width>::intersect(RayPacket& packet, std::array<std::optional<BVHHit>, RayPacket::size>& hits, float tMin, WideBVHKernel kernel) const
+{
+    hits.fill(std::nullopt);
+    if (m_nodes.empty())
+        return;
+
+    if (kernel == WideBVHKernel::SIMD)
+        traversePacket<typename SIMDFloatType<RayPacket::size>::type, false, Width>(m_nodes, m_blocks, packet, tMin, hits);
+    else
+        traversePacket<ScalarFloat<RayPacket::size>, false, Width>(m_nodes, m_blocks, packet, tMin, hits);
+}
+
+template <uint32_t Width>
+std::array<bool, RayPacket::size> WideBVH<Width>::isOccluded(const RayPacket& packet, float tMin, WideBVHKernel kernel) const
+{
+    std::array<bool, RayPacket::size> occluded {};
+    if (m_nodes.empty())
+        return occluded;
+
+    RayPacket shadowPacket = packet;
+    std::array<std::optional<BVHHit>, RayPacket::size> hits;
+    const uint32_t mask = kernel == WideBVHKernel::SIMD
+        ? traversePacket<typename SIMDFloatType<RayPacket::size>::type, true, Width>(m_nodes, m_blocks, shadowPacket, tMin, hits)
+        : traversePacket<ScalarFloat<RayPacket::size>, true, Width>(m_nodes, m_blocks, shadowPacket, tMin, hits);
+    for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx)
+        occluded[rayIdx] = (mask >> rayIdx) & 1;
+    return occluded;
+}
+
+template <uint32_t Width>
+std::span<const WideBVHNode<Width>> WideBVH<Width>::nodes() const
+{
+    return m_nodes;
+}
+
+template <uint32_t Width>
+std::span<const TriangleBlock<Width>> WideBVH<Width>::blocks() const
+{
+    return m_blocks;
+}
+
+template <uint32_t Width>
+bool WideBVH<Width>::empty() const
+{
+    return m_nodes.empty();
+}
+
+template <uint32_t Width>
+bool WideBVH<Width>::hasSIMDKernel()
+{
+#ifdef WIDE_BVH_AVX2
+    if constexpr (Width == 8)
+        return cpuSupportsAVX2();
+#endif
+    return !std::is_same_v<typename SIMDFloatType<Width>::type, ScalarFloat<Width>>;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
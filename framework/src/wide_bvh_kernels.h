@@ -0,0 +1,149 @@
+// The single ray kernels of the wide BVH, written against the SIMD wrapper types of wide_bvh.cpp. This file is included
+// twice by wide_bvh.cpp (once in a region that is compiled for AVX2), so it deliberately has no include guard and
+// relies on the includes of wide_bvh.cpp.
+
+template <typename Float>
+using Vec3 = std::array<Float, 3>;
+
+template <typename Float>
+struct TriangleTest {
+    Float t, u, v;
+    uint32_t mask; // Lanes with an intersection in (tMin, tMax).
+};
+
+// Möller-Trumbore ray/triangle intersection with the operations of intersectTriangle() in bvh.cpp in the same order, such
+// that the lanes compute bit for bit the same distances and barycentric coordinates as the binary BVH. Either the rays or
+// the triangles may differ per lane.
+template <typename Float>
+TriangleTest<Float> intersectTriangles(const Vec3<Float>& origin, const Vec3<Float>& direction, const Vec3<Float>& v0, const Vec3<Float>& edge1,
+    const Vec3<Float>& edge2, const Float& tMin, const Float& tMax)
+{
+    const Vec3<Float> p {
+        direction[1] * edge2[2] - edge2[1] * direction[2],
+        direction[2] * edge2[0] - edge2[2] * direction[0],
+        direction[0] * edge2[1] - edge2[0] * direction[1]
+    };
+    const Float determinant = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+    const Float invDeterminant = Float::broadcast(1.0f) / determinant;
+    const Vec3<Float> s { origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2] };
+    const Float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDeterminant;
+    const Vec3<Float> q {
+        s[1] * edge1[2] - edge1[1] * s[2],
+        s[2] * edge1[0] - edge1[2] * s[0],
+        s[0] * edge1[1] - edge1[0] * s[1]
+    };
+    const Float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invDeterminant;
+    const Float t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * invDeterminant;
+
+    const Float zero = Float::broadcast(0.0f);
+    const Float one = Float::broadcast(1.0f);
+    const uint32_t mask = greaterEqual(abs(determinant), Float::broadcast(1e-12f)) & greaterEqual(u, zero) & lessEqual(u, one)
+        & greaterEqual(v, zero) & lessEqual(u + v, one) & greater(t, tMin) & less(t, tMax);
+    return { t, u, v, mask };
+}
+
+// Same as safeInverseDirection() in bvh.cpp.
+glm::vec3 safeInverseDirection(const glm::vec3& direction)
+{
+    constexpr float minComponent = 1e-20f;
+    glm::vec3 result;
+    for (int axis = 0; axis < 3; ++axis)
+        result[axis] = 1.0f / (std::abs(direction[axis]) < minComponent ? std::copysign(minComponent, direction[axis]) : direction[axis]);
+    return result;
+}
+
+struct StackEntry {
+    uint32_t index; // Node, or first triangle block of a leaf.
+    uint32_t numBlocks; // Zero for nodes.
+    float tEnter;
+};
+
+// Insert the entry above the entries at [first, stackSize) that are nearer, such that the stack is popped near to far.
+template <size_t StackSize>
+void pushSorted(std::array<StackEntry, StackSize>& stack, size_t& stackSize, size_t first, const StackEntry& entry)
+{
+    size_t i = stackSize++;
+    for (; i > first && stack[i - 1].tEnter < entry.tEnter; --i)
+        stack[i] = stack[i - 1];
+    stack[i] = entry;
+}
+
+template <uint32_t Width, typename Float>
+Vec3<Float> loadBlockVector(const std::array<float, Width>& x, const std::array<float, Width>& y, const std::array<float, Width>& z)
+{
+    return { Float::load(x.data()), Float::load(y.data()), Float::load(z.data()) };
+}
+
+// Trace a single ray with the children of a node and the triangles of a block in the lanes.
+template <typename Float, bool AnyHit, uint32_t Width>
+bool traverseRay(std::span<const WideBVHNode<Width>> nodes, std::span<const TriangleBlock<Width>> blocks, Ray& ray, float tMin, BVHHit& hit)
+{
+    static_assert(Float::width == Width);
+    const glm::vec3 invDirection = safeInverseDirection(ray.direction);
+    const Vec3<Float> origin { Float::broadcast(ray.origin.x), Float::broadcast(ray.origin.y), Float::broadcast(ray.origin.z) };
+    const Vec3<Float> direction { Float::broadcast(ray.direction.x), Float::broadcast(ray.direction.y), Float::broadcast(ray.direction.z) };
+    const Vec3<Float> invDirectionLanes { Float::broadcast(invDirection.x), Float::broadcast(invDirection.y), Float::broadcast(invDirection.z) };
+    const Float tMinLanes = Float::broadcast(tMin);
+    // The ray enters a box through the planes of the lower corner on axes with a positive direction and through the
+    // planes of the upper corner otherwise. This also makes the inverted bounds of empty child slots miss.
+    const glm::bvec3 negative = glm::lessThan(invDirection, glm::vec3(0.0f));
+
+    std::array<StackEntry, BVH::maxDepth * Width> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = StackEntry { .index = 0, .numBlocks = 0, .tEnter = tMin };
+    bool found = false;
+    while (stackSize > 0) {
+        const StackEntry entry = stack[--stackSize];
+        if (entry.tEnter > ray.t)
+            continue;
+
+        if (entry.numBlocks > 0) {
+            for (uint32_t blockIdx = entry.index; blockIdx < entry.index + entry.numBlocks; ++blockIdx) {
+                const TriangleBlock<Width>& block = blocks[blockIdx];
+                const TriangleTest<Float> test = intersectTriangles(origin, direction, loadBlockVector<Width, Float>(block.v0X, block.v0Y, block.v0Z),
+                    loadBlockVector<Width, Float>(block.edge1X, block.edge1Y, block.edge1Z), loadBlockVector<Width, Float>(block.edge2X, block.edge2Y, block.edge2Z),
+                    tMinLanes, Float::broadcast(ray.t));
+                if (test.mask == 0)
+                    continue;
+                if constexpr (AnyHit)
+                    return true;
+
+                std::array<float, Width> t, u, v;
+                test.t.store(t.data());
+                test.u.store(u.data());
+                test.v.store(v.data());
+                for (uint32_t mask = test.mask; mask != 0; mask &= mask - 1) {
+                    const auto lane = static_cast<size_t>(std::countr_zero(mask));
+                    if (t[lane] < ray.t) {
+                        ray.t = t[lane];
+                        hit = BVHHit { .mesh = block.mesh[lane], .triangle = block.triangle[lane], .barycentric = glm::vec2(u[lane], v[lane]) };
+                        found = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode<Width>& node = nodes[entry.index];
+        const Float tEnterX = (Float::load(negative.x ? node.upperX.data() : node.lowerX.data()) - origin[0]) * invDirectionLanes[0];
+        const Float tEnterY = (Float::load(negative.y ? node.upperY.data() : node.lowerY.data()) - origin[1]) * invDirectionLanes[1];
+        const Float tEnterZ = (Float::load(negative.z ? node.upperZ.data() : node.lowerZ.data()) - origin[2]) * invDirectionLanes[2];
+        const Float tExitX = (Float::load(negative.x ? node.lowerX.data() : node.upperX.data()) - origin[0]) * invDirectionLanes[0];
+        const Float tExitY = (Float::load(negative.y ? node.lowerY.data() : node.upperY.data()) - origin[1]) * invDirectionLanes[1];
+        const Float tExitZ = (Float::load(negative.z ? node.lowerZ.data() : node.upperZ.data()) - origin[2]) * invDirectionLanes[2];
+        const Float tEnter = max(max(tEnterX, tEnterY), max(tEnterZ, tMinLanes));
+        const Float tExit = min(min(min(tExitX, tExitY), tExitZ) * Float::broadcast(BVH::robustExitScale), Float::broadcast(ray.t));
+        const uint32_t hitMask = lessEqual(tEnter, tExit);
+        if (hitMask == 0)
+            continue;
+
+        std::array<float, Width> tEnters;
+        tEnter.store(tEnters.data());
+        const size_t first = stackSize;
+        for (uint32_t mask = hitMask; mask != 0; mask &= mask - 1) {
+            const auto lane = static_cast<size_t>(std::countr_zero(mask));
+            pushSorted(stack, stackSize, first, StackEntry { .index = node.children[lane], .numBlocks = node.numBlocks[lane], .tEnter = tEnters[lane] });
+        }
+    }
+    return found;
+}
@@ -0,0 +1,10 @@
+#version 410
+
+in vec3 markerColor;
+
+layout(location = 0) out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(markerColor, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 410
+
+layout(location = 0) in vec3 position;
+// Per instance; must match the MarkerInstance defined in src/application.cpp.
+layout(location = 1) in vec4 instancePositionScale;
+layout(location = 2) in vec3 instanceColor;
+
+uniform mat4 viewProjectionMatrix;
+
+out vec3 markerColor;
+
+void main()
+{
+    gl_Position = viewProjectionMatrix * vec4(instancePositionScale.xyz + instancePositionScale.w * position, 1.0);
+    markerColor = instanceColor;
+}
@@ -1,41 +1,141 @@
 #version 410
 
-layout(std140) uniform Material // Must match the GPUMaterial defined in src/mesh.h
+layout(std140) uniform FrameData // Must match the FrameData defined in src/application.cpp
 {
-    vec3 kd;
-	vec3 ks;
-	float shininess;
-	float transparency;
+    mat4 viewProjectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+    int shadingMode;
+    vec3 customDiffuseColor;
+    float specularStrength;
+    vec3 specularColor;
+    float specularShininess;
+    uvec3 clusterGridSize;
+    int numLights;
+    vec2 clusterTileSize;
+    float clusterFirstSliceDepth;
+    float clusterDepthScale;
+    float clusterDepthBias;
+    bool useClusteredLighting;
 };
 
+// Four RGBA32F texels per light: (position, range), (color, spotSoftness), (direction, spotCosCutoff) and
+// (firstShadowView, unused). The direction of point lights is zero. Must match the GPULight defined in src/application.cpp.
+uniform samplerBuffer lightBuffer;
+// Per cluster the offset into lightIndexBuffer and the number of lights (see LightClusterGrid in src/light_clustering.h).
+uniform usamplerBuffer clusterBuffer;
+uniform usamplerBuffer lightIndexBuffer;
+// Shadow maps of all lights packed into one depth texture, and per shadow view five RGBA32F texels: the four columns
+// of the world to atlas matrix and the view's rectangle in the atlas (see ShadowView in src/shadow_atlas.h).
+uniform sampler2DShadow shadowAtlas;
+uniform samplerBuffer shadowViewBuffer;
+
+// Two RGBA32F texels per material: (kd, shininess) and (ks, transparency). Must match the GPUMaterial defined in
+// src/material_table.h; materialIndex selects the material of the draw.
+uniform samplerBuffer materialBuffer;
+uniform int materialIndex;
+
 uniform sampler2D colorMap;
 uniform bool hasTexCoords;
 uniform bool useMaterial;
-uniform int shadingMode;
-uniform vec3 customDiffuseColor;
-uniform vec3 viewPosition;
-uniform vec3 specularColor;
-uniform float specularStrength;
-uniform float specularShininess;
-
-const int MAX_LIGHTS = 8;
-uniform int numLights;
-uniform vec3 lightPositions[MAX_LIGHTS];
-uniform vec3 lightColors[MAX_LIGHTS];
-uniform int lightIsSpotlight[MAX_LIGHTS];
-uniform vec3 lightDirections[MAX_LIGHTS];
-uniform float lightSpotCosCutoff[MAX_LIGHTS];
-uniform float lightSpotSoftness[MAX_LIGHTS];
 
 in vec3 fragPosition;
 in vec3 fragNormal;
 in vec2 fragTexCoord;
+in float fragViewDepth;
 
 layout(location = 0) out vec4 fragColor;
 
+// Fraction of the light that reaches the fragment, filtered with 3x3 hardware (2x2 bilinear) PCF taps.
+float shadowFactor(int firstShadowView, bool isSpotlight, vec3 lightPosition)
+{
+    int view = firstShadowView;
+    if (!isSpotlight) {
+        // Select the cube face in the order +X, -X, +Y, -Y, +Z, -Z.
+        vec3 toFragment = fragPosition - lightPosition;
+        vec3 absToFragment = abs(toFragment);
+        if (absToFragment.x >= absToFragment.y && absToFragment.x >= absToFragment.z)
+            view += toFragment.x > 0.0 ? 0 : 1;
+        else if (absToFragment.y >= absToFragment.z)
+            view += toFragment.y > 0.0 ? 2 : 3;
+        else
+            view += toFragment.z > 0.0 ? 4 : 5;
+    }
+
+    mat4 atlasMatrix = mat4(
+        texelFetch(shadowViewBuffer, 5 * view + 0),
+        texelFetch(shadowViewBuffer, 5 * view + 1),
+        texelFetch(shadowViewBuffer, 5 * view + 2),
+        texelFetch(shadowViewBuffer, 5 * view + 3));
+    vec4 atlasRect = texelFetch(shadowViewBuffer, 5 * view + 4);
+    vec4 shadowPosition = atlasMatrix * vec4(fragPosition, 1.0);
+    shadowPosition.xyz /= shadowPosition.w;
+    if (shadowPosition.z >= 1.0)
+        return 1.0;
+
+    // Keep the taps inside the view's tile so that neighbouring shadow maps do not bleed in.
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 minCoord = atlasRect.xy + texelSize;
+    vec2 maxCoord = atlasRect.zw - texelSize;
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec2 coord = clamp(shadowPosition.xy + vec2(x, y) * texelSize, minCoord, maxCoord);
+            lit += texture(shadowAtlas, vec3(coord, shadowPosition.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+// The range window is only applied when the lights come from the clusters; otherwise lights reach infinitely far.
+void accumulateLight(int lightIndex, bool applyRange, vec3 baseColor, vec3 normal, vec3 viewDir, float exponent, inout vec3 colorAccum, inout vec3 specAccum)
+{
+    vec4 positionRange = texelFetch(lightBuffer, 4 * lightIndex + 0);
+    vec4 colorSoftness = texelFetch(lightBuffer, 4 * lightIndex + 1);
+    vec4 directionCutoff = texelFetch(lightBuffer, 4 * lightIndex + 2);
+    int firstShadowView = int(texelFetch(lightBuffer, 4 * lightIndex + 3).x);
+
+    vec3 toLight = positionRange.xyz - fragPosition;
+    float lightDistance = length(toLight);
+    float attenuation = 1.0;
+    if (applyRange) {
+        // Smooth window that reaches zero at the light's range, so that lights outside their clusters contribute nothing.
+        attenuation = clamp(1.0 - pow(lightDistance / positionRange.w, 4.0), 0.0, 1.0);
+        attenuation *= attenuation;
+        if (attenuation <= 0.0)
+            return;
+    }
+
+    vec3 lightDir = toLight / lightDistance;
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    bool isSpotlight = directionCutoff.xyz != vec3(0);
+    float spotFactor = 1.0;
+    if (isSpotlight) {
+        float c = dot(-lightDir, directionCutoff.xyz);
+        spotFactor = smoothstep(directionCutoff.w, directionCutoff.w + colorSoftness.w, c);
+    }
+    if (firstShadowView >= 0 && diff > 0.0 && spotFactor > 0.0)
+        attenuation *= shadowFactor(firstShadowView, isSpotlight, positionRange.xyz);
+
+    vec3 lightContribution = colorSoftness.rgb * (spotFactor * attenuation);
+    colorAccum += baseColor * diff * lightContribution;
+
+    if (shadingMode == 2 && diff > 0.0) {
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = max(dot(reflectDir, viewDir), 0.0);
+        spec = pow(spec, exponent);
+        specAccum += lightContribution * spec;
+    }
+}
+
 void main()
 {
     vec3 normal = normalize(fragNormal);
+    vec4 kdShininess = texelFetch(materialBuffer, 2 * materialIndex + 0);
+    vec3 kd = kdShininess.rgb;
+    float shininess = kdShininess.a;
+    vec3 ks = texelFetch(materialBuffer, 2 * materialIndex + 1).rgb;
 
     vec3 baseColor;
     if (hasTexCoords)
@@ -55,26 +155,21 @@ void main()
     vec3 colorAccum = vec3(0);
     vec3 specAccum = vec3(0);
     float exponent = specularShininess > 0.0 ? specularShininess : shininess;
-    int lightCount = min(numLights, MAX_LIGHTS);
-    for (int i = 0; i < lightCount; ++i) {
-        vec3 lightDir = normalize(lightPositions[i] - fragPosition);
-        float diff = max(dot(normal, lightDir), 0.0);
-
-        float spotFactor = 1.0;
-        if (lightIsSpotlight[i] != 0) {
-            float c = dot(-lightDir, normalize(lightDirections[i]));
-            spotFactor = smoothstep(lightSpotCosCutoff[i], lightSpotCosCutoff[i] + lightSpotSoftness[i], c);
-        }
-
-        vec3 lightContribution = lightColors[i] * spotFactor;
-        colorAccum += baseColor * diff * lightContribution;
-
-        if (shadingMode == 2 && diff > 0.0) {
-            vec3 reflectDir = reflect(-lightDir, normal);
-            float spec = max(dot(reflectDir, viewDir), 0.0);
-            spec = pow(spec, exponent);
-            specAccum += lightContribution * spec;
+    if (useClusteredLighting) {
+        // Only visit the lights that were assigned to this fragment's cluster on the CPU.
+        uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), clusterGridSize.xy - 1u);
+        uint slice = 0u;
+        if (fragViewDepth >= clusterFirstSliceDepth)
+            slice = uint(clamp(floor(log(fragViewDepth) * clusterDepthScale + clusterDepthBias) + 1.0, 1.0, float(clusterGridSize.z - 1u)));
+        int cluster = int((slice * clusterGridSize.y + tile.y) * clusterGridSize.x + tile.x);
+        uvec2 lightRange = texelFetch(clusterBuffer, cluster).xy;
+        for (uint i = 0u; i < lightRange.y; ++i) {
+            int lightIndex = int(texelFetch(lightIndexBuffer, int(lightRange.x + i)).x);
+            accumulateLight(lightIndex, true, baseColor, normal, viewDir, exponent, colorAccum, specAccum);
         }
+    } else {
+        for (int i = 0; i < numLights; ++i)
+            accumulateLight(i, false, baseColor, normal, viewDir, exponent, colorAccum, specAccum);
     }
 
     vec3 finalColor = colorAccum;
@@ -1,10 +1,31 @@
 #version 410
 
-uniform mat4 mvpMatrix;
+layout(std140) uniform FrameData // Must match the FrameData defined in src/application.cpp
+{
+    mat4 viewProjectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+    int shadingMode;
+    vec3 customDiffuseColor;
+    float specularStrength;
+    vec3 specularColor;
+    float specularShininess;
+    uvec3 clusterGridSize;
+    int numLights;
+    vec2 clusterTileSize;
+    float clusterFirstSliceDepth;
+    float clusterDepthScale;
+    float clusterDepthBias;
+    bool useClusteredLighting;
+};
+
 uniform mat4 modelMatrix;
 // Normals should be transformed differently than positions:
 // https://paroj.github.io/gltut/Illumination/Tut09%20Normal%20Transformation.html
 uniform mat3 normalModelMatrix;
+// Normals are octahedral encoded in two 16 bit integers (see QuantizedVertex in src/mesh.h). The positions of
+// quantized meshes are decoded by the model matrix.
+uniform bool quantizedNormals;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -13,12 +34,25 @@ layout(location = 2) in vec2 texCoord;
 out vec3 fragPosition;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
+out float fragViewDepth;
+
+// Must match decodeOctahedral() in src/mesh.cpp.
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = mvpMatrix * vec4(position, 1);
+    vec3 objectNormal = quantizedNormals ? decodeOctahedral(clamp(normal.xy / 32767.0, -1.0, 1.0)) : normal;
+    vec4 worldPosition = modelMatrix * vec4(position, 1);
+    gl_Position = viewProjectionMatrix * worldPosition;
     
-    fragPosition    = (modelMatrix * vec4(position, 1)).xyz;
-    fragNormal      = normalModelMatrix * normal;
+    fragPosition    = worldPosition.xyz;
+    fragNormal      = normalModelMatrix * objectNormal;
     fragTexCoord    = texCoord;
+    fragViewDepth   = -(viewMatrix * worldPosition).z;
 }
@@ -0,0 +1,72 @@
+#version 410
+
+layout(std140) uniform FrameData // Must match the FrameData defined in src/application.cpp
+{
+    mat4 viewProjectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+    int shadingMode;
+    vec3 customDiffuseColor;
+    float specularStrength;
+    vec3 specularColor;
+    float specularShininess;
+    uvec3 clusterGridSize;
+    int numLights;
+    vec2 clusterTileSize;
+    float clusterFirstSliceDepth;
+    float clusterDepthScale;
+    float clusterDepthBias;
+    bool useClusteredLighting;
+};
+
+// Seconds since the wind farm was created.
+uniform float time;
+// The rotor is positioned at the hub and spins around its local Z axis.
+uniform bool isRotor;
+uniform vec3 hubPosition;
+// Angular speed in radians per second, scaled per instance.
+uniform float rotorSpeed;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+// Per instance; must match the WindmillInstance defined in src/application.cpp.
+layout(location = 3) in vec4 instancePositionYaw;
+layout(location = 4) in vec2 instancePhaseSpeed;
+
+out vec3 fragPosition;
+out vec3 fragNormal;
+out vec2 fragTexCoord;
+out float fragViewDepth;
+
+mat3 rotationY(float angle)
+{
+    float c = cos(angle), s = sin(angle);
+    return mat3(c, 0, -s, 0, 1, 0, s, 0, c);
+}
+
+mat3 rotationZ(float angle)
+{
+    float c = cos(angle), s = sin(angle);
+    return mat3(c, s, 0, -s, c, 0, 0, 0, 1);
+}
+
+void main()
+{
+    // Only rotations and translations, so the normals can be transformed with the same matrix as the positions.
+    mat3 yaw = rotationY(instancePositionYaw.w);
+    vec3 localPosition = position;
+    vec3 localNormal = normal;
+    if (isRotor) {
+        mat3 spin = rotationZ(instancePhaseSpeed.x + instancePhaseSpeed.y * rotorSpeed * time);
+        localPosition = hubPosition + spin * localPosition;
+        localNormal = spin * localNormal;
+    }
+    vec4 worldPosition = vec4(instancePositionYaw.xyz + yaw * localPosition, 1.0);
+    gl_Position = viewProjectionMatrix * worldPosition;
+
+    fragPosition    = worldPosition.xyz;
+    fragNormal      = yaw * localNormal;
+    fragTexCoord    = texCoord;
+    fragViewDepth   = -(viewMatrix * worldPosition).z;
+}
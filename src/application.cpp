@@ -1,6 +1,17 @@
 //#include "Image.h"
+#include "asset_loader.h"
+#include "frustum_culling.h"
+#include "gpu_timer.h"
+#include "light_clustering.h"
 #include "mesh.h"
+#include "path_tracer.h"
+#include "ray_tracer.h"
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "shadow_atlas.h"
 #include "texture.h"
+#include "texture_buffer.h"
+#include "uniform_buffer.h"
 // Always include window first (because it includes glfw, which includes GL which needs to be included AFTER glew).
 // Can't wait for modules to fix this stuff...
 #include <framework/disable_all_warnings.h>
@@ -17,19 +28,30 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/mat4x4.hpp>
 #include <imgui/imgui.h>
 DISABLE_WARNINGS_POP()
+#include <framework/bvh.h>
+#include <framework/image_cache.h>
+#include <framework/mesh_cache.h>
+#include <framework/parallel.h>
 #include <framework/shader.h>
 #include <framework/window.h>
 #include <framework/trackball.h>
 #include <fmt/format.h>
 #include <array>
 #include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <optional>
+#include <random>
+#include <span>
 #include <vector>
 
 namespace {
@@ -45,6 +67,8 @@ struct WindmillParameters {
     float armThickness { 0.12f };
     glm::vec3 structureColor { 0.88f, 0.88f, 0.86f };
     float rotationSpeedDegPerSec { 45.0f };
+
+    bool operator==(const WindmillParameters&) const = default;
 };
 
 struct WindmillMeshes {
@@ -146,54 +170,166 @@ glm::vec3 computeHubPosition(const WindmillParameters& params)
     return glm::vec3(0.0f, towerBaseY + params.towerSize.y + params.hubVerticalOffset, params.hubForwardOffset);
 }
 
-WindmillMeshes buildWindmillMeshes(const WindmillParameters& params)
-{
-    WindmillMeshes result;
-    result.body.vertices.reserve(24 * 4);
-    result.body.triangles.reserve(12 * 4);
-    result.rotor.vertices.reserve(24 * 5);
-    result.rotor.triangles.reserve(12 * 5);
+// The windmill is made of a fixed number of boxes (base and tower for the body; hub and four arms for the rotor). The
+// topology therefore never changes and an edit only has to regenerate the vertices of the boxes that moved or resized.
+struct WindmillBox {
+    glm::vec3 size;
+    glm::mat4 transform;
 
-    const glm::mat4 identity(1.0f);
+    bool operator==(const WindmillBox&) const = default;
+};
+constexpr size_t numVerticesPerBox = 24;
 
-    const Mesh baseMesh = createBoxMesh(params.baseSize);
-    const glm::mat4 baseTransform = glm::translate(identity, glm::vec3(0.0f, params.baseSize.y * 0.5f, 0.0f));
-    appendTransformedMesh(result.body, baseMesh, baseTransform);
+struct WindmillLayout {
+    std::array<WindmillBox, 2> body;
+    std::array<WindmillBox, 5> rotor;
+};
 
-    const Mesh towerMesh = createBoxMesh(params.towerSize);
+WindmillLayout computeWindmillLayout(const WindmillParameters& params)
+{
+    const glm::mat4 identity(1.0f);
+    WindmillLayout layout;
+    layout.body[0] = { params.baseSize, glm::translate(identity, glm::vec3(0.0f, params.baseSize.y * 0.5f, 0.0f)) };
     const float towerBaseY = params.baseSize.y;
-    const glm::mat4 towerTransform = glm::translate(identity, glm::vec3(0.0f, towerBaseY + params.towerSize.y * 0.5f, 0.0f));
-    appendTransformedMesh(result.body, towerMesh, towerTransform);
+    layout.body[1] = { params.towerSize, glm::translate(identity, glm::vec3(0.0f, towerBaseY + params.towerSize.y * 0.5f, 0.0f)) };
 
-    const Mesh hubMesh = createBoxMesh(params.hubSize);
-    appendTransformedMesh(result.rotor, hubMesh, identity);
-
-    const Mesh armMesh = createBoxMesh(glm::vec3(params.armLength, params.armWidth, params.armThickness));
+    layout.rotor[0] = { params.hubSize, identity };
     for (int i = 0; i < 4; ++i) {
         const float angle = glm::radians(90.0f * static_cast<float>(i));
         const glm::mat4 armTransform = glm::rotate(identity, angle, glm::vec3(0.0f, 0.0f, 1.0f))
             * glm::translate(identity, glm::vec3(params.armLength * 0.5f, 0.0f, 0.0f));
-        appendTransformedMesh(result.rotor, armMesh, armTransform);
+        layout.rotor[static_cast<size_t>(i) + 1] = { glm::vec3(params.armLength, params.armWidth, params.armThickness), armTransform };
     }
+    return layout;
+}
 
-    result.body.material.kd = params.structureColor;
-    result.body.material.ks = glm::vec3(0.2f);
-    result.body.material.shininess = 32.0f;
-
-    result.rotor.material.kd = params.structureColor;
-    result.rotor.material.ks = glm::vec3(0.2f);
-    result.rotor.material.shininess = 32.0f;
+Material computeWindmillMaterial(const WindmillParameters& params)
+{
+    Material material;
+    material.kd = params.structureColor;
+    material.ks = glm::vec3(0.2f);
+    material.shininess = 32.0f;
+    return material;
+}
 
+WindmillMeshes buildWindmillMeshes(const WindmillParameters& params)
+{
+    const WindmillLayout layout = computeWindmillLayout(params);
+    WindmillMeshes result;
+    result.body.vertices.reserve(numVerticesPerBox * layout.body.size());
+    result.body.triangles.reserve(12 * layout.body.size());
+    result.rotor.vertices.reserve(numVerticesPerBox * layout.rotor.size());
+    result.rotor.triangles.reserve(12 * layout.rotor.size());
+
+    for (const WindmillBox& box : layout.body)
+        appendTransformedMesh(result.body, createBoxMesh(box.size), box.transform);
+    for (const WindmillBox& box : layout.rotor)
+        appendTransformedMesh(result.rotor, createBoxMesh(box.size), box.transform);
+
+    result.body.material = computeWindmillMaterial(params);
+    result.rotor.material = computeWindmillMaterial(params);
     return result;
 }
 
+// Regenerate the vertices of the boxes that differ from previousBoxes and upload them in place. Returns the number of
+// boxes that were updated.
+template <size_t N>
+size_t updateWindmillBoxes(GPUMesh& mesh, const std::array<WindmillBox, N>& boxes, const std::array<WindmillBox, N>& previousBoxes)
+{
+    size_t numUpdated = 0;
+    Mesh boxMesh;
+    for (size_t i = 0; i < N; ++i) {
+        if (boxes[i] == previousBoxes[i])
+            continue;
+        boxMesh.vertices.clear();
+        appendTransformedMesh(boxMesh, createBoxMesh(boxes[i].size), boxes[i].transform);
+        mesh.updateVertices(i * numVerticesPerBox, boxMesh.vertices);
+        ++numUpdated;
+    }
+    return numUpdated;
+}
+
+// Bounds of the mesh made of the given boxes; the meshes are updated in place so their bounds have to be recomputed.
+template <size_t N>
+MeshBounds computeWindmillBoxesBounds(const std::array<WindmillBox, N>& boxes)
+{
+    Mesh mesh;
+    for (const WindmillBox& box : boxes)
+        appendTransformedMesh(mesh, createBoxMesh(box.size), box.transform);
+    return computeMeshBounds(mesh.vertices);
+}
+
+// Uniform block binding points.
+constexpr GLuint frameDataBinding = 1;
+// Texture units of the light data; unit 0 is used by the color map.
+constexpr GLint lightBufferTextureUnit = 1;
+constexpr GLint clusterBufferTextureUnit = 2;
+constexpr GLint lightIndexBufferTextureUnit = 3;
+constexpr GLint shadowAtlasTextureUnit = 4;
+constexpr GLint shadowViewBufferTextureUnit = 5;
+constexpr GLint materialBufferTextureUnit = 6;
+
+constexpr const char* sceneMeshFile = RESOURCE_ROOT "resources/dragon.obj";
+constexpr const char* sceneTextureFile = RESOURCE_ROOT "resources/checkerboard.png";
+
+// Alignment directives are to comply with std140 alignment requirements (https://www.khronos.org/opengl/wiki/Interface_Block_(GLSL)#Memory_layout)
+// Must match the FrameData block in shader_vert.glsl and shader_frag.glsl.
+struct FrameData {
+    glm::mat4 viewProjectionMatrix;
+    glm::mat4 viewMatrix;
+    alignas(16) glm::vec3 viewPosition;
+    int32_t shadingMode;
+    alignas(16) glm::vec3 customDiffuseColor;
+    float specularStrength;
+    alignas(16) glm::vec3 specularColor;
+    float specularShininess;
+    alignas(16) glm::uvec3 clusterGridSize;
+    int32_t numLights;
+    alignas(8) glm::vec2 clusterTileSize;
+    float clusterFirstSliceDepth;
+    float clusterDepthScale;
+    float clusterDepthBias;
+    int32_t useClusteredLighting;
+};
+static_assert(offsetof(FrameData, specularShininess) == 172 && offsetof(FrameData, useClusteredLighting) == 212, "FrameData does not match the std140 layout");
+
+// Every light is stored as four RGBA32F texels in the light buffer; must match accumulateLight() in shader_frag.glsl.
+struct GPULight {
+    glm::vec3 position;
+    float range;
+    glm::vec3 color;
+    float spotSoftness;
+    glm::vec3 direction; // Zero for point lights.
+    float spotCosCutoff;
+    float firstShadowView; // Index into the shadow view buffer or -1 if the light has no shadow map.
+    glm::vec3 padding;
+};
+static_assert(sizeof(GPULight) == 4 * sizeof(glm::vec4));
+
+// Every shadow view is stored as five RGBA32F texels in the shadow view buffer; must match shadowFactor() in shader_frag.glsl.
+static_assert(sizeof(ShadowView) == 5 * sizeof(glm::vec4));
+
+// Must match the instance attributes in windmill_instanced_vert.glsl.
+struct WindmillInstance {
+    glm::vec3 position;
+    float yaw;
+    float rotorPhase;
+    float rotorSpeedScale;
+};
+
+// Must match the instance attributes in light_marker_instanced_vert.glsl.
+struct MarkerInstance {
+    glm::vec3 position;
+    float scale;
+    glm::vec3 color;
+};
+
 } // namespace
 
 class Application {
 public:
     Application()
         : m_window("Final Project", glm::ivec2(1024, 1024), OpenGLVersion::GL41)
-        , m_texture(RESOURCE_ROOT "resources/checkerboard.png")
     {
         m_window.registerKeyCallback([this](int key, int scancode, int action, int mods) {
             if (action == GLFW_PRESS)
@@ -201,7 +337,15 @@ public:
             else if (action == GLFW_RELEASE)
                 onKeyReleased(key, mods);
         });
-        m_meshes = GPUMesh::loadMeshGPU(RESOURCE_ROOT "resources/dragon.obj");
+        m_window.registerMouseButtonCallback([this](int button, int action, int mods) {
+            if (action == GLFW_PRESS)
+                onMouseClicked(button, mods);
+            else if (action == GLFW_RELEASE)
+                onMouseReleased(button, mods);
+        });
+        // Load the models and textures in the background; they pop in as soon as they are uploaded by update().
+        loadMeshes();
+        m_assetLoader.loadTexture(sceneTextureFile, [this](Texture&& texture) { m_texture = std::move(texture); });
         try {
             ShaderBuilder defaultBuilder;
             defaultBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shader_vert.glsl");
@@ -210,7 +354,7 @@ public:
 
             ShaderBuilder shadowBuilder;
             shadowBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/shadow_vert.glsl");
-            shadowBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "Shaders/shadow_frag.glsl");
+            shadowBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shadow_frag.glsl");
             m_shadowShader = shadowBuilder.build();
 
             ShaderBuilder lightBuilder;
@@ -218,6 +362,16 @@ public:
             lightBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/light_marker_frag.glsl");
             m_lightShader = lightBuilder.build();
 
+            ShaderBuilder markerBuilder;
+            markerBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/light_marker_instanced_vert.glsl");
+            markerBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/light_marker_instanced_frag.glsl");
+            m_markerShader = markerBuilder.build();
+
+            ShaderBuilder windFarmBuilder;
+            windFarmBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/windmill_instanced_vert.glsl");
+            windFarmBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/shader_frag.glsl");
+            m_windFarmShader = windFarmBuilder.build();
+
             // Any new shaders can be added below in similar fashion.
             // ==> Don't forget to reconfigure CMake when you do!
             //     Visual Studio: PROJECT => Generate Cache for ComputerGraphics
@@ -231,6 +385,9 @@ public:
         initializeLightGeometry();
         resetLights();
         initializeLightPath();
+        m_windmillNode = m_sceneGraph.createNode();
+        m_windmillBodyNode = m_sceneGraph.createNode(m_windmillNode);
+        m_windmillRotorNode = m_sceneGraph.createNode(m_windmillNode);
         sanitizeWindmillParams();
         rebuildWindmillMesh();
         m_lastFrameTime = glfwGetTime();
@@ -240,20 +397,46 @@ public:
     {
         if (m_lightVbo != 0)
             glDeleteBuffers(1, &m_lightVbo);
+        if (m_lightInstanceVbo != 0)
+            glDeleteBuffers(1, &m_lightInstanceVbo);
+        if (m_windFarmInstanceVbo != 0)
+            glDeleteBuffers(1, &m_windFarmInstanceVbo);
         if (m_lightVao != 0)
             glDeleteVertexArrays(1, &m_lightVao);
         if (m_lightPathVbo != 0)
             glDeleteBuffers(1, &m_lightPathVbo);
         if (m_lightPathVao != 0)
             glDeleteVertexArrays(1, &m_lightPathVao);
+        if (m_referenceViewFramebuffer != 0)
+            glDeleteFramebuffers(1, &m_referenceViewFramebuffer);
+        if (m_referenceViewTexture != 0)
+            glDeleteTextures(1, &m_referenceViewTexture);
+    }
+
+    // Block until all assets requested by the constructor have been loaded (for headless or benchmark runs).
+    void waitForAssets()
+    {
+        m_assetLoader.waitUntilIdle();
     }
 
+    // Render numWindmills instanced windmills around the main one (also used as a benchmark scene).
+    void enableWindFarm(int numWindmills)
+    {
+        m_windFarmEnabled = true;
+        m_windFarmSize = std::max(numWindmills, 1);
+        m_windFarmDirty = true;
+    }
+
+    // Ray trace the current view on the CPU (see rayTraceImage()) and write it to a bitmap file.
+    void renderReferenceImage(const std::filesystem::path& filePath);
+
     void update()
     {
         while (!m_window.shouldClose()) {
             // This is your game loop
             // Put your real-time logic and rendering in here
             m_window.updateInput();
+            m_assetLoader.update(assetUploadBudget);
 
             const double currentTime = glfwGetTime();
             float deltaTime = static_cast<float>(currentTime - m_lastFrameTime);
@@ -276,6 +459,9 @@ public:
             renderGui();
             if (m_windmillDirty)
                 rebuildWindmillMesh();
+            m_sceneGraph.setRotation(m_windmillRotorNode, glm::angleAxis(m_windmillRotationAngle, glm::vec3(0.0f, 0.0f, 1.0f)));
+            m_sceneGraph.updateWorldMatrices();
+            updateMeshBounds();
 
             // Clear the screen
             glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
@@ -293,47 +479,78 @@ public:
             m_viewMatrix = camera.viewMatrix();
             m_projectionMatrix = camera.projectionMatrix();
 
-            auto drawMeshWithModel = [&](GPUMesh& mesh, const glm::mat4& modelMatrix) {
-                const glm::mat4 localMvp = m_projectionMatrix * m_viewMatrix * modelMatrix;
-                // Normals need the inverse transpose to handle non-uniform scaling correctly.
-                const glm::mat3 localNormal = glm::inverseTranspose(glm::mat3(modelMatrix));
-
-                m_defaultShader.bind();
-                glUniformMatrix4fv(m_defaultShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(localMvp));
-                glUniformMatrix4fv(m_defaultShader.getUniformLocation("modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
-                glUniformMatrix3fv(m_defaultShader.getUniformLocation("normalModelMatrix"), 1, GL_FALSE, glm::value_ptr(localNormal));
-                if (mesh.hasTextureCoords()) {
-                    m_texture.bind(GL_TEXTURE0);
-                    glUniform1i(m_defaultShader.getUniformLocation("colorMap"), 0);
-                    glUniform1i(m_defaultShader.getUniformLocation("hasTexCoords"), GL_TRUE);
-                    glUniform1i(m_defaultShader.getUniformLocation("useMaterial"), GL_FALSE);
-                } else {
-                    glUniform1i(m_defaultShader.getUniformLocation("hasTexCoords"), GL_FALSE);
-                    glUniform1i(m_defaultShader.getUniformLocation("useMaterial"), m_useMaterial);
-                }
-                glUniform1i(m_defaultShader.getUniformLocation("shadingMode"), static_cast<int>(m_shadingModel));
-                glUniform3fv(m_defaultShader.getUniformLocation("customDiffuseColor"), 1, glm::value_ptr(m_customDiffuseColor));
-                glUniform3fv(m_defaultShader.getUniformLocation("viewPosition"), 1, glm::value_ptr(camera.position()));
-                glUniform3fv(m_defaultShader.getUniformLocation("specularColor"), 1, glm::value_ptr(m_specularColor));
-                glUniform1f(m_defaultShader.getUniformLocation("specularStrength"), m_specularStrength);
-                glUniform1f(m_defaultShader.getUniformLocation("specularShininess"), m_specularShininess);
-                uploadLightsToShader();
-                mesh.draw(m_defaultShader);
-            };
+            // The reference view replaces the rasterized image as soon as the path tracer has finished a pass.
+            updateReferenceView(camera);
+            if (m_referenceViewNumSamples > 0) {
+                drawReferenceView();
+                m_window.swapBuffers();
+                continue;
+            }
+            m_numVisibleMeshes = cullMeshes(m_projectionMatrix * m_viewMatrix, m_meshVisibility);
 
-            for (GPUMesh& mesh : m_meshes)
-                drawMeshWithModel(mesh, m_modelMatrix);
+            if (m_shadowsEnabled) {
+                m_shadowTimer.begin();
+                updateShadowMaps();
+                m_shadowTimer.end();
+            }
 
-            if (m_windmillBodyMesh)
-                drawMeshWithModel(*m_windmillBodyMesh, glm::mat4(1.0f));
+            // Camera and light data only change once per frame so they are uploaded and bound once per frame.
+            updateFrameUniforms(camera);
+            m_lightBuffer.bind(GL_TEXTURE0 + lightBufferTextureUnit);
+            m_clusterBuffer.bind(GL_TEXTURE0 + clusterBufferTextureUnit);
+            m_lightIndexBuffer.bind(GL_TEXTURE0 + lightIndexBufferTextureUnit);
+            m_shadowAtlas.bind(GL_TEXTURE0 + shadowAtlasTextureUnit);
+            m_shadowViewBuffer.bind(GL_TEXTURE0 + shadowViewBufferTextureUnit);
+            m_pMaterialTable->bind(GL_TEXTURE0 + materialBufferTextureUnit);
+            m_defaultShader.bind();
+            setLightingUniforms(m_defaultShader);
+
+            // The meshes are drawn through a render queue that groups draws with the same state and skips the state
+            // changes that would not change anything. The cache must be invalidated because other passes change the
+            // same state directly.
+            const glm::vec3 cameraPosition = camera.position();
+            m_renderQueue.clear();
+            auto submitMesh = [&](GPUMesh& mesh, const glm::mat4& modelMatrix, std::span<const uint8_t> clusterVisibility = {}) {
+                const float viewDepth = glm::distance(cameraPosition, glm::vec3(modelMatrix * glm::vec4(mesh.bounds().sphereCenter, 1.0f)));
+                Texture* pTexture = mesh.hasTextureCoords() && m_texture ? &*m_texture : nullptr;
+                m_renderQueue.submit(m_defaultShader, mesh, modelMatrix, pTexture, m_useMaterial, viewDepth, clusterVisibility);
+            };
 
-            if (m_windmillRotorMesh) {
-                glm::mat4 rotorModel = glm::translate(glm::mat4(1.0f), m_windmillHubPosition);
-                rotorModel = rotorModel * glm::rotate(glm::mat4(1.0f), m_windmillRotationAngle, glm::vec3(0.0f, 0.0f, 1.0f));
-                drawMeshWithModel(*m_windmillRotorMesh, rotorModel);
+            // The clusters of the loaded meshes are culled in object space, which is where their bounds are stored.
+            m_clusterCullingStats = {};
+            const glm::vec3 objectSpaceViewPosition = glm::vec3(glm::inverse(m_modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+            for (size_t i = 0; i < m_meshes.size(); ++i) {
+                if (!m_meshVisibility[i])
+                    continue;
+                if (m_clusterCullingEnabled) {
+                    m_clusterCullingStats += m_meshClusterCullers[i].cull(m_projectionMatrix * m_viewMatrix * m_modelMatrix,
+                        m_backFacingClusterCullingEnabled ? std::optional(objectSpaceViewPosition) : std::nullopt, m_clusterVisibility);
+                    submitMesh(m_meshes[i], m_modelMatrix, m_clusterVisibility);
+                } else {
+                    submitMesh(m_meshes[i], m_modelMatrix);
+                }
+            }
+            if (m_windmillBodyMesh && m_meshVisibility[windmillBodyCullIndex()])
+                submitMesh(*m_windmillBodyMesh, m_sceneGraph.worldMatrix(m_windmillBodyNode));
+            if (m_windmillRotorMesh && m_meshVisibility[windmillRotorCullIndex()])
+                submitMesh(*m_windmillRotorMesh, m_sceneGraph.worldMatrix(m_windmillRotorNode));
+
+            if (m_sortDrawCalls)
+                m_renderQueue.sort();
+            m_glStateCache.invalidate();
+            m_glStateCache.setFilteringEnabled(m_filterStateChanges);
+            m_glStateCache.resetCounters();
+            m_renderQueue.execute(m_glStateCache);
+
+            if (m_windFarmEnabled) {
+                if (m_windFarmDirty)
+                    rebuildWindFarm();
+                renderWindFarm();
             }
 
             // Processes input and swaps the window buffer
+            m_numVisibleMarkers = 0;
+            m_numCulledMarkers = 0;
             renderLightPath();
             renderLightMarkers();
             m_window.swapBuffers();
@@ -368,6 +585,9 @@ public:
     void onMouseClicked(int button, int mods)
     {
         std::cout << "Pressed mouse button: " << button << std::endl;
+        // Ctrl + left click picks the object under the cursor.
+        if (button == GLFW_MOUSE_BUTTON_LEFT && (mods & GLFW_MOD_CONTROL) && !ImGui::GetIO().WantCaptureMouse)
+            pickObject(m_window.getNormalizedCursorPos() * 2.0f - 1.0f);
     }
 
     // If one of the mouse buttons is released this function will be called
@@ -386,6 +606,50 @@ private:
     Shader m_shadowShader;
 
     Shader m_lightShader;
+    // Draws many cubes (light markers, control points) with a single instanced draw call.
+    Shader m_markerShader;
+    // Draws all windmills of the wind farm with one instanced draw call for the bodies and one for the rotors.
+    Shader m_windFarmShader;
+
+    UniformBuffer m_frameUniforms { sizeof(FrameData) };
+    TextureBuffer m_lightBuffer { GL_RGBA32F };
+    TextureBuffer m_clusterBuffer { GL_RG32UI };
+    TextureBuffer m_lightIndexBuffer { GL_R32UI };
+    LightClusterGrid m_lightClusters;
+    bool m_useClusteredLighting { true };
+    float m_lightBinningTimeMs { 0.0f };
+    int m_numStressTestLights { 1024 };
+
+    ShadowAtlas m_shadowAtlas;
+    TextureBuffer m_shadowViewBuffer { GL_RGBA32F };
+    // Materials of all meshes (see GPUMesh::sharedMaterialTable()).
+    std::shared_ptr<MaterialTable> m_pMaterialTable { GPUMesh::sharedMaterialTable() };
+    GpuTimer m_shadowTimer;
+    bool m_shadowsEnabled { true };
+    std::vector<int32_t> m_lightFirstShadowView;
+    std::string m_shadowBenchmarkResults;
+
+    // World space bounds of m_meshes followed by the windmill body and rotor (see updateMeshBounds()); culled against
+    // the camera once per frame and against every shadow map view that is rendered.
+    FrustumCuller m_meshCuller;
+    std::vector<uint8_t> m_meshVisibility;
+    std::vector<uint8_t> m_shadowCasterVisibility;
+    bool m_frustumCullingEnabled { true };
+    size_t m_numVisibleMeshes { 0 };
+    size_t m_numShadowCastersDrawn { 0 };
+    size_t m_numShadowCastersCulled { 0 };
+    // One per mesh in m_meshes; culls the mesh's clusters (see buildMeshClusters()) before they are drawn.
+    std::vector<ClusterCuller> m_meshClusterCullers;
+    std::vector<uint8_t> m_clusterVisibility;
+    bool m_clusterCullingEnabled { true };
+    // Off by default: the scene is drawn without GL_CULL_FACE, so back faces can be visible and culling them changes the image.
+    bool m_backFacingClusterCullingEnabled { false };
+    ClusterCullingStats m_clusterCullingStats;
+
+    RenderQueue m_renderQueue;
+    GLStateCache m_glStateCache;
+    bool m_sortDrawCalls { true };
+    bool m_filterStateChanges { true };
 
     struct Light {
         glm::vec3 position { 0.0f, 0.0f, 3.0f };
@@ -395,6 +659,9 @@ private:
         glm::vec3 direction { 0.0f, -1.0f, 0.0f };
         float spotCosCutoff { 0.9f };
         float spotSoftness { 0.1f };
+        // Distance at which the light's contribution has smoothly fallen off to zero.
+        float range { 25.0f };
+        bool castsShadows { true };
         bool hasTexture { false };
         GLuint textureId { 0 };
     };
@@ -418,15 +685,79 @@ private:
         Phong = 2
     };
 
+    // Time per frame that may be spent on creating the OpenGL objects of assets that finished loading.
+    static constexpr std::chrono::milliseconds assetUploadBudget { 4 };
+
     std::vector<GPUMesh> m_meshes;
-    Texture m_texture;
+    // Layout of the vertices of m_meshes; changing it reloads the meshes.
+    GPUVertexFormat m_meshVertexFormat { GPUVertexFormat::Float };
+    // Incremented by every loadMeshes(); results of older (superseded) loads are dropped.
+    uint32_t m_meshLoadGeneration { 0 };
+    std::string m_meshArenaBenchmarkResults;
+    // CPU copies of m_meshes for the ray tracer and picking, loaded on first use (see cpuMeshes()).
+    std::vector<Mesh> m_cpuMeshes;
+    std::optional<BVH> m_cpuMeshBVH; // Object space.
+    std::string m_referenceRenderResults;
+    std::string m_pickResults;
+
+    // Inputs of the path traced reference view; the accumulated samples are discarded when any of them changes.
+    struct ReferenceViewInputs {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        glm::ivec2 resolution;
+        RayTracingShading shading;
+        std::vector<RayTracingLight> lights;
+        WindmillParameters windmillParams;
+        size_t numMeshes;
+        bool textured;
+        int maxBounces;
+
+        bool operator==(const ReferenceViewInputs&) const = default;
+    };
+    bool m_referenceViewEnabled { false };
+    int m_pathTracingMaxBounces { 4 };
+    PathTracer m_pathTracer;
+    // Scene of the path tracer; the geometry is only rebuilt when it changed (the rotor keeps the angle it had then).
+    std::shared_ptr<RayTracingScene> m_pPathTracingScene;
+    std::optional<ReferenceViewInputs> m_referenceViewInputs;
+    std::vector<glm::vec3> m_referenceViewPixels;
+    uint32_t m_referenceViewNumSamples { 0 }; // Samples per pixel in m_referenceViewTexture.
+    glm::ivec2 m_referenceViewTextureSize { 0 };
+    GLuint m_referenceViewTexture { 0 };
+    GLuint m_referenceViewFramebuffer { 0 };
+    std::optional<Texture> m_texture;
+    // Declared after the assets such that in-flight loads are cancelled before the assets are destroyed.
+    AssetLoader m_assetLoader;
     bool m_useMaterial { true };
     ShadingModel m_shadingModel { ShadingModel::Lambert };
     WindmillParameters m_windmillParams;
     std::optional<GPUMesh> m_windmillBodyMesh;
     std::optional<GPUMesh> m_windmillRotorMesh;
+    // Layout and material that the windmill meshes currently contain.
+    WindmillLayout m_windmillLayout;
+    Material m_windmillMaterial;
     bool m_windmillDirty { true };
-    glm::vec3 m_windmillHubPosition { 0.0f };
+    size_t m_windmillBoxesUpdated { 0 };
+    float m_windmillUpdateTimeUs { 0.0f };
+    // The windmill's transforms: the body and the rotor are children of the windmill node.
+    SceneGraph m_sceneGraph;
+    SceneNode m_windmillNode { SceneGraph::noParent };
+    SceneNode m_windmillBodyNode { SceneGraph::noParent };
+    SceneNode m_windmillRotorNode { SceneGraph::noParent };
+
+    bool m_windFarmEnabled { false };
+    bool m_windFarmDirty { true };
+    int m_windFarmSize { 10000 };
+    GLsizei m_windFarmNumInstances { 0 };
+    GLsizei m_windFarmNumVisibleInstances { 0 };
+    GLuint m_windFarmInstanceVbo { 0 };
+    // All instances of the wind farm and their bounding spheres; only the visible instances are uploaded each frame.
+    std::vector<WindmillInstance> m_windFarmInstances;
+    std::vector<WindmillInstance> m_visibleWindFarmInstances;
+    FrustumCuller m_windFarmCuller;
+    std::vector<uint8_t> m_windFarmVisibility;
+    double m_windFarmStartTime { 0.0 };
+    GpuTimer m_windFarmTimer;
     float m_windmillRotationAngle { 0.0f };
     glm::vec3 m_customDiffuseColor { 0.8f, 0.4f, 0.2f };
     glm::vec3 m_specularColor { 1.0f, 1.0f, 1.0f };
@@ -449,7 +780,14 @@ private:
     std::unique_ptr<Trackball> m_trackball;
     GLuint m_lightVao { 0 };
     GLuint m_lightVbo { 0 };
+    GLuint m_lightInstanceVbo { 0 };
     GLsizei m_lightVertexCount { 0 };
+    std::vector<MarkerInstance> m_markerInstances;
+    std::vector<MarkerInstance> m_visibleMarkerInstances;
+    FrustumCuller m_markerCuller;
+    std::vector<uint8_t> m_markerVisibility;
+    size_t m_numVisibleMarkers { 0 };
+    size_t m_numCulledMarkers { 0 };
     float m_lightMarkerScale { 0.1f };
     std::vector<BezierSegment> m_lightPathSegments;
     std::vector<PathSample> m_lightPathSamples;
@@ -495,12 +833,33 @@ private:
     void updateCameraPath(float deltaTime, Trackball& camera);
     void renderLightPath();
     void renderLightPathControlPoints();
+    void drawMarkerInstances(std::span<const MarkerInstance> instances);
     void ensureLightPathFollowerValid();
     void resetLights();
     void selectNextLight();
     void selectPreviousLight();
+    void spawnRandomLights(size_t count);
     void renderGui();
-    void uploadLightsToShader();
+    void updateFrameUniforms(const Trackball& camera);
+    void loadMeshes();
+    void updateMeshBounds();
+    size_t cullMeshes(const glm::mat4& viewProjectionMatrix, std::vector<uint8_t>& visibility) const;
+    size_t windmillBodyCullIndex() const;
+    size_t windmillRotorCullIndex() const;
+    void updateShadowMaps();
+    void drawShadowCasters(const glm::mat4& lightViewProjectionMatrix, bool dynamicCasters);
+    void benchmarkShadowPass();
+    void benchmarkMeshArena();
+    const std::vector<Mesh>& cpuMeshes();
+    std::vector<RayTracingLight> rayTracingLights() const;
+    RayTracingScene buildRayTracingScene();
+    [[nodiscard]] RayTracingShading rayTracingShading() const;
+    void updateReferenceView(const Trackball& camera);
+    void drawReferenceView();
+    void pickObject(const glm::vec2& ndc);
+    void setLightingUniforms(const Shader& shader);
+    void rebuildWindFarm();
+    void renderWindFarm();
     void rebuildWindmillMesh();
     void sanitizeWindmillParams();
 };
@@ -563,6 +922,8 @@ void Application::initializeLightGeometry()
 {
     if (m_lightVbo != 0)
         glDeleteBuffers(1, &m_lightVbo);
+    if (m_lightInstanceVbo != 0)
+        glDeleteBuffers(1, &m_lightInstanceVbo);
     if (m_lightVao != 0)
         glDeleteVertexArrays(1, &m_lightVao);
 
@@ -615,6 +976,7 @@ void Application::initializeLightGeometry()
 
     glGenVertexArrays(1, &m_lightVao);
     glGenBuffers(1, &m_lightVbo);
+    glGenBuffers(1, &m_lightInstanceVbo);
 
     glBindVertexArray(m_lightVao);
     glBindBuffer(GL_ARRAY_BUFFER, m_lightVbo);
@@ -623,6 +985,15 @@ void Application::initializeLightGeometry()
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<void*>(0));
 
+    // Per instance attributes, filled by drawMarkerInstances().
+    glBindBuffer(GL_ARRAY_BUFFER, m_lightInstanceVbo);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(MarkerInstance), reinterpret_cast<void*>(offsetof(MarkerInstance, position)));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(MarkerInstance), reinterpret_cast<void*>(offsetof(MarkerInstance, color)));
+    glVertexAttribDivisor(2, 1);
+
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -898,9 +1269,9 @@ void Application::renderLightPath()
     glBindVertexArray(m_lightPathVao);
 
     const glm::mat4 mvp = m_projectionMatrix * m_viewMatrix;
-    glUniformMatrix4fv(m_lightShader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvp));
+    m_lightShader.set("mvpMatrix", mvp);
     const glm::vec3 pathColor { 0.95f, 0.55f, 0.15f };
-    glUniform3fv(m_lightShader.getUniformLocation("markerColor"), 1, glm::value_ptr(pathColor));
+    m_lightShader.set("markerColor", pathColor);
 
     glLineWidth(2.0f);
     glDrawArrays(GL_LINE_STRIP, 0, m_lightPathVertexCount);
@@ -917,46 +1288,18 @@ void Application::renderLightPathControlPoints()
     if (m_lightVao == 0)
         return;
 
-    std::vector<glm::vec3> cornerPoints;
-    std::vector<glm::vec3> handlePoints;
-    cornerPoints.reserve(m_lightPathSegments.size());
-    handlePoints.reserve(m_lightPathSegments.size() * 2);
-
+    const glm::vec3 cornerColor { 0.2f, 0.7f, 1.0f };
+    const glm::vec3 handleColor { 1.0f, 0.3f, 0.6f };
+    m_markerInstances.clear();
     for (size_t i = 0; i < m_lightPathSegments.size(); ++i) {
         const BezierSegment& seg = m_lightPathSegments[i];
         if (i == 0)
-            cornerPoints.push_back(seg.p0);
-        handlePoints.push_back(seg.p1);
-        handlePoints.push_back(seg.p2);
-        cornerPoints.push_back(seg.p3);
-    }
-
-    m_lightShader.bind();
-    glBindVertexArray(m_lightVao);
-    const GLint mvpLocation = m_lightShader.getUniformLocation("mvpMatrix");
-    const GLint colorLocation = m_lightShader.getUniformLocation("markerColor");
-
-    for (const glm::vec3& pt : cornerPoints) {
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), pt);
-        model = glm::scale(model, glm::vec3(m_lightPathControlPointScale));
-        const glm::mat4 mvp = m_projectionMatrix * m_viewMatrix * model;
-        const glm::vec3 color { 0.2f, 0.7f, 1.0f };
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform3fv(colorLocation, 1, glm::value_ptr(color));
-        glDrawArrays(GL_TRIANGLES, 0, m_lightVertexCount);
-    }
-
-    for (const glm::vec3& pt : handlePoints) {
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), pt);
-        model = glm::scale(model, glm::vec3(m_lightPathControlPointScale * 0.8f));
-        const glm::mat4 mvp = m_projectionMatrix * m_viewMatrix * model;
-        const glm::vec3 color { 1.0f, 0.3f, 0.6f };
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform3fv(colorLocation, 1, glm::value_ptr(color));
-        glDrawArrays(GL_TRIANGLES, 0, m_lightVertexCount);
+            m_markerInstances.push_back({ seg.p0, m_lightPathControlPointScale, cornerColor });
+        m_markerInstances.push_back({ seg.p1, m_lightPathControlPointScale * 0.8f, handleColor });
+        m_markerInstances.push_back({ seg.p2, m_lightPathControlPointScale * 0.8f, handleColor });
+        m_markerInstances.push_back({ seg.p3, m_lightPathControlPointScale, cornerColor });
     }
-
-    glBindVertexArray(0);
+    drawMarkerInstances(m_markerInstances);
 }
 
 void Application::renderLightMarkers()
@@ -964,27 +1307,49 @@ void Application::renderLightMarkers()
     if (m_lights.empty() || m_lightVao == 0)
         return;
 
-    m_lightShader.bind();
-    glBindVertexArray(m_lightVao);
-
-    const GLint mvpLocation = m_lightShader.getUniformLocation("mvpMatrix");
-    const GLint colorLocation = m_lightShader.getUniformLocation("markerColor");
-
+    m_markerInstances.clear();
     for (size_t i = 0; i < m_lights.size(); ++i) {
-        const Light& light = m_lights[i];
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), light.position);
-        model = glm::scale(model, glm::vec3(m_lightMarkerScale));
-        const glm::mat4 mvp = m_projectionMatrix * m_viewMatrix * model;
-
-        glm::vec3 color = (i == m_selectedLightIndex) ? glm::vec3(1.0f, 0.8f, 0.0f) : glm::vec3(1.0f, 1.0f, 0.0f);
+        const glm::vec3 color = (i == m_selectedLightIndex) ? glm::vec3(1.0f, 0.8f, 0.0f) : glm::vec3(1.0f, 1.0f, 0.0f);
+        m_markerInstances.push_back({ m_lights[i].position, m_lightMarkerScale, color });
+    }
+    drawMarkerInstances(m_markerInstances);
+}
 
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform3fv(colorLocation, 1, glm::value_ptr(color));
-        glDrawArrays(GL_TRIANGLES, 0, m_lightVertexCount);
+void Application::drawMarkerInstances(std::span<const MarkerInstance> instances)
+{
+    if (m_frustumCullingEnabled) {
+        // A marker is a cube with sides of length scale.
+        m_markerCuller.clear();
+        for (const MarkerInstance& instance : instances)
+            m_markerCuller.addSphere(instance.position, instance.scale * 0.5f * std::sqrt(3.0f));
+        const size_t numVisible = m_markerCuller.cull(m_projectionMatrix * m_viewMatrix, m_markerVisibility);
+        m_numVisibleMarkers += numVisible;
+        m_numCulledMarkers += instances.size() - numVisible;
+
+        m_visibleMarkerInstances.clear();
+        for (size_t i = 0; i < instances.size(); ++i) {
+            if (m_markerVisibility[i])
+                m_visibleMarkerInstances.push_back(instances[i]);
+        }
+        instances = m_visibleMarkerInstances;
+    } else {
+        m_numVisibleMarkers += instances.size();
     }
+    if (instances.empty())
+        return;
 
-    glBindVertexArray(0);
+    // Orphan the instance buffer such that the previous draw using it does not have to finish first.
+    const auto instanceDataSize = static_cast<GLsizeiptr>(instances.size_bytes());
+    glBindBuffer(GL_ARRAY_BUFFER, m_lightInstanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, instanceDataSize, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instanceDataSize, instances.data());
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_markerShader.bind();
+    m_markerShader.set("viewProjectionMatrix", m_projectionMatrix * m_viewMatrix);
+    glBindVertexArray(m_lightVao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, m_lightVertexCount, static_cast<GLsizei>(instances.size()));
+    glBindVertexArray(0);
 }
 
 void Application::resetLights()
@@ -1005,6 +1370,21 @@ void Application::resetLights()
     }
 }
 
+void Application::spawnRandomLights(size_t count)
+{
+    // Small, colorful lights scattered over and around the scene for stress testing the light clustering.
+    std::mt19937 rng { static_cast<unsigned>(m_lights.size()) };
+    std::uniform_real_distribution<float> unitDistribution { 0.0f, 1.0f };
+    for (size_t i = 0; i < count; ++i) {
+        Light light;
+        light.position = glm::vec3(unitDistribution(rng) * 20.0f - 10.0f, unitDistribution(rng) * 6.0f, unitDistribution(rng) * 20.0f - 10.0f);
+        light.color = glm::vec3(unitDistribution(rng), unitDistribution(rng), unitDistribution(rng));
+        light.range = 0.5f + unitDistribution(rng) * 2.5f;
+        light.castsShadows = false;
+        m_lights.push_back(light);
+    }
+}
+
 void Application::selectNextLight()
 {
     if (m_lights.empty())
@@ -1035,6 +1415,10 @@ void Application::renderGui()
     };
 
     ImGui::Begin("Shading & Lighting");
+    if (const size_t numLoadingAssets = m_assetLoader.numPending(); numLoadingAssets > 0)
+        ImGui::Text("Loading %zu asset(s)...", numLoadingAssets);
+    const ImageCacheStatistics imageCacheStats = imageCacheStatistics();
+    ImGui::Text("Image cache: %zu decoded (%.1f MiB), %zu hits", imageCacheStats.numDecodes, static_cast<double>(imageCacheStats.numDecodedBytes) / (1024.0 * 1024.0), imageCacheStats.numHits);
     static const char* shadingModes[] = { "Unlit", "Lambert", "Phong" };
     int shadingIndex = static_cast<int>(m_shadingModel);
     if (ImGui::Combo("Shading Model", &shadingIndex, shadingModes, IM_ARRAYSIZE(shadingModes)))
@@ -1072,6 +1456,18 @@ void Application::renderGui()
     if (windmillChanged) {
         sanitizeWindmillParams();
         m_windmillDirty = true;
+        m_windFarmDirty = true;
+    }
+    ImGui::Text("Last edit: %zu box(es) updated in %.1f us", m_windmillBoxesUpdated, static_cast<double>(m_windmillUpdateTimeUs));
+    if (ImGui::Checkbox("Wind farm", &m_windFarmEnabled))
+        m_windFarmDirty = true;
+    if (m_windFarmEnabled) {
+        if (ImGui::SliderInt("Windmills", &m_windFarmSize, 1, 20000))
+            m_windFarmDirty = true;
+        ImGui::Text("%d windmills in 2 draw calls, %.1f FPS", m_windFarmNumInstances, static_cast<double>(ImGui::GetIO().Framerate));
+        ImGui::Text("%d visible, %d culled", m_windFarmNumVisibleInstances, m_windFarmNumInstances - m_windFarmNumVisibleInstances);
+        if (const std::optional<float> windFarmTimeMs = m_windFarmTimer.latestMs())
+            ImGui::Text("Wind farm pass: %.3f ms (GPU)", static_cast<double>(*windFarmTimeMs));
     }
 
     ImGui::Separator();
@@ -1307,6 +1703,7 @@ void Application::renderGui()
         ImGui::DragFloat3("Position", glm::value_ptr(selectedLight.position), 0.05f);
         ImGui::ColorEdit3("Color", glm::value_ptr(selectedLight.color));
         ImGui::Checkbox("Peels Depth", &selectedLight.peelsDepth);
+        ImGui::Checkbox("Casts Shadows", &selectedLight.castsShadows);
 
         ImGui::Separator();
         ImGui::Text("Spotlight Settings");
@@ -1319,7 +1716,119 @@ void Application::renderGui()
         }
         ImGui::SliderFloat("Spot Cos Cutoff", &selectedLight.spotCosCutoff, 0.0f, 1.0f);
         ImGui::SliderFloat("Spot Softness", &selectedLight.spotSoftness, 0.0f, 1.0f);
+        ImGui::DragFloat("Range", &selectedLight.range, 0.1f, 0.1f, 1000.0f);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Clustered Lighting");
+    ImGui::Checkbox("Clustered lighting", &m_useClusteredLighting);
+    if (m_useClusteredLighting) {
+        const size_t numClusters = m_lightClusters.numClusters();
+        const double averageLights = static_cast<double>(m_lightClusters.lightIndices().size()) / static_cast<double>(numClusters);
+        ImGui::Text("%zu lights, binning %.3f ms", m_lights.size(), static_cast<double>(m_lightBinningTimeMs));
+        ImGui::Text("Lights per cluster: %.2f average, %u max", averageLights, m_lightClusters.maxLightsPerCluster());
+    } else {
+        ImGui::Text("%zu lights, every fragment loops over all of them", m_lights.size());
+    }
+    ImGui::SliderInt("Stress test lights", &m_numStressTestLights, 1, 4096);
+    if (ImGui::Button("Spawn Random Lights"))
+        spawnRandomLights(static_cast<size_t>(m_numStressTestLights));
+
+    ImGui::Separator();
+    ImGui::Text("Shadows");
+    ImGui::Checkbox("Shadow mapping", &m_shadowsEnabled);
+    if (m_shadowsEnabled) {
+        ImGui::Text("%zu shadow maps rendered, %zu with static casters", m_shadowAtlas.numViewsRendered(), m_shadowAtlas.numStaticViewsRendered());
+        if (const std::optional<float> shadowTimeMs = m_shadowTimer.latestMs())
+            ImGui::Text("Shadow pass: %.3f ms (GPU)", static_cast<double>(*shadowTimeMs));
     }
+    if (ImGui::Button("Benchmark Shadow Pass"))
+        benchmarkShadowPass();
+    if (!m_shadowBenchmarkResults.empty())
+        ImGui::TextUnformatted(m_shadowBenchmarkResults.c_str());
+
+    ImGui::Separator();
+    ImGui::Text("Frustum Culling");
+    ImGui::Checkbox("Frustum culling", &m_frustumCullingEnabled);
+    ImGui::Text("Meshes: %zu visible, %zu culled", m_numVisibleMeshes, m_meshCuller.size() - m_numVisibleMeshes);
+    if (m_shadowsEnabled)
+        ImGui::Text("Shadow casters: %zu drawn, %zu culled", m_numShadowCastersDrawn, m_numShadowCastersCulled);
+    ImGui::Text("Markers: %zu visible, %zu culled", m_numVisibleMarkers, m_numCulledMarkers);
+    ImGui::Checkbox("Cluster culling", &m_clusterCullingEnabled);
+    if (m_clusterCullingEnabled) {
+        ImGui::Checkbox("Cull backfacing clusters", &m_backFacingClusterCullingEnabled);
+        ImGui::Text("Clusters: %zu drawn, %zu outside frustum, %zu backfacing", m_clusterCullingStats.numVisible,
+            m_clusterCullingStats.numOutsideFrustum, m_clusterCullingStats.numBackFacing);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Render Queue");
+    ImGui::Checkbox("Sort draw calls", &m_sortDrawCalls);
+    ImGui::Checkbox("Skip redundant state changes", &m_filterStateChanges);
+    const GLStateCache::Counters& glCallCounters = m_glStateCache.counters();
+    ImGui::Text("%zu draws, %zu of %zu GL calls issued", glCallCounters.numDrawCalls, glCallCounters.numIssuedCalls, glCallCounters.numRequestedCalls);
+
+    ImGui::Separator();
+    ImGui::Text("Vertex Format");
+    bool quantizeVertices = m_meshVertexFormat == GPUVertexFormat::Quantized;
+    if (ImGui::Checkbox("Quantized vertices", &quantizeVertices)) {
+        m_meshVertexFormat = quantizeVertices ? GPUVertexFormat::Quantized : GPUVertexFormat::Float;
+        loadMeshes();
+    }
+    size_t meshMemoryUsage = 0;
+    VertexQuantizationError quantizationError;
+    for (const GPUMesh& mesh : m_meshes) {
+        meshMemoryUsage += mesh.gpuMemoryUsage();
+        quantizationError.maxPositionError = std::max(quantizationError.maxPositionError, mesh.quantizationError().maxPositionError);
+        quantizationError.rmsPositionError = std::max(quantizationError.rmsPositionError, mesh.quantizationError().rmsPositionError);
+        quantizationError.maxNormalErrorDegrees = std::max(quantizationError.maxNormalErrorDegrees, mesh.quantizationError().maxNormalErrorDegrees);
+        quantizationError.maxTexCoordError = std::max(quantizationError.maxTexCoordError, mesh.quantizationError().maxTexCoordError);
+    }
+    ImGui::Text("Vertex and index buffers: %.2f MiB", static_cast<double>(meshMemoryUsage) / (1024.0 * 1024.0));
+    if (m_meshVertexFormat == GPUVertexFormat::Quantized) {
+        ImGui::Text("Position error: %.3g max, %.3g RMS", static_cast<double>(quantizationError.maxPositionError), static_cast<double>(quantizationError.rmsPositionError));
+        ImGui::Text("Normal error: %.3f deg max, texture coordinate error: %.3g max", static_cast<double>(quantizationError.maxNormalErrorDegrees),
+            static_cast<double>(quantizationError.maxTexCoordError));
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Mesh Buffers");
+    for (const GPUVertexFormat vertexFormat : { GPUVertexFormat::Float, GPUVertexFormat::Quantized }) {
+        const GPUBufferArena::Stats stats = GPUMesh::sharedArena(vertexFormat)->stats();
+        ImGui::Text("%s: %zu meshes in %zu pages, %.2f of %.2f MiB used, %zu free ranges", vertexFormat == GPUVertexFormat::Float ? "Float" : "Quantized",
+            stats.numAllocations, stats.numPages, static_cast<double>(stats.usedSize) / (1024.0 * 1024.0), static_cast<double>(stats.capacity) / (1024.0 * 1024.0),
+            stats.numFreeRanges);
+    }
+    if (ImGui::Button("Defragment")) {
+        size_t numBytesMoved = 0;
+        for (const GPUVertexFormat vertexFormat : { GPUVertexFormat::Float, GPUVertexFormat::Quantized })
+            numBytesMoved += GPUMesh::sharedArena(vertexFormat)->defragment();
+        std::cout << "Defragmenting the mesh buffers moved " << numBytesMoved << " bytes" << std::endl;
+    }
+    if (ImGui::Button("Benchmark Mesh Buffers"))
+        benchmarkMeshArena();
+    if (!m_meshArenaBenchmarkResults.empty())
+        ImGui::TextUnformatted(m_meshArenaBenchmarkResults.c_str());
+
+    ImGui::Separator();
+    ImGui::Text("Reference Renderer");
+    if (ImGui::Button("Ray Trace Reference Image"))
+        renderReferenceImage("reference.bmp");
+    if (!m_referenceRenderResults.empty())
+        ImGui::TextUnformatted(m_referenceRenderResults.c_str());
+    ImGui::Checkbox("Path traced reference view", &m_referenceViewEnabled);
+    if (m_referenceViewEnabled) {
+        ImGui::SliderInt("Max bounces", &m_pathTracingMaxBounces, 0, 16);
+        if (m_pathTracer.isRunning()) {
+            ImGui::Text("%u samples per pixel, %.0f samples/s (%.2f Mrays/s) on %u threads", m_pathTracer.numSamplesPerPixel(),
+                static_cast<double>(m_pathTracer.samplesPerSecond()), static_cast<double>(m_pathTracer.megaRaysPerSecond()), PathTracer::defaultNumThreads());
+        } else {
+            ImGui::Text("Waiting for the scene to be rebuilt");
+        }
+    }
+    ImGui::Text("Ctrl + left click picks the object under the cursor.");
+    if (!m_pickResults.empty())
+        ImGui::TextUnformatted(m_pickResults.c_str());
 
     ImGui::End();
 }
@@ -1352,66 +1861,677 @@ void Application::sanitizeWindmillParams()
 
 void Application::rebuildWindmillMesh()
 {
+    const auto start = std::chrono::steady_clock::now();
     sanitizeWindmillParams();
-    const WindmillMeshes cpuMeshes = buildWindmillMeshes(m_windmillParams);
-    m_windmillHubPosition = computeHubPosition(m_windmillParams);
-
-    m_windmillBodyMesh.reset();
-    m_windmillRotorMesh.reset();
-
-    m_windmillBodyMesh.emplace(cpuMeshes.body);
-    m_windmillRotorMesh.emplace(cpuMeshes.rotor);
+    m_sceneGraph.setTranslation(m_windmillRotorNode, computeHubPosition(m_windmillParams));
+    const WindmillLayout layout = computeWindmillLayout(m_windmillParams);
+    const Material material = computeWindmillMaterial(m_windmillParams);
+
+    if (!m_windmillBodyMesh || !m_windmillRotorMesh) {
+        const WindmillMeshes cpuMeshes = buildWindmillMeshes(m_windmillParams);
+        m_windmillBodyMesh.emplace(cpuMeshes.body);
+        m_windmillRotorMesh.emplace(cpuMeshes.rotor);
+        m_windmillBoxesUpdated = layout.body.size() + layout.rotor.size();
+        m_shadowAtlas.invalidateStaticCasters();
+    } else {
+        // The meshes keep their buffers; only the boxes that changed are regenerated and uploaded.
+        const size_t numBodyBoxesUpdated = updateWindmillBoxes(*m_windmillBodyMesh, layout.body, m_windmillLayout.body);
+        m_windmillBoxesUpdated = numBodyBoxesUpdated + updateWindmillBoxes(*m_windmillRotorMesh, layout.rotor, m_windmillLayout.rotor);
+        m_windmillBodyMesh->setBounds(computeWindmillBoxesBounds(layout.body));
+        m_windmillRotorMesh->setBounds(computeWindmillBoxesBounds(layout.rotor));
+        if (material.kd != m_windmillMaterial.kd) {
+            m_windmillBodyMesh->updateMaterial(material);
+            m_windmillRotorMesh->updateMaterial(material);
+        }
+        // The rotor is a dynamic shadow caster; only changes to the body affect the cached shadow maps.
+        if (numBodyBoxesUpdated > 0)
+            m_shadowAtlas.invalidateStaticCasters();
+    }
+    m_windmillLayout = layout;
+    m_windmillMaterial = material;
     m_windmillDirty = false;
+    m_windmillUpdateTimeUs = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
 }
 
-void Application::uploadLightsToShader()
+void Application::updateFrameUniforms(const Trackball& camera)
 {
-    constexpr int MAX_LIGHTS = 8;
-    using Vec3Array = std::array<glm::vec3, MAX_LIGHTS>;
-    using FloatArray = std::array<float, MAX_LIGHTS>;
-    using IntArray = std::array<int, MAX_LIGHTS>;
-
-    Vec3Array positions {};
-    Vec3Array colors {};
-    Vec3Array directions {};
-    FloatArray cosCutoff {};
-    FloatArray softness {};
-    IntArray spotFlags {};
-
-    const int count = static_cast<int>(std::min(m_lights.size(), static_cast<size_t>(MAX_LIGHTS)));
-
-    for (int i = 0; i < count; ++i) {
+    std::vector<GPULight> gpuLights(m_lights.size());
+    std::vector<ClusterLight> clusterLights(m_lights.size());
+    for (size_t i = 0; i < m_lights.size(); ++i) {
         const Light& light = m_lights[i];
-        positions[i] = light.position;
-        colors[i] = light.color;
         glm::vec3 dir = light.direction;
         const float len = glm::length(dir);
         if (len > 1e-4f)
             dir /= len;
         else
             dir = glm::vec3(0.0f, -1.0f, 0.0f);
-        directions[i] = dir;
-        cosCutoff[i] = glm::clamp(light.spotCosCutoff, 0.0f, 1.0f);
-        softness[i] = glm::clamp(light.spotSoftness, 0.0f, 1.0f);
-        spotFlags[i] = light.isSpotlight ? 1 : 0;
+
+        GPULight& gpuLight = gpuLights[i];
+        gpuLight.position = light.position;
+        gpuLight.range = std::max(light.range, 1e-3f);
+        gpuLight.color = light.color;
+        gpuLight.spotSoftness = glm::clamp(light.spotSoftness, 0.0f, 1.0f);
+        gpuLight.direction = light.isSpotlight ? dir : glm::vec3(0.0f);
+        gpuLight.spotCosCutoff = glm::clamp(light.spotCosCutoff, 0.0f, 1.0f);
+        gpuLight.firstShadowView = m_shadowsEnabled && i < m_lightFirstShadowView.size() ? static_cast<float>(m_lightFirstShadowView[i]) : -1.0f;
+
+        // The clusters are defined in view space.
+        ClusterLight& clusterLight = clusterLights[i];
+        clusterLight.position = glm::vec3(m_viewMatrix * glm::vec4(gpuLight.position, 1.0f));
+        clusterLight.range = gpuLight.range;
+        clusterLight.isSpotlight = light.isSpotlight;
+        clusterLight.direction = glm::mat3(m_viewMatrix) * dir;
+        clusterLight.spotCosCutoff = gpuLight.spotCosCutoff;
+    }
+    m_lightBuffer.update(gpuLights.data(), static_cast<GLsizeiptr>(gpuLights.size() * sizeof(GPULight)));
+
+    if (m_useClusteredLighting) {
+        const auto start = std::chrono::steady_clock::now();
+        m_lightClusters.assignLights(m_projectionMatrix, clusterLights);
+        m_lightBinningTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        const auto clusterRanges = m_lightClusters.clusterLightRanges();
+        const auto lightIndices = m_lightClusters.lightIndices();
+        m_clusterBuffer.update(clusterRanges.data(), static_cast<GLsizeiptr>(clusterRanges.size_bytes()));
+        m_lightIndexBuffer.update(lightIndices.data(), static_cast<GLsizeiptr>(lightIndices.size_bytes()));
     }
 
-    glUniform1i(m_defaultShader.getUniformLocation("numLights"), count);
+    FrameData frameData;
+    frameData.viewProjectionMatrix = m_projectionMatrix * m_viewMatrix;
+    frameData.viewMatrix = m_viewMatrix;
+    frameData.viewPosition = camera.position();
+    frameData.shadingMode = static_cast<int32_t>(m_shadingModel);
+    frameData.customDiffuseColor = m_customDiffuseColor;
+    frameData.specularStrength = m_specularStrength;
+    frameData.specularColor = m_specularColor;
+    frameData.specularShininess = m_specularShininess;
+    frameData.clusterGridSize = m_lightClusters.dimensions();
+    frameData.numLights = static_cast<int32_t>(m_lights.size());
+    frameData.clusterTileSize = glm::vec2(m_window.getFrameBufferSize()) / glm::vec2(frameData.clusterGridSize);
+    frameData.clusterFirstSliceDepth = m_lightClusters.firstSliceDepth();
+    frameData.clusterDepthScale = m_lightClusters.depthScale();
+    frameData.clusterDepthBias = m_lightClusters.depthBias();
+    frameData.useClusteredLighting = m_useClusteredLighting ? 1 : 0;
+    m_frameUniforms.update(frameData);
+}
 
-    if (count == 0)
+void Application::loadMeshes()
+{
+    const uint32_t generation = ++m_meshLoadGeneration;
+    m_assetLoader.loadMesh(sceneMeshFile, false, m_meshVertexFormat, [this, generation](std::vector<GPUMesh>&& meshes) {
+        // The vertex format may have changed again while this load was in flight.
+        if (generation != m_meshLoadGeneration)
+            return;
+        m_meshes = std::move(meshes);
+        m_meshClusterCullers.clear();
+        for (const GPUMesh& mesh : m_meshes)
+            m_meshClusterCullers.emplace_back(mesh.clusters());
+        m_shadowAtlas.invalidateStaticCasters();
+    });
+}
+
+void Application::updateMeshBounds()
+{
+    m_meshCuller.clear();
+    for (const GPUMesh& mesh : m_meshes)
+        m_meshCuller.add(mesh.bounds(), m_modelMatrix);
+    // The windmill meshes are created together in the constructor.
+    if (m_windmillBodyMesh && m_windmillRotorMesh) {
+        m_meshCuller.add(m_windmillBodyMesh->bounds(), m_sceneGraph.worldMatrix(m_windmillBodyNode));
+        m_meshCuller.add(m_windmillRotorMesh->bounds(), m_sceneGraph.worldMatrix(m_windmillRotorNode));
+    }
+}
+
+size_t Application::cullMeshes(const glm::mat4& viewProjectionMatrix, std::vector<uint8_t>& visibility) const
+{
+    if (m_frustumCullingEnabled)
+        return m_meshCuller.cull(viewProjectionMatrix, visibility);
+    visibility.assign(m_meshCuller.size(), 1);
+    return visibility.size();
+}
+
+size_t Application::windmillBodyCullIndex() const
+{
+    return m_meshes.size();
+}
+
+size_t Application::windmillRotorCullIndex() const
+{
+    return m_meshes.size() + 1;
+}
+
+void Application::updateShadowMaps()
+{
+    std::vector<ShadowLight> shadowLights;
+    std::vector<size_t> shadowLightIndices;
+    for (size_t i = 0; i < m_lights.size(); ++i) {
+        const Light& light = m_lights[i];
+        if (!light.castsShadows)
+            continue;
+        const float len = glm::length(light.direction);
+        shadowLights.push_back({ .position = light.position,
+            .range = std::max(light.range, 1e-3f),
+            .isSpotlight = light.isSpotlight,
+            .direction = len > 1e-4f ? light.direction / len : glm::vec3(0.0f, -1.0f, 0.0f),
+            .spotCosCutoff = glm::clamp(light.spotCosCutoff, 0.0f, 1.0f) });
+        shadowLightIndices.push_back(i);
+    }
+
+    m_numShadowCastersDrawn = 0;
+    m_numShadowCastersCulled = 0;
+    m_shadowShader.bind();
+    m_shadowAtlas.update(
+        shadowLights, m_projectionMatrix * m_viewMatrix,
+        [this](const glm::mat4& lightViewProjection) { drawShadowCasters(lightViewProjection, false); },
+        [this](const glm::mat4& lightViewProjection) { drawShadowCasters(lightViewProjection, true); });
+
+    m_lightFirstShadowView.assign(m_lights.size(), -1);
+    for (size_t i = 0; i < shadowLightIndices.size(); ++i)
+        m_lightFirstShadowView[shadowLightIndices[i]] = m_shadowAtlas.firstView(i);
+    const auto shadowViews = m_shadowAtlas.views();
+    m_shadowViewBuffer.update(shadowViews.data(), static_cast<GLsizeiptr>(shadowViews.size_bytes()));
+}
+
+void Application::drawShadowCasters(const glm::mat4& lightViewProjectionMatrix, bool dynamicCasters)
+{
+    cullMeshes(lightViewProjectionMatrix, m_shadowCasterVisibility);
+    const auto countCaster = [this](bool isVisible) {
+        ++(isVisible ? m_numShadowCastersDrawn : m_numShadowCastersCulled);
+        return isVisible;
+    };
+
+    // The rotor is the only moving geometry; everything else can be cached by the shadow atlas.
+    if (dynamicCasters) {
+        if (m_windmillRotorMesh && countCaster(m_shadowCasterVisibility[windmillRotorCullIndex()])) {
+            m_shadowShader.set("mvpMatrix", lightViewProjectionMatrix * m_sceneGraph.worldMatrix(m_windmillRotorNode));
+            m_windmillRotorMesh->drawGeometry();
+        }
         return;
+    }
+
+    // Both sides of the triangles cast shadows, so the clusters are only culled against the light's frustum.
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        if (!countCaster(m_shadowCasterVisibility[i]))
+            continue;
+        m_shadowShader.set("mvpMatrix", lightViewProjectionMatrix * m_modelMatrix * m_meshes[i].dequantizationMatrix());
+        if (m_clusterCullingEnabled) {
+            m_meshClusterCullers[i].cull(lightViewProjectionMatrix * m_modelMatrix, std::nullopt, m_clusterVisibility);
+            m_meshes[i].drawClustersGeometry(m_clusterVisibility);
+        } else {
+            m_meshes[i].drawGeometry();
+        }
+    }
+    if (m_windmillBodyMesh && countCaster(m_shadowCasterVisibility[windmillBodyCullIndex()])) {
+        m_shadowShader.set("mvpMatrix", lightViewProjectionMatrix * m_sceneGraph.worldMatrix(m_windmillBodyNode));
+        m_windmillBodyMesh->drawGeometry();
+    }
+}
+
+void Application::benchmarkShadowPass()
+{
+    // Time the shadow pass for an increasing number of shadow casting point lights around the scene, both when all
+    // static casters have to be rendered (lights moved) and when they come from the cache (lights static).
+    const std::vector<Light> originalLights = m_lights;
+    m_lights.clear();
+    updateMeshBounds(); // The GUI runs before the bounds of this frame are gathered.
+    std::string results = "Point lights | full (ms) | cached (ms)\n";
+    for (const int numLights : { 1, 2, 4, 6, 8, 10 }) {
+        while (m_lights.size() < static_cast<size_t>(numLights)) {
+            const float angle = glm::two_pi<float>() * static_cast<float>(m_lights.size()) / 10.0f;
+            Light& light = m_lights.emplace_back();
+            light.position = glm::vec3(4.0f * std::cos(angle), 3.0f, 4.0f * std::sin(angle));
+        }
+
+        constexpr int numIterations = 10;
+        float fullTimeMs = 0.0f, cachedTimeMs = 0.0f;
+        for (int i = 0; i < numIterations; ++i) {
+            m_shadowAtlas.invalidateStaticCasters();
+            m_shadowTimer.begin();
+            updateShadowMaps();
+            m_shadowTimer.end();
+            fullTimeMs += m_shadowTimer.waitForMs();
+
+            m_shadowTimer.begin();
+            updateShadowMaps();
+            m_shadowTimer.end();
+            cachedTimeMs += m_shadowTimer.waitForMs();
+        }
+        results += fmt::format("{:12} | {:9.3f} | {:11.3f}\n", numLights, fullTimeMs / numIterations, cachedTimeMs / numIterations);
+    }
+    std::cout << results;
+
+    m_lights = originalLights;
+    m_shadowAtlas.invalidateStaticCasters();
+    m_shadowBenchmarkResults = std::move(results);
+}
+
+void Application::setLightingUniforms(const Shader& shader)
+{
+    // Shaders that use shader_frag.glsl share the per frame data and the light and shadow textures.
+    shader.bindUniformBlock("FrameData", frameDataBinding, m_frameUniforms.handle());
+    shader.set("colorMap", 0);
+    shader.set("lightBuffer", lightBufferTextureUnit);
+    shader.set("clusterBuffer", clusterBufferTextureUnit);
+    shader.set("lightIndexBuffer", lightIndexBufferTextureUnit);
+    shader.set("shadowAtlas", shadowAtlasTextureUnit);
+    shader.set("shadowViewBuffer", shadowViewBufferTextureUnit);
+    shader.set("materialBuffer", materialBufferTextureUnit);
+}
+
+void Application::rebuildWindFarm()
+{
+    // A square grid around the main windmill (whose cell is left empty) with some variation per windmill.
+    const float spacing = 1.5f * std::max({ m_windmillParams.baseSize.x, m_windmillParams.baseSize.z, 2.0f * m_windmillParams.armLength });
+    const int gridSize = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(m_windFarmSize + 1))));
+    std::mt19937 rng { 42 };
+    std::uniform_real_distribution<float> unitDistribution { 0.0f, 1.0f };
+    std::vector<WindmillInstance>& instances = m_windFarmInstances;
+    instances.clear();
+    instances.reserve(static_cast<size_t>(m_windFarmSize));
+    for (int z = 0; z < gridSize && instances.size() < static_cast<size_t>(m_windFarmSize); ++z) {
+        for (int x = 0; x < gridSize && instances.size() < static_cast<size_t>(m_windFarmSize); ++x) {
+            const glm::vec2 cell = glm::vec2(x, z) - glm::floor(static_cast<float>(gridSize) * 0.5f);
+            if (cell == glm::vec2(0.0f))
+                continue;
+            WindmillInstance& instance = instances.emplace_back();
+            instance.position = glm::vec3(cell.x, 0.0f, cell.y) * spacing;
+            instance.yaw = glm::radians(20.0f) * (unitDistribution(rng) - 0.5f);
+            instance.rotorPhase = glm::two_pi<float>() * unitDistribution(rng);
+            instance.rotorSpeedScale = 0.8f + 0.4f * unitDistribution(rng);
+        }
+    }
+
+    // Bounding sphere of a windmill in its own space: the body and the sphere that the rotor sweeps around the hub
+    // (the rotor spins around the z axis through the hub, which is the origin of the rotor mesh).
+    const MeshBounds& bodyBounds = m_windmillBodyMesh->bounds();
+    const MeshBounds& rotorBounds = m_windmillRotorMesh->bounds();
+    const glm::vec3 rotorSphereCenter = computeHubPosition(m_windmillParams) + glm::vec3(0.0f, 0.0f, rotorBounds.sphereCenter.z);
+    const float rotorSphereRadius = rotorBounds.sphereRadius + glm::length(glm::vec2(rotorBounds.sphereCenter));
+    const float centerDistance = glm::distance(bodyBounds.sphereCenter, rotorSphereCenter);
+    glm::vec3 sphereCenter = bodyBounds.sphereCenter;
+    float sphereRadius = bodyBounds.sphereRadius;
+    if (centerDistance + rotorSphereRadius <= sphereRadius) {
+        // The rotor is inside the body's sphere.
+    } else if (centerDistance + sphereRadius <= rotorSphereRadius) {
+        sphereCenter = rotorSphereCenter;
+        sphereRadius = rotorSphereRadius;
+    } else {
+        const float unionRadius = 0.5f * (centerDistance + sphereRadius + rotorSphereRadius);
+        sphereCenter += (unionRadius - sphereRadius) / centerDistance * (rotorSphereCenter - sphereCenter);
+        sphereRadius = unionRadius;
+    }
+    // The instances are rotated around the y axis; grow the sphere such that it contains every yaw.
+    const float yawRadius = sphereRadius + glm::length(glm::vec2(sphereCenter.x, sphereCenter.z));
+    m_windFarmCuller.clear();
+    m_windFarmCuller.reserve(instances.size());
+    for (const WindmillInstance& instance : instances)
+        m_windFarmCuller.addSphere(instance.position + glm::vec3(0.0f, sphereCenter.y, 0.0f), yawRadius);
+
+    if (m_windFarmInstanceVbo == 0)
+        glGenBuffers(1, &m_windFarmInstanceVbo);
+    for (GPUMesh* pMesh : { &*m_windmillBodyMesh, &*m_windmillRotorMesh }) {
+        pMesh->setInstanceAttribute(3, 4, m_windFarmInstanceVbo, sizeof(WindmillInstance), offsetof(WindmillInstance, position));
+        pMesh->setInstanceAttribute(4, 2, m_windFarmInstanceVbo, sizeof(WindmillInstance), offsetof(WindmillInstance, rotorPhase));
+    }
+
+    m_windFarmNumInstances = static_cast<GLsizei>(instances.size());
+    m_windFarmNumVisibleInstances = 0;
+    m_windFarmStartTime = glfwGetTime();
+    m_windFarmDirty = false;
+}
+
+void Application::renderWindFarm()
+{
+    if (m_windFarmNumInstances == 0)
+        return;
+
+    // Upload the instances that intersect the view frustum; orphan the buffer such that the previous frame's draws do
+    // not have to finish first.
+    const std::vector<WindmillInstance>* pVisibleInstances = &m_windFarmInstances;
+    if (m_frustumCullingEnabled) {
+        m_windFarmCuller.cull(m_projectionMatrix * m_viewMatrix, m_windFarmVisibility);
+        m_visibleWindFarmInstances.clear();
+        for (size_t i = 0; i < m_windFarmInstances.size(); ++i) {
+            if (m_windFarmVisibility[i])
+                m_visibleWindFarmInstances.push_back(m_windFarmInstances[i]);
+        }
+        pVisibleInstances = &m_visibleWindFarmInstances;
+    }
+    m_windFarmNumVisibleInstances = static_cast<GLsizei>(pVisibleInstances->size());
+    if (m_windFarmNumVisibleInstances == 0)
+        return;
+    const auto instanceDataSize = static_cast<GLsizeiptr>(pVisibleInstances->size() * sizeof(WindmillInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, m_windFarmInstanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, instanceDataSize, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instanceDataSize, pVisibleInstances->data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glUniform3fv(m_defaultShader.getUniformLocation("lightPositions"), count, glm::value_ptr(positions[0]));
-    glUniform3fv(m_defaultShader.getUniformLocation("lightColors"), count, glm::value_ptr(colors[0]));
-    glUniform1iv(m_defaultShader.getUniformLocation("lightIsSpotlight"), count, spotFlags.data());
-    glUniform3fv(m_defaultShader.getUniformLocation("lightDirections"), count, glm::value_ptr(directions[0]));
-    glUniform1fv(m_defaultShader.getUniformLocation("lightSpotCosCutoff"), count, cosCutoff.data());
-    glUniform1fv(m_defaultShader.getUniformLocation("lightSpotSoftness"), count, softness.data());
+    // The rotors are animated on the GPU from the time, each instance's phase and its speed.
+    m_windFarmTimer.begin();
+    m_windFarmShader.bind();
+    setLightingUniforms(m_windFarmShader);
+    m_windFarmShader.set("time", static_cast<float>(glfwGetTime() - m_windFarmStartTime));
+    m_windFarmShader.set("rotorSpeed", glm::radians(m_windmillParams.rotationSpeedDegPerSec));
+    m_windFarmShader.set("hubPosition", computeHubPosition(m_windmillParams));
+    m_windFarmShader.set("hasTexCoords", false);
+    m_windFarmShader.set("useMaterial", m_useMaterial);
+    m_windFarmShader.set("isRotor", false);
+    m_windmillBodyMesh->drawInstanced(m_windFarmShader, m_windFarmNumVisibleInstances);
+    m_windFarmShader.set("isRotor", true);
+    m_windmillRotorMesh->drawInstanced(m_windFarmShader, m_windFarmNumVisibleInstances);
+    m_windFarmTimer.end();
 }
 
-int main()
+void Application::benchmarkMeshArena()
 {
+    // Draw 1000 small meshes with the depth only shadow shader, once with every mesh in buffers of its own (how meshes
+    // were stored before the arena) and once with all meshes in a single arena page. Color and depth writes are
+    // disabled such that the frame that is being rendered is not affected.
+    constexpr size_t numMeshes = 1000;
+    constexpr int numIterations = 20;
+    std::mt19937 rng { 12345 };
+    std::uniform_real_distribution<float> unitDistribution { 0.0f, 1.0f };
+    std::vector<Mesh> cpuMeshes;
+    std::vector<glm::mat4> modelMatrices;
+    for (size_t i = 0; i < numMeshes; ++i) {
+        cpuMeshes.push_back(createBoxMesh(glm::vec3(0.05f) + 0.2f * glm::vec3(unitDistribution(rng), unitDistribution(rng), unitDistribution(rng))));
+        modelMatrices.push_back(glm::translate(glm::mat4(1.0f), 10.0f * glm::vec3(unitDistribution(rng), unitDistribution(rng), unitDistribution(rng)) - 5.0f));
+    }
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    m_shadowShader.bind();
+    const glm::mat4 viewProjectionMatrix = m_projectionMatrix * m_viewMatrix;
+    std::string results;
+    for (const bool separateBuffers : { true, false }) {
+        // Pages of a single vertex and index hold exactly one mesh each.
+        const std::shared_ptr<GPUBufferArena> pArena = separateBuffers ? GPUMesh::createArena(GPUVertexFormat::Float, 1, 1) : GPUMesh::createArena(GPUVertexFormat::Float, 1 << 16, 1 << 20);
+        std::vector<GPUMesh> meshes;
+        for (const Mesh& cpuMesh : cpuMeshes)
+            meshes.emplace_back(cpuMesh, GPUVertexFormat::Float, pArena);
+
+        size_t numVertexArrayBinds = 0;
+        const auto drawMeshes = [&]() {
+            GLuint boundVertexArray = 0;
+            numVertexArrayBinds = 0;
+            for (size_t i = 0; i < numMeshes; ++i) {
+                m_shadowShader.set("mvpMatrix", viewProjectionMatrix * modelMatrices[i]);
+                if (meshes[i].vertexArray() != boundVertexArray) {
+                    boundVertexArray = meshes[i].vertexArray();
+                    glBindVertexArray(boundVertexArray);
+                    ++numVertexArrayBinds;
+                }
+                meshes[i].drawGeometryWithoutBinding();
+            }
+        };
+        drawMeshes(); // Warm up.
+        glFinish();
+
+        GpuTimer gpuTimer;
+        const auto start = std::chrono::steady_clock::now();
+        gpuTimer.begin();
+        for (int iteration = 0; iteration < numIterations; ++iteration)
+            drawMeshes();
+        gpuTimer.end();
+        const float submitTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / numIterations;
+        glFinish();
+        const float frameTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / numIterations;
+        const float gpuTimeMs = gpuTimer.waitForMs() / numIterations;
+
+        const GPUBufferArena::Stats stats = pArena->stats();
+        results += fmt::format("{}: {} pages, {} VAO binds, submit {:.3f} ms, frame {:.3f} ms, GPU {:.3f} ms\n",
+            separateBuffers ? "Separate buffers" : "Shared arena", stats.numPages, numVertexArrayBinds, submitTimeMs, frameTimeMs, gpuTimeMs);
+
+        if (!separateBuffers) {
+            // Punch holes into the arena and close them again.
+            std::vector<GPUMesh> remainingMeshes;
+            for (size_t i = 0; i < meshes.size(); i += 2)
+                remainingMeshes.push_back(std::move(meshes[i]));
+            meshes.clear();
+            const size_t numFreeRanges = pArena->stats().numFreeRanges;
+            const auto defragmentStart = std::chrono::steady_clock::now();
+            const size_t numBytesMoved = pArena->defragment();
+            glFinish();
+            const float defragmentTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - defragmentStart).count();
+            results += fmt::format("Defragmenting after freeing every other mesh: {} -> {} free ranges, {} KiB moved in {:.3f} ms\n",
+                numFreeRanges, pArena->stats().numFreeRanges, numBytesMoved / 1024, defragmentTimeMs);
+        }
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+
+    m_meshArenaBenchmarkResults = fmt::format("{} meshes, {} iterations\n{}", numMeshes, numIterations, results);
+    std::cout << m_meshArenaBenchmarkResults << std::flush;
+}
+
+const std::vector<Mesh>& Application::cpuMeshes()
+{
+    // The GPU meshes do not keep their vertices, so the CPU loads its own copy (from the mesh cache if it exists, which
+    // the GPU meshes were loaded from as well).
+    if (m_cpuMeshes.empty()) {
+        const LoadMeshSettings settings = GPUMesh::loadSettings(false);
+        if (const auto cache = MeshCache::open(sceneMeshFile, settings))
+            m_cpuMeshes = cache->toMeshes();
+        else
+            m_cpuMeshes = loadMesh(sceneMeshFile, settings);
+    }
+    return m_cpuMeshes;
+}
+
+RayTracingScene Application::buildRayTracingScene()
+{
+    RayTracingScene scene;
+    if (!m_meshes.empty()) {
+        // Like the rasterizer, textured meshes are shaded with the checkerboard texture once it is loaded.
+        const std::shared_ptr<const Image> pColorMap = m_texture ? loadImageCached(sceneTextureFile) : nullptr;
+        for (const Mesh& mesh : cpuMeshes())
+            scene.addMesh(mesh, m_modelMatrix, pColorMap);
+    }
+    if (m_windmillBodyMesh && m_windmillRotorMesh) {
+        m_sceneGraph.updateWorldMatrices();
+        const WindmillMeshes windmillMeshes = buildWindmillMeshes(m_windmillParams);
+        scene.addMesh(windmillMeshes.body, m_sceneGraph.worldMatrix(m_windmillBodyNode));
+        scene.addMesh(windmillMeshes.rotor, m_sceneGraph.worldMatrix(m_windmillRotorNode));
+    }
+
+    for (const RayTracingLight& light : rayTracingLights())
+        scene.addLight(light);
+    scene.buildBVH();
+    return scene;
+}
+
+std::vector<RayTracingLight> Application::rayTracingLights() const
+{
+    // Same conversion as in updateFrameUniforms().
+    std::vector<RayTracingLight> lights;
+    for (const Light& light : m_lights) {
+        const float directionLength = glm::length(light.direction);
+        lights.push_back(RayTracingLight {
+            .position = light.position,
+            .color = light.color,
+            .direction = light.isSpotlight ? (directionLength > 1e-4f ? light.direction / directionLength : glm::vec3(0.0f, -1.0f, 0.0f)) : glm::vec3(0.0f),
+            .spotCosCutoff = glm::clamp(light.spotCosCutoff, 0.0f, 1.0f),
+            .spotSoftness = glm::clamp(light.spotSoftness, 0.0f, 1.0f),
+            .range = std::max(light.range, 1e-3f),
+            .castsShadows = light.castsShadows });
+    }
+    return lights;
+}
+
+RayTracingShading Application::rayTracingShading() const
+{
+    return RayTracingShading {
+        .shadingMode = static_cast<int>(m_shadingModel),
+        .customDiffuseColor = m_customDiffuseColor,
+        .specularStrength = m_specularStrength,
+        .specularColor = m_specularColor,
+        .specularShininess = m_specularShininess,
+        .useMaterial = m_useMaterial,
+        .shadows = m_shadowsEnabled
+    };
+}
+
+void Application::updateReferenceView(const Trackball& camera)
+{
+    if (!m_referenceViewEnabled) {
+        m_pathTracer.stop();
+        m_pPathTracingScene.reset();
+        m_referenceViewInputs.reset();
+        m_referenceViewNumSamples = 0;
+        return;
+    }
+
+    ReferenceViewInputs inputs {
+        .viewMatrix = m_viewMatrix,
+        .projectionMatrix = m_projectionMatrix,
+        .resolution = m_window.getFrameBufferSize(),
+        .shading = rayTracingShading(),
+        .lights = rayTracingLights(),
+        .windmillParams = m_windmillParams,
+        .numMeshes = m_meshes.size(),
+        .textured = m_texture.has_value(),
+        .maxBounces = m_pathTracingMaxBounces
+    };
+    if (inputs != m_referenceViewInputs && inputs.resolution.x > 0 && inputs.resolution.y > 0) {
+        const bool geometryChanged = !m_pPathTracingScene || inputs.windmillParams != m_referenceViewInputs->windmillParams
+            || inputs.numMeshes != m_referenceViewInputs->numMeshes || inputs.textured != m_referenceViewInputs->textured;
+        // The workers must be done with the scene before it is modified.
+        m_pathTracer.stop();
+        m_referenceViewNumSamples = 0;
+        if (geometryChanged) {
+            // Building the BVH takes too long to do on every frame while a slider is dragged; wait until it is released.
+            m_pPathTracingScene.reset();
+            if (ImGui::IsAnyItemActive())
+                return;
+            m_pPathTracingScene = std::make_shared<RayTracingScene>(buildRayTracingScene());
+        } else {
+            m_pPathTracingScene->clearLights();
+            for (const RayTracingLight& light : inputs.lights)
+                m_pPathTracingScene->addLight(light);
+        }
+        m_pathTracer.start(m_pPathTracingScene, camera, inputs.shading, inputs.resolution, static_cast<uint32_t>(inputs.maxBounces));
+        m_referenceViewInputs = std::move(inputs);
+    }
+
+    if (!m_pathTracer.resolve(m_referenceViewPixels))
+        return;
+    const glm::ivec2 resolution = m_pathTracer.resolution();
+    if (resolution != m_referenceViewTextureSize) {
+        if (m_referenceViewTexture == 0) {
+            glGenTextures(1, &m_referenceViewTexture);
+            glGenFramebuffers(1, &m_referenceViewFramebuffer);
+        }
+        // RGBA32F because RGB32F does not have to be supported as a render target, which the blit needs.
+        glBindTexture(GL_TEXTURE_2D, m_referenceViewTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution.x, resolution.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_referenceViewFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_referenceViewTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_referenceViewTextureSize = resolution;
+    }
+    glBindTexture(GL_TEXTURE_2D, m_referenceViewTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGB, GL_FLOAT, m_referenceViewPixels.data());
+    m_referenceViewNumSamples = m_pathTracer.numSamplesPerPixel();
+}
+
+void Application::drawReferenceView()
+{
+    // The texture is as large as the framebuffer was when the path tracer was started.
+    const glm::ivec2 size = m_window.getFrameBufferSize();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_referenceViewFramebuffer);
+    glBlitFramebuffer(0, 0, m_referenceViewTextureSize.x, m_referenceViewTextureSize.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Application::pickObject(const glm::vec2& ndc)
+{
+    // Every object is intersected in its own object space, where the BVHs are built once (the windmill is small enough
+    // to build its BVHs on every click). The ray direction is not normalized after the transformation, so ray.t stays
+    // comparable between objects.
+    const Ray worldRay = activeTrackball().generateRay(ndc);
+    float closestT = worldRay.t;
+    std::string closestObject;
+    const auto pick = [&](const BVH& bvh, const glm::mat4& modelMatrix, std::string_view name) {
+        const glm::mat4 inverseModelMatrix = glm::inverse(modelMatrix);
+        Ray ray {
+            .origin = glm::vec3(inverseModelMatrix * glm::vec4(worldRay.origin, 1.0f)),
+            .direction = glm::mat3(inverseModelMatrix) * worldRay.direction,
+            .t = closestT
+        };
+        if (const std::optional<BVHHit> hit = bvh.intersect(ray)) {
+            closestT = ray.t;
+            closestObject = fmt::format("{} (mesh {}, triangle {})", name, hit->mesh, hit->triangle);
+        }
+    };
+    if (!m_meshes.empty()) {
+        if (!m_cpuMeshBVH)
+            m_cpuMeshBVH.emplace(cpuMeshes());
+        pick(*m_cpuMeshBVH, m_modelMatrix, "scene mesh");
+    }
+    if (m_windmillBodyMesh && m_windmillRotorMesh) {
+        m_sceneGraph.updateWorldMatrices();
+        const WindmillMeshes windmillMeshes = buildWindmillMeshes(m_windmillParams);
+        pick(BVH(windmillMeshes.body), m_sceneGraph.worldMatrix(m_windmillBodyNode), "windmill body");
+        pick(BVH(windmillMeshes.rotor), m_sceneGraph.worldMatrix(m_windmillRotorNode), "windmill rotor");
+    }
+
+    if (closestObject.empty()) {
+        m_pickResults = "Picked nothing";
+    } else {
+        const glm::vec3 position = worldRay.origin + closestT * worldRay.direction;
+        m_pickResults = fmt::format("Picked {} at ({:.2f}, {:.2f}, {:.2f})", closestObject, position.x, position.y, position.z);
+    }
+    std::cout << m_pickResults << std::endl;
+}
+
+void Application::renderReferenceImage(const std::filesystem::path& filePath)
+{
+    const RayTracingScene scene = buildRayTracingScene();
+    const RayTracingShading shading = rayTracingShading();
+    // The rays of the trackball have the aspect ratio of the window.
+    const glm::ivec2 size = m_window.getFrameBufferSize();
+    Image image { size.x, size.y, 3 };
+    const RayTracingStats stats = rayTraceImage(scene, activeTrackball(), shading, image);
+    image.writeBitmapToFile(filePath);
+
+    m_referenceRenderResults = fmt::format("{}x{}, {} triangles: {:.2f} s, {:.2f} Mrays/s on {} threads", size.x, size.y, scene.numTriangles(),
+        stats.seconds, stats.megaRaysPerSecond(), numWorkerThreads());
+    std::cout << "Reference image written to " << filePath.string() << " (" << m_referenceRenderResults << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    // Benchmark scene: --wind-farm [number of windmills]
+    std::optional<int> numWindmills;
+    if (const auto arg = std::find(argv + 1, argv + argc, std::string_view("--wind-farm")); arg != argv + argc) {
+        numWindmills = 10000;
+        // The count is optional; a following flag is not consumed as the count.
+        if (arg + 1 != argv + argc && !std::string_view(arg[1]).starts_with("--")) {
+            const std::string_view value { arg[1] };
+            int count = 0;
+            const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+            if (ec != std::errc {} || ptr != value.data() + value.size() || count <= 0) {
+                std::cerr << "Invalid number of windmills \"" << value << "\" for --wind-farm (expected a positive integer)" << std::endl;
+                return 1;
+            }
+            numWindmills = count;
+        }
+    }
+
     Application app;
+    // Render the default view with the CPU ray tracer and exit: --reference-render <output.bmp>
+    if (const auto arg = std::find(argv + 1, argv + argc, std::string_view("--reference-render")); arg != argv + argc) {
+        app.waitForAssets();
+        app.renderReferenceImage(arg + 1 != argv + argc ? arg[1] : "reference.bmp");
+        return 0;
+    }
+    // Headless/benchmark runs can wait for all assets instead of letting them pop in.
+    if (std::find(argv + 1, argv + argc, std::string_view("--wait-for-assets")) != argv + argc)
+        app.waitForAssets();
+    if (numWindmills)
+        app.enableWindFarm(*numWindmills);
     app.update();
 
     return 0;
@@ -0,0 +1,212 @@
+#include "asset_loader.h"
+#include <framework/image_cache.h>
+#include <framework/mesh_cache.h>
+#include <framework/parallel.h>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+struct AssetLoader::Request {
+    explicit Request(std::filesystem::path assetFilePath)
+        : filePath(std::move(assetFilePath))
+    {
+    }
+    virtual ~Request() = default;
+
+    // Called on a worker thread.
+    virtual void load() = 0;
+    // Called on the OpenGL thread; creates (part of) the OpenGL objects and returns true once the callback was invoked.
+    virtual bool uploadNext() = 0;
+
+    std::filesystem::path filePath;
+    std::exception_ptr pError;
+};
+
+namespace {
+
+class MeshRequest : public AssetLoader::Request {
+public:
+    MeshRequest(std::filesystem::path meshFilePath, bool normalize, GPUVertexFormat vertexFormat, AssetLoader::MeshCallback callback)
+        : Request(std::move(meshFilePath))
+        , m_settings(GPUMesh::loadSettings(normalize))
+        , m_vertexFormat(vertexFormat)
+        , m_callback(std::move(callback))
+    {
+    }
+
+    void load() override
+    {
+        if (!std::filesystem::exists(filePath))
+            throw MeshLoadingException("File " + filePath.string() + " does not exist");
+
+        // Upload straight from the memory mapped cache if possible. The materials are created here because that
+        // requires loading their textures from disk.
+        m_cache = MeshCache::open(filePath, m_settings);
+        if (m_cache) {
+            m_cachedMaterials.resize(m_cache->numSubMeshes());
+            parallelFor(m_cachedMaterials.size(), [&](size_t i) { m_cachedMaterials[i] = m_cache->material(i); });
+        } else {
+            m_subMeshes = GPUMesh::loadAndCacheMeshes(filePath, m_settings);
+        }
+    }
+
+    bool uploadNext() override
+    {
+        // One sub mesh at a time so that large models are spread over multiple frames.
+        const size_t subMesh = m_gpuMeshes.size();
+        if (m_cache && subMesh < m_cache->numSubMeshes())
+            m_gpuMeshes.emplace_back(m_cache->vertices(subMesh), m_cache->triangles(subMesh), m_cachedMaterials[subMesh], m_cache->clusters(subMesh), m_vertexFormat);
+        else if (!m_cache && subMesh < m_subMeshes.size())
+            m_gpuMeshes.emplace_back(m_subMeshes[subMesh], m_vertexFormat);
+
+        if (m_gpuMeshes.size() != (m_cache ? m_cache->numSubMeshes() : m_subMeshes.size()))
+            return false;
+        m_callback(std::move(m_gpuMeshes));
+        return true;
+    }
+
+private:
+    LoadMeshSettings m_settings;
+    GPUVertexFormat m_vertexFormat;
+    AssetLoader::MeshCallback m_callback;
+
+    std::optional<MeshCache> m_cache;
+    std::vector<Material> m_cachedMaterials;
+    std::vector<Mesh> m_subMeshes;
+    std::vector<GPUMesh> m_gpuMeshes;
+};
+
+class TextureRequest : public AssetLoader::Request {
+public:
+    TextureRequest(std::filesystem::path textureFilePath, AssetLoader::TextureCallback callback)
+        : Request(std::move(textureFilePath))
+        , m_callback(std::move(callback))
+    {
+    }
+
+    void load() override
+    {
+        m_pImage = loadImageCached(filePath);
+    }
+
+    bool uploadNext() override
+    {
+        m_callback(Texture(*m_pImage));
+        return true;
+    }
+
+private:
+    AssetLoader::TextureCallback m_callback;
+    std::shared_ptr<Image> m_pImage;
+};
+
+}
+
+AssetLoader::AssetLoader(unsigned numThreads)
+{
+    for (unsigned i = 0; i < std::max(numThreads, 1u); ++i)
+        m_workers.emplace_back([this](std::stop_token stopToken) { workerLoop(stopToken); });
+}
+
+AssetLoader::~AssetLoader()
+{
+    // Requests that are still being loaded are finished but never uploaded.
+    for (std::jthread& worker : m_workers)
+        worker.request_stop();
+    m_workers.clear();
+}
+
+void AssetLoader::loadMesh(std::filesystem::path filePath, bool normalize, GPUVertexFormat vertexFormat, MeshCallback callback)
+{
+    submit(std::make_unique<MeshRequest>(std::move(filePath), normalize, vertexFormat, std::move(callback)));
+}
+
+void AssetLoader::loadTexture(std::filesystem::path filePath, TextureCallback callback)
+{
+    submit(std::make_unique<TextureRequest>(std::move(filePath), std::move(callback)));
+}
+
+void AssetLoader::submit(std::unique_ptr<Request> pRequest)
+{
+    {
+        std::scoped_lock lock { m_mutex };
+        m_loadQueue.push_back(std::move(pRequest));
+        ++m_numPending;
+    }
+    m_requestAdded.notify_one();
+}
+
+void AssetLoader::workerLoop(std::stop_token stopToken)
+{
+    while (true) {
+        std::unique_ptr<Request> pRequest;
+        {
+            std::unique_lock lock { m_mutex };
+            if (!m_requestAdded.wait(lock, stopToken, [this]() { return !m_loadQueue.empty(); }))
+                return;
+            pRequest = std::move(m_loadQueue.front());
+            m_loadQueue.pop_front();
+        }
+
+        try {
+            pRequest->load();
+        } catch (...) {
+            pRequest->pError = std::current_exception();
+        }
+
+        {
+            std::scoped_lock lock { m_mutex };
+            m_uploadQueue.push_back(std::move(pRequest));
+        }
+        m_requestCompleted.notify_all();
+    }
+}
+
+void AssetLoader::update(std::chrono::microseconds timeBudget)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = timeBudget == std::chrono::microseconds::max() ? Clock::time_point::max() : Clock::now() + timeBudget;
+    do {
+        if (!m_pCurrentUpload) {
+            std::scoped_lock lock { m_mutex };
+            if (m_uploadQueue.empty())
+                return;
+            m_pCurrentUpload = std::move(m_uploadQueue.front());
+            m_uploadQueue.pop_front();
+        }
+
+        bool finished = true;
+        try {
+            if (m_pCurrentUpload->pError)
+                std::rethrow_exception(m_pCurrentUpload->pError);
+            finished = m_pCurrentUpload->uploadNext();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load asset " << m_pCurrentUpload->filePath << ": " << e.what() << std::endl;
+        }
+
+        if (finished) {
+            m_pCurrentUpload.reset();
+            std::scoped_lock lock { m_mutex };
+            --m_numPending;
+        }
+    } while (Clock::now() < deadline);
+}
+
+void AssetLoader::waitUntilIdle()
+{
+    while (numPending() > 0) {
+        if (!m_pCurrentUpload) {
+            std::unique_lock lock { m_mutex };
+            m_requestCompleted.wait(lock, [this]() { return !m_uploadQueue.empty(); });
+        }
+        update(std::chrono::microseconds::max());
+    }
+}
+
+size_t AssetLoader::numPending() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_numPending;
+}
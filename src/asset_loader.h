@@ -0,0 +1,66 @@
+#pragma once
+#include "mesh.h"
+#include "texture.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Loads meshes and textures in the background so that the application does not stall while reading assets.
+//
+// Worker threads do all the disk I/O, OBJ parsing and image decoding. The finished assets are placed in a completion
+// queue from which update() creates the OpenGL objects on the main (OpenGL) thread and hands them to the callbacks.
+// Callbacks are therefore always invoked on the thread that calls update() or waitUntilIdle(). Assets that fail to
+// load are reported on std::cerr and their callback is never invoked.
+class AssetLoader {
+public:
+    using MeshCallback = std::function<void(std::vector<GPUMesh>&&)>;
+    using TextureCallback = std::function<void(Texture&&)>;
+
+    explicit AssetLoader(unsigned numThreads = 2);
+    AssetLoader(const AssetLoader&) = delete;
+    ~AssetLoader();
+
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // Same as GPUMesh::loadMeshGPU(), including the use of the mesh cache.
+    void loadMesh(std::filesystem::path filePath, bool normalize, GPUVertexFormat vertexFormat, MeshCallback callback);
+    void loadTexture(std::filesystem::path filePath, TextureCallback callback);
+
+    // Create the OpenGL objects of finished assets until the time budget is spent. At least one sub mesh or texture
+    // is uploaded per call (if available) such that loading always makes progress. Must be called on the OpenGL thread.
+    void update(std::chrono::microseconds timeBudget);
+    // Block until all requested assets have been loaded and handed to their callbacks (e.g. for headless or benchmark
+    // runs). Must be called on the OpenGL thread.
+    void waitUntilIdle();
+
+    // Number of requested assets that have not been handed to their callback yet.
+    [[nodiscard]] size_t numPending() const;
+
+public:
+    struct Request;
+
+private:
+    void submit(std::unique_ptr<Request> pRequest);
+    void workerLoop(std::stop_token stopToken);
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable_any m_requestAdded;
+    std::condition_variable m_requestCompleted;
+    std::deque<std::unique_ptr<Request>> m_loadQueue;
+    std::deque<std::unique_ptr<Request>> m_uploadQueue;
+    size_t m_numPending { 0 };
+
+    // Request that is partially uploaded; only accessed from the OpenGL thread.
+    std::unique_ptr<Request> m_pCurrentUpload;
+
+    std::vector<std::jthread> m_workers;
+};
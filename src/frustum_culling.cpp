@@ -0,0 +1,189 @@
+#include "frustum_culling.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t simdWidth = 4;
+
+}
+
+Frustum::Frustum(const glm::mat4& viewProjectionMatrix)
+{
+    // Rows of the matrix; a clip space position is inside if -w <= x, y, z <= w.
+    const glm::mat4 transposed = glm::transpose(viewProjectionMatrix);
+    planes = {
+        transposed[3] + transposed[0], transposed[3] - transposed[0],
+        transposed[3] + transposed[1], transposed[3] - transposed[1],
+        transposed[3] + transposed[2], transposed[3] - transposed[2]
+    };
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+void FrustumCuller::clear()
+{
+    m_numObjects = 0;
+    for (std::vector<float>* pArray : { &m_centerX, &m_centerY, &m_centerZ, &m_radius, &m_lowerX, &m_lowerY, &m_lowerZ, &m_upperX, &m_upperY, &m_upperZ })
+        pArray->clear();
+}
+
+void FrustumCuller::reserve(size_t numObjects)
+{
+    const size_t paddedSize = (numObjects + simdWidth - 1) / simdWidth * simdWidth;
+    for (std::vector<float>* pArray : { &m_centerX, &m_centerY, &m_centerZ, &m_radius, &m_lowerX, &m_lowerY, &m_lowerZ, &m_upperX, &m_upperY, &m_upperZ })
+        pArray->reserve(paddedSize);
+}
+
+size_t FrustumCuller::add(const MeshBounds& objectBounds, const glm::mat4& modelMatrix)
+{
+    // Transform the box by its center and its extent along the world axes (Arvo); the sphere grows with the largest
+    // scale factor of the model matrix.
+    const glm::mat3 linear { modelMatrix };
+    const glm::mat3 absLinear { glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]) };
+    const glm::vec3 boxCenter = glm::vec3(modelMatrix * glm::vec4(0.5f * (objectBounds.lower + objectBounds.upper), 1.0f));
+    const glm::vec3 boxExtent = absLinear * (0.5f * (objectBounds.upper - objectBounds.lower));
+    const float maxScale = std::max({ glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]) });
+    push(glm::vec3(modelMatrix * glm::vec4(objectBounds.sphereCenter, 1.0f)), objectBounds.sphereRadius * maxScale, boxCenter - boxExtent, boxCenter + boxExtent);
+    return m_numObjects - 1;
+}
+
+size_t FrustumCuller::addSphere(const glm::vec3& center, float radius)
+{
+    push(center, radius, center - radius, center + radius);
+    return m_numObjects - 1;
+}
+
+size_t FrustumCuller::size() const
+{
+    return m_numObjects;
+}
+
+void FrustumCuller::push(const glm::vec3& center, float radius, const glm::vec3& lower, const glm::vec3& upper)
+{
+    // Overwrite the padding of the last group of four if there is any.
+    const size_t index = m_numObjects++;
+    if (index == m_centerX.size()) {
+        for (std::vector<float>* pArray : { &m_centerX, &m_centerY, &m_centerZ, &m_radius, &m_lowerX, &m_lowerY, &m_lowerZ, &m_upperX, &m_upperY, &m_upperZ })
+            pArray->resize(index + simdWidth, 0.0f);
+    }
+    m_centerX[index] = center.x;
+    m_centerY[index] = center.y;
+    m_centerZ[index] = center.z;
+    m_radius[index] = radius;
+    m_lowerX[index] = lower.x;
+    m_lowerY[index] = lower.y;
+    m_lowerZ[index] = lower.z;
+    m_upperX[index] = upper.x;
+    m_upperY[index] = upper.y;
+    m_upperZ[index] = upper.z;
+}
+
+size_t FrustumCuller::cull(const glm::mat4& viewProjectionMatrix, std::vector<uint8_t>& visibility) const
+{
+    const Frustum frustum { viewProjectionMatrix };
+    visibility.resize(m_numObjects);
+
+    size_t numVisible = 0;
+    for (size_t first = 0; first < m_numObjects; first += simdWidth) {
+        const size_t numLanes = std::min(simdWidth, m_numObjects - first);
+#ifdef FRUSTUM_CULLING_SSE
+        const __m128 centerX = _mm_loadu_ps(&m_centerX[first]);
+        const __m128 centerY = _mm_loadu_ps(&m_centerY[first]);
+        const __m128 centerZ = _mm_loadu_ps(&m_centerZ[first]);
+        const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_radius[first]));
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+        for (const glm::vec4& plane : frustum.planes) {
+            const __m128 normalX = _mm_set1_ps(plane.x);
+            const __m128 normalY = _mm_set1_ps(plane.y);
+            const __m128 normalZ = _mm_set1_ps(plane.z);
+            const __m128 offset = _mm_set1_ps(plane.w);
+
+            const __m128 sphereDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, centerX), _mm_mul_ps(normalY, centerY)), _mm_add_ps(_mm_mul_ps(normalZ, centerZ), offset));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(sphereDistance, negativeRadius));
+
+            // The corner of each box that lies farthest along the plane normal is the same for all four boxes.
+            const __m128 cornerX = _mm_loadu_ps(plane.x >= 0.0f ? &m_upperX[first] : &m_lowerX[first]);
+            const __m128 cornerY = _mm_loadu_ps(plane.y >= 0.0f ? &m_upperY[first] : &m_lowerY[first]);
+            const __m128 cornerZ = _mm_loadu_ps(plane.z >= 0.0f ? &m_upperZ[first] : &m_lowerZ[first]);
+            const __m128 boxDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, cornerX), _mm_mul_ps(normalY, cornerY)), _mm_add_ps(_mm_mul_ps(normalZ, cornerZ), offset));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(boxDistance, _mm_setzero_ps()));
+        }
+        const int insideMask = _mm_movemask_ps(inside);
+        for (size_t lane = 0; lane < numLanes; ++lane) {
+            const auto isVisible = static_cast<uint8_t>((insideMask >> lane) & 1);
+            visibility[first + lane] = isVisible;
+            numVisible += isVisible;
+        }
+#else
+        for (size_t i = first; i < first + numLanes; ++i) {
+            const bool isVisible = std::all_of(std::begin(frustum.planes), std::end(frustum.planes), [&](const glm::vec4& plane) {
+                const float sphereDistance = plane.x * m_centerX[i] + plane.y * m_centerY[i] + plane.z * m_centerZ[i] + plane.w;
+                const glm::vec3 corner {
+                    plane.x >= 0.0f ? m_upperX[i] : m_lowerX[i],
+                    plane.y >= 0.0f ? m_upperY[i] : m_lowerY[i],
+                    plane.z >= 0.0f ? m_upperZ[i] : m_lowerZ[i]
+                };
+                return sphereDistance >= -m_radius[i] && glm::dot(glm::vec3(plane), corner) + plane.w >= 0.0f;
+            });
+            visibility[i] = isVisible ? 1 : 0;
+            numVisible += isVisible ? 1 : 0;
+        }
+#endif
+    }
+    return numVisible;
+}
+
+ClusterCullingStats& ClusterCullingStats::operator+=(const ClusterCullingStats& other)
+{
+    numVisible += other.numVisible;
+    numOutsideFrustum += other.numOutsideFrustum;
+    numBackFacing += other.numBackFacing;
+    return *this;
+}
+
+ClusterCuller::ClusterCuller(std::span<const MeshCluster> clusters)
+{
+    m_bounds.reserve(clusters.size());
+    m_spheres.reserve(clusters.size());
+    m_cones.reserve(clusters.size());
+    for (const MeshCluster& cluster : clusters) {
+        m_bounds.add(cluster.bounds, glm::mat4(1.0f));
+        m_spheres.emplace_back(cluster.bounds.sphereCenter, cluster.bounds.sphereRadius);
+        m_cones.emplace_back(cluster.coneAxis, cluster.coneCutoff);
+    }
+}
+
+ClusterCullingStats ClusterCuller::cull(const glm::mat4& modelViewProjectionMatrix, const std::optional<glm::vec3>& objectSpaceViewPosition, std::vector<uint8_t>& visibility) const
+{
+    ClusterCullingStats stats;
+    stats.numVisible = m_bounds.cull(modelViewProjectionMatrix, visibility);
+    stats.numOutsideFrustum = m_bounds.size() - stats.numVisible;
+    if (!objectSpaceViewPosition)
+        return stats;
+
+    // Only the clusters inside the frustum are left, so the cone test is not worth vectorizing.
+    for (size_t i = 0; i < visibility.size(); ++i) {
+        if (!visibility[i])
+            continue;
+        const glm::vec3 viewToCenter = glm::vec3(m_spheres[i]) - *objectSpaceViewPosition;
+        const float cutoff = m_cones[i].w;
+        if (glm::dot(viewToCenter, glm::vec3(m_cones[i])) > cutoff * glm::length(viewToCenter) + (1.0f + cutoff) * m_spheres[i].w) {
+            visibility[i] = 0;
+            --stats.numVisible;
+            ++stats.numBackFacing;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+#include <framework/mesh.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// The six planes of a view frustum, extracted from a view projection matrix (Gribb & Hartmann). The planes are
+// normalized and point inwards: dot(plane.xyz, p) + plane.w is the signed distance of p to the plane.
+struct Frustum {
+    explicit Frustum(const glm::mat4& viewProjectionMatrix);
+
+    std::array<glm::vec4, 6> planes;
+};
+
+// World space bounding volumes (an axis-aligned box and a sphere per object) that are culled against view frustums.
+//
+// The bounds are stored as structure-of-arrays such that cull() tests four objects against a plane at once with SSE
+// (with a scalar fallback on other architectures). An object is culled if either its sphere or its box lies completely
+// outside one of the planes.
+class FrustumCuller {
+public:
+    void clear();
+    void reserve(size_t numObjects);
+
+    // Add the bounds of a mesh placed with the given model matrix; returns the index of the object.
+    size_t add(const MeshBounds& objectBounds, const glm::mat4& modelMatrix);
+    // Add an object that is bounded by a world space sphere; returns the index of the object.
+    size_t addSphere(const glm::vec3& center, float radius);
+    [[nodiscard]] size_t size() const;
+
+    // Set visibility[i] to 1 if object i intersects the frustum and to 0 otherwise; returns the number of visible objects.
+    size_t cull(const glm::mat4& viewProjectionMatrix, std::vector<uint8_t>& visibility) const;
+
+private:
+    void push(const glm::vec3& center, float radius, const glm::vec3& lower, const glm::vec3& upper);
+
+private:
+    size_t m_numObjects { 0 };
+    // Padded to a multiple of four objects.
+    std::vector<float> m_centerX, m_centerY, m_centerZ, m_radius;
+    std::vector<float> m_lowerX, m_lowerY, m_lowerZ;
+    std::vector<float> m_upperX, m_upperY, m_upperZ;
+};
+
+// Outcome of culling the clusters of one or more meshes.
+struct ClusterCullingStats {
+    size_t numVisible { 0 };
+    size_t numOutsideFrustum { 0 };
+    size_t numBackFacing { 0 };
+
+    ClusterCullingStats& operator+=(const ClusterCullingStats& other);
+};
+
+// Culls the clusters of a mesh (see MeshCluster) against a view frustum and against their normal cones. The tests are
+// done in the object space of the mesh such that the cluster bounds never have to be transformed.
+class ClusterCuller {
+public:
+    explicit ClusterCuller(std::span<const MeshCluster> clusters);
+
+    // Set visibility[i] to 1 if cluster i intersects the frustum of modelViewProjectionMatrix and, if a view position
+    // (in object space) is given, has at least one triangle facing it. Backface culling assumes closed meshes.
+    ClusterCullingStats cull(const glm::mat4& modelViewProjectionMatrix, const std::optional<glm::vec3>& objectSpaceViewPosition, std::vector<uint8_t>& visibility) const;
+
+private:
+    FrustumCuller m_bounds;
+    std::vector<glm::vec4> m_spheres; // Center and radius.
+    std::vector<glm::vec4> m_cones; // Axis and cutoff.
+};
@@ -0,0 +1,315 @@
+#include "gpu_buffer_arena.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Index buffer ranges are aligned such that they can hold 32 bit indices.
+constexpr size_t indexAlignment = sizeof(uint32_t);
+
+}
+
+FreeListAllocator::FreeListAllocator(size_t capacity)
+    : m_capacity(capacity)
+    , m_freeSize(capacity)
+{
+    if (capacity > 0)
+        m_freeRanges.emplace(0, capacity);
+}
+
+std::optional<size_t> FreeListAllocator::allocate(size_t size, size_t alignment)
+{
+    if (size == 0)
+        return 0;
+
+    for (auto iter = std::begin(m_freeRanges); iter != std::end(m_freeRanges); ++iter) {
+        const auto [rangeOffset, rangeSize] = *iter;
+        const size_t offset = alignUp(rangeOffset, alignment);
+        if (offset + size > rangeOffset + rangeSize)
+            continue;
+
+        // Keep the padding in front of the allocation and the remainder behind it.
+        m_freeRanges.erase(iter);
+        if (offset > rangeOffset)
+            m_freeRanges.emplace(rangeOffset, offset - rangeOffset);
+        if (offset + size < rangeOffset + rangeSize)
+            m_freeRanges.emplace(offset + size, rangeOffset + rangeSize - offset - size);
+        m_freeSize -= size;
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void FreeListAllocator::free(size_t offset, size_t size)
+{
+    if (size == 0)
+        return;
+    assert(offset + size <= m_capacity);
+    m_freeSize += size;
+
+    // Merge with the free ranges directly before and after the freed range.
+    auto next = m_freeRanges.lower_bound(offset);
+    assert(next == std::end(m_freeRanges) || next->first >= offset + size);
+    if (next != std::end(m_freeRanges) && next->first == offset + size) {
+        size += next->second;
+        next = m_freeRanges.erase(next);
+    }
+    if (next != std::begin(m_freeRanges)) {
+        const auto previous = std::prev(next);
+        assert(previous->first + previous->second <= offset);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    m_freeRanges.emplace_hint(next, offset, size);
+}
+
+void FreeListAllocator::reset(size_t usedSize)
+{
+    assert(usedSize <= m_capacity);
+    m_freeRanges.clear();
+    if (usedSize < m_capacity)
+        m_freeRanges.emplace(usedSize, m_capacity - usedSize);
+    m_freeSize = m_capacity - usedSize;
+}
+
+size_t FreeListAllocator::capacity() const
+{
+    return m_capacity;
+}
+
+size_t FreeListAllocator::freeSize() const
+{
+    return m_freeSize;
+}
+
+size_t FreeListAllocator::numFreeRanges() const
+{
+    return m_freeRanges.size();
+}
+
+GPUBufferArena::GPUBufferArena(GLsizei vertexStride, std::function<void()> specifyVertexAttributes, size_t verticesPerPage, size_t indexBytesPerPage)
+    : m_vertexStride(vertexStride)
+    , m_specifyVertexAttributes(std::move(specifyVertexAttributes))
+    , m_verticesPerPage(verticesPerPage)
+    , m_indexBytesPerPage(indexBytesPerPage)
+{
+}
+
+GPUBufferArena::~GPUBufferArena()
+{
+    for (const Page& page : m_pages) {
+        glDeleteVertexArrays(1, &page.vertexArray);
+        glDeleteBuffers(1, &page.vertexBuffer);
+        glDeleteBuffers(1, &page.indexBuffer);
+    }
+}
+
+GPUBufferArena::Handle GPUBufferArena::allocate(const void* pVertices, size_t numVertices, std::span<const std::byte> indices)
+{
+    Allocation allocation { .page = Allocation::freed, .firstVertex = 0, .numVertices = numVertices, .indexOffset = 0, .indexSize = indices.size() };
+    for (size_t pageIdx = 0; pageIdx < m_pages.size() && allocation.page == Allocation::freed; ++pageIdx) {
+        Page& page = m_pages[pageIdx];
+        const std::optional<size_t> firstVertex = page.vertices.allocate(numVertices);
+        if (!firstVertex)
+            continue;
+        const std::optional<size_t> indexOffset = page.indices.allocate(indices.size(), indexAlignment);
+        if (!indexOffset) {
+            page.vertices.free(*firstVertex, numVertices);
+            continue;
+        }
+        allocation.page = static_cast<uint32_t>(pageIdx);
+        allocation.firstVertex = *firstVertex;
+        allocation.indexOffset = *indexOffset;
+    }
+    if (allocation.page == Allocation::freed) {
+        // The new page is large enough for the allocation, even if it is larger than a regular page.
+        Page& page = createPage(numVertices, indices.size());
+        allocation.page = static_cast<uint32_t>(m_pages.size() - 1);
+        allocation.firstVertex = page.vertices.allocate(numVertices).value();
+        allocation.indexOffset = page.indices.allocate(indices.size(), indexAlignment).value();
+    }
+
+    Page& page = m_pages[allocation.page];
+    ++page.numAllocations;
+    // Upload through the copy targets such that the element array binding of the bound vertex array is not changed.
+    if (numVertices > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.firstVertex * size_t(m_vertexStride)),
+            static_cast<GLsizeiptr>(numVertices * size_t(m_vertexStride)), pVertices);
+    }
+    if (!indices.empty()) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.indexOffset), static_cast<GLsizeiptr>(indices.size()), indices.data());
+    }
+
+    if (m_freeHandles.empty()) {
+        m_allocations.push_back(allocation);
+        return static_cast<Handle>(m_allocations.size() - 1);
+    }
+    const Handle handle = m_freeHandles.back();
+    m_freeHandles.pop_back();
+    m_allocations[handle] = allocation;
+    return handle;
+}
+
+void GPUBufferArena::free(Handle handle)
+{
+    Allocation& allocation = m_allocations[handle];
+    assert(allocation.page != Allocation::freed);
+    Page& page = m_pages[allocation.page];
+    page.vertices.free(allocation.firstVertex, allocation.numVertices);
+    page.indices.free(allocation.indexOffset, allocation.indexSize);
+    --page.numAllocations;
+    allocation.page = Allocation::freed;
+    m_freeHandles.push_back(handle);
+}
+
+GPUBufferArena::Location GPUBufferArena::location(Handle handle) const
+{
+    const Allocation& allocation = m_allocations[handle];
+    const Page& page = m_pages[allocation.page];
+    return Location {
+        .vertexArray = page.vertexArray,
+        .vertexBuffer = page.vertexBuffer,
+        .indexBuffer = page.indexBuffer,
+        .baseVertex = static_cast<GLint>(allocation.firstVertex),
+        .indexOffset = allocation.indexOffset
+    };
+}
+
+void GPUBufferArena::updateVertices(Handle handle, size_t firstVertex, const void* pVertices, size_t numVertices)
+{
+    const Allocation& allocation = m_allocations[handle];
+    assert(firstVertex + numVertices <= allocation.numVertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_pages[allocation.page].vertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>((allocation.firstVertex + firstVertex) * size_t(m_vertexStride)),
+        static_cast<GLsizeiptr>(numVertices * size_t(m_vertexStride)), pVertices);
+}
+
+void GPUBufferArena::specifyVertexAttributes() const
+{
+    m_specifyVertexAttributes();
+}
+
+GLsizei GPUBufferArena::vertexStride() const
+{
+    return m_vertexStride;
+}
+
+size_t GPUBufferArena::defragment()
+{
+    size_t numBytesMoved = 0;
+    for (uint32_t pageIdx = 0; pageIdx < m_pages.size();) {
+        if (m_pages[pageIdx].numAllocations > 0) {
+            numBytesMoved += compactPage(pageIdx++);
+            continue;
+        }
+
+        // Nothing refers to the buffers of an empty page anymore.
+        const Page& page = m_pages[pageIdx];
+        glDeleteVertexArrays(1, &page.vertexArray);
+        glDeleteBuffers(1, &page.vertexBuffer);
+        glDeleteBuffers(1, &page.indexBuffer);
+        m_pages.erase(std::begin(m_pages) + pageIdx);
+        for (Allocation& allocation : m_allocations) {
+            if (allocation.page != Allocation::freed && allocation.page > pageIdx)
+                --allocation.page;
+        }
+    }
+    return numBytesMoved;
+}
+
+GPUBufferArena::Stats GPUBufferArena::stats() const
+{
+    Stats stats;
+    stats.numPages = m_pages.size();
+    stats.numAllocations = m_allocations.size() - m_freeHandles.size();
+    for (const Page& page : m_pages) {
+        const size_t vertexCapacity = page.vertices.capacity() * size_t(m_vertexStride);
+        stats.capacity += vertexCapacity + page.indices.capacity();
+        stats.usedSize += vertexCapacity - page.vertices.freeSize() * size_t(m_vertexStride) + page.indices.capacity() - page.indices.freeSize();
+        stats.numFreeRanges += page.vertices.numFreeRanges() + page.indices.numFreeRanges();
+    }
+    return stats;
+}
+
+GPUBufferArena::Page& GPUBufferArena::createPage(size_t numVertices, size_t indexSize)
+{
+    const size_t vertexCapacity = std::max(numVertices, m_verticesPerPage);
+    const size_t indexCapacity = alignUp(std::max(indexSize, m_indexBytesPerPage), indexAlignment);
+    Page& page = m_pages.emplace_back(Page { .vertexArray = 0, .vertexBuffer = 0, .indexBuffer = 0, .vertices = FreeListAllocator(vertexCapacity), .indices = FreeListAllocator(indexCapacity) });
+
+    glGenVertexArrays(1, &page.vertexArray);
+    glBindVertexArray(page.vertexArray);
+    glGenBuffers(1, &page.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertexCapacity * size_t(m_vertexStride)), nullptr, GL_STATIC_DRAW);
+    glGenBuffers(1, &page.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexCapacity), nullptr, GL_STATIC_DRAW);
+    m_specifyVertexAttributes();
+    glBindVertexArray(0);
+    return page;
+}
+
+size_t GPUBufferArena::compactPage(uint32_t pageIdx)
+{
+    Page& page = m_pages[pageIdx];
+    std::vector<Allocation*> pAllocations;
+    for (Allocation& allocation : m_allocations) {
+        if (allocation.page == pageIdx)
+            pAllocations.push_back(&allocation);
+    }
+
+    // Vertices and indices are compacted separately; the ranges are moved through a temporary buffer because the
+    // source and destination ranges of glCopyBufferSubData() may not overlap.
+    const auto compact = [&](GLuint buffer, FreeListAllocator& allocator, size_t Allocation::*pOffset, size_t Allocation::*pSize, size_t unitSize, size_t alignment) {
+        std::sort(std::begin(pAllocations), std::end(pAllocations), [=](const Allocation* pLhs, const Allocation* pRhs) { return pLhs->*pOffset < pRhs->*pOffset; });
+        std::vector<size_t> newOffsets;
+        size_t usedSize = 0;
+        bool anyMoved = false;
+        for (const Allocation* pAllocation : pAllocations) {
+            if (pAllocation->*pSize == 0) {
+                newOffsets.push_back(0);
+                continue;
+            }
+            usedSize = alignUp(usedSize, alignment);
+            newOffsets.push_back(usedSize);
+            anyMoved |= usedSize != pAllocation->*pOffset;
+            usedSize += pAllocation->*pSize;
+        }
+        if (!anyMoved)
+            return size_t(0);
+
+        GLuint scratchBuffer;
+        glGenBuffers(1, &scratchBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, scratchBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(usedSize * unitSize), nullptr, GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        for (size_t i = 0; i < pAllocations.size(); ++i) {
+            Allocation& allocation = *pAllocations[i];
+            if (allocation.*pSize > 0) {
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.*pOffset * unitSize),
+                    static_cast<GLintptr>(newOffsets[i] * unitSize), static_cast<GLsizeiptr>(allocation.*pSize * unitSize));
+            }
+            allocation.*pOffset = newOffsets[i];
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, scratchBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(usedSize * unitSize));
+        glDeleteBuffers(1, &scratchBuffer);
+        allocator.reset(usedSize);
+        return usedSize * unitSize;
+    };
+    return compact(page.vertexBuffer, page.vertices, &Allocation::firstVertex, &Allocation::numVertices, size_t(m_vertexStride), 1)
+        + compact(page.indexBuffer, page.indices, &Allocation::indexOffset, &Allocation::indexSize, 1, indexAlignment);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <framework/opengl_includes.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Hands out ranges of [0, capacity) with first fit; freed ranges are merged with their free neighbours. The allocator
+// only does the bookkeeping, the memory itself lives elsewhere (e.g. in a buffer object).
+class FreeListAllocator {
+public:
+    explicit FreeListAllocator(size_t capacity);
+
+    // Returns the offset of the range, which is a multiple of alignment, or nothing if no free range is large enough.
+    [[nodiscard]] std::optional<size_t> allocate(size_t size, size_t alignment = 1);
+    void free(size_t offset, size_t size);
+    // Mark everything before usedSize as allocated and everything after it as free (after compacting the ranges).
+    void reset(size_t usedSize);
+
+    [[nodiscard]] size_t capacity() const;
+    [[nodiscard]] size_t freeSize() const;
+    [[nodiscard]] size_t numFreeRanges() const;
+
+private:
+    size_t m_capacity;
+    size_t m_freeSize;
+    std::map<size_t, size_t> m_freeRanges; // Offset to size.
+};
+
+// Stores the vertices and indices of many meshes in a few large buffer objects ("pages") that share one vertex array
+// object per page, such that drawing them does not require rebinding buffers or vertex arrays. Meshes are drawn with
+// glDrawElementsBaseVertex() using the offsets returned by location().
+//
+// Pages are allocated with a free list; meshes that do not fit in a page get a page of their own. Freed ranges are
+// reused but can leave holes, which defragment() removes by compacting every page. Buffer objects are never
+// recreated, so vertex array objects that refer to them stay valid; only the offsets of the allocations change.
+class GPUBufferArena {
+public:
+    using Handle = uint32_t;
+
+    // Where the data of an allocation lives. Indices start at the first vertex of the allocation, so the base vertex
+    // must be passed to the draw call.
+    struct Location {
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        GLint baseVertex;
+        size_t indexOffset; // In bytes.
+    };
+
+    struct Stats {
+        size_t numPages { 0 };
+        size_t numAllocations { 0 };
+        size_t capacity { 0 }; // Vertex and index bytes.
+        size_t usedSize { 0 };
+        size_t numFreeRanges { 0 };
+    };
+
+    // specifyVertexAttributes() is called with the vertex array and the vertex buffer of a page bound, and must set up
+    // the vertex attributes for vertices of vertexStride bytes starting at offset 0.
+    GPUBufferArena(GLsizei vertexStride, std::function<void()> specifyVertexAttributes, size_t verticesPerPage = 1 << 20, size_t indexBytesPerPage = 16 << 20);
+    // Cannot copy an arena because it would require reference counting of GPU resources.
+    GPUBufferArena(const GPUBufferArena&) = delete;
+    ~GPUBufferArena();
+
+    GPUBufferArena& operator=(const GPUBufferArena&) = delete;
+
+    // Copy numVertices vertices of vertexStride bytes and the (16 or 32 bit) indices into the arena.
+    [[nodiscard]] Handle allocate(const void* pVertices, size_t numVertices, std::span<const std::byte> indices);
+    void free(Handle handle);
+    [[nodiscard]] Location location(Handle handle) const;
+    void updateVertices(Handle handle, size_t firstVertex, const void* pVertices, size_t numVertices);
+
+    // Set up the vertex attributes of another vertex array object that sources the vertex buffer that is bound.
+    void specifyVertexAttributes() const;
+    [[nodiscard]] GLsizei vertexStride() const;
+
+    // Move the allocations of every page to the front of its buffers and release pages that are empty; returns the
+    // number of bytes that were moved.
+    size_t defragment();
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Page {
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        FreeListAllocator vertices; // In vertices.
+        FreeListAllocator indices; // In bytes.
+        size_t numAllocations { 0 };
+    };
+    struct Allocation {
+        static constexpr uint32_t freed = 0xFFFFFFFF;
+        uint32_t page;
+        size_t firstVertex;
+        size_t numVertices;
+        size_t indexOffset;
+        size_t indexSize;
+    };
+
+    Page& createPage(size_t numVertices, size_t indexSize);
+    size_t compactPage(uint32_t page);
+
+private:
+    GLsizei m_vertexStride;
+    std::function<void()> m_specifyVertexAttributes;
+    size_t m_verticesPerPage;
+    size_t m_indexBytesPerPage;
+
+    std::vector<Page> m_pages;
+    std::vector<Allocation> m_allocations; // Indexed by handle.
+    std::vector<Handle> m_freeHandles;
+};
@@ -0,0 +1,57 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(static_cast<GLsizei>(m_queries.size()), m_queries.data());
+}
+
+GpuTimer::~GpuTimer()
+{
+    glDeleteQueries(static_cast<GLsizei>(m_queries.size()), m_queries.data());
+}
+
+void GpuTimer::begin()
+{
+    // The query that is about to be reused was issued numQueries frames ago, so waiting for it rarely blocks.
+    collectResults(m_pending[m_next]);
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    m_pending[m_next] = true;
+    m_next = (m_next + 1) % numQueries;
+}
+
+std::optional<float> GpuTimer::latestMs()
+{
+    collectResults(false);
+    return m_latestMs;
+}
+
+float GpuTimer::waitForMs()
+{
+    collectResults(true);
+    return m_latestMs.value_or(0.0f);
+}
+
+void GpuTimer::collectResults(bool wait)
+{
+    // Results become available in the order in which the queries were issued, starting with the oldest.
+    for (size_t i = 0; i < numQueries; ++i) {
+        const size_t query = (m_next + i) % numQueries;
+        if (!m_pending[query])
+            continue;
+        if (!wait) {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(m_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(m_queries[query], GL_QUERY_RESULT, &nanoseconds);
+        m_latestMs = static_cast<float>(nanoseconds) * 1e-6f;
+        m_pending[query] = false;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <framework/opengl_includes.h>
+#include <array>
+#include <optional>
+
+// Measures the GPU time of the commands between begin() and end() with GL_TIME_ELAPSED queries.
+//
+// Query results become available a frame or more after they were issued. To never stall the pipeline the timer
+// cycles through a few queries and latestMs() returns the most recent result that is available.
+class GpuTimer {
+public:
+    GpuTimer();
+    // Cannot copy a GPU timer because it would require reference counting of GPU resources.
+    GpuTimer(const GpuTimer&) = delete;
+    ~GpuTimer();
+
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Only one GL_TIME_ELAPSED query can be active at a time, so timers cannot be nested.
+    void begin();
+    void end();
+
+    // Time in milliseconds of the most recently finished begin()/end() pair, if any.
+    [[nodiscard]] std::optional<float> latestMs();
+    // Wait for the GPU to finish the last begin()/end() pair and return its time in milliseconds.
+    [[nodiscard]] float waitForMs();
+
+private:
+    void collectResults(bool wait);
+
+private:
+    static constexpr size_t numQueries = 4;
+    std::array<GLuint, numQueries> m_queries;
+    std::array<bool, numQueries> m_pending {};
+    size_t m_next { 0 };
+    std::optional<float> m_latestMs;
+};
@@ -0,0 +1,233 @@
+#include "light_clustering.h"
+#include <framework/parallel.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+bool sphereIntersectsAABB(const glm::vec3& center, float radius, const glm::vec3& lower, const glm::vec3& upper)
+{
+    const glm::vec3 closestPoint = glm::clamp(center, lower, upper);
+    const glm::vec3 delta = closestPoint - center;
+    return glm::dot(delta, delta) <= radius * radius;
+}
+
+// Conservative test whether a sphere intersects a spot light cone, see:
+// https://bartwronski.com/2017/04/13/cull-that-cone/
+bool sphereIntersectsCone(const glm::vec3& center, float radius, const ClusterLight& light)
+{
+    const glm::vec3 v = center - light.position;
+    const float lengthSquared = glm::dot(v, v);
+    const float v1Length = glm::dot(v, light.direction);
+    const float sinAngle = std::sqrt(std::max(1.0f - light.spotCosCutoff * light.spotCosCutoff, 0.0f));
+    const float distanceClosestPoint = light.spotCosCutoff * std::sqrt(std::max(lengthSquared - v1Length * v1Length, 0.0f)) - v1Length * sinAngle;
+    const bool angleCull = distanceClosestPoint > radius;
+    const bool frontCull = v1Length > radius + light.range;
+    const bool backCull = v1Length < -radius;
+    return !(angleCull || frontCull || backCull);
+}
+
+}
+
+LightClusterGrid::LightClusterGrid(const glm::uvec3& dimensions, float firstSliceDepth)
+    : m_dimensions(glm::max(dimensions, glm::uvec3(1, 1, 2)))
+    , m_firstSliceDepth(firstSliceDepth)
+    , m_clusterBounds(numClusters())
+    , m_slicePairs(m_dimensions.z)
+    , m_sliceOffsets(m_dimensions.z + 1)
+    , m_clusterLightRanges(numClusters())
+{
+}
+
+void LightClusterGrid::assignLights(const glm::mat4& projectionMatrix, std::span<const ClusterLight> lights)
+{
+    if (projectionMatrix != m_boundsProjectionMatrix)
+        updateClusterBounds(projectionMatrix);
+
+    // Range of depth slices touched by each light.
+    m_lightSliceRanges.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const ClusterLight& light = lights[i];
+        const float minDepth = -light.position.z - light.range;
+        const float maxDepth = -light.position.z + light.range;
+        if (maxDepth < m_near || minDepth > m_far)
+            m_lightSliceRanges[i] = glm::uvec2(1, 0);
+        else
+            m_lightSliceRanges[i] = glm::uvec2(depthSlice(std::max(minDepth, m_near)), depthSlice(std::min(maxDepth, m_far)));
+    }
+
+    // Depth slices are independent so each is binned by its own thread. A slice first gathers (tile, light) pairs and
+    // then counting sorts them by tile, which keeps the lights of each cluster in increasing order.
+    const uint32_t tilesPerSlice = m_dimensions.x * m_dimensions.y;
+    parallelFor(m_dimensions.z, [&](size_t sliceIndex) {
+        const auto slice = static_cast<uint32_t>(sliceIndex);
+        const float sliceNear = -m_clusterBounds[slice * tilesPerSlice].upper.z;
+        const float sliceFar = -m_clusterBounds[slice * tilesPerSlice].lower.z;
+        const glm::vec2 gridSize { m_dimensions };
+
+        auto& pairs = m_slicePairs[slice];
+        pairs.clear();
+        for (uint32_t lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+            const glm::uvec2 sliceRange = m_lightSliceRanges[lightIndex];
+            if (slice < sliceRange.x || slice > sliceRange.y)
+                continue;
+
+            // Bound the tiles by projecting the box around the part of the sphere that lies within this slice. The
+            // radius of that part shrinks when the slice does not contain the center of the sphere.
+            const ClusterLight& light = lights[lightIndex];
+            const float centerDepth = -light.position.z;
+            const float minDepth = std::max(centerDepth - light.range, sliceNear);
+            const float maxDepth = std::min(centerDepth + light.range, sliceFar);
+            const float depthOffset = std::max({ minDepth - centerDepth, centerDepth - maxDepth, 0.0f });
+            const float radius = std::sqrt(std::max(light.range * light.range - depthOffset * depthOffset, 0.0f));
+            glm::vec2 ndcMin { std::numeric_limits<float>::max() }, ndcMax { std::numeric_limits<float>::lowest() };
+            for (const float depth : { minDepth, maxDepth }) {
+                for (const float sign : { -1.0f, +1.0f }) {
+                    const glm::vec2 ndc = (glm::vec2(light.position) + sign * radius) / (depth * m_tanHalfFov);
+                    ndcMin = glm::min(ndcMin, ndc);
+                    ndcMax = glm::max(ndcMax, ndc);
+                }
+            }
+            if (glm::any(glm::lessThan(ndcMax, glm::vec2(-1.0f))) || glm::any(glm::greaterThan(ndcMin, glm::vec2(1.0f))))
+                continue;
+            const glm::uvec2 tileMin { glm::clamp(glm::floor((ndcMin * 0.5f + 0.5f) * gridSize), glm::vec2(0.0f), gridSize - 1.0f) };
+            const glm::uvec2 tileMax { glm::clamp(glm::floor((ndcMax * 0.5f + 0.5f) * gridSize), glm::vec2(0.0f), gridSize - 1.0f) };
+
+            for (uint32_t y = tileMin.y; y <= tileMax.y; ++y) {
+                for (uint32_t x = tileMin.x; x <= tileMax.x; ++x) {
+                    const uint32_t tile = y * m_dimensions.x + x;
+                    const AABB& bounds = m_clusterBounds[slice * tilesPerSlice + tile];
+                    if (!sphereIntersectsAABB(light.position, light.range, bounds.lower, bounds.upper))
+                        continue;
+                    if (light.isSpotlight && light.spotCosCutoff > 0.0f) {
+                        const glm::vec3 center = (bounds.lower + bounds.upper) * 0.5f;
+                        const float boundingRadius = glm::length(bounds.upper - bounds.lower) * 0.5f;
+                        if (!sphereIntersectsCone(center, boundingRadius, light))
+                            continue;
+                    }
+                    pairs.emplace_back(tile, lightIndex);
+                }
+            }
+        }
+    });
+
+    m_sliceOffsets[0] = 0;
+    for (uint32_t slice = 0; slice < m_dimensions.z; ++slice)
+        m_sliceOffsets[slice + 1] = m_sliceOffsets[slice] + static_cast<uint32_t>(m_slicePairs[slice].size());
+    m_lightIndices.resize(m_sliceOffsets.back());
+
+    std::vector<uint32_t> sliceMaxLights(m_dimensions.z, 0);
+    parallelFor(m_dimensions.z, [&](size_t slice) {
+        const std::span<glm::uvec2> ranges { &m_clusterLightRanges[slice * tilesPerSlice], tilesPerSlice };
+        for (glm::uvec2& range : ranges)
+            range = glm::uvec2(0);
+        for (const auto& [tile, lightIndex] : m_slicePairs[slice])
+            ++ranges[tile].y;
+
+        uint32_t offset = m_sliceOffsets[slice];
+        for (glm::uvec2& range : ranges) {
+            range.x = offset;
+            offset += range.y;
+            sliceMaxLights[slice] = std::max(sliceMaxLights[slice], range.y);
+            range.y = 0;
+        }
+        for (const auto& [tile, lightIndex] : m_slicePairs[slice])
+            m_lightIndices[ranges[tile].x + ranges[tile].y++] = lightIndex;
+    });
+    m_maxLightsPerCluster = *std::max_element(std::begin(sliceMaxLights), std::end(sliceMaxLights));
+}
+
+void LightClusterGrid::updateClusterBounds(const glm::mat4& projectionMatrix)
+{
+    m_boundsProjectionMatrix = projectionMatrix;
+
+    // Recover the frustum from a (glm::perspective style) projection matrix.
+    m_near = projectionMatrix[3][2] / (projectionMatrix[2][2] - 1.0f);
+    m_far = projectionMatrix[3][2] / (projectionMatrix[2][2] + 1.0f);
+    m_tanHalfFov = glm::vec2(1.0f / projectionMatrix[0][0], 1.0f / projectionMatrix[1][1]);
+
+    const float splitDepth = std::clamp(m_firstSliceDepth, m_near, m_far);
+    m_depthScale = static_cast<float>(m_dimensions.z - 1) / std::log(m_far / splitDepth);
+    m_depthBias = -std::log(splitDepth) * m_depthScale;
+
+    for (uint32_t z = 0; z < m_dimensions.z; ++z) {
+        // Slightly enlarge the clusters so that fragments on a boundary, which may be classified into either
+        // neighbour due to rounding differences with the GPU, are still covered.
+        const float nearDepth = sliceStartDepth(z) * 0.999f;
+        const float farDepth = sliceStartDepth(z + 1) * 1.001f;
+        for (uint32_t y = 0; y < m_dimensions.y; ++y) {
+            for (uint32_t x = 0; x < m_dimensions.x; ++x) {
+                const glm::vec2 ndcLower = glm::vec2(x, y) / glm::vec2(m_dimensions) * 2.0f - 1.0f - 1e-3f;
+                const glm::vec2 ndcUpper = glm::vec2(x + 1, y + 1) / glm::vec2(m_dimensions) * 2.0f - 1.0f + 1e-3f;
+                // The tile's corners at both depths; the extremes in x and y are reached at either depth.
+                const glm::vec2 a = ndcLower * m_tanHalfFov * nearDepth, b = ndcLower * m_tanHalfFov * farDepth;
+                const glm::vec2 c = ndcUpper * m_tanHalfFov * nearDepth, d = ndcUpper * m_tanHalfFov * farDepth;
+                AABB& bounds = m_clusterBounds[(z * m_dimensions.y + y) * m_dimensions.x + x];
+                bounds.lower = glm::vec3(glm::min(glm::min(a, b), glm::min(c, d)), -farDepth);
+                bounds.upper = glm::vec3(glm::max(glm::max(a, b), glm::max(c, d)), -nearDepth);
+            }
+        }
+    }
+}
+
+uint32_t LightClusterGrid::depthSlice(float viewDepth) const
+{
+    if (viewDepth < firstSliceDepth())
+        return 0;
+    const float slice = std::floor(std::log(viewDepth) * m_depthScale + m_depthBias) + 1.0f;
+    return static_cast<uint32_t>(std::clamp(slice, 1.0f, static_cast<float>(m_dimensions.z - 1)));
+}
+
+float LightClusterGrid::sliceStartDepth(uint32_t slice) const
+{
+    if (slice == 0)
+        return m_near;
+    const float splitDepth = firstSliceDepth();
+    return splitDepth * std::pow(m_far / splitDepth, static_cast<float>(slice - 1) / static_cast<float>(m_dimensions.z - 1));
+}
+
+glm::uvec3 LightClusterGrid::dimensions() const
+{
+    return m_dimensions;
+}
+
+size_t LightClusterGrid::numClusters() const
+{
+    return size_t(m_dimensions.x) * m_dimensions.y * m_dimensions.z;
+}
+
+float LightClusterGrid::firstSliceDepth() const
+{
+    return std::clamp(m_firstSliceDepth, m_near, m_far);
+}
+
+float LightClusterGrid::depthScale() const
+{
+    return m_depthScale;
+}
+
+float LightClusterGrid::depthBias() const
+{
+    return m_depthBias;
+}
+
+std::span<const glm::uvec2> LightClusterGrid::clusterLightRanges() const
+{
+    return m_clusterLightRanges;
+}
+
+std::span<const uint32_t> LightClusterGrid::lightIndices() const
+{
+    return m_lightIndices;
+}
+
+uint32_t LightClusterGrid::maxLightsPerCluster() const
+{
+    return m_maxLightsPerCluster;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Light as seen by the light clustering; positions and directions are in view space.
+struct ClusterLight {
+    glm::vec3 position;
+    float range;
+    bool isSpotlight { false };
+    glm::vec3 direction { 0.0f, 0.0f, -1.0f }; // Normalized.
+    float spotCosCutoff { 0.0f };
+};
+
+// Assigns lights to the clusters ("froxels") of the view frustum for clustered forward shading.
+//
+// The frustum is divided into uniform tiles in screen space and into exponentially growing slices in depth. The
+// first slice covers [near, firstSliceDepth] so that the very thin slices close to the near plane do not waste
+// the depth resolution. A fragment finds its cluster with:
+//   tile  = floor(gl_FragCoord.xy / (framebufferSize / dimensions.xy))
+//   slice = viewDepth < firstSliceDepth ? 0 : min(floor(log(viewDepth) * depthScale() + depthBias()) + 1, dimensions.z - 1)
+// Clusters are numbered x first, then y, then z.
+class LightClusterGrid {
+public:
+    explicit LightClusterGrid(const glm::uvec3& dimensions = { 16, 9, 24 }, float firstSliceDepth = 0.1f);
+
+    // Bin the lights into the clusters of the given (symmetric) perspective projection. The lights of each cluster
+    // are stored in increasing order of their index in lights.
+    void assignLights(const glm::mat4& projectionMatrix, std::span<const ClusterLight> lights);
+
+    [[nodiscard]] glm::uvec3 dimensions() const;
+    [[nodiscard]] size_t numClusters() const;
+    [[nodiscard]] float firstSliceDepth() const;
+    [[nodiscard]] float depthScale() const;
+    [[nodiscard]] float depthBias() const;
+
+    // Offset into lightIndices() and number of lights for every cluster.
+    [[nodiscard]] std::span<const glm::uvec2> clusterLightRanges() const;
+    [[nodiscard]] std::span<const uint32_t> lightIndices() const;
+    [[nodiscard]] uint32_t maxLightsPerCluster() const;
+
+private:
+    struct AABB {
+        glm::vec3 lower;
+        glm::vec3 upper;
+    };
+    void updateClusterBounds(const glm::mat4& projectionMatrix);
+    [[nodiscard]] uint32_t depthSlice(float viewDepth) const;
+    [[nodiscard]] float sliceStartDepth(uint32_t slice) const;
+
+private:
+    glm::uvec3 m_dimensions;
+    float m_firstSliceDepth;
+    float m_depthScale { 0.0f };
+    float m_depthBias { 0.0f };
+    float m_near { 0.0f };
+    float m_far { 0.0f };
+    glm::vec2 m_tanHalfFov { 0.0f };
+
+    // View space bounds of every cluster; only recomputed when the projection matrix changes.
+    glm::mat4 m_boundsProjectionMatrix { 0.0f };
+    std::vector<AABB> m_clusterBounds;
+
+    // Scratch space reused between calls to prevent allocations every frame.
+    std::vector<glm::uvec2> m_lightSliceRanges; // First and last depth slice of every light.
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_slicePairs; // (tile, light) per depth slice.
+    std::vector<uint32_t> m_sliceOffsets;
+
+    std::vector<glm::uvec2> m_clusterLightRanges;
+    std::vector<uint32_t> m_lightIndices;
+    uint32_t m_maxLightsPerCluster { 0 };
+};
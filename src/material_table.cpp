@@ -0,0 +1,54 @@
+#include "material_table.h"
+#include <cassert>
+
+GPUMaterial::GPUMaterial(const Material& material)
+    : kd(material.kd)
+    , shininess(material.shininess)
+    , ks(material.ks)
+    , transparency(material.transparency)
+{
+}
+
+MaterialTable::MaterialID MaterialTable::add(const Material& material)
+{
+    m_dirty = true;
+    if (m_freeIDs.empty()) {
+        m_materials.emplace_back(material);
+        return static_cast<MaterialID>(m_materials.size() - 1);
+    }
+    const MaterialID id = m_freeIDs.back();
+    m_freeIDs.pop_back();
+    m_materials[id] = GPUMaterial(material);
+    return id;
+}
+
+void MaterialTable::update(MaterialID id, const Material& material)
+{
+    assert(id < m_materials.size());
+    m_materials[id] = GPUMaterial(material);
+    m_dirty = true;
+}
+
+void MaterialTable::remove(MaterialID id)
+{
+    assert(id < m_materials.size());
+    m_freeIDs.push_back(id);
+}
+
+size_t MaterialTable::size() const
+{
+    return m_materials.size() - m_freeIDs.size();
+}
+
+void MaterialTable::upload()
+{
+    if (!m_dirty)
+        return;
+    m_buffer.update(m_materials.data(), static_cast<GLsizeiptr>(m_materials.size() * sizeof(GPUMaterial)));
+    m_dirty = false;
+}
+
+void MaterialTable::bind(GLint textureSlot) const
+{
+    m_buffer.bind(textureSlot);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "texture_buffer.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/mesh.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Every material is stored as two RGBA32F texels in the material buffer; must match the materialBuffer in shader_frag.glsl.
+struct GPUMaterial {
+    GPUMaterial() = default;
+    GPUMaterial(const Material& material);
+
+    glm::vec3 kd { 1.0f };
+    float shininess { 1.0f };
+    glm::vec3 ks { 0.0f };
+    float transparency { 1.0f };
+};
+static_assert(sizeof(GPUMaterial) == 8 * sizeof(float));
+
+// All materials in one buffer texture, such that a draw selects its material with an integer uniform (the material
+// ID) instead of binding a uniform buffer per mesh. Changes are kept on the CPU until upload() is called.
+class MaterialTable {
+public:
+    using MaterialID = uint32_t;
+
+    [[nodiscard]] MaterialID add(const Material& material);
+    void update(MaterialID id, const Material& material);
+    // The ID may be reused by materials that are added later.
+    void remove(MaterialID id);
+    [[nodiscard]] size_t size() const;
+
+    // Upload the materials if any of them changed since the last upload.
+    void upload();
+    // Bind the buffer texture to the given texture slot (GL_TEXTURE0, ...).
+    void bind(GLint textureSlot) const;
+
+private:
+    std::vector<GPUMaterial> m_materials;
+    std::vector<MaterialID> m_freeIDs;
+    TextureBuffer m_buffer { GL_RGBA32F };
+    bool m_dirty { false };
+};
@@ -2,57 +2,195 @@
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
 DISABLE_WARNINGS_POP()
+#include <framework/mesh_cache.h>
+#include <framework/mesh_optimization.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <numbers>
 #include <vector>
 
-GPUMaterial::GPUMaterial(const Material& material) :
-    kd(material.kd),
-    ks(material.ks),
-    shininess(material.shininess),
-    transparency(material.transparency)
-{}
+namespace {
 
-GPUMesh::GPUMesh(const Mesh& cpuMesh)
-{
-    // Create uniform buffer to store mesh material (https://learnopengl.com/Advanced-OpenGL/Advanced-GLSL)
-    GPUMaterial gpuMaterial(cpuMesh.material);
-    glGenBuffers(1, &m_uboMaterial);
-    glBindBuffer(GL_UNIFORM_BUFFER, m_uboMaterial);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(GPUMaterial), &gpuMaterial, GL_STATIC_READ);
+constexpr float maxQuantizedPosition = 65535.0f;
+constexpr float maxQuantizedNormal = 32767.0f;
 
-    // Figure out if this mesh has texture coordinates
-    m_hasTextureCoords = static_cast<bool>(cpuMesh.material.kdTexture);
+// Flat axes (e.g. of a ground quad) get a small extent relative to the largest axis, such that the quantization scale
+// stays finite. All positions on such an axis quantize to 0 and dequantize to bounds.lower.
+glm::vec3 quantizationExtent(const MeshBounds& bounds)
+{
+    const glm::vec3 extent = bounds.upper - bounds.lower;
+    const float largestExtent = std::max({ extent.x, extent.y, extent.z });
+    const float minExtent = std::isfinite(largestExtent) && largestExtent > 0.0f ? std::max(largestExtent * 1e-6f, 1e-30f) : 1.0f;
+    return glm::max(extent, glm::vec3(minExtent));
+}
 
-    // Create VAO and bind it so subsequent creations of VBO and IBO are bound to this VAO
-    glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
+glm::vec2 signNotZero(const glm::vec2& v)
+{
+    return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
 
-    // Create vertex buffer object (VBO)
-    glGenBuffers(1, &m_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(cpuMesh.vertices.size() * sizeof(decltype(cpuMesh.vertices)::value_type)), cpuMesh.vertices.data(), GL_STATIC_DRAW);
+// Project the normal onto the octahedron |x| + |y| + |z| = 1 and unfold the lower half onto the outer triangles of
+// the [-1, 1]^2 square.
+glm::vec2 encodeOctahedral(const glm::vec3& normal)
+{
+    const float l1Norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1Norm == 0.0f)
+        return glm::vec2(0.0f);
+    const glm::vec3 octahedron = normal / l1Norm;
+    if (octahedron.z >= 0.0f)
+        return glm::vec2(octahedron);
+    return (1.0f - glm::abs(glm::vec2(octahedron.y, octahedron.x))) * signNotZero(glm::vec2(octahedron));
+}
 
-    // Create index buffer object (IBO)
-    glGenBuffers(1, &m_ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(cpuMesh.triangles.size() * sizeof(decltype(cpuMesh.triangles)::value_type)), cpuMesh.triangles.data(), GL_STATIC_DRAW);
+GLsizei vertexStride(GPUVertexFormat vertexFormat)
+{
+    return vertexFormat == GPUVertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+}
 
-    // Tell OpenGL that we will be using vertex attributes 0, 1 and 2.
+// Tell OpenGL what each vertex looks like and how they are mapped to the shader (location = ...), for the vertex
+// array and vertex buffer that are bound.
+void specifyVertexAttributes(GPUVertexFormat vertexFormat)
+{
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
-    // We tell OpenGL what each vertex looks like and how they are mapped to the shader (location = ...).
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+    if (vertexFormat == GPUVertexFormat::Quantized) {
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, texCoord));
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+    }
     // Reuse all attributes for each instance
     glVertexAttribDivisor(0, 0);
     glVertexAttribDivisor(1, 0);
     glVertexAttribDivisor(2, 0);
+}
+
+// Must match decodeOctahedral() in shader_vert.glsl.
+glm::vec3 decodeOctahedral(const glm::vec2& encoded)
+{
+    glm::vec3 normal { encoded, 1.0f - std::abs(encoded.x) - std::abs(encoded.y) };
+    if (normal.z < 0.0f) {
+        const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) * signNotZero(glm::vec2(normal));
+        normal.x = folded.x;
+        normal.y = folded.y;
+    }
+    return glm::normalize(normal);
+}
+
+}
+
+std::vector<QuantizedVertex> quantizeVertices(std::span<const Vertex> vertices, const MeshBounds& bounds)
+{
+    const glm::vec3 scale = maxQuantizedPosition / quantizationExtent(bounds);
+    std::vector<QuantizedVertex> quantizedVertices(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vertex& vertex = vertices[i];
+        QuantizedVertex& quantizedVertex = quantizedVertices[i];
+        const glm::vec3 position = glm::clamp(glm::round((vertex.position - bounds.lower) * scale), 0.0f, maxQuantizedPosition);
+        const glm::vec2 normal = glm::round(glm::clamp(encodeOctahedral(vertex.normal), -1.0f, 1.0f) * maxQuantizedNormal);
+        for (glm::length_t axis = 0; axis < 3; ++axis)
+            quantizedVertex.position[axis] = static_cast<uint16_t>(position[axis]);
+        quantizedVertex.position[3] = 0;
+        for (glm::length_t axis = 0; axis < 2; ++axis) {
+            quantizedVertex.normal[axis] = static_cast<int16_t>(normal[axis]);
+            quantizedVertex.texCoord[axis] = glm::packHalf1x16(vertex.texCoord[axis]);
+        }
+    }
+    return quantizedVertices;
+}
+
+VertexQuantizationError measureQuantizationError(std::span<const Vertex> vertices, std::span<const QuantizedVertex> quantizedVertices, const MeshBounds& bounds)
+{
+    assert(vertices.size() == quantizedVertices.size());
+    const glm::vec3 scale = quantizationExtent(bounds) / maxQuantizedPosition;
+    VertexQuantizationError error;
+    double sumSquaredPositionErrors = 0.0;
+    float minNormalCosine = 1.0f;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vertex& vertex = vertices[i];
+        const QuantizedVertex& quantizedVertex = quantizedVertices[i];
+        const glm::vec3 position = bounds.lower + scale * glm::vec3(quantizedVertex.position[0], quantizedVertex.position[1], quantizedVertex.position[2]);
+        const float positionError = glm::length(position - vertex.position);
+        error.maxPositionError = std::max(error.maxPositionError, positionError);
+        sumSquaredPositionErrors += static_cast<double>(positionError * positionError);
+
+        const float normalLength = glm::length(vertex.normal);
+        if (normalLength > 0.0f) {
+            const glm::vec3 normal = decodeOctahedral(glm::vec2(quantizedVertex.normal[0], quantizedVertex.normal[1]) / maxQuantizedNormal);
+            minNormalCosine = std::min(minNormalCosine, glm::dot(normal, vertex.normal / normalLength));
+        }
+        for (glm::length_t axis = 0; axis < 2; ++axis)
+            error.maxTexCoordError = std::max(error.maxTexCoordError, std::abs(glm::unpackHalf1x16(quantizedVertex.texCoord[axis]) - vertex.texCoord[axis]));
+    }
+    if (!vertices.empty())
+        error.rmsPositionError = static_cast<float>(std::sqrt(sumSquaredPositionErrors / static_cast<double>(vertices.size())));
+    error.maxNormalErrorDegrees = std::acos(std::clamp(minNormalCosine, -1.0f, 1.0f)) * 180.0f / std::numbers::pi_v<float>;
+    return error;
+}
+
+GPUMesh::GPUMesh(const Mesh& cpuMesh, GPUVertexFormat vertexFormat, std::shared_ptr<GPUBufferArena> pArena)
+    : GPUMesh(cpuMesh.vertices, cpuMesh.triangles, cpuMesh.material, cpuMesh.clusters, vertexFormat, std::move(pArena))
+{
+}
+
+GPUMesh::GPUMesh(std::span<const Vertex> vertices, std::span<const glm::uvec3> triangles, const Material& material, std::span<const MeshCluster> clusters,
+    GPUVertexFormat vertexFormat, std::shared_ptr<GPUBufferArena> pArena)
+    : m_vertexFormat(vertexFormat)
+{
+    m_pMaterialTable = sharedMaterialTable();
+    m_materialID = m_pMaterialTable->add(material);
+
+    // Figure out if this mesh has texture coordinates
+    m_hasTextureCoords = static_cast<bool>(material.kdTexture);
+
+    m_bounds = computeMeshBounds(vertices);
+    if (!pArena)
+        pArena = sharedArena(vertexFormat);
+    m_pArena = std::move(pArena);
+    assert(m_pArena->vertexStride() == vertexStride(vertexFormat));
+
+    // 16 bit indices suffice if all vertices can be addressed with them.
+    std::vector<uint16_t> shortIndices;
+    std::span<const std::byte> indices = std::as_bytes(triangles);
+    if (vertices.size() <= size_t(std::numeric_limits<uint16_t>::max()) + 1) {
+        m_indexType = GL_UNSIGNED_SHORT;
+        m_indexSize = sizeof(uint16_t);
+        shortIndices.reserve(3 * triangles.size());
+        for (const glm::uvec3& triangle : triangles)
+            shortIndices.insert(std::end(shortIndices), { static_cast<uint16_t>(triangle.x), static_cast<uint16_t>(triangle.y), static_cast<uint16_t>(triangle.z) });
+        indices = std::as_bytes(std::span(shortIndices));
+    }
+
+    if (vertexFormat == GPUVertexFormat::Quantized) {
+        const std::vector<QuantizedVertex> quantizedVertices = quantizeVertices(vertices, m_bounds);
+        m_quantizationError = measureQuantizationError(vertices, quantizedVertices, m_bounds);
+        const glm::vec3 extent = quantizationExtent(m_bounds);
+        m_dequantizationMatrix = glm::mat4(
+            glm::vec4(extent.x, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, extent.y, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, extent.z, 0.0f), glm::vec4(m_bounds.lower, 1.0f));
+        m_arenaHandle = m_pArena->allocate(quantizedVertices.data(), quantizedVertices.size(), indices);
+    } else {
+        m_arenaHandle = m_pArena->allocate(vertices.data(), vertices.size(), indices);
+    }
+    m_gpuMemoryUsage = vertices.size() * size_t(vertexStride(vertexFormat)) + indices.size();
 
     // Each triangle has 3 vertices.
-    m_numIndices = static_cast<GLsizei>(3 * cpuMesh.triangles.size());
+    m_numIndices = static_cast<GLsizei>(3 * triangles.size());
+    if (clusters.empty())
+        m_clusters.push_back({ .firstTriangle = 0, .numTriangles = static_cast<uint32_t>(triangles.size()), .bounds = m_bounds });
+    else
+        m_clusters.assign(std::begin(clusters), std::end(clusters));
 }
 
 GPUMesh::GPUMesh(GPUMesh&& other)
@@ -71,60 +209,266 @@ GPUMesh& GPUMesh::operator=(GPUMesh&& other)
     return *this;
 }
 
-std::vector<GPUMesh> GPUMesh::loadMeshGPU(std::filesystem::path filePath, bool normalize) {
+std::shared_ptr<GPUBufferArena> GPUMesh::sharedArena(GPUVertexFormat vertexFormat)
+{
+    // Only weak references are kept here such that the arenas are destroyed while the OpenGL context still exists.
+    static std::array<std::weak_ptr<GPUBufferArena>, 2> arenas;
+    std::weak_ptr<GPUBufferArena>& wpArena = arenas[vertexFormat == GPUVertexFormat::Quantized ? 1 : 0];
+    std::shared_ptr<GPUBufferArena> pArena = wpArena.lock();
+    if (!pArena) {
+        pArena = std::make_shared<GPUBufferArena>(vertexStride(vertexFormat), [=]() { specifyVertexAttributes(vertexFormat); });
+        wpArena = pArena;
+    }
+    return pArena;
+}
+
+std::shared_ptr<MaterialTable> GPUMesh::sharedMaterialTable()
+{
+    static std::weak_ptr<MaterialTable> wpMaterialTable;
+    std::shared_ptr<MaterialTable> pMaterialTable = wpMaterialTable.lock();
+    if (!pMaterialTable) {
+        pMaterialTable = std::make_shared<MaterialTable>();
+        wpMaterialTable = pMaterialTable;
+    }
+    return pMaterialTable;
+}
+
+std::shared_ptr<GPUBufferArena> GPUMesh::createArena(GPUVertexFormat vertexFormat, size_t verticesPerPage, size_t indexBytesPerPage)
+{
+    return std::make_shared<GPUBufferArena>(vertexStride(vertexFormat), [=]() { specifyVertexAttributes(vertexFormat); }, verticesPerPage, indexBytesPerPage);
+}
+
+std::vector<GPUMesh> GPUMesh::loadMeshGPU(std::filesystem::path filePath, bool normalize, GPUVertexFormat vertexFormat) {
     if (!std::filesystem::exists(filePath))
         throw MeshLoadingException(fmt::format("File {} does not exist", filePath.string().c_str()));
 
-    // Generate GPU-side meshes for all sub-meshes
-    std::vector<Mesh> subMeshes = loadMesh(filePath, { .normalizeVertexPositions = normalize });
+    const LoadMeshSettings settings = loadSettings(normalize);
     std::vector<GPUMesh> gpuMeshes;
-    for (const Mesh& mesh : subMeshes) { gpuMeshes.emplace_back(mesh); }
+
+    // Upload straight from the memory mapped cache if the model was processed before and did not change since.
+    if (const auto cache = MeshCache::open(filePath, settings)) {
+        for (size_t i = 0; i < cache->numSubMeshes(); ++i)
+            gpuMeshes.emplace_back(cache->vertices(i), cache->triangles(i), cache->material(i), cache->clusters(i), vertexFormat);
+        return gpuMeshes;
+    }
+
+    // Generate GPU-side meshes for all sub-meshes
+    const std::vector<Mesh> subMeshes = loadAndCacheMeshes(filePath, settings);
+    for (const Mesh& mesh : subMeshes) { gpuMeshes.emplace_back(mesh, vertexFormat); }
     
     return gpuMeshes;
 }
 
+LoadMeshSettings GPUMesh::loadSettings(bool normalize)
+{
+    // Clusters allow culling parts of a mesh (see ClusterCuller); the optimized vertex order speeds up drawing them.
+    return LoadMeshSettings { .normalizeVertexPositions = normalize, .maxTrianglesPerCluster = 256, .optimizeVertexOrder = true };
+}
+
+std::vector<Mesh> GPUMesh::loadAndCacheMeshes(const std::filesystem::path& filePath, const LoadMeshSettings& settings)
+{
+    MeshOptimizationReport report;
+    std::vector<Mesh> subMeshes = loadMesh(filePath, settings, &report);
+    if (settings.optimizeVertexOrder) {
+        std::cout << fmt::format("Optimized vertex order of {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", filePath.filename().string(),
+            report.before.acmr(), report.after.acmr(), report.before.atvr(), report.after.atvr()) << std::endl;
+    }
+    MeshCache::write(filePath, settings, subMeshes);
+    return subMeshes;
+}
+
 bool GPUMesh::hasTextureCoords() const
 {
     return m_hasTextureCoords;
 }
 
+const MeshBounds& GPUMesh::bounds() const
+{
+    return m_bounds;
+}
+
+void GPUMesh::setBounds(const MeshBounds& bounds)
+{
+    m_bounds = bounds;
+    // A single cluster covers the whole mesh.
+    if (m_clusters.size() == 1)
+        m_clusters[0].bounds = bounds;
+}
+
+std::span<const MeshCluster> GPUMesh::clusters() const
+{
+    return m_clusters;
+}
+
+GPUVertexFormat GPUMesh::vertexFormat() const
+{
+    return m_vertexFormat;
+}
+
+const glm::mat4& GPUMesh::dequantizationMatrix() const
+{
+    return m_dequantizationMatrix;
+}
+
+const VertexQuantizationError& GPUMesh::quantizationError() const
+{
+    return m_quantizationError;
+}
+
+size_t GPUMesh::gpuMemoryUsage() const
+{
+    return m_gpuMemoryUsage;
+}
+
+GLuint GPUMesh::vertexArray() const
+{
+    return m_pArena->location(m_arenaHandle).vertexArray;
+}
+
+void GPUMesh::updateVertices(size_t firstVertex, std::span<const Vertex> vertices)
+{
+    assert(m_vertexFormat == GPUVertexFormat::Float);
+    m_pArena->updateVertices(m_arenaHandle, firstVertex, vertices.data(), vertices.size());
+}
+
+void GPUMesh::updateMaterial(const Material& material)
+{
+    m_pMaterialTable->update(m_materialID, material);
+}
+
+MaterialTable::MaterialID GPUMesh::materialID() const
+{
+    return m_materialID;
+}
+
 void GPUMesh::draw(const Shader& drawingShader)
 {
-    // Bind material data uniform (we assume that the uniform buffer objects is always called 'Material')
-    // Yes, we could define the binding inside the shader itself, but that would break on OpenGL versions below 4.2
-    drawingShader.bindUniformBlock("Material", 0, m_uboMaterial);
-    
+    setMaterial(drawingShader);
     // Draw the mesh's triangles
-    glBindVertexArray(m_vao);
-    glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, nullptr);
+    drawGeometry();
+}
+
+void GPUMesh::drawGeometry()
+{
+    glBindVertexArray(vertexArray());
+    drawGeometryWithoutBinding();
+}
+
+void GPUMesh::drawGeometryWithoutBinding()
+{
+    const GPUBufferArena::Location location = m_pArena->location(m_arenaHandle);
+    glDrawElementsBaseVertex(GL_TRIANGLES, m_numIndices, m_indexType, reinterpret_cast<const void*>(location.indexOffset), location.baseVertex);
+}
+
+void GPUMesh::drawClusters(const Shader& drawingShader, std::span<const uint8_t> clusterVisibility)
+{
+    setMaterial(drawingShader);
+    drawClustersGeometry(clusterVisibility);
+}
+
+void GPUMesh::drawClustersGeometry(std::span<const uint8_t> clusterVisibility)
+{
+    glBindVertexArray(vertexArray());
+    drawClustersGeometryWithoutBinding(clusterVisibility);
+}
+
+void GPUMesh::drawClustersGeometryWithoutBinding(std::span<const uint8_t> clusterVisibility)
+{
+    assert(clusterVisibility.size() == m_clusters.size());
+    const GPUBufferArena::Location location = m_pArena->location(m_arenaHandle);
+    m_multiDrawCounts.clear();
+    m_multiDrawOffsets.clear();
+    uint32_t rangeEnd = 0;
+    for (size_t i = 0; i < m_clusters.size(); ++i) {
+        if (!clusterVisibility[i])
+            continue;
+        const MeshCluster& cluster = m_clusters[i];
+        if (!m_multiDrawCounts.empty() && cluster.firstTriangle == rangeEnd) {
+            m_multiDrawCounts.back() += static_cast<GLsizei>(3 * cluster.numTriangles);
+        } else {
+            m_multiDrawCounts.push_back(static_cast<GLsizei>(3 * cluster.numTriangles));
+            m_multiDrawOffsets.push_back(reinterpret_cast<const void*>(location.indexOffset + 3 * size_t(cluster.firstTriangle) * m_indexSize));
+        }
+        rangeEnd = cluster.firstTriangle + cluster.numTriangles;
+    }
+    if (m_multiDrawCounts.empty())
+        return;
+
+    m_multiDrawBaseVertices.assign(m_multiDrawCounts.size(), location.baseVertex);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_multiDrawCounts.data(), m_indexType, m_multiDrawOffsets.data(), static_cast<GLsizei>(m_multiDrawCounts.size()),
+        m_multiDrawBaseVertices.data());
+}
+
+void GPUMesh::drawInstanced(const Shader& drawingShader, GLsizei numInstances)
+{
+    setMaterial(drawingShader);
+    const GPUBufferArena::Location location = m_pArena->location(m_arenaHandle);
+    glBindVertexArray(m_instanceVao != INVALID ? m_instanceVao : location.vertexArray);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m_numIndices, m_indexType, reinterpret_cast<const void*>(location.indexOffset), numInstances, location.baseVertex);
+}
+
+void GPUMesh::setInstanceAttribute(GLuint location, GLint numComponents, GLuint buffer, GLsizei stride, size_t offset)
+{
+    if (m_instanceVao == INVALID) {
+        // The arena never recreates the buffers of a page, so this vertex array stays valid when the mesh is moved
+        // within them.
+        const GPUBufferArena::Location arenaLocation = m_pArena->location(m_arenaHandle);
+        glGenVertexArrays(1, &m_instanceVao);
+        glBindVertexArray(m_instanceVao);
+        glBindBuffer(GL_ARRAY_BUFFER, arenaLocation.vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenaLocation.indexBuffer);
+        m_pArena->specifyVertexAttributes();
+    }
+    glBindVertexArray(m_instanceVao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, numComponents, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset));
+    glVertexAttribDivisor(location, 1);
+    glBindVertexArray(0);
+}
+
+void GPUMesh::setMaterial(const Shader& drawingShader)
+{
+    // Materials that were added or changed since the last draw are uploaded first (a no-op otherwise).
+    m_pMaterialTable->upload();
+    drawingShader.set("materialIndex", static_cast<int>(m_materialID));
 }
 
 void GPUMesh::moveInto(GPUMesh&& other)
 {
     freeGpuMemory();
     m_numIndices = other.m_numIndices;
+    m_indexType = other.m_indexType;
+    m_indexSize = other.m_indexSize;
+    m_gpuMemoryUsage = other.m_gpuMemoryUsage;
+    m_vertexFormat = other.m_vertexFormat;
+    m_dequantizationMatrix = other.m_dequantizationMatrix;
+    m_quantizationError = other.m_quantizationError;
     m_hasTextureCoords = other.m_hasTextureCoords;
-    m_ibo = other.m_ibo;
-    m_vbo = other.m_vbo;
-    m_vao = other.m_vao;
-    m_uboMaterial = other.m_uboMaterial;
+    m_bounds = other.m_bounds;
+    m_clusters = std::move(other.m_clusters);
+    m_pArena = std::move(other.m_pArena);
+    m_arenaHandle = other.m_arenaHandle;
+    m_instanceVao = other.m_instanceVao;
+    m_pMaterialTable = std::move(other.m_pMaterialTable);
+    m_materialID = other.m_materialID;
 
     other.m_numIndices = 0;
     other.m_hasTextureCoords = other.m_hasTextureCoords;
-    other.m_ibo = INVALID;
-    other.m_vbo = INVALID;
-    other.m_vao = INVALID;
-    other.m_uboMaterial = INVALID;
+    other.m_pArena.reset();
+    other.m_instanceVao = INVALID;
 }
 
 void GPUMesh::freeGpuMemory()
 {
-    if (m_vao != INVALID)
-        glDeleteVertexArrays(1, &m_vao);
-    if (m_vbo != INVALID)
-        glDeleteBuffers(1, &m_vbo);
-    if (m_ibo != INVALID)
-        glDeleteBuffers(1, &m_ibo);
-    if (m_uboMaterial != INVALID)
-        glDeleteBuffers(1, &m_uboMaterial);
+    if (m_pArena) {
+        m_pArena->free(m_arenaHandle);
+        m_pArena.reset();
+    }
+    if (m_pMaterialTable) {
+        m_pMaterialTable->remove(m_materialID);
+        m_pMaterialTable.reset();
+    }
+    if (m_instanceVao != INVALID)
+        glDeleteVertexArrays(1, &m_instanceVao);
 }
@@ -1,52 +1,146 @@
 #pragma once
 
+#include "gpu_buffer_arena.h"
+#include "material_table.h"
 #include <framework/disable_all_warnings.h>
 #include <framework/mesh.h>
 #include <framework/shader.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 
+#include <cstdint>
 #include <exception>
 #include <filesystem>
 #include <framework/opengl_includes.h>
+#include <memory>
+#include <span>
+#include <vector>
 
 struct MeshLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-// Alignment directives are to comply with std140 alignment requirements (https://www.khronos.org/opengl/wiki/Interface_Block_(GLSL)#Memory_layout)
-struct GPUMaterial {
-    GPUMaterial(const Material& material);
+// Layout of the vertices of a GPUMesh in GPU memory.
+enum class GPUVertexFormat {
+    Float, // The Vertex struct as is (32 bytes).
+    Quantized // QuantizedVertex (16 bytes).
+};
+
+// Compact vertex that is decoded by the vertex attribute fetch and by shader_vert.glsl:
+//  - The position is a 16 bit unsigned normalized coordinate within the bounding box of the mesh; the box is applied
+//    by GPUMesh::dequantizationMatrix(), which is folded into the model matrix.
+//  - The normal is octahedral encoded (Meyer et al., "On Floating-Point Normal Vectors", 2010) in two 16 bit signed
+//    integers that are read as unnormalized floats, because the signed normalization rule differs between OpenGL
+//    versions.
+//  - The texture coordinate is stored as two half floats.
+struct QuantizedVertex {
+    uint16_t position[4]; // The fourth component is padding.
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+static_assert(sizeof(QuantizedVertex) == 16);
 
-    alignas(16) glm::vec3 kd{ 1.0f };
-	alignas(16) glm::vec3 ks{ 0.0f };
-	float shininess{ 1.0f };
-	float transparency{ 1.0f };
+// Difference between the quantized and the original vertices of a mesh.
+struct VertexQuantizationError {
+    float maxPositionError { 0.0f }; // Object space distance.
+    float rmsPositionError { 0.0f };
+    float maxNormalErrorDegrees { 0.0f };
+    float maxTexCoordError { 0.0f };
 };
 
+[[nodiscard]] std::vector<QuantizedVertex> quantizeVertices(std::span<const Vertex> vertices, const MeshBounds& bounds);
+[[nodiscard]] VertexQuantizationError measureQuantizationError(std::span<const Vertex> vertices, std::span<const QuantizedVertex> quantizedVertices, const MeshBounds& bounds);
+
+// The vertices and indices of a GPUMesh are stored in a GPUBufferArena that is shared with other meshes. Unless another
+// arena is given, meshes use the shared arena of their vertex format (see sharedArena()). Their materials are stored in
+// the shared material table (see sharedMaterialTable()).
 class GPUMesh {
 public:
-    GPUMesh(const Mesh& cpuMesh);
+    GPUMesh(const Mesh& cpuMesh, GPUVertexFormat vertexFormat = GPUVertexFormat::Float, std::shared_ptr<GPUBufferArena> pArena = nullptr);
+    // Without clusters the mesh is treated as a single cluster that covers all triangles. The indices are stored as
+    // 16 bit integers if the mesh has at most 65536 vertices.
+    GPUMesh(std::span<const Vertex> vertices, std::span<const glm::uvec3> triangles, const Material& material, std::span<const MeshCluster> clusters = {},
+        GPUVertexFormat vertexFormat = GPUVertexFormat::Float, std::shared_ptr<GPUBufferArena> pArena = nullptr);
     // Cannot copy a GPU mesh because it would require reference counting of GPU resources.
     GPUMesh(const GPUMesh&) = delete;
     GPUMesh(GPUMesh&&);
     ~GPUMesh();
 
     // Generate a number of GPU meshes from a particular model file.
-    // Multiple meshes may be generated if there are multiple sub-meshes in the file
-    static std::vector<GPUMesh> loadMeshGPU(std::filesystem::path filePath, bool normalize = false);
+    // Multiple meshes may be generated if there are multiple sub-meshes in the file.
+    // The processed meshes are stored in a binary cache next to the model file (see <framework/mesh_cache.h>) such
+    // that subsequent runs can upload them straight from the memory mapped cache.
+    static std::vector<GPUMesh> loadMeshGPU(std::filesystem::path filePath, bool normalize = false, GPUVertexFormat vertexFormat = GPUVertexFormat::Float);
+    // Settings with which loadMeshGPU() loads (and caches) model files, such that CPU-side copies can share the cache.
+    [[nodiscard]] static LoadMeshSettings loadSettings(bool normalize);
+    // Load the sub meshes of a model file and write them to the mesh cache. Prints how much the vertex order optimization
+    // improved the vertex cache efficiency.
+    [[nodiscard]] static std::vector<Mesh> loadAndCacheMeshes(const std::filesystem::path& filePath, const LoadMeshSettings& settings);
 
     // Cannot copy a GPU mesh because it would require reference counting of GPU resources.
     GPUMesh& operator=(const GPUMesh&) = delete;
     GPUMesh& operator=(GPUMesh&&);
 
+    // Arena in which all meshes of the given vertex format are stored by default. It is created on first use and
+    // destroyed together with the last mesh (or other owner) that uses it.
+    static std::shared_ptr<GPUBufferArena> sharedArena(GPUVertexFormat vertexFormat);
+    // Create an empty arena with the vertex layout of the given format and pages of the given size.
+    static std::shared_ptr<GPUBufferArena> createArena(GPUVertexFormat vertexFormat, size_t verticesPerPage, size_t indexBytesPerPage);
+    // Table with the materials of all meshes; shaders that draw meshes must bind it to their materialBuffer sampler.
+    // Like the arenas it lives as long as a mesh (or another owner) uses it.
+    static std::shared_ptr<MaterialTable> sharedMaterialTable();
+
     bool hasTextureCoords() const;
+    // Object space bounds of the vertices, computed when the mesh is created.
+    [[nodiscard]] const MeshBounds& bounds() const;
+    // Replace the bounds, e.g. after the vertices were changed with updateVertices().
+    void setBounds(const MeshBounds& bounds);
+    [[nodiscard]] std::span<const MeshCluster> clusters() const;
+
+    [[nodiscard]] GPUVertexFormat vertexFormat() const;
+    // Maps the positions in the vertex buffer to object space: the model matrix of a quantized mesh must be multiplied
+    // by this matrix (identity for other meshes), and shaders must decode its normals (see QuantizedVertex).
+    [[nodiscard]] const glm::mat4& dequantizationMatrix() const;
+    // Error introduced by the quantization (zero for other meshes).
+    [[nodiscard]] const VertexQuantizationError& quantizationError() const;
+    // Size of the vertices and indices in bytes.
+    [[nodiscard]] size_t gpuMemoryUsage() const;
+    // Vertex array that drawGeometry() binds; all meshes in the same page of an arena share it.
+    [[nodiscard]] GLuint vertexArray() const;
 
-    // Bind VAO and call glDrawElements.
+    // Overwrite vertices in place starting at firstVertex, keeping the buffers (and thus the triangles) as they are.
+    // Only supported for meshes with the Float vertex format.
+    void updateVertices(size_t firstVertex, std::span<const Vertex> vertices);
+    // Only changes the mesh's entry in the material table.
+    void updateMaterial(const Material& material);
+    [[nodiscard]] MaterialTable::MaterialID materialID() const;
+
+    // Set the material, bind VAO and call glDrawElementsBaseVertex.
     void draw(const Shader& drawingShader);
+    // Same as draw() but without setting the material, for shaders that only need the geometry (e.g. depth passes).
+    void drawGeometry();
+    // Same as drawGeometry() but expects vertexArray() to be bound already, such that consecutive draws of meshes that
+    // share a vertex array do not have to rebind it.
+    void drawGeometryWithoutBinding();
+    // Same as draw() and drawGeometry() but only draws the clusters whose entry in clusterVisibility is non-zero, using
+    // a single glMultiDrawElementsBaseVertex call (consecutive visible clusters are merged into one range).
+    void drawClusters(const Shader& drawingShader, std::span<const uint8_t> clusterVisibility);
+    void drawClustersGeometry(std::span<const uint8_t> clusterVisibility);
+    // Same as drawClustersGeometry() but expects vertexArray() to be bound already.
+    void drawClustersGeometryWithoutBinding(std::span<const uint8_t> clusterVisibility);
+    // Same as draw() but draws numInstances instances with glDrawElementsInstancedBaseVertex.
+    void drawInstanced(const Shader& drawingShader, GLsizei numInstances);
+
+    // Source a per instance vertex attribute (divisor 1) from the given buffer; the attribute locations 0 to 2 are
+    // used by the vertices. The buffer must contain at least one instance whenever the mesh is drawn. The mesh gets a
+    // vertex array of its own because the one of its arena page is shared with other meshes.
+    void setInstanceAttribute(GLuint location, GLint numComponents, GLuint buffer, GLsizei stride, size_t offset);
 
 private:
+    // Select the mesh's material with the materialIndex uniform.
+    void setMaterial(const Shader& drawingShader);
     void moveInto(GPUMesh&&);
     void freeGpuMemory();
 
@@ -54,9 +148,22 @@ private:
     static constexpr GLuint INVALID = 0xFFFFFFFF;
 
     GLsizei m_numIndices { 0 };
+    GLenum m_indexType { GL_UNSIGNED_INT };
+    size_t m_indexSize { sizeof(uint32_t) };
+    size_t m_gpuMemoryUsage { 0 };
+    GPUVertexFormat m_vertexFormat { GPUVertexFormat::Float };
+    glm::mat4 m_dequantizationMatrix { 1.0f };
+    VertexQuantizationError m_quantizationError;
     bool m_hasTextureCoords { false };
-    GLuint m_ibo { INVALID };
-    GLuint m_vbo { INVALID };
-    GLuint m_vao { INVALID };
-    GLuint m_uboMaterial { INVALID };
+    MeshBounds m_bounds;
+    std::vector<MeshCluster> m_clusters;
+    // Scratch space of drawClusters(), reused between calls to prevent allocations every frame.
+    std::vector<GLsizei> m_multiDrawCounts;
+    std::vector<const void*> m_multiDrawOffsets;
+    std::vector<GLint> m_multiDrawBaseVertices;
+    std::shared_ptr<GPUBufferArena> m_pArena;
+    GPUBufferArena::Handle m_arenaHandle { 0 };
+    GLuint m_instanceVao { INVALID };
+    std::shared_ptr<MaterialTable> m_pMaterialTable;
+    MaterialTable::MaterialID m_materialID { 0 };
 };
@@ -0,0 +1,154 @@
+#include "path_tracer.h"
+#include <framework/parallel.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+PathTracer::PathTracer(unsigned numThreads)
+    : m_numThreads(std::max(numThreads, 1u))
+{
+}
+
+PathTracer::~PathTracer()
+{
+    stop();
+}
+
+unsigned PathTracer::defaultNumThreads()
+{
+    return std::max(numWorkerThreads(), 2u) - 1;
+}
+
+void PathTracer::start(std::shared_ptr<const RayTracingScene> pScene, const Trackball& camera, const RayTracingShading& shading, const glm::ivec2& resolution, uint32_t maxBounces)
+{
+    assert(pScene && resolution.x > 0 && resolution.y > 0);
+    stop();
+
+    m_pScene = std::move(pScene);
+    m_camera.emplace(camera);
+    m_shading = shading;
+    m_resolution = resolution;
+    m_maxBounces = maxBounces;
+    m_numTilesX = (resolution.x + tileSize - 1) / tileSize;
+    m_numTiles = static_cast<size_t>(m_numTilesX) * static_cast<size_t>((resolution.y + tileSize - 1) / tileSize);
+    m_startTime = std::chrono::steady_clock::now();
+
+    const size_t numPixels = static_cast<size_t>(resolution.x) * static_cast<size_t>(resolution.y);
+    m_accumulation.assign(numPixels, glm::vec3(0.0f));
+    m_average.assign(numPixels, glm::vec3(0.0f));
+    m_pass = 0;
+    m_nextTile = 0;
+    m_numTilesDone = 0;
+    m_numSamples = 0;
+    m_numRays = 0;
+    m_resolvedPass = 0;
+
+    for (unsigned i = 0; i < m_numThreads; ++i)
+        m_workers.emplace_back([this](std::stop_token stopToken) { workerLoop(stopToken); });
+}
+
+void PathTracer::stop()
+{
+    // Workers finish the tile that they are rendering.
+    for (std::jthread& worker : m_workers)
+        worker.request_stop();
+    m_workers.clear();
+}
+
+bool PathTracer::isRunning() const
+{
+    return !m_workers.empty();
+}
+
+void PathTracer::workerLoop(std::stop_token stopToken)
+{
+    while (true) {
+        size_t tile;
+        uint32_t pass;
+        {
+            // Wait for the next pass if all tiles of this pass have been handed out.
+            std::unique_lock lock { m_mutex };
+            if (!m_passCompleted.wait(lock, stopToken, [this]() { return m_nextTile < m_numTiles; }) || stopToken.stop_requested())
+                return;
+            tile = m_nextTile++;
+            pass = m_pass;
+        }
+
+        size_t numRays = 0;
+        const size_t numSamples = renderTile(tile, pass, numRays);
+
+        std::scoped_lock lock { m_mutex };
+        m_numSamples += numSamples;
+        m_numRays += numRays;
+        if (++m_numTilesDone < m_numTiles)
+            continue;
+
+        // Last tile of the pass: no worker touches the accumulation buffer until the next pass starts.
+        ++m_pass;
+        const float weight = 1.0f / static_cast<float>(m_pass);
+        std::transform(std::begin(m_accumulation), std::end(m_accumulation), std::begin(m_average), [=](const glm::vec3& sum) { return sum * weight; });
+        m_numTilesDone = 0;
+        m_nextTile = 0;
+        m_passCompleted.notify_all();
+    }
+}
+
+size_t PathTracer::renderTile(size_t tile, uint32_t pass, size_t& numRays)
+{
+    const int tileX = static_cast<int>(tile % static_cast<size_t>(m_numTilesX)) * tileSize;
+    const int tileY = static_cast<int>(tile / static_cast<size_t>(m_numTilesX)) * tileSize;
+    const int tileEndX = std::min(tileX + tileSize, m_resolution.x);
+    const int tileEndY = std::min(tileY + tileSize, m_resolution.y);
+
+    // Every tile of every pass gets its own random sequence, such that the image does not depend on the scheduling.
+    std::seed_seq seed { static_cast<uint32_t>(tile), pass };
+    std::mt19937 rng { seed };
+    std::uniform_real_distribution<float> uniform { 0.0f, 1.0f };
+    for (int y = tileY; y < tileEndY; ++y) {
+        for (int x = tileX; x < tileEndX; ++x) {
+            const glm::vec2 pixel { static_cast<float>(x) + uniform(rng), static_cast<float>(y) + uniform(rng) };
+            const glm::vec2 ndc = pixel / glm::vec2(m_resolution) * 2.0f - 1.0f;
+            const glm::vec3 sample = m_pScene->pathTrace(m_camera->generateRay(ndc), m_shading, m_maxBounces, rng, numRays);
+            // Discard the rare sample that went wrong numerically instead of ruining the pixel for good.
+            if (std::isfinite(sample.x + sample.y + sample.z))
+                m_accumulation[static_cast<size_t>(y) * static_cast<size_t>(m_resolution.x) + static_cast<size_t>(x)] += sample;
+        }
+    }
+    return static_cast<size_t>(tileEndX - tileX) * static_cast<size_t>(tileEndY - tileY);
+}
+
+bool PathTracer::resolve(std::vector<glm::vec3>& image)
+{
+    std::scoped_lock lock { m_mutex };
+    if (m_resolvedPass == m_pass)
+        return false;
+    image = m_average;
+    m_resolvedPass = m_pass;
+    return true;
+}
+
+glm::ivec2 PathTracer::resolution() const
+{
+    return m_resolution;
+}
+
+uint32_t PathTracer::numSamplesPerPixel() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_pass;
+}
+
+float PathTracer::samplesPerSecond() const
+{
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_startTime).count();
+    std::scoped_lock lock { m_mutex };
+    return seconds > 0.0f ? static_cast<float>(m_numSamples) / seconds : 0.0f;
+}
+
+float PathTracer::megaRaysPerSecond() const
+{
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_startTime).count();
+    std::scoped_lock lock { m_mutex };
+    return seconds > 0.0f ? static_cast<float>(m_numRays) / seconds * 1e-6f : 0.0f;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "ray_tracer.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/trackball.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Progressively path traces a scene on worker threads (see RayTracingScene::pathTrace()) while the caller carries on.
+//
+// Every pass adds one sample per pixel (at a random position inside the pixel) to a float accumulation buffer. The
+// pixels are split into tiles that the workers take one at a time; the next pass starts once every tile of the current
+// pass is done, at which point the average of all passes is published for resolve(). The workers keep rendering
+// passes until stop() or start() is called.
+class PathTracer {
+public:
+    // Leaves one core to the thread that renders the user interface.
+    explicit PathTracer(unsigned numThreads = defaultNumThreads());
+    PathTracer(const PathTracer&) = delete;
+    ~PathTracer();
+
+    PathTracer& operator=(const PathTracer&) = delete;
+
+    // Discard the accumulated samples and start rendering the scene as seen by the camera (which is copied).
+    void start(std::shared_ptr<const RayTracingScene> pScene, const Trackball& camera, const RayTracingShading& shading, const glm::ivec2& resolution, uint32_t maxBounces);
+    // Wait for the workers to stop; the scene is not accessed anymore afterwards, so it may be modified.
+    void stop();
+    [[nodiscard]] bool isRunning() const;
+
+    // Copy the average of all completed passes into image, with the first row at the bottom (like OpenGL textures).
+    // Returns false and leaves image untouched if no pass has been completed since the previous call.
+    bool resolve(std::vector<glm::vec3>& image);
+
+    [[nodiscard]] glm::ivec2 resolution() const;
+    [[nodiscard]] uint32_t numSamplesPerPixel() const;
+    // Throughput since start(), counting the samples of unfinished passes too.
+    [[nodiscard]] float samplesPerSecond() const;
+    [[nodiscard]] float megaRaysPerSecond() const;
+
+    [[nodiscard]] static unsigned defaultNumThreads();
+
+private:
+    void workerLoop(std::stop_token stopToken);
+    // Returns the number of samples (pixels) that were rendered.
+    size_t renderTile(size_t tile, uint32_t pass, size_t& numRays);
+
+private:
+    static constexpr int tileSize = 16;
+
+    unsigned m_numThreads;
+
+    // Set by start(); only read by the workers.
+    std::shared_ptr<const RayTracingScene> m_pScene;
+    std::optional<Trackball> m_camera;
+    RayTracingShading m_shading;
+    glm::ivec2 m_resolution { 0 };
+    uint32_t m_maxBounces { 0 };
+    int m_numTilesX { 0 };
+    size_t m_numTiles { 0 };
+    std::chrono::steady_clock::time_point m_startTime;
+
+    // Every pixel of a tile is only accessed by the worker that renders the tile.
+    std::vector<glm::vec3> m_accumulation;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable_any m_passCompleted;
+    uint32_t m_pass { 0 };
+    size_t m_nextTile { 0 };
+    size_t m_numTilesDone { 0 };
+    size_t m_numSamples { 0 }; // Pixel samples, including those of the current pass.
+    size_t m_numRays { 0 };
+    std::vector<glm::vec3> m_average; // Average of the first m_pass passes.
+    uint32_t m_resolvedPass { 0 };
+
+    std::vector<std::jthread> m_workers;
+};
@@ -0,0 +1,318 @@
+#include "ray_tracer.h"
+#include <framework/parallel.h>
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <span>
+
+// Nearest neighbour lookup with wrap around, matching the orientation of the textures uploaded by Texture.
+static glm::vec3 sampleColorMap(const Image& image, const glm::vec2& texCoord)
+{
+    const glm::vec2 wrapped = texCoord - glm::floor(texCoord);
+    const int x = std::min(static_cast<int>(wrapped.x * static_cast<float>(image.width)), image.width - 1);
+    const int y = std::min(static_cast<int>(wrapped.y * static_cast<float>(image.height)), image.height - 1);
+    const uint8_t* pTexel = &image.data()[(static_cast<size_t>(y) * static_cast<size_t>(image.width) + static_cast<size_t>(x)) * static_cast<size_t>(image.channels)];
+    if (image.channels >= 3)
+        return glm::vec3(pTexel[0], pTexel[1], pTexel[2]) / 255.0f;
+    return glm::vec3(static_cast<float>(pTexel[0]) / 255.0f);
+}
+
+void RayTracingScene::addMesh(const Mesh& mesh, const glm::mat4& modelMatrix, std::shared_ptr<const Image> pColorMap)
+{
+    Mesh& worldMesh = m_meshes.emplace_back(mesh);
+    const glm::mat3 normalModelMatrix = glm::inverseTranspose(glm::mat3(modelMatrix));
+    for (Vertex& vertex : worldMesh.vertices) {
+        vertex.position = glm::vec3(modelMatrix * glm::vec4(vertex.position, 1.0f));
+        vertex.normal = normalModelMatrix * vertex.normal;
+    }
+    m_colorMaps.push_back(worldMesh.material.kdTexture ? std::move(pColorMap) : nullptr);
+}
+
+void RayTracingScene::addLight(const RayTracingLight& light)
+{
+    m_lights.push_back(light);
+}
+
+void RayTracingScene::clearLights()
+{
+    m_lights.clear();
+}
+
+void RayTracingScene::buildBVH(const BVHBuildSettings& settings)
+{
+    m_bvh = BVH(m_meshes, settings);
+    if (BVH8::hasSIMDKernel())
+        m_bvh8 = BVH8(m_bvh);
+    else
+        m_bvh4 = BVH4(m_bvh);
+}
+
+std::optional<BVHHit> RayTracingScene::intersect(Ray& ray) const
+{
+    return m_bvh8.empty() ? m_bvh4.intersect(ray, rayEpsilon) : m_bvh8.intersect(ray, rayEpsilon);
+}
+
+void RayTracingScene::intersect(RayPacket& packet, std::array<std::optional<BVHHit>, RayPacket::size>& hits) const
+{
+    if (m_bvh8.empty())
+        m_bvh4.intersect(packet, hits, rayEpsilon);
+    else
+        m_bvh8.intersect(packet, hits, rayEpsilon);
+}
+
+bool RayTracingScene::isOccluded(const Ray& ray) const
+{
+    return m_bvh8.empty() ? m_bvh4.isOccluded(ray, rayEpsilon) : m_bvh8.isOccluded(ray, rayEpsilon);
+}
+
+glm::vec3 RayTracingScene::shade(Ray ray, const RayTracingShading& shading, size_t& numRays) const
+{
+    ++numRays;
+    const std::optional<BVHHit> hit = intersect(ray);
+    return shadeHit(ray, hit, shading, numRays);
+}
+
+std::array<glm::vec3, RayPacket::size> RayTracingScene::shade(RayPacket packet, const RayTracingShading& shading, size_t& numRays) const
+{
+    numRays += RayPacket::size;
+    std::array<std::optional<BVHHit>, RayPacket::size> hits;
+    intersect(packet, hits);
+    std::array<glm::vec3, RayPacket::size> colors;
+    for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx)
+        colors[rayIdx] = shadeHit(packet.rays[rayIdx], hits[rayIdx], shading, numRays);
+    return colors;
+}
+
+glm::vec3 RayTracingScene::shadeHit(const Ray& ray, const std::optional<BVHHit>& hit, const RayTracingShading& shading, size_t& numRays) const
+{
+    if (!hit)
+        return shading.backgroundColor;
+
+    const SurfacePoint surface = surfacePoint(ray, *hit, shading);
+    if (shading.shadingMode == 0 || m_lights.empty())
+        return surface.diffuse;
+    return directLighting(surface, -glm::normalize(ray.direction), shading, numRays);
+}
+
+RayTracingScene::SurfacePoint RayTracingScene::surfacePoint(const Ray& ray, const BVHHit& hit, const RayTracingShading& shading) const
+{
+    const Mesh& mesh = m_meshes[hit.mesh];
+    const Image* pColorMap = m_colorMaps[hit.mesh].get();
+    const glm::uvec3& triangle = mesh.triangles[hit.triangle];
+    const Vertex& v0 = mesh.vertices[triangle.x];
+    const Vertex& v1 = mesh.vertices[triangle.y];
+    const Vertex& v2 = mesh.vertices[triangle.z];
+    const float w0 = 1.0f - hit.barycentric.x - hit.barycentric.y;
+    const glm::vec2 texCoord = w0 * v0.texCoord + hit.barycentric.x * v1.texCoord + hit.barycentric.y * v2.texCoord;
+
+    SurfacePoint surface {
+        .position = ray.origin + ray.t * ray.direction,
+        .normal = glm::normalize(w0 * v0.normal + hit.barycentric.x * v1.normal + hit.barycentric.y * v2.normal),
+        .specular = shading.specularColor * shading.specularStrength,
+        .shininess = shading.specularShininess > 0.0f ? shading.specularShininess : mesh.material.shininess
+    };
+    // The rasterizer turns the material off for textured meshes.
+    const bool useMaterial = shading.useMaterial && !pColorMap;
+    if (pColorMap)
+        surface.diffuse = sampleColorMap(*pColorMap, texCoord);
+    else if (useMaterial)
+        surface.diffuse = mesh.material.kd;
+    else
+        surface.diffuse = shading.customDiffuseColor;
+    if (useMaterial)
+        surface.specular *= mesh.material.ks;
+    return surface;
+}
+
+glm::vec3 RayTracingScene::directLighting(const SurfacePoint& surface, const glm::vec3& viewDir, const RayTracingShading& shading, size_t& numRays) const
+{
+    glm::vec3 colorAccum { 0.0f };
+    glm::vec3 specAccum { 0.0f };
+    for (const RayTracingLight& light : m_lights) {
+        const glm::vec3 toLight = light.position - surface.position;
+        const float lightDistance = glm::length(toLight);
+        float attenuation = glm::clamp(1.0f - std::pow(lightDistance / light.range, 4.0f), 0.0f, 1.0f);
+        attenuation *= attenuation;
+        if (attenuation <= 0.0f)
+            continue;
+
+        const glm::vec3 lightDir = toLight / lightDistance;
+        const float diff = std::max(glm::dot(surface.normal, lightDir), 0.0f);
+        const bool isSpotlight = light.direction != glm::vec3(0.0f);
+        float spotFactor = 1.0f;
+        if (isSpotlight)
+            spotFactor = glm::smoothstep(light.spotCosCutoff, light.spotCosCutoff + light.spotSoftness, glm::dot(-lightDir, light.direction));
+        if (shading.shadows && light.castsShadows && diff > 0.0f && spotFactor > 0.0f) {
+            ++numRays;
+            if (isOccluded(Ray { .origin = surface.position, .direction = lightDir, .t = lightDistance - rayEpsilon }))
+                continue;
+        }
+
+        const glm::vec3 lightContribution = light.color * (spotFactor * attenuation);
+        colorAccum += surface.diffuse * diff * lightContribution;
+        if (shading.shadingMode == 2 && diff > 0.0f) {
+            const glm::vec3 reflectDir = glm::reflect(-lightDir, surface.normal);
+            const float spec = std::pow(std::max(glm::dot(reflectDir, viewDir), 0.0f), surface.shininess);
+            specAccum += lightContribution * spec;
+        }
+    }
+
+    glm::vec3 finalColor = colorAccum;
+    if (shading.shadingMode == 2)
+        finalColor += surface.specular * specAccum;
+    return finalColor;
+}
+
+// Orthonormal basis around a unit vector (Duff et al., "Building an Orthonormal Basis, Revisited", 2017).
+static glm::mat3 orthonormalBasis(const glm::vec3& n)
+{
+    const float sign = std::copysign(1.0f, n.z);
+    const float a = -1.0f / (sign + n.z);
+    const float b = n.x * n.y * a;
+    return glm::mat3(glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x), glm::vec3(b, sign + n.y * n.y * a, -n.y), n);
+}
+
+// Direction around the z-axis with probability density proportional to cos^exponent of its angle with the z-axis.
+static glm::vec3 sampleCosinePowerLobe(float exponent, const glm::vec2& u)
+{
+    const float cosTheta = std::pow(u.x, 1.0f / (exponent + 1.0f));
+    const float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+    const float phi = glm::two_pi<float>() * u.y;
+    return glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+
+static float luminance(const glm::vec3& color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+glm::vec3 RayTracingScene::pathTrace(Ray ray, const RayTracingShading& shading, uint32_t maxBounces, std::mt19937& rng, size_t& numRays) const
+{
+    std::uniform_real_distribution<float> uniform { 0.0f, 1.0f };
+    glm::vec3 radiance { 0.0f };
+    glm::vec3 throughput { 1.0f };
+    for (uint32_t bounce = 0; bounce <= maxBounces; ++bounce) {
+        ++numRays;
+        const std::optional<BVHHit> hit = intersect(ray);
+        // Only the lights illuminate the scene; the background is what the camera sees behind it.
+        if (!hit)
+            return bounce == 0 ? shading.backgroundColor : radiance;
+        const SurfacePoint surface = surfacePoint(ray, *hit, shading);
+        if (shading.shadingMode == 0)
+            return surface.diffuse;
+
+        const glm::vec3 viewDir = -glm::normalize(ray.direction);
+        radiance += throughput * directLighting(surface, viewDir, shading, numRays);
+
+        // Continue the path into the diffuse or the specular lobe, chosen in proportion to their reflectance. The
+        // weights follow from interpreting the lighting model of shader_frag.glsl as a BRDF (with the light intensity
+        // scaled by pi): the diffuse lobe is sampled with a cosine distribution and the specular lobe with a cos^n
+        // distribution around the mirror direction, which makes the weights kd and 2 / (n + 1) * ks.
+        const glm::vec3 normal = glm::dot(surface.normal, viewDir) < 0.0f ? -surface.normal : surface.normal;
+        const glm::vec3 specularWeight = shading.shadingMode == 2 ? surface.specular * (2.0f / (surface.shininess + 1.0f)) : glm::vec3(0.0f);
+        const float diffuseLuminance = luminance(surface.diffuse);
+        const float specularLuminance = luminance(specularWeight);
+        if (diffuseLuminance + specularLuminance <= 0.0f)
+            break;
+        const float diffuseProbability = diffuseLuminance / (diffuseLuminance + specularLuminance);
+        const glm::vec2 u { uniform(rng), uniform(rng) };
+        glm::vec3 direction;
+        if (uniform(rng) < diffuseProbability) {
+            direction = orthonormalBasis(normal) * sampleCosinePowerLobe(1.0f, u);
+            throughput *= surface.diffuse / diffuseProbability;
+        } else {
+            direction = orthonormalBasis(glm::reflect(-viewDir, normal)) * sampleCosinePowerLobe(surface.shininess, u);
+            if (glm::dot(direction, normal) <= 0.0f)
+                break;
+            throughput *= specularWeight / (1.0f - diffuseProbability);
+        }
+
+        // Russian roulette (Arvo and Kirk, 1990) ends paths that carry little light without biasing the result.
+        if (bounce >= 2) {
+            const float survivalProbability = std::min(std::max({ throughput.x, throughput.y, throughput.z }), 0.95f);
+            if (uniform(rng) >= survivalProbability)
+                break;
+            throughput /= survivalProbability;
+        }
+        ray = Ray { .origin = surface.position, .direction = direction };
+    }
+    return radiance;
+}
+
+size_t RayTracingScene::numTriangles() const
+{
+    size_t numTriangles = 0;
+    for (const Mesh& mesh : m_meshes)
+        numTriangles += mesh.triangles.size();
+    return numTriangles;
+}
+
+const BVH& RayTracingScene::bvh() const
+{
+    return m_bvh;
+}
+
+float RayTracingStats::megaRaysPerSecond() const
+{
+    return seconds > 0.0f ? static_cast<float>(numRays) / seconds * 1e-6f : 0.0f;
+}
+
+RayTracingStats rayTraceImage(const RayTracingScene& scene, const Trackball& camera, const RayTracingShading& shading, Image& image)
+{
+    assert(image.channels >= 3);
+    constexpr int tileSize = 16;
+    const int numTilesX = (image.width + tileSize - 1) / tileSize;
+    const int numTilesY = (image.height + tileSize - 1) / tileSize;
+    const std::span<uint8_t> pixels = image.data();
+    const size_t channels = static_cast<size_t>(image.channels);
+
+    std::atomic_size_t numRays { 0 };
+    const auto start = std::chrono::steady_clock::now();
+    parallelForWorkStealing(static_cast<size_t>(numTilesX * numTilesY), [&](size_t tile) {
+        const int tileX = static_cast<int>(tile) % numTilesX * tileSize;
+        const int tileY = static_cast<int>(tile) / numTilesX * tileSize;
+        size_t numTileRays = 0;
+        const int tileEndX = std::min(tileX + tileSize, image.width);
+        const int tileEndY = std::min(tileY + tileSize, image.height);
+        for (int blockY = tileY; blockY < tileEndY; blockY += 2) {
+            for (int blockX = tileX; blockX < tileEndX; blockX += 2) {
+                // Pixels of the block that lie outside the image (if its size is odd) repeat the last column or row.
+                std::array<glm::ivec2, RayPacket::size> blockPixels;
+                RayPacket packet;
+                for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx) {
+                    const glm::ivec2 pixel { std::min(blockX + static_cast<int>(rayIdx % 2), tileEndX - 1), std::min(blockY + static_cast<int>(rayIdx / 2), tileEndY - 1) };
+                    // The first row of the image is the top of the screen.
+                    const glm::vec2 ndc {
+                        2.0f * (static_cast<float>(pixel.x) + 0.5f) / static_cast<float>(image.width) - 1.0f,
+                        1.0f - 2.0f * (static_cast<float>(pixel.y) + 0.5f) / static_cast<float>(image.height)
+                    };
+                    blockPixels[rayIdx] = pixel;
+                    packet.rays[rayIdx] = camera.generateRay(ndc);
+                }
+                const std::array<glm::vec3, RayPacket::size> colors = scene.shade(packet, shading, numTileRays);
+                for (size_t rayIdx = 0; rayIdx < RayPacket::size; ++rayIdx) {
+                    const glm::vec3 color = glm::clamp(colors[rayIdx], 0.0f, 1.0f);
+                    const glm::ivec2 pixel = blockPixels[rayIdx];
+                    uint8_t* pPixel = &pixels[(static_cast<size_t>(pixel.y) * static_cast<size_t>(image.width) + static_cast<size_t>(pixel.x)) * channels];
+                    for (glm::length_t channel = 0; channel < 3; ++channel)
+                        pPixel[channel] = static_cast<uint8_t>(color[channel] * 255.0f + 0.5f);
+                }
+            }
+        }
+        numRays += numTileRays;
+    });
+
+    return RayTracingStats {
+        .numRays = numRays,
+        .seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count()
+    };
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <framework/bvh.h>
+#include <framework/disable_all_warnings.h>
+#include <framework/image.h>
+#include <framework/mesh.h>
+#include <framework/ray.h>
+#include <framework/trackball.h>
+#include <framework/wide_bvh.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+// Light as seen by the ray tracer; the same parameters as the GPULight that shader_frag.glsl reads.
+struct RayTracingLight {
+    glm::vec3 position { 0.0f };
+    glm::vec3 color { 1.0f };
+    glm::vec3 direction { 0.0f }; // Normalized, or zero for point lights.
+    float spotCosCutoff { 0.9f };
+    float spotSoftness { 0.1f };
+    float range { 25.0f };
+    bool castsShadows { true };
+
+    bool operator==(const RayTracingLight&) const = default;
+};
+
+// Shading parameters of shader_frag.glsl (see FrameData in src/application.cpp).
+struct RayTracingShading {
+    int shadingMode { 1 }; // 0: unlit, 1: Lambert, 2: Phong.
+    glm::vec3 customDiffuseColor { 0.8f, 0.4f, 0.2f };
+    float specularStrength { 1.0f };
+    glm::vec3 specularColor { 1.0f };
+    float specularShininess { 32.0f }; // The material's shininess is used if this is zero.
+    bool useMaterial { true };
+    bool shadows { true };
+    glm::vec3 backgroundColor { 0.2f };
+
+    bool operator==(const RayTracingShading&) const = default;
+};
+
+// Triangles and lights of a scene in world space, for rendering on the CPU. Rays are traced through a wide BVH over the
+// triangles of all meshes (BVH8 if it has a SIMD kernel, BVH4 otherwise), which has to be built with buildBVH() after
+// the last mesh was added.
+class RayTracingScene {
+public:
+    // Copy the mesh into the scene, transformed to world space by modelMatrix. Meshes with a diffuse texture are
+    // shaded with colorMap if it is given, like the rasterizer shades them with its checkerboard texture.
+    void addMesh(const Mesh& mesh, const glm::mat4& modelMatrix, std::shared_ptr<const Image> pColorMap = nullptr);
+    void addLight(const RayTracingLight& light);
+    void clearLights();
+    void buildBVH(const BVHBuildSettings& settings = {});
+
+    // Closest intersection in (rayEpsilon, ray.t); ray.t is set to the distance of the intersection.
+    [[nodiscard]] std::optional<BVHHit> intersect(Ray& ray) const;
+    void intersect(RayPacket& packet, std::array<std::optional<BVHHit>, RayPacket::size>& hits) const;
+    // Whether anything intersects the ray in (rayEpsilon, ray.t).
+    [[nodiscard]] bool isOccluded(const Ray& ray) const;
+
+    // Color of the closest surface along the ray with the lighting model of shader_frag.glsl, where the shadow maps
+    // are replaced by shadow rays. numRays is incremented by the number of rays that were traced.
+    [[nodiscard]] glm::vec3 shade(Ray ray, const RayTracingShading& shading, size_t& numRays) const;
+    // Same as shade() for a packet of coherent primary rays; only the primary rays are traced as a packet.
+    [[nodiscard]] std::array<glm::vec3, RayPacket::size> shade(RayPacket packet, const RayTracingShading& shading, size_t& numRays) const;
+    // One sample of the light arriving along the ray, including light that reflects off other surfaces up to
+    // maxBounces times. Every surface reflects with the lighting model of shade() (same materials and lights), so the
+    // average of many samples shows what the rasterized lighting looks like with global illumination.
+    [[nodiscard]] glm::vec3 pathTrace(Ray ray, const RayTracingShading& shading, uint32_t maxBounces, std::mt19937& rng, size_t& numRays) const;
+
+    [[nodiscard]] size_t numTriangles() const;
+    // The binary BVH that the wide BVH was collapsed from.
+    [[nodiscard]] const BVH& bvh() const;
+
+    // Distance along a ray below which intersections are ignored, such that shadow rays do not hit their own surface.
+    static constexpr float rayEpsilon = 1e-4f;
+
+private:
+    // Material of the surface at an intersection.
+    struct SurfacePoint {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 diffuse { 0.0f };
+        glm::vec3 specular; // Includes the specular strength.
+        float shininess;
+    };
+
+    // Shading of a ray that was intersected with the scene.
+    [[nodiscard]] glm::vec3 shadeHit(const Ray& ray, const std::optional<BVHHit>& hit, const RayTracingShading& shading, size_t& numRays) const;
+    [[nodiscard]] SurfacePoint surfacePoint(const Ray& ray, const BVHHit& hit, const RayTracingShading& shading) const;
+    // Light that the surface reflects towards viewDir, directly from the lights (traces the shadow rays).
+    [[nodiscard]] glm::vec3 directLighting(const SurfacePoint& surface, const glm::vec3& viewDir, const RayTracingShading& shading, size_t& numRays) const;
+
+private:
+    std::vector<Mesh> m_meshes; // World space.
+    std::vector<std::shared_ptr<const Image>> m_colorMaps; // Per mesh, null if the mesh is not textured.
+    std::vector<RayTracingLight> m_lights;
+    BVH m_bvh;
+    BVH4 m_bvh4; // Only one of the wide BVHs is built.
+    BVH8 m_bvh8;
+};
+
+struct RayTracingStats {
+    size_t numRays { 0 }; // Primary and shadow rays.
+    float seconds { 0.0f };
+
+    [[nodiscard]] float megaRaysPerSecond() const;
+};
+
+// Render the scene as seen by the camera into image (3 channels), with one ray through the center of every pixel. The
+// image is split into tiles that are spread over all cores with work stealing (see parallelForWorkStealing()), and the
+// primary rays of every 2x2 block of pixels are traced as a packet.
+RayTracingStats rayTraceImage(const RayTracingScene& scene, const Trackball& camera, const RayTracingShading& shading, Image& image);
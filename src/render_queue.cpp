@@ -0,0 +1,222 @@
+#include "render_queue.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/matrix_inverse.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+void GLStateCache::invalidate()
+{
+    m_pProgram = nullptr;
+    m_vertexArray = INVALID;
+    m_textures.fill(nullptr);
+    m_uniforms.clear();
+}
+
+void GLStateCache::setFilteringEnabled(bool enabled)
+{
+    m_filteringEnabled = enabled;
+}
+
+void GLStateCache::useProgram(const Shader& shader)
+{
+    ++m_counters.numRequestedCalls;
+    if (m_filteringEnabled && m_pProgram == &shader)
+        return;
+    shader.bind();
+    m_pProgram = &shader;
+    ++m_counters.numIssuedCalls;
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+    ++m_counters.numRequestedCalls;
+    if (m_filteringEnabled && m_vertexArray == vertexArray)
+        return;
+    glBindVertexArray(vertexArray);
+    m_vertexArray = vertexArray;
+    ++m_counters.numIssuedCalls;
+}
+
+void GLStateCache::bindTexture(GLuint unit, Texture& texture)
+{
+    assert(unit < maxTextureUnits);
+    ++m_counters.numRequestedCalls;
+    if (m_filteringEnabled && m_textures[unit] == &texture)
+        return;
+    texture.bind(GL_TEXTURE0 + static_cast<GLint>(unit));
+    m_textures[unit] = &texture;
+    ++m_counters.numIssuedCalls;
+}
+
+void GLStateCache::setUniform(const Shader& shader, UniformName name, bool value)
+{
+    setUniform(shader, name, value ? 1 : 0);
+}
+
+void GLStateCache::setUniform(const Shader& shader, UniformName name, int value)
+{
+    if (updateUniformShadow(shader, name, &value, sizeof(value)))
+        shader.set(name, value);
+}
+
+void GLStateCache::setUniform(const Shader& shader, UniformName name, const glm::mat3& value)
+{
+    if (updateUniformShadow(shader, name, &value, sizeof(value)))
+        shader.set(name, value);
+}
+
+void GLStateCache::setUniform(const Shader& shader, UniformName name, const glm::mat4& value)
+{
+    if (updateUniformShadow(shader, name, &value, sizeof(value)))
+        shader.set(name, value);
+}
+
+void GLStateCache::countDrawCall()
+{
+    ++m_counters.numRequestedCalls;
+    ++m_counters.numIssuedCalls;
+    ++m_counters.numDrawCalls;
+}
+
+const GLStateCache::Counters& GLStateCache::counters() const
+{
+    return m_counters;
+}
+
+void GLStateCache::resetCounters()
+{
+    m_counters = {};
+}
+
+bool GLStateCache::updateUniformShadow(const Shader& shader, UniformName name, const void* pValue, size_t size)
+{
+    assert(size <= sizeof(UniformShadow::value));
+    ++m_counters.numRequestedCalls;
+    // Only a handful of uniforms is set per draw, so a linear search is faster than a hash map.
+    auto iter = std::find_if(std::begin(m_uniforms), std::end(m_uniforms),
+        [&](const UniformShadow& uniform) { return uniform.pShader == &shader && uniform.nameHash == name.hash; });
+    if (iter == std::end(m_uniforms))
+        iter = m_uniforms.insert(std::end(m_uniforms), UniformShadow { .pShader = &shader, .nameHash = name.hash, .value = {} });
+    else if (m_filteringEnabled && std::memcmp(iter->value.data(), pValue, size) == 0)
+        return false;
+    std::memcpy(iter->value.data(), pValue, size);
+    ++m_counters.numIssuedCalls;
+    return true;
+}
+
+// Number of a state value in order of first use, saturated to the given number of bits.
+template <typename T>
+static uint64_t denseID(std::vector<T>& ids, T value, int numBits)
+{
+    const auto iter = std::find(std::begin(ids), std::end(ids), value);
+    const uint64_t id = static_cast<uint64_t>(std::distance(std::begin(ids), iter));
+    if (iter == std::end(ids))
+        ids.push_back(value);
+    return std::min(id, (uint64_t(1) << numBits) - 1);
+}
+
+void RenderQueue::clear()
+{
+    m_draws.clear();
+    m_sortEntries.clear();
+    m_clusterVisibility.clear();
+    m_shaderIDs.clear();
+    m_textureIDs.clear();
+    m_vertexArrayIDs.clear();
+}
+
+void RenderQueue::submit(const Shader& shader, GPUMesh& mesh, const glm::mat4& modelMatrix, Texture* pTexture, bool useMaterial, float viewDepth,
+    std::span<const uint8_t> clusterVisibility)
+{
+    const uint32_t drawIdx = static_cast<uint32_t>(m_draws.size());
+    m_draws.push_back(Draw {
+        .pShader = &shader,
+        .pMesh = &mesh,
+        .pTexture = pTexture,
+        .modelMatrix = modelMatrix * mesh.dequantizationMatrix(),
+        // Normals need the inverse transpose to handle non-uniform scaling correctly.
+        .normalModelMatrix = glm::inverseTranspose(glm::mat3(modelMatrix)),
+        .useMaterial = useMaterial,
+        .firstClusterVisibility = static_cast<uint32_t>(m_clusterVisibility.size()),
+        .numClusterVisibility = static_cast<uint32_t>(clusterVisibility.size()) });
+    m_clusterVisibility.insert(std::end(m_clusterVisibility), std::begin(clusterVisibility), std::end(clusterVisibility));
+
+    // The bit patterns of non-negative floats are ordered like the floats themselves; the sign bit is always zero, so
+    // the most significant 22 bits of the depth are bits 30 to 9.
+    const uint64_t depthBits = std::bit_cast<uint32_t>(std::max(viewDepth, 0.0f)) >> 9;
+    const uint64_t key = denseID<const void*>(m_shaderIDs, &shader, 6) << 58
+        | denseID<const void*>(m_textureIDs, pTexture, 8) << 50
+        | denseID(m_vertexArrayIDs, mesh.vertexArray(), 12) << 38
+        | std::min(uint64_t(mesh.materialID()), uint64_t(0xFFFF)) << 22
+        | depthBits;
+    m_sortEntries.push_back({ .key = key, .draw = drawIdx });
+}
+
+void RenderQueue::sort()
+{
+    // Least significant digit first radix sort with 8-bit digits. Every pass is stable, so after the last pass the
+    // entries are sorted by the whole key. Digits that are the same for all keys (e.g. the shader if all draws use the
+    // same shader) are skipped.
+    constexpr size_t numDigits = sizeof(uint64_t);
+    std::array<std::array<uint32_t, 256>, numDigits> histograms {};
+    for (const SortEntry& entry : m_sortEntries) {
+        for (size_t digit = 0; digit < numDigits; ++digit)
+            ++histograms[digit][(entry.key >> (8 * digit)) & 0xFF];
+    }
+
+    m_sortScratch.resize(m_sortEntries.size());
+    for (size_t digit = 0; digit < numDigits; ++digit) {
+        std::array<uint32_t, 256>& histogram = histograms[digit];
+        if (std::find(std::begin(histogram), std::end(histogram), m_sortEntries.size()) != std::end(histogram))
+            continue;
+
+        // Turn the counts into the first output position of every digit value.
+        uint32_t offset = 0;
+        for (uint32_t& count : histogram)
+            offset += std::exchange(count, offset);
+        for (const SortEntry& entry : m_sortEntries)
+            m_sortScratch[histogram[(entry.key >> (8 * digit)) & 0xFF]++] = entry;
+        std::swap(m_sortEntries, m_sortScratch);
+    }
+}
+
+void RenderQueue::execute(GLStateCache& stateCache)
+{
+    GPUMesh::sharedMaterialTable()->upload();
+    for (const SortEntry& entry : m_sortEntries) {
+        const Draw& draw = m_draws[entry.draw];
+        const Shader& shader = *draw.pShader;
+        GPUMesh& mesh = *draw.pMesh;
+
+        stateCache.useProgram(shader);
+        stateCache.setUniform(shader, "modelMatrix", draw.modelMatrix);
+        stateCache.setUniform(shader, "normalModelMatrix", draw.normalModelMatrix);
+        stateCache.setUniform(shader, "quantizedNormals", mesh.vertexFormat() == GPUVertexFormat::Quantized);
+        if (draw.pTexture) {
+            stateCache.bindTexture(0, *draw.pTexture);
+            stateCache.setUniform(shader, "hasTexCoords", true);
+            stateCache.setUniform(shader, "useMaterial", false);
+        } else {
+            stateCache.setUniform(shader, "hasTexCoords", false);
+            stateCache.setUniform(shader, "useMaterial", draw.useMaterial);
+        }
+        stateCache.setUniform(shader, "materialIndex", static_cast<int>(mesh.materialID()));
+        stateCache.bindVertexArray(mesh.vertexArray());
+
+        if (draw.numClusterVisibility == 0)
+            mesh.drawGeometryWithoutBinding();
+        else
+            mesh.drawClustersGeometryWithoutBinding(std::span(m_clusterVisibility).subspan(draw.firstClusterVisibility, draw.numClusterVisibility));
+        stateCache.countDrawCall();
+    }
+}
+
+size_t RenderQueue::size() const
+{
+    return m_draws.size();
+}
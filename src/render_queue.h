@@ -0,0 +1,118 @@
+#pragma once
+#include "mesh.h"
+#include "texture.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/shader.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <framework/opengl_includes.h>
+#include <span>
+#include <vector>
+
+// Shadow copy of the OpenGL state that is changed while executing a RenderQueue, such that calls that would not change
+// anything are skipped. Code that changes the same state without going through the cache must call invalidate()
+// before the cache is used again.
+class GLStateCache {
+public:
+    struct Counters {
+        size_t numRequestedCalls { 0 }; // State changes that would have been made without the cache.
+        size_t numIssuedCalls { 0 };
+        size_t numDrawCalls { 0 };
+    };
+
+    // Forget the shadowed state; the next state change is issued regardless of its value.
+    void invalidate();
+    // Without filtering every requested state change is issued (but still counted), for comparison.
+    void setFilteringEnabled(bool enabled);
+
+    void useProgram(const Shader& shader);
+    void bindVertexArray(GLuint vertexArray);
+    // Bind to texture unit GL_TEXTURE0 + unit (glActiveTexture() and glBindTexture() count as one call).
+    void bindTexture(GLuint unit, Texture& texture);
+    // Set a uniform of the given shader; uniforms are part of the program, so their values are shadowed per shader.
+    void setUniform(const Shader& shader, UniformName name, bool value);
+    void setUniform(const Shader& shader, UniformName name, int value);
+    void setUniform(const Shader& shader, UniformName name, const glm::mat3& value);
+    void setUniform(const Shader& shader, UniformName name, const glm::mat4& value);
+    void countDrawCall();
+
+    [[nodiscard]] const Counters& counters() const;
+    void resetCounters();
+
+private:
+    // Returns whether the value differs from the shadowed value (and updates the shadow if it does).
+    bool updateUniformShadow(const Shader& shader, UniformName name, const void* pValue, size_t size);
+
+private:
+    static constexpr GLuint INVALID = 0xFFFFFFFF;
+    static constexpr size_t maxTextureUnits = 8;
+
+    struct UniformShadow {
+        const Shader* pShader;
+        uint64_t nameHash;
+        std::array<std::byte, sizeof(glm::mat4)> value;
+    };
+
+    bool m_filteringEnabled { true };
+    Counters m_counters;
+    const Shader* m_pProgram { nullptr };
+    GLuint m_vertexArray { INVALID };
+    std::array<const Texture*, maxTextureUnits> m_textures {};
+    std::vector<UniformShadow> m_uniforms;
+};
+
+// Collects the draws of a frame as 64-bit sort keys that are radix sorted before execution, such that draws that share
+// a shader, texture, vertex array or material are executed consecutively (and their state only has to be set once),
+// and draws with the same state are executed front to back. The key stores, from the most to the least significant
+// bits: the shader (6 bits), the texture (8 bits), the vertex array (12 bits), the material (16 bits) and the view
+// depth (22 bits). The first three are numbered in order of submission every frame; they are only used for sorting, so
+// running out of bits makes the order less efficient but never wrong.
+//
+// Draws use the uniforms of shader_vert.glsl and shader_frag.glsl; the camera, light and material buffers must be
+// bound by the caller.
+class RenderQueue {
+public:
+    // Remove all draws (keeping the allocated memory for the next frame).
+    void clear();
+    // Draw the whole mesh, or only the clusters whose entry in clusterVisibility is non-zero (which is copied). If a
+    // texture is given it is used as the color map, otherwise the mesh's material is used if useMaterial is set.
+    // viewDepth is the distance between the camera and the mesh.
+    void submit(const Shader& shader, GPUMesh& mesh, const glm::mat4& modelMatrix, Texture* pTexture, bool useMaterial, float viewDepth,
+        std::span<const uint8_t> clusterVisibility = {});
+    // Order the draws by their sort keys; without sorting they are executed in submission order.
+    void sort();
+    void execute(GLStateCache& stateCache);
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Draw {
+        const Shader* pShader;
+        GPUMesh* pMesh;
+        Texture* pTexture;
+        glm::mat4 modelMatrix;
+        glm::mat3 normalModelMatrix;
+        bool useMaterial;
+        uint32_t firstClusterVisibility;
+        uint32_t numClusterVisibility; // Zero if the whole mesh is drawn.
+    };
+    struct SortEntry {
+        uint64_t key;
+        uint32_t draw;
+    };
+
+private:
+    std::vector<Draw> m_draws;
+    std::vector<SortEntry> m_sortEntries;
+    std::vector<SortEntry> m_sortScratch;
+    std::vector<uint8_t> m_clusterVisibility;
+    // Values of the state that is encoded in the sort keys, in order of first use during this frame.
+    std::vector<const void*> m_shaderIDs;
+    std::vector<const void*> m_textureIDs;
+    std::vector<GLuint> m_vertexArrayIDs;
+};
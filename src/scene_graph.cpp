@@ -0,0 +1,163 @@
+#include "scene_graph.h"
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <utility>
+
+SceneNode SceneGraph::createNode(SceneNode parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+    assert(parent == noParent || parent < m_nodeToSlot.size());
+    const auto node = static_cast<SceneNode>(m_nodeToSlot.size());
+    const auto slot = static_cast<uint32_t>(m_parentSlots.size());
+    const uint32_t parentSlot = parent == noParent ? noParent : m_nodeToSlot[parent];
+
+    m_nodeToSlot.push_back(slot);
+    m_depths.push_back(parent == noParent ? 0 : m_depths[parent] + 1);
+    m_parentSlots.push_back(parentSlot);
+    m_translations.push_back(translation);
+    m_rotations.push_back(rotation);
+    m_scales.push_back(scale);
+    m_dirty.push_back(1);
+    m_worldMatrices.emplace_back(1.0f);
+    m_slotToNode.push_back(node);
+
+    // Appending keeps every parent in front of its children, but a node that is deeper than its successor breaks
+    // the depth order.
+    if (slot > 0 && m_depths[m_slotToNode[slot - 1]] > m_depths[node])
+        m_needsSort = true;
+    return node;
+}
+
+void SceneGraph::reserve(size_t numNodes)
+{
+    m_nodeToSlot.reserve(numNodes);
+    m_depths.reserve(numNodes);
+    m_parentSlots.reserve(numNodes);
+    m_translations.reserve(numNodes);
+    m_rotations.reserve(numNodes);
+    m_scales.reserve(numNodes);
+    m_dirty.reserve(numNodes);
+    m_worldMatrices.reserve(numNodes);
+    m_slotToNode.reserve(numNodes);
+}
+
+void SceneGraph::setTranslation(SceneNode node, const glm::vec3& translation)
+{
+    const uint32_t slot = m_nodeToSlot[node];
+    m_translations[slot] = translation;
+    m_dirty[slot] = 1;
+}
+
+void SceneGraph::setRotation(SceneNode node, const glm::quat& rotation)
+{
+    const uint32_t slot = m_nodeToSlot[node];
+    m_rotations[slot] = rotation;
+    m_dirty[slot] = 1;
+}
+
+void SceneGraph::setScale(SceneNode node, const glm::vec3& scale)
+{
+    const uint32_t slot = m_nodeToSlot[node];
+    m_scales[slot] = scale;
+    m_dirty[slot] = 1;
+}
+
+glm::vec3 SceneGraph::translation(SceneNode node) const
+{
+    return m_translations[m_nodeToSlot[node]];
+}
+
+glm::quat SceneGraph::rotation(SceneNode node) const
+{
+    return m_rotations[m_nodeToSlot[node]];
+}
+
+glm::vec3 SceneGraph::scale(SceneNode node) const
+{
+    return m_scales[m_nodeToSlot[node]];
+}
+
+void SceneGraph::updateWorldMatrices()
+{
+    if (m_needsSort)
+        sortByDepth();
+
+    // Parents are visited before their children, so a parent's dirty flag already includes its ancestors when its
+    // children are visited. Clean subtrees only cost a flag check per node.
+    size_t numUpdated = 0;
+    const size_t numSlots = m_parentSlots.size();
+    for (size_t slot = 0; slot < numSlots; ++slot) {
+        const uint32_t parentSlot = m_parentSlots[slot];
+        if (parentSlot != noParent)
+            m_dirty[slot] |= m_dirty[parentSlot];
+        if (!m_dirty[slot])
+            continue;
+
+        glm::mat4 localMatrix = glm::mat4_cast(m_rotations[slot]);
+        localMatrix[0] *= m_scales[slot].x;
+        localMatrix[1] *= m_scales[slot].y;
+        localMatrix[2] *= m_scales[slot].z;
+        localMatrix[3] = glm::vec4(m_translations[slot], 1.0f);
+        m_worldMatrices[slot] = parentSlot == noParent ? localMatrix : m_worldMatrices[parentSlot] * localMatrix;
+        ++numUpdated;
+    }
+    std::fill(std::begin(m_dirty), std::end(m_dirty), uint8_t(0));
+    m_numUpdatedNodes = numUpdated;
+}
+
+const glm::mat4& SceneGraph::worldMatrix(SceneNode node) const
+{
+    return m_worldMatrices[m_nodeToSlot[node]];
+}
+
+size_t SceneGraph::numNodes() const
+{
+    return m_nodeToSlot.size();
+}
+
+size_t SceneGraph::numUpdatedNodes() const
+{
+    return m_numUpdatedNodes;
+}
+
+void SceneGraph::sortByDepth()
+{
+    // Counting sort by depth; stable so that siblings stay in creation order.
+    const uint32_t maxDepth = *std::max_element(std::begin(m_depths), std::end(m_depths));
+    std::vector<uint32_t> depthOffsets(maxDepth + 2, 0);
+    for (const uint32_t depth : m_depths)
+        ++depthOffsets[depth + 1];
+    for (size_t depth = 1; depth < depthOffsets.size(); ++depth)
+        depthOffsets[depth] += depthOffsets[depth - 1];
+
+    const size_t numSlots = m_parentSlots.size();
+    std::vector<uint32_t> newNodeToSlot(numSlots);
+    std::vector<SceneNode> newSlotToNode(numSlots);
+    for (size_t slot = 0; slot < numSlots; ++slot) {
+        const SceneNode node = m_slotToNode[slot];
+        const uint32_t newSlot = depthOffsets[m_depths[node]]++;
+        newNodeToSlot[node] = newSlot;
+        newSlotToNode[newSlot] = node;
+    }
+
+    const auto permute = [&](auto& values) {
+        std::remove_reference_t<decltype(values)> sortedValues(values.size());
+        for (size_t slot = 0; slot < numSlots; ++slot)
+            sortedValues[newNodeToSlot[m_slotToNode[slot]]] = values[slot];
+        values = std::move(sortedValues);
+    };
+    for (uint32_t& parentSlot : m_parentSlots) {
+        if (parentSlot != noParent)
+            parentSlot = newNodeToSlot[m_slotToNode[parentSlot]];
+    }
+    permute(m_parentSlots);
+    permute(m_translations);
+    permute(m_rotations);
+    permute(m_scales);
+    permute(m_dirty);
+    permute(m_worldMatrices);
+
+    m_nodeToSlot = std::move(newNodeToSlot);
+    m_slotToNode = std::move(newSlotToNode);
+    m_needsSort = false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Handle to a node of a SceneGraph; stays valid for the lifetime of the graph.
+using SceneNode = uint32_t;
+
+// Hierarchy of transforms with cached world matrices.
+//
+// Every node has a local translation, rotation and scale (applied in the order scale, rotate, translate) relative to
+// its parent. Internally the nodes are stored as structure-of-arrays sorted by depth, so that every parent precedes its
+// children. updateWorldMatrices() can therefore recompute all world matrices in a single linear pass in which a node
+// is only recomputed when its own local transform or that of one of its ancestors changed.
+class SceneGraph {
+public:
+    static constexpr SceneNode noParent = 0xFFFFFFFF;
+
+    SceneNode createNode(SceneNode parent = noParent, const glm::vec3& translation = glm::vec3(0.0f),
+        const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+    void reserve(size_t numNodes);
+
+    void setTranslation(SceneNode node, const glm::vec3& translation);
+    void setRotation(SceneNode node, const glm::quat& rotation);
+    void setScale(SceneNode node, const glm::vec3& scale);
+    [[nodiscard]] glm::vec3 translation(SceneNode node) const;
+    [[nodiscard]] glm::quat rotation(SceneNode node) const;
+    [[nodiscard]] glm::vec3 scale(SceneNode node) const;
+
+    // Recompute the world matrices of the nodes whose transform (or that of an ancestor) changed.
+    void updateWorldMatrices();
+    // World matrix as of the last call to updateWorldMatrices().
+    [[nodiscard]] const glm::mat4& worldMatrix(SceneNode node) const;
+
+    [[nodiscard]] size_t numNodes() const;
+    // Number of world matrices recomputed by the last call to updateWorldMatrices().
+    [[nodiscard]] size_t numUpdatedNodes() const;
+
+private:
+    void sortByDepth();
+
+private:
+    // Indexed by SceneNode.
+    std::vector<uint32_t> m_nodeToSlot;
+    std::vector<uint32_t> m_depths;
+
+    // Indexed by slot (depth order); the parent slot is always smaller than the node's own slot.
+    std::vector<uint32_t> m_parentSlots;
+    std::vector<glm::vec3> m_translations;
+    std::vector<glm::quat> m_rotations;
+    std::vector<glm::vec3> m_scales;
+    std::vector<uint8_t> m_dirty;
+    std::vector<glm::mat4> m_worldMatrices;
+    std::vector<SceneNode> m_slotToNode;
+
+    // Nodes created since the last sort are appended, which is a valid order but not by depth.
+    bool m_needsSort { false };
+    size_t m_numUpdatedNodes { 0 };
+};
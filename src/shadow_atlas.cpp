@@ -0,0 +1,224 @@
+#include "shadow_atlas.h"
+#include "frustum_culling.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/trigonometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+constexpr float shadowNearPlane = 0.05f;
+
+GLuint createDepthTexture(GLsizei resolution)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Hardware depth comparison; with linear filtering every lookup is a bilinearly filtered 2x2 PCF.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    return texture;
+}
+
+GLuint createDepthFramebuffer(GLuint depthTexture)
+{
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow atlas framebuffer is incomplete" << std::endl;
+        throw std::exception();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return framebuffer;
+}
+
+bool sphereIntersectsFrustum(const glm::mat4& viewProjectionMatrix, const glm::vec3& center, float radius)
+{
+    const Frustum frustum { viewProjectionMatrix };
+    return std::all_of(std::begin(frustum.planes), std::end(frustum.planes), [&](const glm::vec4& plane) {
+        return glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+    });
+}
+
+glm::vec3 perpendicularUp(const glm::vec3& direction)
+{
+    return std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+}
+
+}
+
+ShadowAtlas::ShadowAtlas(GLsizei resolution, GLsizei tileSize)
+    : m_resolution(resolution)
+    , m_tileSize(tileSize)
+    , m_numTiles(static_cast<size_t>(resolution / tileSize) * static_cast<size_t>(resolution / tileSize))
+    , m_staticTiles(m_numTiles)
+{
+    m_texture = createDepthTexture(m_resolution);
+    m_framebuffer = createDepthFramebuffer(m_texture);
+    m_staticTexture = createDepthTexture(m_resolution);
+    m_staticFramebuffer = createDepthFramebuffer(m_staticTexture);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteFramebuffers(1, &m_staticFramebuffer);
+    glDeleteTextures(1, &m_texture);
+    glDeleteTextures(1, &m_staticTexture);
+}
+
+void ShadowAtlas::update(std::span<const ShadowLight> lights, const glm::mat4& cameraViewProjectionMatrix, const DrawCasters& drawStaticCasters, const DrawCasters& drawDynamicCasters)
+{
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    // Slope scaled depth bias against shadow acne.
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    m_lightFirstView.assign(lights.size(), -1);
+    m_views.clear();
+    m_numViewsRendered = 0;
+    m_numStaticViewsRendered = 0;
+    for (size_t lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+        const ShadowLight& light = lights[lightIndex];
+        const size_t numLightViews = light.isSpotlight ? 1 : 6;
+        if (m_views.size() + numLightViews > m_numTiles)
+            break;
+
+        // The light view projection matrices of the spot light or the six cube faces of a point light.
+        std::array<glm::mat4, 6> viewProjectionMatrices;
+        const float nearPlane = std::min(shadowNearPlane, light.range * 0.5f);
+        if (light.isSpotlight) {
+            const float fovy = std::clamp(2.0f * std::acos(std::clamp(light.spotCosCutoff, 0.0f, 1.0f)), glm::radians(1.0f), glm::radians(170.0f));
+            const glm::mat4 projection = glm::perspective(fovy, 1.0f, nearPlane, light.range);
+            viewProjectionMatrices[0] = projection * glm::lookAt(light.position, light.position + light.direction, perpendicularUp(light.direction));
+        } else {
+            static constexpr std::array<std::pair<glm::vec3, glm::vec3>, 6> faces { {
+                { { +1, 0, 0 }, { 0, -1, 0 } },
+                { { -1, 0, 0 }, { 0, -1, 0 } },
+                { { 0, +1, 0 }, { 0, 0, +1 } },
+                { { 0, -1, 0 }, { 0, 0, -1 } },
+                { { 0, 0, +1 }, { 0, -1, 0 } },
+                { { 0, 0, -1 }, { 0, -1, 0 } },
+            } };
+            const glm::mat4 projection = glm::perspective(glm::half_pi<float>(), 1.0f, nearPlane, light.range);
+            for (size_t face = 0; face < faces.size(); ++face)
+                viewProjectionMatrices[face] = projection * glm::lookAt(light.position, light.position + faces[face].first, faces[face].second);
+        }
+
+        m_lightFirstView[lightIndex] = static_cast<int32_t>(m_views.size());
+        const bool isVisible = sphereIntersectsFrustum(cameraViewProjectionMatrix, light.position, light.range);
+        for (size_t lightView = 0; lightView < numLightViews; ++lightView) {
+            const size_t tile = m_views.size();
+            const glm::mat4& viewProjectionMatrix = viewProjectionMatrices[lightView];
+
+            // Maps normalized device coordinates [-1, 1] to the texture coordinates of the tile and depth to [0, 1].
+            const glm::vec2 tileScale = glm::vec2(static_cast<float>(m_tileSize) / static_cast<float>(m_resolution));
+            const glm::vec2 tileOffset = glm::vec2(tileOrigin(tile)) / static_cast<float>(m_resolution);
+            glm::mat4 ndcToAtlas { 1.0f };
+            ndcToAtlas[0][0] = 0.5f * tileScale.x;
+            ndcToAtlas[1][1] = 0.5f * tileScale.y;
+            ndcToAtlas[2][2] = 0.5f;
+            ndcToAtlas[3] = glm::vec4(tileOffset + 0.5f * tileScale, 0.5f, 1.0f);
+            m_views.push_back({ ndcToAtlas * viewProjectionMatrix, glm::vec4(tileOffset, tileOffset + tileScale) });
+
+            CachedTile& cachedTile = m_staticTiles[tile];
+            if (!cachedTile.valid || cachedTile.viewProjectionMatrix != viewProjectionMatrix) {
+                renderTile(m_staticFramebuffer, tile, viewProjectionMatrix, drawStaticCasters);
+                cachedTile.viewProjectionMatrix = viewProjectionMatrix;
+                cachedTile.valid = true;
+                ++m_numStaticViewsRendered;
+            }
+
+            // Start from the cached static depth, such that every published tile is written this frame (the shader may
+            // still sample the tiles of lights outside of the view frustum, e.g. without clustered lighting).
+            const glm::ivec2 origin = tileOrigin(tile);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_staticFramebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+            glBlitFramebuffer(origin.x, origin.y, origin.x + m_tileSize, origin.y + m_tileSize,
+                origin.x, origin.y, origin.x + m_tileSize, origin.y + m_tileSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+            // The dynamic casters are only worth drawing for lights that can reach the visible part of the scene.
+            if (!isVisible)
+                continue;
+            glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+            glViewport(origin.x, origin.y, m_tileSize, m_tileSize);
+            drawDynamicCasters(viewProjectionMatrix);
+            ++m_numViewsRendered;
+        }
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowAtlas::invalidateStaticCasters()
+{
+    for (CachedTile& cachedTile : m_staticTiles)
+        cachedTile.valid = false;
+}
+
+void ShadowAtlas::renderTile(GLuint framebuffer, size_t tile, const glm::mat4& viewProjectionMatrix, const DrawCasters& drawCasters) const
+{
+    const glm::ivec2 origin = tileOrigin(tile);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(origin.x, origin.y, m_tileSize, m_tileSize);
+    // Only clear this tile; the scissor test also applies to glClear().
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(origin.x, origin.y, m_tileSize, m_tileSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    drawCasters(viewProjectionMatrix);
+}
+
+glm::ivec2 ShadowAtlas::tileOrigin(size_t tile) const
+{
+    const auto tilesPerRow = static_cast<size_t>(m_resolution / m_tileSize);
+    return glm::ivec2(static_cast<int>(tile % tilesPerRow), static_cast<int>(tile / tilesPerRow)) * m_tileSize;
+}
+
+int32_t ShadowAtlas::firstView(size_t lightIndex) const
+{
+    return lightIndex < m_lightFirstView.size() ? m_lightFirstView[lightIndex] : -1;
+}
+
+std::span<const ShadowView> ShadowAtlas::views() const
+{
+    return m_views;
+}
+
+void ShadowAtlas::bind(GLint textureSlot) const
+{
+    glActiveTexture(static_cast<GLenum>(textureSlot));
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+}
+
+size_t ShadowAtlas::numViewsRendered() const
+{
+    return m_numViewsRendered;
+}
+
+size_t ShadowAtlas::numStaticViewsRendered() const
+{
+    return m_numStaticViewsRendered;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/opengl_includes.h>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Light as seen by the shadow atlas; positions and directions are in world space.
+struct ShadowLight {
+    glm::vec3 position;
+    float range;
+    bool isSpotlight { false };
+    glm::vec3 direction { 0.0f, -1.0f, 0.0f }; // Normalized.
+    float spotCosCutoff { 0.0f };
+};
+
+// Shadow map of a single light view (a spot light or one cube face of a point light) inside the atlas.
+struct ShadowView {
+    // Transforms world space positions to atlas texture coordinates (xy) and depth (z) after the perspective divide.
+    glm::mat4 atlasMatrix;
+    // Texture coordinates of the view's tile: (min u, min v, max u, max v).
+    glm::vec4 atlasRect;
+};
+
+// Packs the shadow maps of many lights into a single depth texture made of square tiles.
+//
+// Spot lights use one tile and point lights use six (one per cube face, in the order +X, -X, +Y, -Y, +Z, -Z). The
+// depth of static casters is kept in a separate cache atlas and is only re-rendered when the light's view changes or
+// invalidateStaticCasters() is called. Every frame the cached depth of the lights that can affect the view is copied
+// to the output atlas after which only the dynamic casters are rendered on top of it.
+class ShadowAtlas {
+public:
+    // Draws the shadow casters with the given (light) view projection matrix into the bound framebuffer.
+    using DrawCasters = std::function<void(const glm::mat4& viewProjectionMatrix)>;
+
+    explicit ShadowAtlas(GLsizei resolution = 4096, GLsizei tileSize = 512);
+    // Cannot copy a shadow atlas because it would require reference counting of GPU resources.
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ~ShadowAtlas();
+
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Assign tiles to the lights (in order, until the atlas is full) and render the shadow maps of the lights whose
+    // range intersects the camera frustum. Restores the default framebuffer and the viewport afterwards.
+    void update(std::span<const ShadowLight> lights, const glm::mat4& cameraViewProjectionMatrix, const DrawCasters& drawStaticCasters, const DrawCasters& drawDynamicCasters);
+    // Re-render the static casters of every light during the next update(), e.g. after the scene geometry changed.
+    void invalidateStaticCasters();
+
+    // Index of the first view of the light in views() or -1 if the light has no shadow map.
+    [[nodiscard]] int32_t firstView(size_t lightIndex) const;
+    [[nodiscard]] std::span<const ShadowView> views() const;
+
+    // Bind the depth texture (with depth comparison enabled, for use with a sampler2DShadow).
+    void bind(GLint textureSlot) const;
+
+    // Statistics of the last update().
+    [[nodiscard]] size_t numViewsRendered() const;
+    [[nodiscard]] size_t numStaticViewsRendered() const;
+
+private:
+    struct CachedTile {
+        glm::mat4 viewProjectionMatrix { 0.0f };
+        bool valid { false };
+    };
+    void renderTile(GLuint framebuffer, size_t tile, const glm::mat4& viewProjectionMatrix, const DrawCasters& drawCasters) const;
+    [[nodiscard]] glm::ivec2 tileOrigin(size_t tile) const;
+
+private:
+    static constexpr GLuint INVALID = 0xFFFFFFFF;
+
+    GLsizei m_resolution;
+    GLsizei m_tileSize;
+    size_t m_numTiles;
+
+    GLuint m_texture { INVALID };
+    GLuint m_framebuffer { INVALID };
+    GLuint m_staticTexture { INVALID };
+    GLuint m_staticFramebuffer { INVALID };
+
+    std::vector<CachedTile> m_staticTiles;
+    std::vector<int32_t> m_lightFirstView;
+    std::vector<ShadowView> m_views;
+    size_t m_numViewsRendered { 0 };
+    size_t m_numStaticViewsRendered { 0 };
+};
@@ -8,11 +8,14 @@ DISABLE_WARNINGS_POP()
 #include <iostream>
 
 Texture::Texture(std::filesystem::path filePath)
-{
     // Load image from disk to CPU memory.
     // Image class is defined in <framework/image.h>
-    Image cpuTexture { filePath };
+    : Texture(Image { filePath })
+{
+}
 
+Texture::Texture(const Image& cpuTexture)
+{
     // Create a texture on the GPU and bind it for parameter setting
     glGenTextures(1, &m_texture);
     glBindTexture(GL_TEXTURE_2D, m_texture);
@@ -28,13 +31,13 @@ Texture::Texture(std::filesystem::path filePath)
     // Define GPU texture parameters and upload corresponding data based on number of image channels
     switch (cpuTexture.channels) {
         case 1:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, cpuTexture.width, cpuTexture.height, 0, GL_RED, GL_UNSIGNED_BYTE, cpuTexture.get_data());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, cpuTexture.width, cpuTexture.height, 0, GL_RED, GL_UNSIGNED_BYTE, cpuTexture.data().data());
             break;
         case 3:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, cpuTexture.width, cpuTexture.height, 0, GL_RGB, GL_UNSIGNED_BYTE, cpuTexture.get_data());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, cpuTexture.width, cpuTexture.height, 0, GL_RGB, GL_UNSIGNED_BYTE, cpuTexture.data().data());
             break;
         case 4:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cpuTexture.width, cpuTexture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, cpuTexture.get_data());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cpuTexture.width, cpuTexture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, cpuTexture.data().data());
             break;
         default:
             std::cerr << "Number of channels read for texture is not supported" << std::endl;
@@ -51,6 +54,17 @@ Texture::Texture(Texture&& other)
     other.m_texture = INVALID;
 }
 
+Texture& Texture::operator=(Texture&& other)
+{
+    if (this != &other) {
+        if (m_texture != INVALID)
+            glDeleteTextures(1, &m_texture);
+        m_texture = other.m_texture;
+        other.m_texture = INVALID;
+    }
+    return *this;
+}
+
 Texture::~Texture()
 {
     if (m_texture != INVALID)
@@ -7,6 +7,8 @@ DISABLE_WARNINGS_POP()
 #include <filesystem>
 #include <framework/opengl_includes.h>
 
+struct Image;
+
 struct ImageLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
@@ -14,12 +16,14 @@ struct ImageLoadingException : public std::runtime_error {
 class Texture {
 public:
     Texture(std::filesystem::path filePath);
+    // Upload an image that was already loaded into CPU memory (e.g. by a background thread).
+    Texture(const Image& cpuTexture);
     Texture(const Texture&) = delete;
     Texture(Texture&&);
     ~Texture();
 
     Texture& operator=(const Texture&) = delete;
-    Texture& operator=(Texture&&) = default;
+    Texture& operator=(Texture&&);
 
     void bind(GLint textureSlot);
 
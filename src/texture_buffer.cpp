@@ -0,0 +1,57 @@
+#include "texture_buffer.h"
+#include <algorithm>
+#include <utility>
+
+TextureBuffer::TextureBuffer(GLenum internalFormat)
+{
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    // Start with a small non-empty store so that the texture is always complete.
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, m_buffer);
+}
+
+TextureBuffer::TextureBuffer(TextureBuffer&& other)
+    : m_buffer(std::exchange(other.m_buffer, INVALID))
+    , m_texture(std::exchange(other.m_texture, INVALID))
+{
+}
+
+TextureBuffer::~TextureBuffer()
+{
+    if (m_texture != INVALID)
+        glDeleteTextures(1, &m_texture);
+    if (m_buffer != INVALID)
+        glDeleteBuffers(1, &m_buffer);
+}
+
+TextureBuffer& TextureBuffer::operator=(TextureBuffer&& other)
+{
+    if (this != &other) {
+        if (m_texture != INVALID)
+            glDeleteTextures(1, &m_texture);
+        if (m_buffer != INVALID)
+            glDeleteBuffers(1, &m_buffer);
+        m_buffer = std::exchange(other.m_buffer, INVALID);
+        m_texture = std::exchange(other.m_texture, INVALID);
+    }
+    return *this;
+}
+
+void TextureBuffer::update(const void* pData, GLsizeiptr size)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    // Re-specifying the data store orphans the old storage; the buffer texture keeps referring to the buffer object.
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, GLsizeiptr(16)), nullptr, GL_STREAM_DRAW);
+    if (size > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, pData);
+}
+
+void TextureBuffer::bind(GLint textureSlot) const
+{
+    glActiveTexture(static_cast<GLenum>(textureSlot));
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <framework/opengl_includes.h>
+
+// Buffer texture: a one-dimensional array of texels backed by a buffer object, read in shaders with texelFetch().
+// Unlike uniform buffers its size is only limited by GL_MAX_TEXTURE_BUFFER_SIZE (at least 64K texels).
+class TextureBuffer {
+public:
+    explicit TextureBuffer(GLenum internalFormat);
+    // Cannot copy a texture buffer because it would require reference counting of GPU resources.
+    TextureBuffer(const TextureBuffer&) = delete;
+    TextureBuffer(TextureBuffer&&);
+    ~TextureBuffer();
+
+    TextureBuffer& operator=(const TextureBuffer&) = delete;
+    TextureBuffer& operator=(TextureBuffer&&);
+
+    // Replace the contents of the buffer. The previous storage is orphaned (see UniformBuffer::update()).
+    void update(const void* pData, GLsizeiptr size);
+
+    // Bind the buffer texture to the given texture slot (GL_TEXTURE0, ...).
+    void bind(GLint textureSlot) const;
+
+private:
+    static constexpr GLuint INVALID = 0xFFFFFFFF;
+
+    GLuint m_buffer { INVALID };
+    GLuint m_texture { INVALID };
+};
@@ -0,0 +1,48 @@
+#include "uniform_buffer.h"
+#include <cassert>
+#include <utility>
+
+UniformBuffer::UniformBuffer(GLsizeiptr size)
+    : m_size(size)
+{
+    glGenBuffers(1, &m_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+}
+
+UniformBuffer::UniformBuffer(UniformBuffer&& other)
+    : m_ubo(std::exchange(other.m_ubo, INVALID))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    if (m_ubo != INVALID)
+        glDeleteBuffers(1, &m_ubo);
+}
+
+UniformBuffer& UniformBuffer::operator=(UniformBuffer&& other)
+{
+    if (this != &other) {
+        if (m_ubo != INVALID)
+            glDeleteBuffers(1, &m_ubo);
+        m_ubo = std::exchange(other.m_ubo, INVALID);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+void UniformBuffer::update(const void* pData, GLsizeiptr size)
+{
+    assert(size <= m_size);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+    // Re-specifying the data store with a null pointer orphans the old storage.
+    glBufferData(GL_UNIFORM_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, pData);
+}
+
+GLuint UniformBuffer::handle() const
+{
+    return m_ubo;
+}
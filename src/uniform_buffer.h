@@ -0,0 +1,32 @@
+#pragma once
+#include <framework/opengl_includes.h>
+
+// Uniform buffer object whose contents are replaced as a whole, typically once per frame.
+class UniformBuffer {
+public:
+    explicit UniformBuffer(GLsizeiptr size);
+    // Cannot copy a uniform buffer because it would require reference counting of GPU resources.
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer(UniformBuffer&&);
+    ~UniformBuffer();
+
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(UniformBuffer&&);
+
+    // Replace the contents of the buffer. The previous storage is orphaned such that the driver does not have to
+    // wait for draw calls of the previous frame that may still be reading from it.
+    void update(const void* pData, GLsizeiptr size);
+    template <typename T>
+    void update(const T& data)
+    {
+        update(&data, sizeof(T));
+    }
+
+    [[nodiscard]] GLuint handle() const;
+
+private:
+    static constexpr GLuint INVALID = 0xFFFFFFFF;
+
+    GLuint m_ubo { INVALID };
+    GLsizeiptr m_size { 0 };
+};